@@ -192,7 +192,20 @@ enum fpta_bits {
   fpta_name_hash_shift = fpta_column_index_shift + fpta_column_index_bits,
 
   /* Максимальное кол-во индексов для одной таблице (порядка 500) */
-  fpta_max_indexes = (1 << (fpta_id_bits - fpta_name_hash_bits))
+  fpta_max_indexes = (1 << (fpta_id_bits - fpta_name_hash_bits)),
+
+  /* Максимальный размер (в 64-битных словах) дополнительного описания
+   * таблицы, т.е. свойств колонок и индексов сверх типа данных и вида
+   * индекса. Например, колонки для TTL. */
+  fpta_max_schema_extra = 256,
+
+  /* Максимальное количество зарегистрированных функций извлечения ключа,
+   * см. fpta_key_extractor_register(). */
+  fpta_max_key_extractors = 64,
+
+  /* Максимальная глубина пути к полю вложенного кортежа для индексов,
+   * см. fpta_column_describe_nested(). */
+  fpta_max_nested_depth = 4
 };
 
 /* Экземпляр БД.
@@ -415,6 +428,8 @@ enum fpta_error {
   /* Too many columns or indexes (one of fpta's limits reached) */,
   FPTA_WANNA_DIE
   /* Failure while transaction rollback */,
+  FPTA_TXN_CANCELLED
+  /* Transaction was cancelled as a laggard reader */,
 
   FPTA_ENOFIELD = FPTU_ENOFIELD,
   FPTA_ENOSPACE = FPTU_ENOSPACE,
@@ -550,22 +565,51 @@ typedef enum fpta_durability {
               * порядок операций записи (см режим data=writeback
               * для ext4). */
 
-  fpta_async /* Самый быстрый режим. Образ БД отображается в
-              * память в режиме read-write и изменения
-              * производятся только в памяти.
-              *
-              * Ядро ОС, по своему усмотрению, асинхронно
-              * записывает измененные страницы на диск.
-              * При этом ядро ОС обещает запись всех изменений
-              * при сбое приложения, OOM или при штатной
-              * остановке. Но НЕ при сбое в ядре или при
-              * отключении питания.
-              *
-              * Также, БД может быть повреждена в результате
-              * некорректных действий приложения (роспись памяти).
-              *
-              * Производительность по записи в основном
-              * определяется скоростью CPU и RAM (более 100K TPS). */
+  fpta_async, /* Самый быстрый режим. Образ БД отображается в
+               * память в режиме read-write и изменения
+               * производятся только в памяти.
+               *
+               * Ядро ОС, по своему усмотрению, асинхронно
+               * записывает измененные страницы на диск.
+               * При этом ядро ОС обещает запись всех изменений
+               * при сбое приложения, OOM или при штатной
+               * остановке. Но НЕ при сбое в ядре или при
+               * отключении питания.
+               *
+               * Также, БД может быть повреждена в результате
+               * некорректных действий приложения (роспись памяти).
+               *
+               * Производительность по записи в основном
+               * определяется скоростью CPU и RAM (более 100K TPS). */
+
+  fpta_sync_group, /* Полностью синхронный режим с групповой фиксацией.
+                    * Сохранность такая же как в режиме fpta_sync:
+                    * fpta_transaction_end() возвращает управление только
+                    * после сохранения изменений на диск.
+                    *
+                    * Однако, транзакции фиксируются без ожидания диска,
+                    * а ожидание выполняется после освобождения
+                    * блокировок. Один fdatasync() выполняется сразу для
+                    * всех транзакций, зафиксированных к его началу.
+                    * Поэтому производительность по записи растет
+                    * с количеством конкурирующих писателей, а для
+                    * одного писателя соответствует fpta_sync.
+                    *
+                    * Если транзакция зафиксирована, но при сбросе на
+                    * диск произошла ошибка, то fpta_transaction_end()
+                    * вернет код этой ошибки. */
+
+  fpta_sync_deferred /* Отложенное сохранение с ограниченным отставанием.
+                      * Транзакции фиксируются без ожидания диска,
+                      * а сброс на диск выполняет фоновый поток при
+                      * достижении одного из заданных ограничений,
+                      * см. fpta_db_durability_limits(). Таким образом,
+                      * в случае сбоя могут быть потеряны транзакции
+                      * только в пределах этих ограничений, при этом
+                      * БД остается целостной.
+                      *
+                      * Дождаться сохранения конкретной транзакции
+                      * можно посредством fpta_db_wait_durable(). */
 } fpta_durability;
 
 /* Открывает базу по заданному пути и в durability режиме.
@@ -581,13 +625,61 @@ typedef enum fpta_durability {
  *
  * Аргумент alterable_schema определяет намерения по созданию и/или
  * удалению таблиц в процессе работы. Обещание "не менять схему"
- * позволяет отказаться от захвата pthread_rwlock_t в процессе работы.
+ * позволяет отказаться от учета транзакций для координации с изменением
+ * схемы.
  *
  * В случае успеха возвращает ноль, иначе код ошибки. */
 FPTA_API int fpta_db_open(const char *path, fpta_durability durability,
                           mode_t file_mode, size_t megabytes,
                           bool alterable_schema, fpta_db **db);
 
+/* Геометрия БД с динамическим размером, все размеры в мегабайтах. */
+typedef struct fpta_db_geometry {
+  /* начальный и минимальный размер */
+  size_t lower;
+  /* максимальный размер */
+  size_t upper;
+  /* шаг увеличения размера */
+  size_t growth_step;
+  /* объем неиспользуемого места в конце БД, при превышении которого
+   * размер уменьшается, ноль отключает уменьшение */
+  size_t shrink_threshold;
+} fpta_db_geometry;
+
+/* Открывает базу аналогично fpta_db_open(), но с динамическим размером.
+ *
+ * Размер БД увеличивается на growth_step, когда перед стартом или после
+ * завершения пишущей транзакции свободного места остается меньше шага
+ * увеличения, но не более чем до upper. Соответственно, если после
+ * удаления данных в конце БД освободилось более shrink_threshold,
+ * то размер уменьшается, но не менее чем до lower. Таким образом, ошибка
+ * FPTA_DB_FULL возможна только при достижении upper, если одна транзакция
+ * потребовала больше growth_step, либо если размер не удалось увеличить
+ * из-за невозможности приостановить транзакции (см. ниже). В последних
+ * случаях транзакцию следует повторить, так как размер будет увеличен
+ * при старте следующей пишущей транзакции.
+ *
+ * Изменение размера требует кратковременной приостановки всех
+ * транзакций процесса. Если за отведенное время этого не удалось
+ * добиться, например из-за длительной читающей транзакции, то попытка
+ * будет повторена позже, с удвоением отсрочки при повторных неудачах.
+ * Пока есть транзакции, отмеченные посредством fpta_transaction_longterm(),
+ * попытки выполняются без ожидания, т.е. без приостановки транзакций.
+ * Изменение размера другими процессами подхватывается при старте
+ * транзакций, также с ограниченным временем ожидания. Если приостановить
+ * транзакции процесса не удалось, например из-за длительной транзакции
+ * или незавершенной транзакции самого стартующего потока, то
+ * fpta_transaction_begin() возвращает FPTA_DB_RESIZED и ее следует
+ * повторить после завершения таких транзакций.
+ *
+ * При lower равном upper поведение совпадает с fpta_db_open().
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_db_open_ex(const char *path, fpta_durability durability,
+                             mode_t file_mode,
+                             const fpta_db_geometry *geometry,
+                             bool alterable_schema, fpta_db **db);
+
 /* Закрывает ранее открытую базу.
  *
  * На момент закрытия базы должны быть закрыты все ранее открытые
@@ -596,6 +688,156 @@ FPTA_API int fpta_db_open(const char *path, fpta_durability durability,
  * В случае успеха возвращает ноль, иначе код ошибки. */
 FPTA_API int fpta_db_close(fpta_db *db);
 
+/* Включает хеш-таблицу для точечного поиска строк по неупорядоченным
+ * уникальным первичным ключам (fpta_primary_unique_unordered).
+ *
+ * Таблица размещается в памяти процесса и отображает ключ на адрес строки
+ * внутри БД, что позволяет fpta_get() в читающих транзакциях находить
+ * ранее запрошенные строки за O(1) без спуска по дереву. Аргумент entries
+ * задает количество элементов (округляется до степени двойки), которые
+ * разделяются между всеми таблицами БД.
+ *
+ * Адрес строки используется только в пределах снимка данных, в котором
+ * он был получен. Поэтому элементы также хранят копии строк размером
+ * до 192 байт, которые после фиксации изменений остаются в силе для
+ * ключей, не изменявшихся с момента сохранения. Последующие читающие
+ * транзакции получают такие строки в виде копии в памяти транзакции,
+ * действительной до её завершения. Изменения отслеживаются пишущими
+ * транзакциями процесса по ключам, а очистка таблиц и изменения схемы
+ * делают недействительными все копии. Изменения других процессов
+ * обнаруживаются только при старте пишущей транзакции в этом процессе,
+ * до чего копии не используются, а в процессах без пишущих транзакций
+ * таблица действует только в пределах снимка.
+ *
+ * Пишущие транзакции таблицу не используют. Поиск в таблице выполняется
+ * без записи в разделяемую память, поэтому не создает конкуренции между
+ * читающими потоками.
+ *
+ * Функция должна быть вызвана сразу после fpta_db_open(), до начала
+ * каких-либо транзакций. Повторный вызов возвращает EEXIST.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_db_pkcache(fpta_db *db, size_t entries);
+
+/* Сведения о хеш-таблице fpta_db_pkcache(). */
+typedef struct fpta_pkcache_info {
+  /* количество элементов, ноль если таблица не включена */
+  size_t entries;
+  /* количество найденных и не найденных в таблице строк, учитываются
+   * при завершении читающих транзакций */
+  uint64_t hits;
+  uint64_t misses;
+} fpta_pkcache_info;
+
+/* Возвращает сведения о хеш-таблице fpta_db_pkcache().
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_db_pkcache_info(fpta_db *db, fpta_pkcache_info *info);
+
+/* Ограничения отставания сохранения на диск от фиксации транзакций
+ * для режима fpta_sync_deferred. */
+typedef struct fpta_durability_limits {
+  /* Объем несохраненных данных в байтах, при превышении которого сброс
+   * выполняется непосредственно при фиксации транзакции. Ноль означает
+   * отсутствие ограничения. */
+  size_t max_unsynced_bytes;
+  /* Максимальная задержка сохранения в миллисекундах (100 по умолчанию),
+   * отсчитываемая от фиксации первой из несохраненных транзакций. */
+  unsigned max_lag_ms;
+  /* Количество несохраненных транзакций, при достижении которого
+   * сброс выполняется без ожидания задержки (1000 по умолчанию).
+   * Ноль означает отсутствие ограничения. */
+  size_t max_unsynced_txns;
+} fpta_durability_limits;
+
+/* Задает ограничения отставания сохранения для БД, открытой в режиме
+ * fpta_sync_deferred. Для других режимов возвращается FPTA_EINVAL.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_db_durability_limits(fpta_db *db,
+                                       const fpta_durability_limits *limits);
+
+/* Ожидает сохранения на диск транзакции с заданным номером, который
+ * можно получить посредством fpta_transaction_versions() в пишущей
+ * транзакции перед её завершением. Если транзакция еще не сохранена,
+ * то сброс на диск выполняется без ожидания фонового потока.
+ *
+ * Для режимов fpta_sync_group и fpta_sync_deferred номер не должен
+ * превышать номер последней зафиксированной транзакции, иначе
+ * возвращается FPTA_EINVAL. Для режимов fpta_lazy и fpta_async
+ * выполняется сброс на диск всех изменений.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_db_wait_durable(fpta_db *db, uint64_t txn_id);
+
+/* Флаги копирования БД. */
+typedef enum fpta_copy_flags {
+  fpta_copy_default = 0,
+  fpta_copy_compact = 1 /* Копия записывается плотно, без свободных
+                         * страниц, а страницы перенумеровываются.
+                         * Требует больше ресурсов процессора, но
+                         * копия получается меньше. */
+} fpta_copy_flags;
+
+/* Создает копию БД по заданному пути без остановки пишущих транзакций.
+ *
+ * Копируется согласованный снимок данных на момент начала копирования,
+ * который удерживается читающей транзакцией. Поэтому на время
+ * копирования применимы все ограничения длительных читающих транзакций,
+ * а изменение схемы ожидает завершения копирования.
+ *
+ * Аргумент bytes_per_second ограничивает скорость записи копии, чтобы
+ * копирование не мешало вводу-выводу основной нагрузки, а нулевое
+ * значение снимает ограничение.
+ *
+ * Файл копии не должен существовать, а в случае ошибки он удаляется.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_db_copy(fpta_db *db, const char *path, unsigned flags,
+                          size_t bytes_per_second);
+
+/* Аналогично fpta_db_copy(), но записывает копию в открытый файловый
+ * дескриптор, например в канал или сокет. Дескриптор не закрывается
+ * и не сбрасывается на диск. */
+FPTA_API int fpta_db_copy_fd(fpta_db *db, int fd, unsigned flags,
+                             size_t bytes_per_second);
+
+/* Разностное резервное копирование.
+ *
+ * Записывает в файл delta только страницы БД, изменившиеся с момента
+ * предыдущего вызова с тем же файлом digest, в котором сохраняются
+ * контрольные суммы страниц последней копии. При первом вызове digest
+ * создается, а delta содержит все страницы, т.е. является полной копией.
+ *
+ * Копируется согласованный снимок данных аналогично fpta_db_copy(),
+ * а аргумент bytes_per_second ограничивает скорость чтения снимка.
+ *
+ * Важно: это не инкрементальное копирование по чтению. Изменившиеся
+ * страницы определяются сравнением контрольных сумм, поэтому каждый
+ * вызов читает весь снимок БД и вычисляет хеш каждой его страницы.
+ * Затраты на чтение и процессор пропорциональны размеру БД и такие же,
+ * как у полной копии fpta_db_copy(), а сокращается только объем
+ * записываемых и хранимых данных.
+ *
+ * Файл delta не должен существовать. В случае ошибки он удаляется,
+ * а digest не изменяется.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_db_backup_delta(fpta_db *db, const char *digest,
+                                  const char *delta,
+                                  size_t bytes_per_second);
+
+/* Применяет delta к образу БД по пути image, создавая его при
+ * необходимости. Для восстановления к пустому образу должны быть
+ * последовательно применены все delta в порядке их создания, после
+ * чего образ может быть открыт посредством fpta_db_open().
+ *
+ * Файлы delta и digest записываются в порядке байт платформы
+ * и переносимы только между однотипными платформами.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_db_restore_delta(const char *image, const char *delta);
+
 //----------------------------------------------------------------------------
 /* Инициация и завершение транзакций. */
 
@@ -659,7 +901,7 @@ typedef enum fpta_level {
                    *
                    * Однако, транзакция изменения схемы также
                    * блокирует все читающие транзакции в рамках
-                   * своего процесса посредством pthread_rwlock_t.
+                   * своего процесса, дожидаясь завершения начатых.
                    * Такая блокировка обусловлена двумя причинами:
                    *  - спецификой движков libmdbx/LMDB (удаление
                    *    таблицы приводит к закрытию её разделяемого
@@ -672,11 +914,16 @@ typedef enum fpta_level {
                    *
                    * С другой стороны, обещание не менять схему
                    * (указание alterable_schema = false) позволяет
-                   * экономить на захвате pthread_rwlock_t при старте
-                   * читающих транзакций. */
+                   * экономить на учете транзакций при их старте
+                   * и завершении. */
 } fpta_level;
 
 /* Инициация транзакции заданного уровня.
+ *
+ * Для БД с динамическим размером может вернуть FPTA_DB_RESIZED, если
+ * размер был изменен другим процессом, а приостановить транзакции
+ * текущего процесса для применения изменения не удалось, см.
+ * fpta_db_open_ex(). В этом случае инициацию следует повторить.
  *
  * В случае успеха возвращает ноль, иначе код ошибки. */
 FPTA_API int fpta_transaction_begin(fpta_db *db, fpta_level level,
@@ -708,6 +955,190 @@ static __inline int fpta_transaction_abort(fpta_txn *txn) {
 FPTA_API int fpta_transaction_versions(fpta_txn *txn, uint64_t *data_version,
                                        uint64_t *schema_version);
 
+/* Точки сохранения внутри пишущей транзакции.
+ *
+ * Позволяют отменить часть изменений, сделанных после установки точки
+ * сохранения, не отменяя транзакцию целиком. Например, при пакетной
+ * вставке можно отменить вставку одной строки, нарушающей ограничения
+ * уникальности, и продолжить вставку остальных.
+ *
+ * Точки сохранения реализованы посредством вложенных транзакций mdbx
+ * и могут быть вложены друг в друга. При этом:
+ *  - точки сохранения доступны только в транзакциях уровня fpta_write
+ *    и не поддерживаются в режиме fpta_async;
+ *  - курсоры, открытые после установки точки сохранения, должны быть
+ *    закрыты до её фиксации или отмены, а открытые ранее курсоры нельзя
+ *    использовать до завершения точки сохранения;
+ *  - если внутри точки сохранения операция привела к отмене транзакции
+ *    (см. fpta_inconsistent_abort), то отменяются только изменения после
+ *    точки сохранения, а транзакция может быть продолжена после вызова
+ *    fpta_savepoint_rollback();
+ *  - при завершении транзакции все незавершенные точки сохранения
+ *    фиксируются или отменяются вместе с ней;
+ *  - при установке первой точки сохранения в транзакции открываются
+ *    дескрипторы всех таблиц и индексов, если этого еще не было сделано
+ *    для текущей версии схемы. Поэтому таблицы, впервые используемые
+ *    внутри точки сохранения, остаются доступны после её отмены.
+ *
+ * В случае успеха функции возвращают ноль, иначе код ошибки. */
+
+/* Устанавливает точку сохранения. */
+FPTA_API int fpta_savepoint_begin(fpta_txn *txn);
+
+/* Отменяет все изменения после последней точки сохранения
+ * и удаляет её. */
+FPTA_API int fpta_savepoint_rollback(fpta_txn *txn);
+
+/* Удаляет последнюю точку сохранения, сохраняя сделанные после нее
+ * изменения в транзакции. Если изменения были отменены в результате
+ * ошибки, то точка сохранения удаляется и возвращается FPTA_BAD_TXN. */
+FPTA_API int fpta_savepoint_release(fpta_txn *txn);
+
+//----------------------------------------------------------------------------
+/* Длительные читающие транзакции.
+ *
+ * Читающая транзакция удерживает свой снимок данных, поэтому страницы,
+ * освобожденные последующими пишущими транзакциями, не могут быть
+ * использованы повторно до её завершения. Длительная читающая
+ * транзакция (например, аналитическая выборка) при интенсивной записи
+ * приводит к росту БД вплоть до ошибки FPTA_DB_FULL.
+ *
+ * Такие транзакции следует отмечать посредством
+ * fpta_transaction_longterm(), что позволяет контролировать их
+ * отставание посредством fpta_db_readers_info() и задать политику
+ * отмены отстающих транзакций посредством fpta_db_laggard_policy().
+ *
+ * Отмененная транзакция остается открытой, но все операции в ней,
+ * кроме закрытия курсоров, возвращают FPTA_EINVAL, а завершение
+ * транзакции возвращает FPTA_TXN_CANCELLED. Прочитанные в такой
+ * транзакции данные следует считать недостоверными, так как
+ * удерживаемые ею страницы могли быть использованы повторно. */
+
+/* Отмечает читающую транзакцию как длительную.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_transaction_longterm(fpta_txn *txn);
+
+/* Сведения о длительных читающих транзакциях. */
+typedef struct fpta_readers_info {
+  /* номер последней зафиксированной транзакции */
+  uint64_t last_txnid;
+  /* количество длительных читающих транзакций */
+  size_t longterm;
+  /* снимок самой старой из длительных транзакций, её отставание
+   * в транзакциях и время жизни в миллисекундах */
+  uint64_t oldest_txnid;
+  uint64_t oldest_lag;
+  unsigned oldest_age_ms;
+  /* заполнение БД в процентах, включая удерживаемые читателями
+   * страницы */
+  unsigned space_used_percent;
+  /* количество отмененных отстающих транзакций */
+  uint64_t cancelled;
+} fpta_readers_info;
+
+/* Получает сведения о длительных читающих транзакциях.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_db_readers_info(fpta_db *db, fpta_readers_info *info);
+
+/* Функция согласия на отмену отстающей длительной транзакции, где lag
+ * отставание транзакции, а age_ms время её жизни. Вызывается в потоке
+ * пишущей транзакции, поэтому не должна выполнять операции с БД
+ * и обращаться к txn, который передается только для идентификации.
+ *
+ * Возвращает true для отмены транзакции. */
+typedef bool(fpta_laggard_callback)(void *context, const fpta_txn *txn,
+                                    uint64_t lag, unsigned age_ms);
+
+/* Задает политику отмены отстающих длительных транзакций.
+ *
+ * Длительная транзакция считается отстающей при отставании не менее
+ * max_lag транзакций. Отстающие транзакции отменяются:
+ *  - после фиксации пишущей транзакции, если заполнение БД достигло
+ *    space_threshold процентов;
+ *  - при исчерпании места в БД во время пишущей транзакции. В этом
+ *    случае удерживаемые отмененной транзакцией страницы сразу
+ *    становятся доступными, и пишущая транзакция продолжается.
+ *
+ * Если задана функция callback, то транзакция отменяется только при
+ * её согласии. Нулевое значение space_threshold отключает политику.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_db_laggard_policy(fpta_db *db, unsigned space_threshold,
+                                    uint64_t max_lag,
+                                    fpta_laggard_callback *callback,
+                                    void *context);
+
+//----------------------------------------------------------------------------
+/* Планировщик пишущих транзакций. */
+
+/* Класс приоритета запроса на изменение данных. */
+typedef enum fpta_write_priority {
+  fpta_write_interactive, /* Интерактивный запрос, выполняется раньше
+                           * пакетных в отдельной транзакции. */
+  fpta_write_batch /* Пакетный запрос, несколько таких запросов могут
+                    * объединяться в одну транзакцию. */
+} fpta_write_priority;
+
+/* Функция изменения данных, выполняемая планировщиком в рамках
+ * пишущей транзакции. Функция не должна завершать транзакцию, а для
+ * отмены своих изменений должна вернуть ненулевой код ошибки. */
+typedef int(fpta_write_closure)(fpta_txn *txn, void *context);
+
+/* Выполняет функцию изменения данных через планировщик пишущих
+ * транзакций и возвращает результат после фиксации транзакции.
+ *
+ * В отличие от непосредственного использования fpta_transaction_begin(),
+ * где порядок получения права на запись не определен, планировщик
+ * выполняет интерактивные запросы раньше пакетных, а пакетные запросы
+ * объединяет в общие транзакции ограниченного размера. Поэтому
+ * интерактивный запрос ожидает не более одной пакетной транзакции.
+ * Для исключения голодания после нескольких интерактивных транзакций
+ * подряд выполняется одна пакетная.
+ *
+ * Если функция вернула ошибку, то её изменения отменяются и этот же код
+ * ошибки возвращается из fpta_db_write(). Объединенные в одну транзакцию
+ * пакетные запросы выполняются каждый внутри своей точки сохранения
+ * (см. fpta_savepoint_begin()), поэтому ошибка одного запроса отменяет
+ * только его изменения и не влияет на остальные.
+ *
+ * Однако в режиме fpta_async точки сохранения недоступны, и ошибка
+ * одного из объединенных запросов приводит к отмене всей транзакции
+ * и повторному выполнению остальных запросов пакета, каждого в отдельной
+ * транзакции. Поэтому в этом режиме функция пакетного запроса может быть
+ * вызвана дважды, но изменения сохраняются только от одного вызова.
+ * Такая функция должна быть идемпотентной и не иметь побочных эффектов
+ * вне транзакции.
+ *
+ * Функции выполняются одним из потоков, ожидающих в fpta_db_write(),
+ * т.е. не обязательно потоком, поставившим запрос, и не должны вызывать
+ * fpta_db_write() рекурсивно.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_db_write(fpta_db *db, fpta_write_priority priority,
+                           fpta_write_closure *closure, void *context);
+
+/* Статистика планировщика пишущих транзакций, массивы индексируются
+ * классом приоритета fpta_write_priority. */
+typedef struct fpta_write_stats {
+  /* текущая длина очередей */
+  size_t queued[2];
+  /* количество выполненных запросов */
+  uint64_t executed[2];
+  /* суммарное и максимальное время ожидания запросов в очереди
+   * в микросекундах */
+  uint64_t wait_total_us[2];
+  uint64_t wait_max_us[2];
+  /* количество выполненных пишущих транзакций */
+  uint64_t transactions;
+} fpta_write_stats;
+
+/* Получает статистику планировщика пишущих транзакций.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_db_write_stats(fpta_db *db, fpta_write_stats *stats);
+
 //----------------------------------------------------------------------------
 /* Управление схемой:
  *  - Изменение схемы происходит в рамках "пишущей" транзакции
@@ -854,6 +1285,10 @@ typedef struct FPTA_API fpta_column_set {
   unsigned count;
   /* Упакованное внутреннее описание колонок. */
   fpta_shove_t shoves[fpta_max_cols];
+  /* Счетчик заполненных слов дополнительного описания. */
+  unsigned extra_count;
+  /* Упакованное дополнительное описание колонок и индексов. */
+  fpta_shove_t extra[fpta_max_schema_extra];
 } fpta_column_set;
 
 /* Вспомогательная функция, проверяет корректность имени */
@@ -866,12 +1301,278 @@ FPTA_API bool fpta_validate_name(const char *name);
  * таблиц и колонок допускаются символы: 0-9 A-Z a-z _
  * Начинаться имя должно с буквы. Регистр символов не различается.
  *
+ * Тип данных может быть массивом (fptu_farray в сочетании с типом элемента)
+ * целочисленных значений, чисел с плавающей точкой, fptu_datetime,
+ * fptu_96/128/160/256 или строк. Массивы fptu_opaque и fptu_nested
+ * не поддерживаются, так как для их элементов не определено представление
+ * в виде ключа, в этом случае возвращается FPTA_ETYPE.
+ * Для колонки-массива допускается только вторичный индекс с повторами,
+ * который содержит отдельную запись для каждого элемента массива
+ * (мульти-индекс). Соответственно, курсор по такому индексу позволяет
+ * выбрать строки, массив которых содержит заданные значения, при этом
+ * строка встречается столько раз, сколько различных элементов её массива
+ * попадает в диапазон курсора. Отсутствие колонки равнозначно пустому
+ * массиву. Обновление строки через курсор по мульти-индексу, в том числе
+ * с изменением PK, допускается если массив продолжает содержать текущий
+ * элемент. При удалении посредством fpta_delete_range() по мульти-индексу
+ * строка удаляется и учитывается однократно, если в диапазон попадает
+ * хотя бы один элемент её массива.
+ *
  * В случае успеха возвращает ноль, иначе код ошибки. */
 FPTA_API int fpta_column_describe(const char *column_name,
                                   enum fptu_type data_type,
                                   enum fpta_index_type index_type,
                                   fpta_column_set *column_set);
 
+/* Назначает колонку для отслеживания времени жизни строк (TTL).
+ *
+ * Колонка column_name должна быть предварительно добавлена в column_set
+ * посредством fpta_column_describe() и иметь тип fptu_datetime. Значение
+ * колонки задает момент, начиная с которого строка считается устаревшей.
+ * Так как колонка индексируется, то её значение должно присутствовать
+ * в каждой строке, а для "вечных" строк следует задавать заведомо
+ * большое значение (например, UINT64_MAX).
+ *
+ * Если колонка не индексирована, то для неё автоматически создается
+ * вторичный упорядоченный индекс с повторами (fpta_secondary_withdups),
+ * что требует уникальности первичного ключа. Неупорядоченный индекс
+ * для такой колонки не допускается.
+ *
+ * Устаревшие строки не видны для fpta_get() и курсоров, но физически
+ * удаляются только посредством fpta_expire(). До удаления они продолжают
+ * участвовать в контроле уникальности.
+ *
+ * В таблице может быть только одна такая колонка.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_column_describe_expiry(const char *column_name,
+                                         fpta_column_set *column_set);
+
+/* Включает для таблицы режим хранения строк без значения первичного ключа.
+ *
+ * Значение PK всегда хранится в ключе основной таблицы, поэтому в этом
+ * режиме соответствующее поле удаляется из кортежа при сохранении строки,
+ * а при чтении восстанавливается из ключа. Это уменьшает размер каждой
+ * строки на 4-36 байт и повышает количество строк на странице.
+ *
+ * Первичный ключ должен быть предварительно описан посредством
+ * fpta_column_describe(), быть уникальным и иметь тип, значение которого
+ * точно восстанавливается из ключа: целочисленный, с плавающей точкой,
+ * fptu_datetime, либо fptu_96/128/160/256 при упорядоченном индексе.
+ * Иначе возвращается FPTA_EINVAL или FPTA_ETYPE соответственно.
+ *
+ * ВАЖНО: Строки таких таблиц, получаемые посредством fpta_get()
+ * и fpta_cursor_get(), восстанавливаются в буфере транзакции или курсора
+ * соответственно. Поэтому полученная строка действительна только до
+ * следующего вызова fpta_get() в рамках той же транзакции, либо до
+ * следующего чтения или перемещения того же курсора.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_column_set_strip_pk(fpta_column_set *column_set);
+
+/* Включает для таблицы журнал изменений строк.
+ *
+ * Журнал хранится в отдельной служебной таблице и пополняется в той же
+ * пишущей транзакции, что и изменяемые строки. Каждая запись получает
+ * очередной порядковый номер, начиная с 1, и содержит вид изменения,
+ * значение PK и новую версию строки. Это позволяет потребителям получать
+ * изменения посредством fpta_changelog_open() и fpta_changelog_next()
+ * вместо периодического полного просмотра таблицы.
+ *
+ * Аргумент retention задает количество последних записей, сохраняемых
+ * в журнале. При добавлении новой записи самая старая сверх этого
+ * количества удаляется. При нулевом retention записи удаляются только
+ * посредством fpta_changelog_trim().
+ *
+ * Количество индексов в такой таблице должно быть меньше fpta_max_indexes
+ * на единицу, иначе fpta_table_create() вернет FPTA_TOOMANY.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_column_set_changelog(fpta_column_set *column_set,
+                                       unsigned retention);
+
+/* Задает предикат для частичного вторичного индекса колонки column_name.
+ *
+ * Частичный индекс содержит записи только для строк, удовлетворяющих
+ * предикату, соответственно курсоры и fpta_get() по такому индексу "видят"
+ * только эти строки. Для остальных строк индекс не обновляется, а значение
+ * индексируемой колонки в них может отсутствовать. Это позволяет уменьшить
+ * размер индекса и затраты на его обновление, если индекс востребован
+ * только для небольшой части строк.
+ *
+ * Колонка должна быть предварительно описана посредством
+ * fpta_column_describe() со вторичным индексом. Предикат задается
+ * фильтром, который сохраняется в схеме таблицы и поэтому может состоять
+ * только из узлов НЕ, И, ИЛИ и сравнений колонок с константами. Колонки
+ * в узлах сравнения идентифицируются по имени, поэтому для них достаточно
+ * вызова fpta_column_init() без fpta_name_refresh(). Функторы не
+ * допускаются (FPTA_EINVAL), а на колонки с PK нельзя ссылаться, если
+ * задан режим fpta_column_set_strip_pk().
+ *
+ * Обновление строки через курсор по частичному индексу, после которого
+ * строка не удовлетворяет предикату, отвергается с FPTA_KEY_MISMATCH.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_column_describe_partial(const char *column_name,
+                                         const struct fpta_filter *predicate,
+                                         fpta_column_set *column_set);
+
+/* Выражения для индексов по вычисляемому значению колонки. */
+enum fpta_index_expression {
+  /* Строка в нижнем регистре, преобразуются только символы A-Z.
+   * Допускается только для колонок типа fptu_cstr. */
+  fpta_expr_lowercase = 1,
+  /* Первые param байт значения, где param от 1 до fpta_max_keylen.
+   * Допускается только для колонок типа fptu_cstr и fptu_opaque. */
+  fpta_expr_prefix = 2,
+  /* Время, округленное вниз до кратного param секунд, например
+   * fpta_expr_trunc_hour или fpta_expr_trunc_day. Дробная часть
+   * отбрасывается. Допускается только для колонок типа fptu_datetime. */
+  fpta_expr_datetime_trunc = 3,
+  /* Значение, получаемое зарегистрированной функцией извлечения ключа,
+   * задается посредством fpta_column_describe_extractor(). */
+  fpta_expr_extractor = 4,
+  /* Значение поля внутри колонки-кортежа fptu_nested, заданное путем,
+   * задается посредством fpta_column_describe_nested(). */
+  fpta_expr_nested_path = 5,
+  /* Строка UTF-8 с простой сверткой регистра (simple case folding)
+   * для латиницы, греческого алфавита, кириллицы и армянского алфавита.
+   * Допускается только для колонок типа fptu_cstr. */
+  fpta_expr_casefold = 6
+};
+
+enum fpta_expression_trunc {
+  fpta_expr_trunc_hour = 60 * 60,
+  fpta_expr_trunc_day = 60 * 60 * 24
+};
+
+/* Задает для вторичного индекса колонки column_name вычисление ключа
+ * посредством выражения expression с параметром param (см. описание
+ * fpta_index_expression).
+ *
+ * Индекс строится не по значению колонки, а по результату выражения,
+ * что позволяет не хранить вычисляемое значение в отдельной колонке.
+ * Соответственно, при уникальном индексе уникальность контролируется
+ * для результата выражения, например, без учета регистра символов.
+ *
+ * Значения, передаваемые в fpta_cursor_open(), fpta_cursor_locate()
+ * и fpta_get() для поиска по такому индексу, также преобразуются
+ * выражением. Поэтому искать можно как по исходному значению,
+ * так и по уже вычисленному. А fpta_cursor_key() возвращает результат
+ * выражения.
+ *
+ * Колонка должна быть предварительно описана посредством
+ * fpta_column_describe() со вторичным индексом. Выражения не допускаются
+ * для первичного ключа и TTL-колонки.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_column_describe_expression(
+    const char *column_name, enum fpta_index_expression expression,
+    unsigned param, fpta_column_set *column_set);
+
+/* Функция извлечения ключа для индекса по вычисляемому значению.
+ *
+ * Должна быть детерминированной, т.е. для одной и той же строки всегда
+ * возвращать одинаковое значение, иначе индекс будет разрушен. Значение
+ * возвращается через key_value и должно соответствовать типу индексируемой
+ * колонки, а указатели внутри него должны быть действительны до возврата
+ * из функции. В случае успеха функция должна вернуть ноль, иначе код
+ * ошибки, который будет возвращен из вызвавшей операции. */
+typedef int(fpta_key_extractor)(void *context, const fptu_ro *row,
+                                fpta_value *key_value);
+
+/* Регистрирует функцию извлечения ключа под именем name.
+ *
+ * Регистрация выполняется в пределах процесса и не может быть отменена.
+ * Функция должна быть зарегистрирована до первого обращения к таблицам,
+ * в схеме которых она упоминается, иначе изменение и чтение строк
+ * посредством соответствующего индекса будет завершаться ошибкой
+ * FPTA_ENOIMP. Повторная регистрация того же имени возвращает EEXIST,
+ * а превышение fpta_max_key_extractors - FPTA_TOOMANY.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_key_extractor_register(const char *name,
+                                         fpta_key_extractor *extractor,
+                                         void *context);
+
+/* Задает для вторичного индекса колонки column_name вычисление ключа
+ * посредством функции, зарегистрированной под именем extractor_name.
+ *
+ * В схеме таблицы сохраняется только имя функции. Тип индексируемой
+ * колонки определяет тип ключа, при этом само значение колонки в строках
+ * не используется и может отсутствовать. Поиск по такому индексу
+ * выполняется по уже вычисленным значениям.
+ *
+ * Колонка не может быть типа fptu_nested или массивом, так как для
+ * кортежей и массивов не определено представление в виде ключа, в этом
+ * случае возвращается FPTA_ETYPE. Для индексации поля внутри кортежа
+ * следует использовать fpta_column_describe_nested().
+ *
+ * Если на момент изменения или чтения строк функция extractor_name
+ * не зарегистрирована, то операции с индексом завершаются ошибкой
+ * FPTA_ENOIMP (см. fpta_key_extractor_register()).
+ *
+ * В остальном аналогично fpta_column_describe_expression().
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_column_describe_extractor(const char *column_name,
+                                            const char *extractor_name,
+                                            fpta_column_set *column_set);
+
+/* Задает для вторичного индекса колонки column_name вычисление ключа
+ * из поля внутри колонки-кортежа nested_column_name типа fptu_nested.
+ *
+ * Поле задается путем из depth номеров колонок (от 1 до
+ * fpta_max_nested_depth): path[0] - номер поля внутри кортежа колонки
+ * nested_column_name, path[1] - внутри вложенного в него кортежа и т.д.
+ * Например, для "address.city" путь состоит из одного номера поля "city"
+ * внутри кортежа "address". Все промежуточные поля должны быть типа
+ * fptu_nested, а тип конечного поля должен совпадать с типом колонки
+ * column_name, который определяет тип ключа.
+ *
+ * Извлеченное значение кодируется как обычный ключ этого типа, поэтому
+ * упорядоченные индексы и диапазоны работают так же, как для плоских
+ * колонок, а сравнение целых кортежей не требуется. Само значение
+ * колонки column_name в строках не используется и может отсутствовать,
+ * а поиск выполняется по значениям конечного поля. При отсутствии поля
+ * в строке вставка и обновление завершаются ошибкой FPTA_COLUMN_MISSING.
+ *
+ * В остальном аналогично fpta_column_describe_expression().
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_column_describe_nested(const char *column_name,
+                                         const char *nested_column_name,
+                                         const unsigned *path, size_t depth,
+                                         fpta_column_set *column_set);
+
+/* Правила сравнения (collation) строк в индексе. */
+enum fpta_collation {
+  /* побайтовое сравнение, используется по-умолчанию */
+  fpta_collation_binary = 0,
+  /* без учета регистра латинских букв A-Z */
+  fpta_collation_ascii_ci = 1,
+  /* без учета регистра символов UTF-8, см. fpta_expr_casefold */
+  fpta_collation_utf8_ci = 2
+};
+
+/* Задает правила сравнения строк для вторичного индекса колонки
+ * column_name типа fptu_cstr.
+ *
+ * Правила реализуются посредством индекса по выражению
+ * (fpta_expr_lowercase или fpta_expr_casefold): при формировании ключа
+ * строка приводится к ключу сортировки, а сами ключи по-прежнему
+ * сравниваются побайтово. Поэтому для уникального индекса строки,
+ * различающиеся только регистром, считаются одинаковыми, а искать
+ * можно по значению в любом регистре. Сами строки хранятся без
+ * изменений.
+ *
+ * В остальном аналогично fpta_column_describe_expression().
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_column_describe_collation(const char *column_name,
+                                            enum fpta_collation collation,
+                                            fpta_column_set *column_set);
+
 /* Инициализирует column_set перед заполнением посредством
  * fpta_column_describe(). */
 FPTA_API void fpta_column_set_init(fpta_column_set *column_set);
@@ -1257,6 +1958,34 @@ FPTA_API int fpta_cursor_open(fpta_txn *txn, fpta_name *column_id,
                               fpta_cursor **cursor);
 FPTA_API int fpta_cursor_close(fpta_cursor *cursor);
 
+/* Создает и открывает курсор для выборки строк, у которых значение
+ * ключевой колонки начинается с заданного префикса. Курсор закрывается
+ * посредством fpta_cursor_close().
+ *
+ * Опорная колонка должна иметь упорядоченный индекс и строковый
+ * либо двоичный тип, а префикс задается значением типа fpta_string
+ * или fpta_binary соответственно. Для индексов с порядком сравнения
+ * "от хвоста к голове" (fpta_index_*_last2first) выбираются строки,
+ * у которых значение колонки заканчивается заданным префиксом, так как
+ * именно такие ключи образуют в индексе непрерывный диапазон. Например,
+ * все поддомены по суффиксу ".example.com".
+ *
+ * Курсор сразу позиционируется на начало диапазона без перебора ключей.
+ * Префиксы длиннее fpta_max_keylen допустимы: диапазон определяется
+ * сохраняемой в индексе частью ключа, а остаток префикса сверяется
+ * со значением колонки. Для индексов по выражениям и колонок-массивов
+ * длина префикса ограничена fpta_max_keylen, иначе возвращается
+ * FPTA_EVALUE.
+ *
+ * Остальные аргументы и поведение аналогичны fpta_cursor_open().
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_cursor_open_prefix(fpta_txn *txn, fpta_name *column_id,
+                                     fpta_value prefix,
+                                     const fpta_filter *filter,
+                                     fpta_cursor_options op,
+                                     fpta_cursor **cursor);
+
 /* Проверяет наличие за курсором данных.
  *
  * Отсутствие данных означает что нет возможности их прочитать, изменить
@@ -1285,6 +2014,116 @@ FPTA_API int fpta_cursor_eof(fpta_cursor *cursor);
 FPTA_API int fpta_cursor_count(fpta_cursor *cursor, size_t *count,
                                size_t limit);
 
+/* Выбирает limit первых строк курсора в порядке значений колонки
+ * column_id, которая может не иметь индекса, т.е. выполняет аналог
+ * "ORDER BY column LIMIT limit" без сортировки всей выборки.
+ *
+ * Производится полный проход курсора с учетом диапазона и фильтра,
+ * заданных при открытии. При этом поддерживается куча из не более чем
+ * limit строк, поэтому стоимость порядка O(RANGE * log(limit)), а объем
+ * дополнительной памяти пропорционален только limit.
+ *
+ * Аргумент order задает порядок: fpta_ascending для наименьших значений
+ * колонки и fpta_descending для наибольших. Строки, не содержащие
+ * значения колонки, пропускаются, а при равных значениях сохраняется
+ * порядок курсора. Колонки-массивы и fptu_nested не допускаются.
+ *
+ * Строки сохраняются в массив rows по возрастанию или убыванию значений,
+ * а их количество в count. Строки не копируются и ссылаются на данные
+ * внутри БД, т.е. остаются действительными до завершения или изменения
+ * данных в транзакции. Для таблиц с исключенным PK строки
+ * восстанавливаются в буфере курсора и действительны до следующего
+ * чтения через курсор либо до его закрытия.
+ *
+ * Текущая позиция курсора сбрасывается аналогично fpta_cursor_count().
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_topk(fpta_cursor *cursor, fpta_name *column_id,
+                       fpta_cursor_options order, size_t limit, fptu_ro *rows,
+                       size_t *count);
+
+/* Агрегатные функции для fpta_cursor_aggregate(). */
+typedef enum fpta_aggregate_function {
+  /* Количество строк, содержащих значение колонки, либо всех строк
+   * курсора, если колонка не задана. Результат fpta_unsigned_int. */
+  fpta_aggregate_count,
+  /* Сумма значений. Результат fpta_signed_int, fpta_unsigned_int или
+   * fpta_float_point в зависимости от типа колонки. При переполнении
+   * целочисленной суммы возвращается FPTA_EVALUE. */
+  fpta_aggregate_sum,
+  /* Наименьшее и наибольшее значения, в том числе для fptu_datetime.
+   * Результат того же вида, что и значения колонки. */
+  fpta_aggregate_min,
+  fpta_aggregate_max,
+  /* Среднее значение, результат fpta_float_point. */
+  fpta_aggregate_avg
+} fpta_aggregate_function;
+
+/* Элемент запроса к fpta_cursor_aggregate(). */
+typedef struct fpta_aggregate {
+  /* Агрегируемая колонка, либо nullptr для fpta_aggregate_count
+   * по всем строкам. */
+  fpta_name *column_id;
+  fpta_aggregate_function function;
+  /* Результат, либо fpta_null при отсутствии значений
+   * (кроме fpta_aggregate_count). */
+  fpta_value result;
+} fpta_aggregate;
+
+/* Вычисляет агрегатные функции по строкам курсора с учетом диапазона
+ * и фильтра, заданных при открытии курсора.
+ *
+ * Все элементы массива aggregates вычисляются за один проход по строкам
+ * курсора, без копирования строк. Агрегировать можно только колонки
+ * числовых типов и fptu_datetime (последние только для count, min и max),
+ * но не колонки-массивы.
+ *
+ * Если запрошены только min и max по колонке упорядоченного индекса
+ * курсора, то значения берутся из первого и последнего ключей диапазона
+ * без прохода по строкам, т.е. за O(log(ALL)) при отсутствии фильтра.
+ * Аналогично, для значений колонки индекса курсора и для count без
+ * колонки сами строки не читаются.
+ *
+ * Текущая позиция курсора сбрасывается аналогично fpta_cursor_count().
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_cursor_aggregate(fpta_cursor *cursor,
+                                   fpta_aggregate *aggregates, size_t count);
+
+/* Функция получения результатов для fpta_group_aggregate().
+ *
+ * Вызывается для каждой группы строк со значением группирующей колонки
+ * в group (fpta_null для строк без значения) и результатами агрегатных
+ * функций в aggregates[].result. Указатели внутри group ссылаются
+ * на данные внутри БД и действительны до завершения или изменения данных
+ * в транзакции. Для продолжения функция должна вернуть ноль, иначе
+ * группировка прерывается и возвращенное значение передается
+ * в качестве результата fpta_group_aggregate(). */
+typedef int(fpta_group_callback)(void *context, const fpta_value *group,
+                                 const fpta_aggregate *aggregates,
+                                 size_t count);
+
+/* Группирует строки курсора по значению колонки group_column и вычисляет
+ * для каждой группы агрегатные функции аналогично fpta_cursor_aggregate(),
+ * т.е. аналог "GROUP BY" с учетом диапазона и фильтра курсора.
+ *
+ * Группирующая колонка может быть любого типа, кроме колонок-массивов
+ * и fptu_nested. Если курсор открыт по упорядоченному индексу этой
+ * колонки, то строки каждой группы идут подряд и группы обрабатываются
+ * потоком, без дополнительной памяти, в порядке курсора. Иначе
+ * используется хеш-таблица с размещением групп в пуле памяти, а группы
+ * передаются в callback после прохода по всем строкам в порядке их
+ * первого появления.
+ *
+ * Текущая позиция курсора сбрасывается аналогично fpta_cursor_count().
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_group_aggregate(fpta_cursor *cursor,
+                                  fpta_name *group_column,
+                                  fpta_aggregate *aggregates, size_t count,
+                                  fpta_group_callback *callback,
+                                  void *context);
+
 /* Считает и возвращает количество дубликатов для ключа в текущей
  * позиции курсора, БЕЗ учета фильтра заданного при открытии курсора.
  *
@@ -1464,6 +2303,32 @@ FPTA_API int fpta_cursor_delete(fpta_cursor *cursor);
 FPTA_API int fpta_get(fpta_txn *txn, fpta_name *column_id,
                       const fpta_value *column_value, fptu_ro *row);
 
+/* Включает или отключает фильтр отрицательных поисков (фильтр Блума)
+ * для уникального индекса колонки column_id.
+ *
+ * Фильтр позволяет без обращения к индексу определить, что ключа в нем
+ * заведомо нет. Это ускоряет проверку уникальности в fpta_validate_put(),
+ * fpta_put() и при обновлении через курсоры, а также fpta_get() внутри
+ * пишущих транзакций, когда искомые ключи в основном отсутствуют.
+ *
+ * Аргумент expected_keys задает ожидаемое количество ключей, от которого
+ * зависит размер фильтра (около 10 бит на ключ), ноль отключает фильтр.
+ * При переполнении размер увеличивается автоматически.
+ *
+ * Фильтр хранится в памяти процесса в пределах экземпляра fpta_db, строится
+ * при первом использовании, в том числе после открытия БД, и обновляется
+ * при добавлении ключей. Удаленные ключи остаются в фильтре до его
+ * перестроения, что лишь увеличивает долю ложноположительных ответов.
+ * Фильтр используется только в пишущих транзакциях. Если между ними БД
+ * изменялась другим процессом или изменялась схема, то фильтр
+ * автоматически перестраивается сканированием индекса.
+ *
+ * Требуется транзакция уровня не ниже fpta_write.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_index_keyfilter(fpta_txn *txn, fpta_name *column_id,
+                                  size_t expected_keys);
+
 /* Опции при помещении или обновлении данных, т.е. для fpta_put(). */
 typedef enum fpta_put_options {
   /* Вставить новую запись, т.е. не обновлять существующую.
@@ -1726,6 +2591,182 @@ static __inline int fpta_probe_and_upsert_row(fpta_txn *txn,
  * В случае успеха возвращает ноль, иначе код ошибки. */
 FPTA_API int fpta_delete(fpta_txn *txn, fpta_name *table_id, fptu_ro row_value);
 
+/* Удаляет строки таблицы, у которых значение индексированной колонки
+ * column_id попадает в диапазон [range_from, range_to), с учетом фильтра
+ * аналогично fpta_cursor_open(). Количество удаленных строк сохраняется
+ * по указателю deleted.
+ *
+ * В сравнении с перебором курсором и вызовом fpta_cursor_delete() для
+ * каждой строки, удаление из вторичных индексов выполняется пакетами,
+ * в отсортированном по каждому индексу порядке.
+ *
+ * ВАЖНО: При ошибке после удаления части строк транзакция будет
+ * прервана, т.е. все сделанные в ней изменения будут отменены.
+ *
+ * Аргумент column_id перед первым использованием должен
+ * быть инициализированы посредством fpta_column_init().
+ * Предварительный вызов fpta_name_refresh() не обязателен.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_delete_range(fpta_txn *txn, fpta_name *column_id,
+                               fpta_value range_from, fpta_value range_to,
+                               const fpta_filter *filter, size_t *deleted);
+
+/* Удаляет все строки таблицы, сохраняя саму таблицу и её схему.
+ *
+ * Основная таблица и все служебные таблицы вторичных индексов очищаются
+ * целиком, поэтому затраты пропорциональны количеству страниц, а не строк.
+ * Не требует транзакции уровня fpta_schema.
+ *
+ * Аргумент table_id перед первым использованием должен
+ * быть инициализированы посредством fpta_table_init().
+ * Предварительный вызов fpta_name_refresh() не обязателен.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_table_clear(fpta_txn *txn, fpta_name *table_id);
+
+/* Удаляет устаревшие строки таблицы с TTL-колонкой, заданной посредством
+ * fpta_column_describe_expiry().
+ *
+ * Удаляются строки, у которых значение TTL-колонки не больше now, в порядке
+ * возрастания этого значения по соответствующему индексу. Поэтому затраты
+ * пропорциональны количеству устаревших строк, а не размеру таблицы.
+ * За один вызов удаляется не более budget строк, что позволяет выполнять
+ * очистку ограниченными порциями в отдельных транзакциях. Количество
+ * удаленных строк сохраняется по указателю expired, если он не nullptr.
+ *
+ * Для таблицы без TTL-колонки возвращается FPTA_NO_INDEX.
+ *
+ * Аргумент table_id перед первым использованием должен
+ * быть инициализированы посредством fpta_table_init().
+ * Предварительный вызов fpta_name_refresh() не обязателен.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_expire(fpta_txn *txn, fpta_name *table_id, fptu_time now,
+                         size_t budget, size_t *expired);
+
+/* Атомарно прибавляет delta к значению числовой колонки в строке с заданным
+ * значением первичного ключа, т.е. реализует счетчики без последовательности
+ * fpta_get() + fpta_upsert_column() + fpta_put().
+ *
+ * Поддерживаются колонки целочисленных типов и с плавающей точкой, для
+ * уменьшения значения следует передать отрицательное delta. Тип delta должен
+ * соответствовать типу колонки: fpta_signed_int или fpta_unsigned_int для
+ * целочисленных колонок и fpta_float_point для колонок с плавающей точкой.
+ * Отсутствующее в строке значение колонки считается нулевым.
+ *
+ * Строка ищется однократно, после чего обновляется "на месте". Проверка
+ * переполнения выполняется по тем же правилам что и в fpta_upsert_column(),
+ * при выходе за допустимый диапазон возвращается FPTA_EVALUE без изменения
+ * данных. Если колонка индексирована, то соответствующий вторичный индекс
+ * обновляется, а для уникального индекса предварительно проверяется
+ * соблюдение ограничения уникальности.
+ *
+ * Первичный ключ таблицы должен быть уникальным, а сама колонка column_id
+ * не может быть первичным ключом. Транзакция txn должна быть пишущей,
+ * иначе возвращается FPTA_EINVAL.
+ *
+ * Если result не равен nullptr, то по нему будет сохранено новое значение.
+ *
+ * Аргумент column_id перед первым использованием должен
+ * быть инициализированы посредством fpta_column_init().
+ * Предварительный вызов fpta_name_refresh() не обязателен.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_column_add(fpta_txn *txn, fpta_name *column_id,
+                             const fpta_value *pk_value, fpta_value delta,
+                             fpta_value *result);
+
+//----------------------------------------------------------------------------
+/* Журнал изменений строк.
+ *
+ * Для таблиц, созданных с fpta_column_set_changelog(), все изменения строк
+ * посредством fpta_put(), fpta_delete(), fpta_cursor_update(),
+ * fpta_cursor_delete(), fpta_delete_range(), fpta_expire(),
+ * fpta_column_add() и fpta_table_clear() регистрируются в журнале.
+ *
+ * Потребитель запоминает номер последней обработанной записи и в очередной
+ * транзакции читает журнал начиная со следующего номера. Таким образом
+ * затраты на синхронизацию пропорциональны количеству изменений, а не
+ * размеру таблицы. Если номер первой прочитанной записи больше ожидаемого,
+ * то часть записей уже удалена согласно политике хранения и потребителю
+ * требуется полная синхронизация. */
+
+/* Вид изменения в записи журнала. */
+typedef enum fpta_change_kind {
+  /* добавлена новая строка */
+  fpta_change_insert = 1,
+  /* строка с данным PK обновлена */
+  fpta_change_update = 2,
+  /* строка с данным PK удалена */
+  fpta_change_delete = 3,
+  /* удалены все строки таблицы посредством fpta_table_clear() */
+  fpta_change_clear = 4
+} fpta_change_kind;
+
+/* Запись журнала изменений. */
+typedef struct fpta_change {
+  /* порядковый номер записи */
+  uint64_t seq;
+  /* версия данных транзакции, в которой выполнено изменение,
+   * см. fpta_transaction_versions() */
+  uint64_t txnid;
+  fpta_change_kind kind;
+  /* значение первичного ключа, отсутствует для fpta_change_clear */
+  fpta_value pk;
+  /* новая версия строки в том виде, в котором она хранится в таблице,
+   * т.е. без PK при fpta_column_set_strip_pk(). Для fpta_change_delete
+   * и fpta_change_clear строка пустая. */
+  fptu_ro row;
+} fpta_change;
+
+/* Курсор для чтения журнала изменений таблицы. */
+typedef struct fpta_changelog fpta_changelog;
+
+/* Открывает курсор для чтения журнала изменений таблицы начиная с записи
+ * с номером from_seq, либо с ближайшей следующей сохранившейся записи.
+ *
+ * Курсор видит журнал в том же состоянии, что и остальные операции
+ * в транзакции txn, и должен быть закрыт посредством fpta_changelog_close()
+ * до её завершения. Для таблицы без журнала возвращается FPTA_NO_INDEX.
+ *
+ * Аргумент table_id перед первым использованием должен
+ * быть инициализированы посредством fpta_table_init().
+ * Предварительный вызов fpta_name_refresh() не обязателен.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_changelog_open(fpta_txn *txn, fpta_name *table_id,
+                                 uint64_t from_seq, fpta_changelog **plog);
+
+/* Получает очередную запись журнала и переходит к следующей.
+ *
+ * Значения PK и строки указывают на данные внутри БД и действительны
+ * до завершения транзакции или изменения таблицы в ней.
+ *
+ * Возвращает FPTA_NODATA при исчерпании записей, ноль в случае успеха,
+ * иначе код ошибки. */
+FPTA_API int fpta_changelog_next(fpta_changelog *log, fpta_change *change);
+
+/* Закрывает курсор журнала изменений.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_changelog_close(fpta_changelog *log);
+
+/* Получает номера первой сохранившейся и последней записей журнала.
+ * Для пустого журнала first будет на единицу больше last.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_changelog_bounds(fpta_txn *txn, fpta_name *table_id,
+                                   uint64_t *first, uint64_t *last);
+
+/* Удаляет из журнала записи с номерами не больше upto_seq, например
+ * после их обработки всеми потребителями. Нумерация записей при этом
+ * продолжается. Требует пишущей транзакции.
+ *
+ * В случае успеха возвращает ноль, иначе код ошибки. */
+FPTA_API int fpta_changelog_trim(fpta_txn *txn, fpta_name *table_id,
+                                 uint64_t upto_seq);
+
 //----------------------------------------------------------------------------
 /* Манипуляция данными внутри строк. */
 
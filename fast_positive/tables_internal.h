@@ -70,6 +70,36 @@ static int __inline pthread_mutex_destroy(struct pthread_mutex_t *) {
   return ENOSYS;
 }
 
+struct pthread_cond_t {};
+static int __inline pthread_cond_init(struct pthread_cond_t *, void *) {
+  return ENOSYS;
+}
+static int __inline pthread_cond_wait(struct pthread_cond_t *,
+                                      struct pthread_mutex_t *) {
+  return ENOSYS;
+}
+static int __inline pthread_cond_timedwait(struct pthread_cond_t *,
+                                           struct pthread_mutex_t *,
+                                           const struct timespec *) {
+  return ENOSYS;
+}
+static int __inline pthread_cond_signal(struct pthread_cond_t *) {
+  return ENOSYS;
+}
+static int __inline pthread_cond_broadcast(struct pthread_cond_t *) {
+  return ENOSYS;
+}
+static int __inline pthread_cond_destroy(struct pthread_cond_t *) {
+  return ENOSYS;
+}
+
+typedef int pthread_t;
+static int __inline pthread_create(pthread_t *, void *, void *(*)(void *),
+                                   void *) {
+  return ENOSYS;
+}
+static int __inline pthread_join(pthread_t, void **) { return ENOSYS; }
+
 #endif /* windows must die (CMAKE_HAVE_PTHREAD_H) */
 
 #ifdef __linux__
@@ -148,10 +178,16 @@ static __inline int mdbx_env_set_maxreaders(MDB_env *, unsigned) {
 }
 static __inline void mdbx_env_close(MDB_env *) {}
 static __inline int mdbx_env_sync(MDB_env *, int) { return ENOSYS; }
+static __inline int mdbx_env_set_syncbytes(MDB_env *, size_t) {
+  return ENOSYS;
+}
 static __inline int mdbx_env_open(MDB_env *, const char *, unsigned, mode_t) {
   return ENOSYS;
 }
 static __inline int mdbx_env_create(MDB_env **) { return ENOSYS; }
+static __inline int mdbx_env_copyfd2(MDB_env *, int, unsigned) {
+  return ENOSYS;
+}
 static __inline const char *mdbx_strerror(int) { return "ENOSYS"; }
 static __inline const char *mdbx_strerror_r(int, char *, size_t) {
   return "ENOSYS";
@@ -182,7 +218,26 @@ static __inline int mdbx_dcmp(MDB_txn *, MDB_dbi, const MDB_val *,
   return 0;
 }
 static __inline int mdbx_env_set_userctx(MDB_env *, void *) { return ENOSYS; }
+static __inline void *mdbx_env_get_userctx(MDB_env *) { return nullptr; }
+typedef pthread_t mdbx_tid_t;
+typedef int(MDBX_oom_func)(MDB_env *env, int pid, mdbx_tid_t tid, uint64_t txn,
+                           unsigned gap, int retry);
+static __inline void mdbx_env_set_oomfunc(MDB_env *, MDBX_oom_func *) {}
+static __inline int mdbx_txn_straggler(MDB_txn *, int *) { return ENOSYS; }
 static __inline int mdbx_env_set_mapsize(MDB_env *, size_t) { return ENOSYS; }
+typedef struct MDBX_envinfo {
+  void *me_mapaddr;
+  size_t me_mapsize;
+  size_t me_last_pgno;
+  size_t me_last_txnid;
+} MDBX_envinfo;
+static __inline int mdbx_env_info(MDB_env *, MDBX_envinfo *, size_t) {
+  return ENOSYS;
+}
+typedef struct MDBX_stat { unsigned ms_psize; } MDBX_stat;
+static __inline int mdbx_env_stat(MDB_env *, MDBX_stat *, size_t) {
+  return ENOSYS;
+}
 static __inline int mdbx_env_close_ex(MDB_env *, int) { return ENOSYS; }
 
 static __inline int mdbx_cursor_on_first(MDB_cursor *) { return ENOSYS; }
@@ -198,6 +253,7 @@ enum stub_MDB_defs {
   MDB_WRITEMAP,
   MDB_MAPASYNC,
   MDBX_UTTERLY_NOSYNC,
+  MDB_CP_COMPACT,
   MDB_SUCCESS,
   MDB_NOTFOUND,
   MDB_KEYEXIST,
@@ -214,6 +270,8 @@ enum stub_MDB_defs {
   MDB_NOOVERWRITE,
   MDB_NODUPDATA,
   MDB_CURRENT,
+  MDB_RESERVE,
+  MDB_APPEND,
 
   MDB_GET_CURRENT,
   MDB_NEXT,
@@ -237,6 +295,7 @@ enum stub_MDB_defs {
 #include "t1ha/t1ha.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cfloat> // for float limits
 #include <cmath>  // for fabs()
 #include <functional>
@@ -257,10 +316,217 @@ struct fpta_table_schema {
   fpta_shove_t columns[fpta_max_cols];
 };
 
-static __inline size_t fpta_table_schema_size(size_t cols) {
+static __inline size_t fpta_table_schema_size(size_t cols, size_t extra = 0) {
   assert(cols <= fpta_max_cols);
+  assert(extra <= fpta_max_schema_extra);
   return sizeof(fpta_table_schema) -
-         sizeof(fpta_shove_t) * (fpta_max_cols - cols);
+         sizeof(fpta_shove_t) * (fpta_max_cols - cols) +
+         sizeof(fpta_shove_t) * extra;
+}
+
+/* Дополнительное описание таблицы размещается в записи схемы следом
+ * за columns[count], в виде последовательности элементов. Каждый элемент
+ * состоит из слова-заголовка и следующих за ним слов с данными.
+ *
+ * Заголовок упакован в 64-битное слово:
+ *  - младшие 8 бит: вид элемента (fpta_schema_extra_kind);
+ *  - следующие 8 бит: количество слов данных после заголовка;
+ *  - следующие 16 бит: номер колонки, к которой относится элемент;
+ *  - старшие 32 бита: параметр, смысл которого зависит от вида элемента.
+ *
+ * В копии схемы внутри fpta_name (table.def) последовательность всегда
+ * завершается нулевым словом, поэтому её можно перебирать без знания
+ * размера исходной записи. */
+enum fpta_schema_extra_kind {
+  fpta_extra_end = 0,
+  /* колонка со временем устаревания строк (TTL) */
+  fpta_extra_expiry = 1,
+  /* значение PK не хранится внутри кортежа строки (только для колонки 0) */
+  fpta_extra_pk_stripped = 2,
+  /* предикат частичного индекса, в данных сериализованный fpta_filter */
+  fpta_extra_partial = 3,
+  /* выражение для вычисления ключа индекса, в параметре заголовка вид
+   * выражения (fpta_index_expression), в данных одно слово с аргументом */
+  fpta_extra_expression = 4,
+  /* журнал изменений строк таблицы (только для колонки 0), в параметре
+   * заголовка количество сохраняемых записей (0 - без ограничения) */
+  fpta_extra_changelog = 5,
+  fpta_extra_kind_last = fpta_extra_changelog
+};
+
+static __inline fpta_shove_t fpta_extra_header(unsigned kind, unsigned column,
+                                               size_t words, uint32_t param) {
+  assert(kind > fpta_extra_end && kind <= fpta_extra_kind_last);
+  assert(column < fpta_max_cols && words < 256);
+  return kind | (fpta_shove_t)words << 8 | (fpta_shove_t)column << 16 |
+         (fpta_shove_t)param << 32;
+}
+
+static __inline unsigned fpta_extra_kind(fpta_shove_t header) {
+  return (unsigned)(header & 255);
+}
+
+static __inline size_t fpta_extra_words(fpta_shove_t header) {
+  return (size_t)((header >> 8) & 255);
+}
+
+static __inline unsigned fpta_extra_column(fpta_shove_t header) {
+  return (unsigned)((header >> 16) & UINT16_MAX);
+}
+
+static __inline uint32_t fpta_extra_param(fpta_shove_t header) {
+  return (uint32_t)(header >> 32);
+}
+
+/* Путь к полю вложенного кортежа для выражения fpta_expr_nested_path
+ * упакован в слово аргумента выражения:
+ *  - младшие 16 бит: номер колонки-кортежа в строке;
+ *  - следующие 4 бита: глубина пути;
+ *  - далее по 11 бит на номер поля для каждого уровня вложенности. */
+enum fpta_nested_path_bits {
+  fpta_path_depth_shift = 16,
+  fpta_path_step_shift = 20,
+  fpta_path_step_bits = 11
+};
+
+static_assert(fpta_max_cols < (1 << fpta_path_step_bits),
+              "column number does not fit into a path step");
+static_assert(fpta_path_step_shift +
+                      fpta_path_step_bits * fpta_max_nested_depth <=
+                  64,
+              "nested path does not fit into a word");
+
+static __inline uint64_t fpta_path_pack(unsigned column, const unsigned *path,
+                                        size_t depth) {
+  assert(column < fpta_max_cols && depth <= fpta_max_nested_depth);
+  uint64_t packed = column | (uint64_t)depth << fpta_path_depth_shift;
+  for (size_t i = 0; i < depth; ++i)
+    packed |= (uint64_t)path[i]
+              << (fpta_path_step_shift + fpta_path_step_bits * i);
+  return packed;
+}
+
+static __inline unsigned fpta_path_column(uint64_t packed) {
+  return (unsigned)(packed & UINT16_MAX);
+}
+
+static __inline unsigned fpta_path_depth(uint64_t packed) {
+  return (unsigned)(packed >> fpta_path_depth_shift) & 15;
+}
+
+static __inline unsigned fpta_path_step(uint64_t packed, unsigned level) {
+  return (unsigned)(packed >>
+                    (fpta_path_step_shift + fpta_path_step_bits * level)) &
+         ((1 << fpta_path_step_bits) - 1);
+}
+
+static __inline uint64_t fpta_path_renumber(uint64_t packed,
+                                            unsigned column) {
+  return (packed & ~(uint64_t)UINT16_MAX) | column;
+}
+
+/* Ищет в схеме элемент дополнительного описания заданного вида
+ * для указанной колонки, либо для любой колонки если column < 0. */
+static __inline const fpta_shove_t *
+fpta_schema_extra_lookup(const fpta_table_schema *def, unsigned kind,
+                         int column) {
+  for (const fpta_shove_t *scan = def->columns + def->count;
+       fpta_extra_kind(*scan) != fpta_extra_end;
+       scan += 1 + fpta_extra_words(*scan)) {
+    if (fpta_extra_kind(*scan) == kind &&
+        (column < 0 || fpta_extra_column(*scan) == (unsigned)column))
+      return scan;
+  }
+  return nullptr;
+}
+
+/* Возвращает номер TTL-колонки, либо -1 если она не задана. */
+static __inline int fpta_schema_expiry(const fpta_table_schema *def) {
+  const fpta_shove_t *extra =
+      fpta_schema_extra_lookup(def, fpta_extra_expiry, -1);
+  return extra ? (int)fpta_extra_column(*extra) : -1;
+}
+
+/* Возвращает true, если значение PK исключается из хранимых строк
+ * и восстанавливается из ключа при чтении. */
+static __inline bool fpta_schema_pk_stripped(const fpta_table_schema *def) {
+  return fpta_schema_extra_lookup(def, fpta_extra_pk_stripped, 0) != nullptr;
+}
+
+/* Возвращает true, если для таблицы ведется журнал изменений строк. */
+static __inline bool fpta_schema_changelog(const fpta_table_schema *def) {
+  return fpta_schema_extra_lookup(def, fpta_extra_changelog, 0) != nullptr;
+}
+
+/* Предикат частичного индекса хранится в схеме как последовательность
+ * узлов в префиксном порядке. Каждый узел начинается со слова:
+ *  - младшие 8 бит: тип узла (fpta_filter_bits);
+ *  - следующие 8 бит: тип значения для сравнения (fpta_value_type);
+ *  - следующие 16 бит: номер колонки для сравнения;
+ *  - старшие 32 бита: длина строки или бинарного значения.
+ * После узла сравнения следуют слова со значением, а после узлов "НЕ",
+ * "И" и "ИЛИ" - вложенные узлы. Функторы не сериализуются. */
+static __inline fpta_shove_t fpta_predicate_node(int type,
+                                                 fpta_value_type value_type,
+                                                 unsigned column,
+                                                 uint32_t length) {
+  assert(type >= INT8_MIN && type <= INT8_MAX);
+  assert(column < fpta_max_cols);
+  return (uint8_t)type | (fpta_shove_t)value_type << 8 |
+         (fpta_shove_t)column << 16 | (fpta_shove_t)length << 32;
+}
+
+static __inline int fpta_predicate_type(fpta_shove_t node) {
+  return (int8_t)(node & 255);
+}
+
+static __inline fpta_value_type fpta_predicate_value_type(fpta_shove_t node) {
+  return (fpta_value_type)((node >> 8) & 255);
+}
+
+static __inline unsigned fpta_predicate_column(fpta_shove_t node) {
+  return (unsigned)((node >> 16) & UINT16_MAX);
+}
+
+static __inline uint32_t fpta_predicate_length(fpta_shove_t node) {
+  return (uint32_t)(node >> 32);
+}
+
+/* Количество слов со значением, следующих за узлом сравнения. */
+static __inline size_t fpta_predicate_value_words(fpta_shove_t node) {
+  switch (fpta_predicate_value_type(node)) {
+  case fpta_null:
+    return 0;
+  case fpta_string:
+  case fpta_binary:
+    return (fpta_predicate_length(node) + sizeof(fpta_shove_t) - 1) /
+           sizeof(fpta_shove_t);
+  default:
+    return 1;
+  }
+}
+
+bool fpta_predicate_validate(const fpta_shove_t *predicate, size_t words,
+                             size_t count, bool &refers_pk);
+void fpta_predicate_renumber(fpta_shove_t *predicate, size_t words,
+                             const unsigned *renum);
+bool fpta_predicate_match(const fpta_shove_t *predicate,
+                          const fpta_table_schema *def, const fptu_ro &row);
+
+/* Возвращает true, если строка должна присутствовать в индексе колонки,
+ * т.е. индекс не является частичным, либо строка удовлетворяет его
+ * предикату. */
+static __inline bool fpta_index_row_match(const fpta_table_schema *def,
+                                          size_t column, const fptu_ro &row) {
+  const fpta_shove_t *partial =
+      fpta_schema_extra_lookup(def, fpta_extra_partial, (int)column);
+  return !partial || fpta_predicate_match(partial + 1, def, row);
+}
+
+static __inline bool fpta_row_is_expired(const fptu_ro &row, unsigned column,
+                                         fptu_time now) {
+  const fptu_field *field = fptu_lookup_ro(row, column, fptu_datetime);
+  return field && fptu_field_payload(field)->u64 <= now.fixedpoint;
 }
 
 enum fpta_internals {
@@ -268,22 +534,139 @@ enum fpta_internals {
    * отличать таблицу от колонки, у таблицы в internal будет fpta_ftable. */
   fpta_flag_table = fpta_index_fsecondary,
   fpta_dbi_cache_size = fpta_tables_max * 2,
+  /* количество строк в пакете отложенных удалений из индексов */
+  fpta_purge_batch_rows = 4096,
+  /* количество слотов читателей для координации изменений схемы */
+  fpta_epoch_slots = 128,
+  fpta_cacheline_size = 64,
+  /* планировщик пишущих транзакций, см. src/writer.cxx */
+  fpta_write_priorities = 2,
+  fpta_writer_burst = 8,
+  fpta_writer_batch_max = 64,
+  /* ожидание приостановки транзакций для изменения размера БД
+   * и отсрочка следующей попытки в транзакциях при неудаче, которая
+   * удваивается при каждой следующей неудаче, но не более 2^shift раз */
+  fpta_remap_timeout_ms = 10,
+  fpta_remap_backoff_txns = 64,
+  fpta_remap_backoff_shift = 10,
+  /* наибольший размер строки, копия которой хранится в fpta_db_pkcache(),
+   * а также размер блока и общий объем копий в читающей транзакции */
+  fpta_pkcache_row_max = 192,
+  fpta_pkcache_copies_chunk = 4096,
+  fpta_pkcache_copies_max = 1024 * 1024,
+  /* размер блока записи копии БД при ограничении скорости */
+  fpta_copy_chunk = 65536,
+  /* номер служебной таблицы журнала изменений среди dbi таблицы,
+   * индексов в такой таблице должно быть меньше */
+  fpta_changelog_index = fpta_max_indexes - 1,
+  /* ограничения по умолчанию для режима fpta_sync_deferred */
+  fpta_durable_default_lag_ms = 100,
+  fpta_durable_default_txns = 1000,
+  /* сигнатуры файлов разностного резервного копирования */
+  FPTA_DELTA_SIGNATURE = 1750549373,
+  FPTA_DIGEST_SIGNATURE = 1216340411,
   FTPA_SCHEMA_SIGNATURE = 603397211,
   FTPA_SCHEMA_CHECKSEED = 1546032023
 };
 
 //----------------------------------------------------------------------------
 
+/* Фильтр Блума для отрицательных поисков по уникальному индексу,
+ * см. fpta_index_keyfilter() и src/keyfilter.cxx */
+struct fpta_keyfilter {
+  fpta_keyfilter *next;
+  fpta_shove_t table_shove;
+  unsigned column;
+  size_t expected;
+  /* состояние БД, которому соответствует фильтр */
+  uint64_t schema_version;
+  uint64_t txnid;
+  uint64_t built_txnid;
+  /* количество добавленных ключей, размер в битах минус один и биты */
+  size_t count;
+  size_t mask;
+  uint64_t *bits;
+};
+
+struct fpta_pkcache;
+struct fpta_pkcache_copies;
+struct fpta_durable;
+struct fpta_writer;
+struct fpta_readers;
+
+/* Слот учета транзакций потоков, см. fpta_db_lock(). Поток закрепляет
+ * за собой слот при первом обращении, а каждый слот занимает отдельную
+ * кэш-линию, поэтому начало и завершение транзакций не приводит
+ * к разделению кэш-линий между ядрами. Только при количестве потоков
+ * больше fpta_epoch_slots слоты разделяются, см. src/common.cxx */
+struct fpta_epoch_slot {
+  std::atomic<size_t> active;
+  char padding[fpta_cacheline_size - sizeof(std::atomic<size_t>)];
+};
+
 struct fpta_db {
   fpta_db(const fpta_db &) = delete;
-  pthread_rwlock_t schema_rwlock;
+  /* изменения схемы и размера БД координируются с остальными
+   * транзакциями посредством слотов читателей, см. fpta_db_lock() */
+  pthread_mutex_t schema_mutex;
+  std::atomic<bool> schema_writer;
+  fpta_epoch_slot *epoch_slots;
   MDB_env *mdbx_env;
   MDB_dbi schema_dbi;
   bool alterable_schema;
+  fpta_durability durability;
+  /* права доступа к файлу БД, используются для копий */
+  mode_t file_mode;
+  /* динамический размер БД, см. fpta_db_open_ex() */
+  fpta_db_geometry geometry;
+  unsigned pagesize;
+  /* номер транзакции, до которой отложено изменение размера,
+   * и количество неудачных попыток подряд */
+  std::atomic<uint64_t> remap_backoff;
+  std::atomic<unsigned> remap_failures;
 
   pthread_mutex_t dbi_mutex;
   fpta_shove_t dbi_shoves[fpta_dbi_cache_size];
   MDB_dbi dbi_handles[fpta_dbi_cache_size];
+  /* версия схемы, для которой открыты все дескрипторы,
+   * см. fpta_dbi_preopen() */
+  uint64_t dbi_preopened;
+
+  /* используются только пишущими транзакциями, которые удерживают
+   * keyfilter_mutex до учета результата фиксации, см. src/keyfilter.cxx */
+  pthread_mutex_t keyfilter_mutex;
+  fpta_keyfilter *keyfilters;
+  /* поиск строк по неупорядоченным PK, см. fpta_db_pkcache() */
+  fpta_pkcache *pkcache;
+  /* отложенное сохранение на диск, см. fpta_sync_group,
+   * fpta_sync_deferred и src/durable.cxx */
+  fpta_durable *durable;
+  /* планировщик пишущих транзакций, см. fpta_db_write() */
+  fpta_writer *writer;
+  /* учет длительных читающих транзакций, см. src/readers.cxx */
+  fpta_readers *readers;
+};
+
+/* Буфер для восстановления строк с исключенным PK, владелец буфера
+ * (транзакция или курсор) освобождает его при своем разрушении. */
+struct fpta_rowbuf {
+  void *ptr;
+  size_t size;
+};
+
+/* Длительная читающая транзакция, см. fpta_transaction_longterm(). */
+struct fpta_longterm {
+  fpta_longterm *next;
+  fpta_txn *txn;
+  struct timespec since;
+  /* транзакция отменена как отстающая, см. fpta_db_laggard_policy() */
+  std::atomic<bool> cancelled;
+};
+
+/* Точка сохранения, см. fpta_savepoint_begin(). */
+struct fpta_savepoint {
+  fpta_savepoint *prev;
+  MDB_txn *parent;
 };
 
 struct fpta_txn {
@@ -291,8 +674,17 @@ struct fpta_txn {
   fpta_db *db;
   MDB_txn *mdbx_txn;
   fpta_level level;
+  /* слот потока, в котором учтена транзакция, см. fpta_db_lock() */
+  unsigned epoch_slot;
+  /* стек точек сохранения, mdbx_txn указывает на вложенную транзакцию */
+  fpta_savepoint *savepoint;
+  fpta_longterm *longterm;
   uint64_t schema_version;
   uint64_t data_version;
+  fpta_rowbuf rowbuf;
+  /* копии строк и статистика поиска в fpta_db_pkcache() */
+  fpta_pkcache_copies *pkcache_copies;
+  size_t pkcache_hits, pkcache_misses;
 };
 
 struct fpta_key {
@@ -375,6 +767,25 @@ struct fpta_cursor {
   fpta_key range_from_key;
   fpta_key range_to_key;
 
+  /* Копия префикса для курсоров fpta_cursor_open_prefix(), если префикс
+   * длиннее fpta_max_keylen и не может быть полностью проверен по ключу.
+   * В этом случае значения колонки дополнительно сверяются с префиксом. */
+  struct {
+    void *data;
+    size_t length;
+  } prefix;
+
+  /* TTL-колонка, значения которой требуется проверять для каждой строки
+   * (либо -1), и момент времени относительно которого строки считаются
+   * устаревшими. */
+  struct {
+    int column;
+    fptu_time now;
+  } expiry;
+
+  /* буфер для строк таблиц с исключенным PK */
+  fpta_rowbuf rowbuf;
+
   const fpta_filter *filter;
   fpta_txn *txn;
   fpta_db *db;
@@ -415,6 +826,17 @@ static __inline fpta_index_type fpta_shove2index(fpta_shove_t shove) {
   return (fpta_index_type)index;
 }
 
+/* Для колонок-массивов индекс содержит отдельную запись для каждого
+ * элемента (мульти-индекс), поэтому тип ключа определяется типом
+ * элементов массива. */
+static __inline bool fpta_shove_is_multivalued(fpta_shove_t shove) {
+  return (fpta_shove2type(shove) & fptu_farray) != 0;
+}
+
+static __inline fptu_type fpta_shove2keytype(fpta_shove_t shove) {
+  return (fptu_type)(fpta_shove2type(shove) & ~fptu_farray);
+}
+
 static __inline fptu_type fpta_id2type(const fpta_name *id) {
   return fpta_shove2type(id->shove);
 }
@@ -438,17 +860,65 @@ int fpta_index_key2value(fpta_shove_t shove, const MDB_val &mdbx_key,
 int fpta_index_row2key(fpta_shove_t shove, size_t column, const fptu_ro &row,
                        fpta_key &key, bool copy = false);
 
+int fpta_index_expr_value2key(fpta_shove_t shove,
+                              const fpta_shove_t *expression,
+                              const fpta_value &value, fpta_key &key);
+int fpta_index_expr_row2key(fpta_shove_t shove, const fpta_shove_t *expression,
+                            size_t column, const fptu_ro &row, fpta_key &key);
+fpta_key_extractor *fpta_key_extractor_lookup(fpta_shove_t name,
+                                              void **context);
+
+/* Варианты fpta_index_value2key() и fpta_index_row2key() для индекса
+ * колонки таблицы, учитывающие выражение для вычисления ключа. Ключи
+ * по выражениям всегда копируются внутрь fpta_key. */
+static __inline int fpta_index_value2key(const fpta_table_schema *def,
+                                         size_t column,
+                                         const fpta_value &value,
+                                         fpta_key &key, bool copy = false) {
+  const fpta_shove_t *expression =
+      fpta_schema_extra_lookup(def, fpta_extra_expression, (int)column);
+  if (likely(expression == nullptr))
+    return fpta_index_value2key(def->columns[column], value, key, copy);
+  return fpta_index_expr_value2key(def->columns[column], expression, value,
+                                   key);
+}
+
+static __inline int fpta_index_row2key(const fpta_table_schema *def,
+                                       size_t column, const fptu_ro &row,
+                                       fpta_key &key, bool copy = false) {
+  const fpta_shove_t *expression =
+      fpta_schema_extra_lookup(def, fpta_extra_expression, (int)column);
+  if (likely(expression == nullptr))
+    return fpta_index_row2key(def->columns[column], column, row, key, copy);
+  return fpta_index_expr_row2key(def->columns[column], expression, column,
+                                 row, key);
+}
+
 int fpta_secondary_upsert(fpta_txn *txn, fpta_name *table_id,
                           MDB_val pk_key_old, const fptu_ro &row_old,
                           MDB_val pk_key_new, const fptu_ro &row_new,
-                          unsigned stepover);
+                          unsigned stepover,
+                          const MDB_val *stepover_key = nullptr);
 
 int fpta_check_constraints(fpta_txn *txn, fpta_name *table_id,
                            const fptu_ro &row_old, const fptu_ro &row_new,
                            unsigned stepover);
 
 int fpta_secondary_remove(fpta_txn *txn, fpta_name *table_id, MDB_val &pk_key,
-                          const fptu_ro &row_old, unsigned stepover);
+                          const fptu_ro &row_old, unsigned stepover,
+                          const MDB_val *stepover_key = nullptr);
+
+/* Для таблиц с исключенным из строк PK: fpta_row_strip() удаляет поле PK
+ * из копии строки в предоставленном буфере размером не менее
+ * fpta_row_strip_bytes(), а fpta_row_materialize() восстанавливает поле PK
+ * по значению ключа, размещая копию строки в rowbuf. Буфер расширяется,
+ * если его размер меньше fpta_row_materialize_bytes(). */
+size_t fpta_row_strip_bytes(const fptu_ro &row);
+size_t fpta_row_materialize_bytes(const fptu_ro &row);
+int fpta_row_strip(const fpta_name *table_id, fptu_ro &row, void *buffer,
+                   size_t bytes);
+int fpta_row_materialize(const fpta_name *table_id, const MDB_val &pk_key,
+                         fptu_ro &row, fpta_rowbuf &rowbuf);
 
 //----------------------------------------------------------------------------
 
@@ -456,12 +926,32 @@ int fpta_open_column(fpta_txn *txn, fpta_name *column_id);
 int fpta_open_table(fpta_txn *txn, fpta_name *table_id);
 int fpta_open_secondaries(fpta_txn *txn, fpta_name *table_id,
                           MDB_dbi *dbi_array);
+int fpta_open_changelog(fpta_txn *txn, fpta_name *table_id, MDB_dbi *handle);
+/* Открывает дескрипторы всех таблиц и индексов, если они еще не были
+ * открыты для текущей версии схемы. Вызывается перед запуском вложенной
+ * транзакции, так как при её отмене mdbx закрывает открытые в ней
+ * дескрипторы, которые иначе остались бы в кэше fpta_db и в fpta_name. */
+int fpta_dbi_preopen(fpta_txn *txn);
+
+/* Добавляет запись в журнал изменений таблицы, см. src/changelog.cxx.
+ * При ошибке изменения строки уже выполнены, поэтому вызывающая сторона
+ * должна прервать транзакцию посредством fpta_inconsistent_abort(). */
+int fpta_changelog_append(fpta_txn *txn, fpta_name *table_id,
+                          fpta_change_kind kind, const MDB_val &pk_key,
+                          const fptu_ro &row);
 
 //----------------------------------------------------------------------------
 
 fpta_cursor *fpta_cursor_alloc(fpta_db *db);
 void fpta_cursor_free(fpta_db *db, fpta_cursor *cursor);
 
+/* Для внутренних циклов по строкам курсора без проверки аргументов:
+ * fpta_cursor_step() перемещает курсор к следующей строке в его порядке,
+ * а fpta_cursor_fetch() читает строку в текущей позиции и ключ PK,
+ * без восстановления исключенного из строки PK. */
+int fpta_cursor_step(fpta_cursor *cursor);
+int fpta_cursor_fetch(fpta_cursor *cursor, MDB_val &pk_key, fptu_ro &row);
+
 //----------------------------------------------------------------------------
 
 bool fpta_filter_validate(const fpta_filter *filter);
@@ -481,7 +971,7 @@ static __inline bool fpta_db_validate(fpta_db *db) {
   return true;
 }
 
-static __inline bool fpta_txn_validate(fpta_txn *txn, fpta_level min_level) {
+static __inline bool fpta_txn_check(fpta_txn *txn, fpta_level min_level) {
   if (unlikely(txn == nullptr || !fpta_db_validate(txn->db)))
     return false;
   if (unlikely(txn->level < min_level || txn->level > fpta_schema))
@@ -491,6 +981,16 @@ static __inline bool fpta_txn_validate(fpta_txn *txn, fpta_level min_level) {
   return true;
 }
 
+static __inline bool fpta_txn_cancelled(const fpta_txn *txn) {
+  return txn->longterm != nullptr && txn->longterm->cancelled.load();
+}
+
+/* В отмененной транзакции допускается только закрытие курсоров
+ * и завершение самой транзакции, см. fpta_txn_check(). */
+static __inline bool fpta_txn_validate(fpta_txn *txn, fpta_level min_level) {
+  return fpta_txn_check(txn, min_level) && likely(!fpta_txn_cancelled(txn));
+}
+
 enum fpta_schema_item { fpta_table, fpta_column };
 
 static __inline bool fpta_id_validate(const fpta_name *id,
@@ -555,12 +1055,140 @@ static __inline bool fpta_cursor_is_ascending(fpta_cursor_options op) {
 }
 
 int fpta_inconsistent_abort(fpta_txn *txn, int errnum);
+/* Фиксирует или отменяет все точки сохранения транзакции. */
+int fpta_savepoint_unwind(fpta_txn *txn, bool abort);
+
+bool fpta_keyfilter_lookup(fpta_txn *txn, fpta_name *table_id,
+                           unsigned column, MDB_dbi dbi, const MDB_val &key);
+void fpta_keyfilter_update(fpta_txn *txn, fpta_name *table_id,
+                           unsigned column, const MDB_val &key);
+void fpta_keyfilter_commit(fpta_txn *txn);
+void fpta_keyfilter_abort(fpta_txn *txn);
+/* Передает фильтры ключей пишущей транзакции и возвращает их обратно
+ * после учета результата ее фиксации или отмены. */
+int fpta_keyfilter_acquire(fpta_db *db);
+void fpta_keyfilter_release(fpta_db *db);
+void fpta_keyfilter_destroy(fpta_db *db);
+
+/* Возвращает false, если ключа заведомо нет в уникальном индексе,
+ * иначе требуется обычный поиск. */
+static __inline bool fpta_key_maybe_exists(fpta_txn *txn, fpta_name *table_id,
+                                           unsigned column, MDB_dbi dbi,
+                                           const MDB_val &key) {
+  if (likely(txn->db->keyfilters == nullptr) || txn->level < fpta_write)
+    return true;
+  return fpta_keyfilter_lookup(txn, table_id, column, dbi, key);
+}
+
+bool fpta_pkcache_lookup(fpta_txn *txn, fpta_name *table_id,
+                         const MDB_val &pk_key, fptu_ro &row);
+void fpta_pkcache_store(fpta_txn *txn, fpta_name *table_id,
+                        const MDB_val &pk_key, const fptu_ro &row);
+void fpta_pkcache_destroy(fpta_db *db);
+/* Освобождает копии строк читающей транзакции и учитывает статистику. */
+void fpta_pkcache_release(fpta_txn *txn);
+/* Вызываются пишущими транзакциями под keyfilter_mutex: после старта,
+ * после успешной фиксации, при изменении строки по PK и при очистке
+ * таблицы, см. src/pkcache.cxx */
+void fpta_pkcache_begin(fpta_txn *txn);
+void fpta_pkcache_commit(fpta_txn *txn);
+void fpta_pkcache_changed(fpta_txn *txn, fpta_name *table_id,
+                          const MDB_val &pk_key);
+void fpta_pkcache_cleared(fpta_txn *txn);
+/* Делает недействительными адреса строк в fpta_db_pkcache() после изменения
+ * размера БД, вызывается только при приостановленных транзакциях. */
+void fpta_pkcache_remapped(fpta_db *db);
+
+int fpta_durable_init(fpta_db *db, bool deferred);
+void fpta_durable_destroy(fpta_db *db);
+/* Учитывает зафиксированную транзакцию. */
+void fpta_durable_commit(fpta_db *db, uint64_t txnid);
+/* Ожидает сохранения на диск транзакции, при необходимости выполняя
+ * сброс на диск всех зафиксированных транзакций. */
+int fpta_durable_wait(fpta_db *db, uint64_t txnid);
+
+int fpta_writer_init(fpta_db *db);
+void fpta_writer_destroy(fpta_db *db);
+
+/* Учитывает транзакцию или иное использование снимка данных в слоте
+ * потока, а для fpta_schema приостанавливает все транзакции. */
+int fpta_db_lock(fpta_db *db, fpta_level level, unsigned &slot);
+int fpta_db_unlock(fpta_db *db, fpta_level level, unsigned slot);
+
+int fpta_readers_init(fpta_db *db);
+void fpta_readers_destroy(fpta_db *db);
+/* Исключает завершаемую транзакцию из учета длительных. */
+void fpta_readers_unregister(fpta_txn *txn);
+/* Проверяет наличие незавершенных длительных транзакций. */
+bool fpta_readers_longterm(fpta_db *db);
+/* Применяет политику отмены отстающих транзакций после фиксации
+ * пишущей транзакции. */
+void fpta_readers_check(fpta_db *db);
+
+/* Получает строку по PK, используя для неупорядоченных уникальных PK
+ * в читающих транзакциях хеш-таблицу fpta_db_pkcache(). */
+static __inline int fpta_pk_get(fpta_txn *txn, fpta_name *table_id,
+                                MDB_val &pk_key, fptu_ro &row) {
+  if (likely(txn->db->pkcache == nullptr) || txn->level != fpta_read ||
+      fpta_index_is_ordered(table_id->table.pk) ||
+      !fpta_index_is_unique(table_id->table.pk))
+    return mdbx_get(txn->mdbx_txn, table_id->mdbx_dbi, &pk_key, &row.sys);
+
+  if (fpta_pkcache_lookup(txn, table_id, pk_key, row))
+    return MDB_SUCCESS;
+  int rc = mdbx_get(txn->mdbx_txn, table_id->mdbx_dbi, &pk_key, &row.sys);
+  if (likely(rc == MDB_SUCCESS))
+    fpta_pkcache_store(txn, table_id, pk_key, row);
+  return rc;
+}
+
+/* Учитывает изменение или удаление строки с заданным PK. */
+static __inline void fpta_pk_changed(fpta_txn *txn, fpta_name *table_id,
+                                     const MDB_val &pk_key) {
+  if (unlikely(txn->db->pkcache != nullptr) &&
+      !fpta_index_is_ordered(table_id->table.pk) &&
+      fpta_index_is_unique(table_id->table.pk))
+    fpta_pkcache_changed(txn, table_id, pk_key);
+}
+
+/* Учитывает добавленный в уникальный индекс ключ. */
+static __inline void fpta_key_inserted(fpta_txn *txn, fpta_name *table_id,
+                                       unsigned column, const MDB_val &key) {
+  if (unlikely(txn->db->keyfilters != nullptr))
+    fpta_keyfilter_update(txn, table_id, column, key);
+}
 
 static __inline bool fpta_is_same(const MDB_val &a, const MDB_val &b) {
   return a.iov_len == b.iov_len &&
          memcmp(a.iov_base, b.iov_base, a.iov_len) == 0;
 }
 
+/* Набор ключей мульти-индекса для элементов массива одной строки. */
+struct fpta_keyset {
+  fpta_keyset(const fpta_keyset &) = delete;
+  fpta_keyset() : keys(local), count(0) {}
+  ~fpta_keyset() {
+    if (keys != local)
+      free(keys);
+  }
+
+  /* Ищет ключ среди первых limit элементов набора. */
+  bool contains(const MDB_val &key, size_t limit) const {
+    for (size_t i = 0; i < limit; ++i)
+      if (fpta_is_same(keys[i].mdbx, key))
+        return true;
+    return false;
+  }
+  bool contains(const MDB_val &key) const { return contains(key, count); }
+
+  fpta_key *keys;
+  size_t count;
+  fpta_key local[8];
+};
+
+int fpta_index_row2keys(fpta_shove_t shove, size_t column, const fptu_ro &row,
+                        fpta_keyset &keyset);
+
 namespace std {
 FPTA_API string to_string(const MDB_val &);
 FPTA_API string to_string(const fpta_key &);
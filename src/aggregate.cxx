@@ -0,0 +1,701 @@
+/*
+ * Copyright 2016-2017 libfpta authors: please see AUTHORS file.
+ *
+ * This file is part of libfpta, aka "Fast Positive Tables".
+ *
+ * libfpta is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libfpta is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libfpta.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fast_positive/tables_internal.h"
+
+/* Агрегатные функции по строкам курсора, см. fpta_cursor_aggregate()
+ * и fpta_group_aggregate().
+ *
+ * Значения колонок берутся из наиболее дешевого источника: из ключа
+ * индекса курсора, из ключа PK (для таблиц с исключенным PK), либо
+ * из самой строки. Строки читаются только если хотя бы одно значение
+ * может быть получено только из строки. */
+
+enum fpta_aggregate_source {
+  fpta_aggregate_from_none,
+  fpta_aggregate_from_index_key,
+  fpta_aggregate_from_pk_key,
+  fpta_aggregate_from_row
+};
+
+/* Колонка-источник значений для агрегатной функции или группировки. */
+struct fpta_aggregate_input {
+  fpta_aggregate_source source;
+  unsigned column;
+  fptu_type type;
+  /* требуется чтение строки и/или ключа PK */
+  bool fetch;
+};
+
+struct fpta_aggregate_state {
+  fpta_aggregate_input input;
+  bool overflow;
+  size_t count;
+  double total;
+  fpta_value sum, min, max;
+};
+
+static int fpta_aggregate_cmp(const fpta_value &a, const fpta_value &b) {
+  assert(a.type == b.type);
+  switch (a.type) {
+  case fpta_signed_int:
+    return fptu_cmp2int(a.sint, b.sint);
+  case fpta_unsigned_int:
+    return fptu_cmp2int(a.uint, b.uint);
+  case fpta_float_point:
+    return fptu_cmp2int(a.fp, b.fp);
+  default:
+    assert(a.type == fpta_datetime);
+    return fptu_cmp2int(a.datetime.fixedpoint, b.datetime.fixedpoint);
+  }
+}
+
+static void fpta_aggregate_reset(fpta_aggregate_state &state) {
+  state.overflow = false;
+  state.count = 0;
+  state.total = 0;
+}
+
+static void fpta_aggregate_accumulate(fpta_aggregate_state &state,
+                                      const fpta_value &value) {
+  switch (value.type) {
+  case fpta_signed_int:
+    state.total += (double)value.sint;
+    if (state.count && !state.overflow) {
+      if ((value.sint > 0 && state.sum.sint > INT64_MAX - value.sint) ||
+          (value.sint < 0 && state.sum.sint < INT64_MIN - value.sint))
+        state.overflow = true;
+      else
+        state.sum.sint += value.sint;
+    }
+    break;
+  case fpta_unsigned_int:
+    state.total += (double)value.uint;
+    if (state.count && !state.overflow) {
+      if (state.sum.uint > UINT64_MAX - value.uint)
+        state.overflow = true;
+      else
+        state.sum.uint += value.uint;
+    }
+    break;
+  case fpta_float_point:
+    state.total += value.fp;
+    if (state.count)
+      state.sum.fp += value.fp;
+    break;
+  default:
+    assert(value.type == fpta_datetime);
+    break;
+  }
+
+  if (state.count++ == 0) {
+    state.sum = state.min = state.max = value;
+    return;
+  }
+  if (fpta_aggregate_cmp(value, state.min) < 0)
+    state.min = value;
+  if (fpta_aggregate_cmp(value, state.max) > 0)
+    state.max = value;
+}
+
+static int fpta_aggregate_result(const fpta_aggregate_state &state,
+                                 fpta_aggregate &item) {
+  if (item.function == fpta_aggregate_count) {
+    item.result = fpta_value_uint(state.count);
+    return FPTA_SUCCESS;
+  }
+
+  item.result = fpta_value_null();
+  if (state.count == 0)
+    return FPTA_SUCCESS;
+
+  switch (item.function) {
+  default:
+    assert(false);
+    return FPTA_EOOPS;
+  case fpta_aggregate_sum:
+    if (unlikely(state.overflow))
+      return FPTA_EVALUE;
+    item.result = state.sum;
+    break;
+  case fpta_aggregate_min:
+    item.result = state.min;
+    break;
+  case fpta_aggregate_max:
+    item.result = state.max;
+    break;
+  case fpta_aggregate_avg:
+    item.result = fpta_value_float(state.total / state.count);
+    break;
+  }
+  return FPTA_SUCCESS;
+}
+
+static int fpta_aggregate_results(const fpta_aggregate_state *state,
+                                  fpta_aggregate *aggregates, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    int rc = fpta_aggregate_result(state[i], aggregates[i]);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
+  return FPTA_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+
+/* Проверяет принадлежность колонки таблице курсора и выбирает источник
+ * ее значений. */
+static int fpta_aggregate_bind(fpta_cursor *cursor, fpta_name *column_id,
+                               fpta_aggregate_input &input) {
+  if (unlikely(!fpta_id_validate(column_id, fpta_column)))
+    return FPTA_EINVAL;
+  fpta_name *table_id = column_id->column.table;
+  if (unlikely(table_id->shove != cursor->table_id->shove))
+    return FPTA_EINVAL;
+  int rc = fpta_name_refresh_couple(cursor->txn, table_id, column_id);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  input.type = fpta_shove2type(column_id->shove);
+  if (unlikely(input.type == fptu_nested || (input.type & fptu_farray)))
+    return FPTA_ETYPE;
+
+  const fpta_table_schema *def = cursor->table_id->table.def;
+  input.column = (unsigned)column_id->column.num;
+  if (input.column == cursor->index.column_order &&
+      fpta_index_is_ordered(cursor->index.shove) &&
+      !fpta_schema_extra_lookup(def, fpta_extra_expression,
+                                (int)input.column)) {
+    input.source = fpta_aggregate_from_index_key;
+    /* длинные строки хранятся в ключе усеченными */
+    input.fetch = input.type == fptu_cstr || input.type == fptu_opaque;
+  } else if (input.column == 0 && fpta_schema_pk_stripped(def)) {
+    input.source = fpta_aggregate_from_pk_key;
+    input.fetch = fpta_index_is_secondary(cursor->index.shove);
+  } else {
+    input.source = fpta_aggregate_from_row;
+    input.fetch = true;
+  }
+  return FPTA_SUCCESS;
+}
+
+static int fpta_aggregate_value(fpta_cursor *cursor,
+                                const fpta_aggregate_input &input,
+                                const MDB_val &pk_key, const fptu_ro &row,
+                                fpta_value &value) {
+  switch (input.source) {
+  default:
+    assert(false);
+    return FPTA_EOOPS;
+
+  case fpta_aggregate_from_index_key: {
+    int rc = fpta_index_key2value(cursor->index.shove, cursor->current, value);
+    if (likely(rc != FPTA_SUCCESS || value.type != fpta_shoved))
+      return rc;
+    /* ключ усечен, значение берется из строки */
+    assert(input.fetch);
+  }
+  /* fall through */
+  case fpta_aggregate_from_row:
+    value = fpta_field2value(fptu_lookup_ro(row, input.column, input.type));
+    return FPTA_SUCCESS;
+
+  case fpta_aggregate_from_pk_key:
+    return fpta_index_key2value(cursor->table_id->table.pk, pk_key, value);
+  }
+}
+
+/* Проверяет элемент запроса и выбирает источник значений. */
+static int fpta_aggregate_prepare(fpta_cursor *cursor, fpta_aggregate &item,
+                                  fpta_aggregate_state &state) {
+  switch (item.function) {
+  default:
+    return FPTA_EINVAL;
+  case fpta_aggregate_count:
+  case fpta_aggregate_sum:
+  case fpta_aggregate_min:
+  case fpta_aggregate_max:
+  case fpta_aggregate_avg:
+    break;
+  }
+
+  memset(&state, 0, sizeof(state));
+  if (item.column_id == nullptr) {
+    if (unlikely(item.function != fpta_aggregate_count))
+      return FPTA_EINVAL;
+    state.input.source = fpta_aggregate_from_none;
+    return FPTA_SUCCESS;
+  }
+
+  int rc = fpta_aggregate_bind(cursor, item.column_id, state.input);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  switch (state.input.type) {
+  default:
+    return FPTA_ETYPE;
+  case fptu_datetime:
+    if (unlikely(item.function == fpta_aggregate_sum ||
+                 item.function == fpta_aggregate_avg))
+      return FPTA_ETYPE;
+  /* fall through */
+  case fptu_uint16:
+  case fptu_int32:
+  case fptu_uint32:
+  case fptu_fp32:
+  case fptu_int64:
+  case fptu_uint64:
+  case fptu_fp64:
+    return FPTA_SUCCESS;
+  }
+}
+
+static int fpta_aggregate_prepare_all(fpta_cursor *cursor,
+                                      fpta_aggregate *aggregates, size_t count,
+                                      fpta_aggregate_state *state,
+                                      bool &fetch) {
+  fetch = false;
+  for (size_t i = 0; i < count; ++i) {
+    int rc = fpta_aggregate_prepare(cursor, aggregates[i], state[i]);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+    fetch |= state[i].input.fetch;
+  }
+  return FPTA_SUCCESS;
+}
+
+/* Накапливает значения строки в текущей позиции курсора. */
+static int fpta_aggregate_row(fpta_cursor *cursor, fpta_aggregate_state *state,
+                              size_t count, const MDB_val &pk_key,
+                              const fptu_ro &row) {
+  for (size_t i = 0; i < count; ++i) {
+    if (state[i].input.source == fpta_aggregate_from_none) {
+      state[i].count += 1;
+      continue;
+    }
+
+    fpta_value value;
+    int rc = fpta_aggregate_value(cursor, state[i].input, pk_key, row, value);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+    if (value.type != fpta_null)
+      fpta_aggregate_accumulate(state[i], value);
+  }
+  return FPTA_SUCCESS;
+}
+
+/* Читает строку и ключ PK в текущей позиции курсора, если требуется. */
+static __inline int fpta_aggregate_fetch(fpta_cursor *cursor, bool fetch,
+                                         MDB_val &pk_key, fptu_ro &row) {
+  pk_key = cursor->current;
+  if (!fetch) {
+    row.sys.iov_base = nullptr;
+    row.sys.iov_len = 0;
+    return FPTA_SUCCESS;
+  }
+  return fpta_cursor_fetch(cursor, pk_key, row);
+}
+
+/* Значения min и max по колонке упорядоченного индекса курсора берутся
+ * из первого и последнего ключей диапазона. */
+static int fpta_aggregate_bounds(fpta_cursor *cursor,
+                                 fpta_aggregate_state &state) {
+  fpta_value first, last;
+  int rc = fpta_cursor_move(cursor, fpta_first);
+  if (rc == FPTA_SUCCESS)
+    rc = fpta_index_key2value(cursor->index.shove, cursor->current, first);
+  if (rc == FPTA_SUCCESS)
+    rc = fpta_cursor_move(cursor, fpta_last);
+  if (rc == FPTA_SUCCESS)
+    rc = fpta_index_key2value(cursor->index.shove, cursor->current, last);
+  cursor->set_poor();
+
+  if (rc == FPTA_NODATA)
+    return FPTA_SUCCESS;
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  fpta_aggregate_accumulate(state, first);
+  fpta_aggregate_accumulate(state, last);
+  return FPTA_SUCCESS;
+}
+
+static int fpta_aggregate_scan(fpta_cursor *cursor, fpta_aggregate_state *state,
+                               size_t count, bool fetch) {
+  int rc = fpta_cursor_move(cursor, fpta_first);
+  while (rc == FPTA_SUCCESS) {
+    MDB_val pk_key;
+    fptu_ro row;
+    rc = fpta_aggregate_fetch(cursor, fetch, pk_key, row);
+    if (likely(rc == FPTA_SUCCESS))
+      rc = fpta_aggregate_row(cursor, state, count, pk_key, row);
+    if (unlikely(rc != FPTA_SUCCESS))
+      break;
+    rc = fpta_cursor_step(cursor);
+  }
+
+  cursor->set_poor();
+  return (rc == FPTA_NODATA) ? (int)FPTA_SUCCESS : rc;
+}
+
+int fpta_cursor_aggregate(fpta_cursor *cursor, fpta_aggregate *aggregates,
+                          size_t count) {
+  if (unlikely(!fpta_cursor_validate(cursor, fpta_read)))
+    return FPTA_EINVAL;
+  if (unlikely(aggregates == nullptr && count > 0))
+    return FPTA_EINVAL;
+  if (unlikely(count > SIZE_MAX / sizeof(fpta_aggregate_state)))
+    return FPTA_EINVAL;
+  if (count == 0)
+    return FPTA_SUCCESS;
+
+  fpta_aggregate_state *state =
+      (fpta_aggregate_state *)malloc(count * sizeof(fpta_aggregate_state));
+  if (unlikely(state == nullptr))
+    return FPTA_ENOMEM;
+
+  bool fetch;
+  int rc = fpta_aggregate_prepare_all(cursor, aggregates, count, state, fetch);
+  if (likely(rc == FPTA_SUCCESS)) {
+    bool bounds_only = true;
+    for (size_t i = 0; i < count; ++i)
+      if (state[i].input.source != fpta_aggregate_from_index_key ||
+          (aggregates[i].function != fpta_aggregate_min &&
+           aggregates[i].function != fpta_aggregate_max))
+        bounds_only = false;
+
+    if (bounds_only) {
+      rc = fpta_aggregate_bounds(cursor, state[0]);
+      for (size_t i = 1; i < count; ++i)
+        state[i] = state[0];
+    } else {
+      rc = fpta_aggregate_scan(cursor, state, count, fetch);
+    }
+  }
+
+  if (likely(rc == FPTA_SUCCESS))
+    rc = fpta_aggregate_results(state, aggregates, count);
+  free(state);
+  return rc;
+}
+
+//----------------------------------------------------------------------------
+
+/* Хеш-таблица групп для fpta_group_aggregate().
+ *
+ * Группы вместе с состояниями агрегатных функций размещаются в пуле
+ * памяти, который освобождается целиком по завершении группировки.
+ * Значения группирующей колонки не копируются, а ссылаются на данные
+ * внутри БД. Корзины образуют цепочки, а кроме этого все группы связаны
+ * в порядке их появления. */
+
+struct fpta_group_entry {
+  fpta_group_entry *chain;
+  fpta_group_entry *next;
+  uint64_t hash;
+  fpta_value value;
+  fpta_aggregate_state state[1];
+};
+
+struct fpta_group_chunk {
+  fpta_group_chunk *next;
+  size_t size;
+  uint64_t data[1];
+};
+
+struct fpta_group_table {
+  fpta_group_entry **buckets;
+  size_t mask, groups;
+  fpta_group_entry *first, **tail;
+
+  fpta_group_chunk *chunks;
+  size_t chunk_used, entry_size;
+};
+
+enum {
+  fpta_group_initial_buckets = 64,
+  fpta_group_chunk_bytes = 64 * 1024,
+  fpta_group_seed = 2017
+};
+
+static uint64_t fpta_group_hash(const fpta_value &value) {
+  switch (value.type) {
+  case fpta_null:
+    return 0;
+  case fpta_signed_int:
+  case fpta_unsigned_int:
+  case fpta_float_point:
+  case fpta_datetime:
+    return t1ha(&value.uint, sizeof(value.uint), fpta_group_seed);
+  default:
+    return t1ha(value.binary_data, value.binary_length, fpta_group_seed);
+  }
+}
+
+static bool fpta_group_same(const fpta_value &a, const fpta_value &b) {
+  if (a.type != b.type)
+    return false;
+  switch (a.type) {
+  case fpta_null:
+    return true;
+  case fpta_signed_int:
+  case fpta_unsigned_int:
+  case fpta_float_point:
+  case fpta_datetime:
+    return a.uint == b.uint;
+  default:
+    return a.binary_length == b.binary_length &&
+           memcmp(a.binary_data, b.binary_data, a.binary_length) == 0;
+  }
+}
+
+static void fpta_group_destroy(fpta_group_table &table) {
+  while (table.chunks) {
+    fpta_group_chunk *chunk = table.chunks;
+    table.chunks = chunk->next;
+    free(chunk);
+  }
+  free(table.buckets);
+}
+
+static fpta_group_entry *fpta_group_alloc(fpta_group_table &table) {
+  if (table.chunks == nullptr ||
+      table.chunk_used + table.entry_size > table.chunks->size) {
+    const size_t size = (table.entry_size > fpta_group_chunk_bytes)
+                            ? table.entry_size
+                            : (size_t)fpta_group_chunk_bytes;
+    fpta_group_chunk *chunk = (fpta_group_chunk *)malloc(
+        offsetof(fpta_group_chunk, data) + size);
+    if (unlikely(chunk == nullptr))
+      return nullptr;
+    chunk->next = table.chunks;
+    chunk->size = size;
+    table.chunks = chunk;
+    table.chunk_used = 0;
+  }
+
+  fpta_group_entry *entry =
+      (fpta_group_entry *)((uint8_t *)table.chunks->data + table.chunk_used);
+  table.chunk_used += table.entry_size;
+  return entry;
+}
+
+static int fpta_group_grow(fpta_group_table &table) {
+  const size_t size = (table.mask + 1) * 2;
+  fpta_group_entry **buckets =
+      (fpta_group_entry **)calloc(size, sizeof(fpta_group_entry *));
+  if (unlikely(buckets == nullptr))
+    return FPTA_ENOMEM;
+
+  free(table.buckets);
+  table.buckets = buckets;
+  table.mask = size - 1;
+  for (fpta_group_entry *entry = table.first; entry; entry = entry->next) {
+    fpta_group_entry **bucket = &table.buckets[entry->hash & table.mask];
+    entry->chain = *bucket;
+    *bucket = entry;
+  }
+  return FPTA_SUCCESS;
+}
+
+/* Находит или добавляет группу для значения. */
+static int fpta_group_lookup(fpta_group_table &table, const fpta_value &value,
+                             const fpta_aggregate_state *prototype,
+                             size_t count, fpta_group_entry *&result) {
+  const uint64_t hash = fpta_group_hash(value);
+  for (fpta_group_entry *entry = table.buckets[hash & table.mask]; entry;
+       entry = entry->chain) {
+    if (entry->hash == hash && fpta_group_same(entry->value, value)) {
+      result = entry;
+      return FPTA_SUCCESS;
+    }
+  }
+
+  if (table.groups > table.mask) {
+    int rc = fpta_group_grow(table);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
+
+  fpta_group_entry *entry = fpta_group_alloc(table);
+  if (unlikely(entry == nullptr))
+    return FPTA_ENOMEM;
+
+  entry->hash = hash;
+  entry->value = value;
+  memcpy(entry->state, prototype, count * sizeof(fpta_aggregate_state));
+  for (size_t i = 0; i < count; ++i)
+    fpta_aggregate_reset(entry->state[i]);
+
+  fpta_group_entry **bucket = &table.buckets[hash & table.mask];
+  entry->chain = *bucket;
+  *bucket = entry;
+  entry->next = nullptr;
+  *table.tail = entry;
+  table.tail = &entry->next;
+  table.groups += 1;
+  result = entry;
+  return FPTA_SUCCESS;
+}
+
+static int fpta_group_emit(const fpta_value &group,
+                           const fpta_aggregate_state *state,
+                           fpta_aggregate *aggregates, size_t count,
+                           fpta_group_callback *callback, void *context) {
+  int rc = fpta_aggregate_results(state, aggregates, count);
+  if (likely(rc == FPTA_SUCCESS))
+    rc = callback(context, &group, aggregates, count);
+  return rc;
+}
+
+/* Группы идут подряд в порядке индекса курсора, поэтому достаточно
+ * сравнивать ключ каждой строки с ключом текущей группы. */
+static int fpta_group_stream(fpta_cursor *cursor,
+                             const fpta_aggregate_input &group_input,
+                             fpta_aggregate *aggregates,
+                             fpta_aggregate_state *state, size_t count,
+                             bool fetch, fpta_group_callback *callback,
+                             void *context) {
+  MDB_val group_key = {nullptr, 0};
+  fpta_value group = fpta_value_null();
+  bool have_group = false;
+
+  int rc = fpta_cursor_move(cursor, fpta_first);
+  while (rc == FPTA_SUCCESS) {
+    MDB_val pk_key;
+    fptu_ro row;
+    rc = fpta_aggregate_fetch(cursor, fetch, pk_key, row);
+    if (unlikely(rc != FPTA_SUCCESS))
+      break;
+
+    if (!have_group || !fpta_is_same(cursor->current, group_key)) {
+      if (have_group) {
+        rc = fpta_group_emit(group, state, aggregates, count, callback,
+                             context);
+        if (unlikely(rc != FPTA_SUCCESS))
+          break;
+        for (size_t i = 0; i < count; ++i)
+          fpta_aggregate_reset(state[i]);
+      }
+      rc = fpta_aggregate_value(cursor, group_input, pk_key, row, group);
+      if (unlikely(rc != FPTA_SUCCESS))
+        break;
+      group_key = cursor->current;
+      have_group = true;
+    }
+
+    rc = fpta_aggregate_row(cursor, state, count, pk_key, row);
+    if (unlikely(rc != FPTA_SUCCESS))
+      break;
+    rc = fpta_cursor_step(cursor);
+  }
+  cursor->set_poor();
+
+  if (rc != FPTA_NODATA)
+    return rc;
+  return have_group ? fpta_group_emit(group, state, aggregates, count,
+                                      callback, context)
+                    : (int)FPTA_SUCCESS;
+}
+
+static int fpta_group_hashed(fpta_cursor *cursor,
+                             const fpta_aggregate_input &group_input,
+                             fpta_aggregate *aggregates,
+                             fpta_aggregate_state *state, size_t count,
+                             bool fetch, fpta_group_callback *callback,
+                             void *context) {
+  fpta_group_table table;
+  memset(&table, 0, sizeof(table));
+  table.tail = &table.first;
+  table.entry_size = offsetof(fpta_group_entry, state) +
+                     count * sizeof(fpta_aggregate_state);
+  table.entry_size = (table.entry_size + sizeof(uint64_t) - 1) &
+                     ~(sizeof(uint64_t) - 1);
+  table.buckets = (fpta_group_entry **)calloc(fpta_group_initial_buckets,
+                                              sizeof(fpta_group_entry *));
+  if (unlikely(table.buckets == nullptr))
+    return FPTA_ENOMEM;
+  table.mask = fpta_group_initial_buckets - 1;
+
+  int rc = fpta_cursor_move(cursor, fpta_first);
+  while (rc == FPTA_SUCCESS) {
+    MDB_val pk_key;
+    fptu_ro row;
+    fpta_value group;
+    fpta_group_entry *entry;
+    rc = fpta_aggregate_fetch(cursor, fetch, pk_key, row);
+    if (likely(rc == FPTA_SUCCESS))
+      rc = fpta_aggregate_value(cursor, group_input, pk_key, row, group);
+    if (likely(rc == FPTA_SUCCESS))
+      rc = fpta_group_lookup(table, group, state, count, entry);
+    if (likely(rc == FPTA_SUCCESS))
+      rc = fpta_aggregate_row(cursor, entry->state, count, pk_key, row);
+    if (unlikely(rc != FPTA_SUCCESS))
+      break;
+    rc = fpta_cursor_step(cursor);
+  }
+  cursor->set_poor();
+
+  if (rc == FPTA_NODATA) {
+    rc = FPTA_SUCCESS;
+    for (fpta_group_entry *entry = table.first; entry && rc == FPTA_SUCCESS;
+         entry = entry->next)
+      rc = fpta_group_emit(entry->value, entry->state, aggregates, count,
+                           callback, context);
+  }
+
+  fpta_group_destroy(table);
+  return rc;
+}
+
+int fpta_group_aggregate(fpta_cursor *cursor, fpta_name *group_column,
+                         fpta_aggregate *aggregates, size_t count,
+                         fpta_group_callback *callback, void *context) {
+  if (unlikely(!fpta_cursor_validate(cursor, fpta_read)))
+    return FPTA_EINVAL;
+  if (unlikely(callback == nullptr || (aggregates == nullptr && count > 0)))
+    return FPTA_EINVAL;
+  if (unlikely(count > (SIZE_MAX - sizeof(fpta_group_entry)) /
+                           sizeof(fpta_aggregate_state)))
+    return FPTA_EINVAL;
+
+  fpta_aggregate_input group_input;
+  int rc = fpta_aggregate_bind(cursor, group_column, group_input);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  fpta_aggregate_state *state = (fpta_aggregate_state *)malloc(
+      (count ? count : 1) * sizeof(fpta_aggregate_state));
+  if (unlikely(state == nullptr))
+    return FPTA_ENOMEM;
+
+  bool fetch;
+  rc = fpta_aggregate_prepare_all(cursor, aggregates, count, state, fetch);
+  if (likely(rc == FPTA_SUCCESS)) {
+    fetch |= group_input.fetch;
+    rc = (group_input.source == fpta_aggregate_from_index_key)
+             ? fpta_group_stream(cursor, group_input, aggregates, state,
+                                 count, fetch, callback, context)
+             : fpta_group_hashed(cursor, group_input, aggregates, state,
+                                 count, fetch, callback, context);
+  }
+
+  free(state);
+  return rc;
+}
@@ -0,0 +1,557 @@
+/*
+ * Copyright 2016-2017 libfpta authors: please see AUTHORS file.
+ *
+ * This file is part of libfpta, aka "Fast Positive Tables".
+ *
+ * libfpta is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libfpta is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libfpta.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fast_positive/tables_internal.h"
+
+#include <fcntl.h>
+
+/* Копирование БД, см. fpta_db_copy().
+ *
+ * Копию создает mdbx_env_copyfd2() в отдельном потоке, так как она
+ * запускает собственную читающую транзакцию, что невозможно в потоке
+ * с уже открытой читающей транзакцией. При ограничении скорости копия
+ * передается через канал, из которого вызывающий поток записывает её
+ * в целевой дескриптор с необходимыми паузами. Заполнение канала
+ * приостанавливает mdbx, поэтому снимок данных удерживается только
+ * на время записи копии. */
+
+struct fpta_copy_job {
+  fpta_db *db;
+  int fd;
+  unsigned flags;
+  /* дескриптор принадлежит потоку копирования (канал) */
+  bool own_fd;
+  int rc;
+};
+
+static void *fpta_copy_thread(void *arg) {
+  fpta_copy_job *job = (fpta_copy_job *)arg;
+  job->rc = mdbx_env_copyfd2(job->db->mdbx_env, job->fd, job->flags);
+  /* закрытие канала означает для читающей стороны конец копии */
+  if (job->own_fd && close(job->fd) != 0 && job->rc == MDB_SUCCESS)
+    job->rc = errno;
+  return nullptr;
+}
+
+static int fpta_copy_write(int fd, const char *ptr, size_t bytes) {
+  while (bytes) {
+    ssize_t written = write(fd, ptr, bytes);
+    if (unlikely(written < 0)) {
+      if (errno == EINTR)
+        continue;
+      return errno;
+    }
+    ptr += written;
+    bytes -= (size_t)written;
+  }
+  return FPTA_SUCCESS;
+}
+
+/* Получатель копии, читаемой из канала. */
+typedef int(fpta_copy_consumer)(void *context, const char *data,
+                                size_t bytes);
+
+static int fpta_copy_to_fd(void *context, const char *data, size_t bytes) {
+  return fpta_copy_write(*(const int *)context, data, bytes);
+}
+
+/* Перекачивает копию из канала получателю с ограничением скорости.
+ * После ошибки получателя канал дочитывается до конца, чтобы mdbx
+ * не получила SIGPIPE. */
+static int fpta_copy_pump(int from, fpta_copy_consumer *consumer,
+                          void *context, size_t bytes_per_second) {
+  char *buffer = (char *)malloc(fpta_copy_chunk);
+  int rc = (buffer != nullptr) ? FPTA_SUCCESS : FPTA_ENOMEM;
+  uint64_t total = 0;
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (;;) {
+    char dummy[512];
+    ssize_t got = buffer ? read(from, buffer, fpta_copy_chunk)
+                         : read(from, dummy, sizeof(dummy));
+    if (got == 0)
+      break;
+    if (unlikely(got < 0)) {
+      if (errno == EINTR)
+        continue;
+      if (rc == FPTA_SUCCESS)
+        rc = errno;
+      break;
+    }
+    if (rc != FPTA_SUCCESS)
+      continue;
+
+    rc = consumer(context, buffer, (size_t)got);
+    total += (size_t)got;
+    if (bytes_per_second == 0)
+      continue;
+
+    /* выдерживаем паузу, если запись опережает заданную скорость */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const int64_t elapsed_us = (int64_t)(now.tv_sec - start.tv_sec) * 1000000 +
+                               (now.tv_nsec - start.tv_nsec) / 1000;
+    const int64_t due_us = (int64_t)(total * 1000000 / bytes_per_second);
+    if (due_us > elapsed_us) {
+      struct timespec pause;
+      pause.tv_sec = (time_t)((due_us - elapsed_us) / 1000000);
+      pause.tv_nsec = (long)((due_us - elapsed_us) % 1000000) * 1000;
+      while (nanosleep(&pause, &pause) != 0 && errno == EINTR)
+        ;
+    }
+  }
+
+  free(buffer);
+  return rc;
+}
+
+/* Создает копию и записывает её непосредственно в fd, либо при заданном
+ * получателе передает её через канал. */
+static int fpta_copy_run(fpta_db *db, unsigned flags, int fd,
+                         fpta_copy_consumer *consumer, void *context,
+                         size_t bytes_per_second) {
+  /* снимок копии учитывается наравне с читающими транзакциями, чтобы
+   * изменение схемы или размера БД дожидалось окончания копирования */
+  unsigned slot = 0;
+  int rc = fpta_db_lock(db, fpta_read, slot);
+  if (unlikely(rc != 0))
+    return rc;
+
+  fpta_copy_job job;
+  job.db = db;
+  job.flags = (flags & fpta_copy_compact) ? (unsigned)MDB_CP_COMPACT : 0u;
+  job.rc = MDB_SUCCESS;
+  job.own_fd = consumer != nullptr;
+  job.fd = fd;
+
+  int pipefd[2];
+  if (job.own_fd) {
+    if (unlikely(pipe(pipefd) != 0)) {
+      rc = errno;
+      goto bailout;
+    }
+    job.fd = pipefd[1];
+  }
+
+  pthread_t thread;
+  rc = pthread_create(&thread, nullptr, fpta_copy_thread, &job);
+  if (likely(rc == 0)) {
+    if (job.own_fd)
+      rc = fpta_copy_pump(pipefd[0], consumer, context, bytes_per_second);
+    int err = pthread_join(thread, nullptr);
+    assert(err == 0);
+    (void)err;
+    if (job.rc != MDB_SUCCESS)
+      rc = job.rc;
+  } else if (job.own_fd) {
+    close(pipefd[1]);
+  }
+  if (job.own_fd)
+    close(pipefd[0]);
+
+bailout:
+  int err = fpta_db_unlock(db, fpta_read, slot);
+  assert(err == 0);
+  (void)err;
+  return rc;
+}
+
+int fpta_db_copy_fd(fpta_db *db, int fd, unsigned flags,
+                    size_t bytes_per_second) {
+  if (unlikely(!fpta_db_validate(db) || fd < 0))
+    return FPTA_EINVAL;
+  if (unlikely(flags & ~(unsigned)fpta_copy_compact))
+    return FPTA_EINVAL;
+
+  if (bytes_per_second == 0)
+    return fpta_copy_run(db, flags, fd, nullptr, nullptr, 0);
+  return fpta_copy_run(db, flags, -1, fpta_copy_to_fd, &fd,
+                       bytes_per_second);
+}
+
+int fpta_db_copy(fpta_db *db, const char *path, unsigned flags,
+                 size_t bytes_per_second) {
+  if (unlikely(!fpta_db_validate(db)))
+    return FPTA_EINVAL;
+  if (unlikely(path == nullptr || *path == '\0'))
+    return FPTA_EINVAL;
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, db->file_mode);
+  if (unlikely(fd < 0))
+    return errno;
+
+  int rc = fpta_db_copy_fd(db, fd, flags, bytes_per_second);
+  if (likely(rc == FPTA_SUCCESS) && unlikely(fsync(fd) != 0))
+    rc = errno;
+  if (unlikely(close(fd) != 0) && rc == FPTA_SUCCESS)
+    rc = errno;
+  if (unlikely(rc != FPTA_SUCCESS))
+    unlink(path);
+  return rc;
+}
+
+//----------------------------------------------------------------------------
+
+/* Разностное резервное копирование, см. fpta_db_backup_delta().
+ *
+ * mdbx не предоставляет доступа к номерам транзакций в заголовках
+ * страниц, поэтому изменившиеся страницы определяются сравнением
+ * контрольных сумм с сохраненными для предыдущей копии. Для этого
+ * используется копия без уплотнения, в которой номера страниц совпадают
+ * с исходной БД, а значит такая копия может быть собрана обратно
+ * постраничной записью.
+ *
+ * Поэтому каждый вызов читает весь снимок и хеширует каждую страницу,
+ * т.е. по чтению и процессору обходится как полная копия, а экономится
+ * только запись. Выбор страниц по номеру транзакции без чтения
+ * остальных потребует поддержки со стороны mdbx.
+ *
+ * Файл delta содержит заголовок fpta_delta_header, за которым для
+ * каждой изменившейся страницы следует её номер и содержимое. Файл
+ * digest содержит такой же заголовок и контрольные суммы всех страниц
+ * копии. */
+
+struct fpta_delta_header {
+  uint32_t signature;
+  uint32_t pagesize;
+  /* количество страниц в снимке */
+  uint64_t pages;
+  /* количество страниц в delta */
+  uint64_t changed;
+};
+
+struct fpta_delta {
+  int fd;
+  unsigned pagesize;
+  /* накопление очередной страницы снимка */
+  char *page;
+  size_t filled;
+  /* буфер записи delta */
+  char *out;
+  size_t pending;
+  /* контрольные суммы страниц предыдущей и текущей копий */
+  const uint64_t *prev;
+  uint64_t prev_pages;
+  uint64_t *digest;
+  uint64_t pages, capacity;
+  uint64_t changed;
+};
+
+static int fpta_delta_flush(fpta_delta *delta) {
+  int rc = fpta_copy_write(delta->fd, delta->out, delta->pending);
+  delta->pending = 0;
+  return rc;
+}
+
+static int fpta_delta_emit(fpta_delta *delta, const void *data,
+                           size_t bytes) {
+  if (delta->pending + bytes > fpta_copy_chunk) {
+    int rc = fpta_delta_flush(delta);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+    if (bytes > fpta_copy_chunk)
+      return fpta_copy_write(delta->fd, (const char *)data, bytes);
+  }
+  memcpy(delta->out + delta->pending, data, bytes);
+  delta->pending += bytes;
+  return FPTA_SUCCESS;
+}
+
+static int fpta_delta_page(fpta_delta *delta) {
+  if (delta->pages == delta->capacity) {
+    const uint64_t capacity = delta->capacity ? delta->capacity * 2 : 1024;
+    uint64_t *digest =
+        (uint64_t *)realloc(delta->digest, capacity * sizeof(uint64_t));
+    if (unlikely(digest == nullptr))
+      return FPTA_ENOMEM;
+    delta->digest = digest;
+    delta->capacity = capacity;
+  }
+
+  const uint64_t pgno = delta->pages;
+  const uint64_t hash = t1ha(delta->page, delta->pagesize, 2017);
+  delta->digest[delta->pages++] = hash;
+  if (pgno < delta->prev_pages && delta->prev[pgno] == hash)
+    return FPTA_SUCCESS;
+
+  delta->changed += 1;
+  int rc = fpta_delta_emit(delta, &pgno, sizeof(pgno));
+  if (likely(rc == FPTA_SUCCESS))
+    rc = fpta_delta_emit(delta, delta->page, delta->pagesize);
+  return rc;
+}
+
+static int fpta_delta_consume(void *context, const char *data,
+                              size_t bytes) {
+  fpta_delta *delta = (fpta_delta *)context;
+  while (bytes) {
+    const size_t chunk = std::min(bytes, delta->pagesize - delta->filled);
+    memcpy(delta->page + delta->filled, data, chunk);
+    delta->filled += chunk;
+    data += chunk;
+    bytes -= chunk;
+    if (delta->filled == delta->pagesize) {
+      delta->filled = 0;
+      int rc = fpta_delta_page(delta);
+      if (unlikely(rc != FPTA_SUCCESS))
+        return rc;
+    }
+  }
+  return FPTA_SUCCESS;
+}
+
+static int fpta_backup_read(int fd, void *ptr, size_t bytes) {
+  while (bytes) {
+    ssize_t got = read(fd, ptr, bytes);
+    if (unlikely(got < 0)) {
+      if (errno == EINTR)
+        continue;
+      return errno;
+    }
+    /* неожиданный конец файла означает его повреждение */
+    if (unlikely(got == 0))
+      return FPTA_EINVAL;
+    ptr = (char *)ptr + got;
+    bytes -= (size_t)got;
+  }
+  return FPTA_SUCCESS;
+}
+
+/* Загружает контрольные суммы предыдущей копии, отсутствие файла
+ * означает отсутствие предыдущей копии. */
+static int fpta_digest_load(const char *path, unsigned pagesize,
+                            uint64_t **digest, uint64_t *pages) {
+  *digest = nullptr;
+  *pages = 0;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT)
+      return FPTA_SUCCESS;
+    return errno;
+  }
+
+  fpta_delta_header header;
+  int rc = fpta_backup_read(fd, &header, sizeof(header));
+  if (likely(rc == FPTA_SUCCESS) &&
+      unlikely(header.signature != FPTA_DIGEST_SIGNATURE ||
+               header.pagesize != pagesize ||
+               header.pages > SIZE_MAX / sizeof(uint64_t)))
+    rc = FPTA_EINVAL;
+
+  if (likely(rc == FPTA_SUCCESS) && header.pages) {
+    *digest = (uint64_t *)malloc((size_t)header.pages * sizeof(uint64_t));
+    if (unlikely(*digest == nullptr))
+      rc = FPTA_ENOMEM;
+    else
+      rc = fpta_backup_read(fd, *digest,
+                            (size_t)header.pages * sizeof(uint64_t));
+  }
+
+  close(fd);
+  if (likely(rc == FPTA_SUCCESS)) {
+    *pages = header.pages;
+  } else {
+    free(*digest);
+    *digest = nullptr;
+  }
+  return rc;
+}
+
+/* Сохраняет контрольные суммы через временный файл, чтобы при сбое
+ * оставался прежний digest. */
+static int fpta_digest_save(const char *path, const fpta_delta *delta,
+                            mode_t file_mode) {
+  std::string tmp(path);
+  tmp += ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                file_mode);
+  if (unlikely(fd < 0))
+    return errno;
+
+  fpta_delta_header header;
+  header.signature = FPTA_DIGEST_SIGNATURE;
+  header.pagesize = delta->pagesize;
+  header.pages = delta->pages;
+  header.changed = delta->changed;
+  int rc = fpta_copy_write(fd, (const char *)&header, sizeof(header));
+  if (likely(rc == FPTA_SUCCESS))
+    rc = fpta_copy_write(fd, (const char *)delta->digest,
+                         (size_t)delta->pages * sizeof(uint64_t));
+  if (likely(rc == FPTA_SUCCESS) && unlikely(fsync(fd) != 0))
+    rc = errno;
+  if (unlikely(close(fd) != 0) && rc == FPTA_SUCCESS)
+    rc = errno;
+  if (likely(rc == FPTA_SUCCESS) &&
+      unlikely(rename(tmp.c_str(), path) != 0))
+    rc = errno;
+  if (unlikely(rc != FPTA_SUCCESS))
+    unlink(tmp.c_str());
+  return rc;
+}
+
+int fpta_db_backup_delta(fpta_db *db, const char *digest, const char *path,
+                         size_t bytes_per_second) {
+  if (unlikely(!fpta_db_validate(db)))
+    return FPTA_EINVAL;
+  if (unlikely(digest == nullptr || *digest == '\0' || path == nullptr ||
+               *path == '\0'))
+    return FPTA_EINVAL;
+
+  MDBX_stat stat;
+  int rc = mdbx_env_stat(db->mdbx_env, &stat, sizeof(stat));
+  if (unlikely(rc != MDB_SUCCESS))
+    return rc;
+
+  fpta_delta delta;
+  memset(&delta, 0, sizeof(delta));
+  delta.pagesize = stat.ms_psize;
+  uint64_t *prev;
+  rc = fpta_digest_load(digest, delta.pagesize, &prev, &delta.prev_pages);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+  delta.prev = prev;
+
+  delta.page = (char *)malloc(delta.pagesize);
+  delta.out = (char *)malloc(fpta_copy_chunk);
+  delta.fd = -1;
+  if (unlikely(delta.page == nullptr || delta.out == nullptr)) {
+    rc = FPTA_ENOMEM;
+    goto bailout;
+  }
+
+  delta.fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                  db->file_mode);
+  if (unlikely(delta.fd < 0)) {
+    rc = errno;
+    goto bailout;
+  }
+
+  /* заголовок записывается по окончании копирования */
+  fpta_delta_header header;
+  memset(&header, 0, sizeof(header));
+  rc = fpta_delta_emit(&delta, &header, sizeof(header));
+  if (likely(rc == FPTA_SUCCESS))
+    rc = fpta_copy_run(db, fpta_copy_default, -1, fpta_delta_consume,
+                       &delta, bytes_per_second);
+  if (likely(rc == FPTA_SUCCESS) && unlikely(delta.filled != 0))
+    /* снимок должен состоять из целых страниц */
+    rc = FPTA_EOOPS;
+  if (likely(rc == FPTA_SUCCESS))
+    rc = fpta_delta_flush(&delta);
+
+  if (likely(rc == FPTA_SUCCESS)) {
+    header.signature = FPTA_DELTA_SIGNATURE;
+    header.pagesize = delta.pagesize;
+    header.pages = delta.pages;
+    header.changed = delta.changed;
+    if (unlikely(pwrite(delta.fd, &header, sizeof(header), 0) !=
+                 (ssize_t)sizeof(header)))
+      rc = errno;
+  }
+  if (likely(rc == FPTA_SUCCESS) && unlikely(fsync(delta.fd) != 0))
+    rc = errno;
+  if (unlikely(close(delta.fd) != 0) && rc == FPTA_SUCCESS)
+    rc = errno;
+
+  /* digest обновляется только после сохранения delta */
+  if (likely(rc == FPTA_SUCCESS))
+    rc = fpta_digest_save(digest, &delta, db->file_mode);
+  if (unlikely(rc != FPTA_SUCCESS))
+    unlink(path);
+
+bailout:
+  free(prev);
+  free(delta.page);
+  free(delta.out);
+  free(delta.digest);
+  return rc;
+}
+
+int fpta_db_restore_delta(const char *image, const char *path) {
+  if (unlikely(image == nullptr || *image == '\0' || path == nullptr ||
+               *path == '\0'))
+    return FPTA_EINVAL;
+
+  int in = open(path, O_RDONLY | O_CLOEXEC);
+  if (unlikely(in < 0))
+    return errno;
+
+  fpta_delta_header header;
+  char *page = nullptr;
+  int out = -1;
+  struct stat st;
+  int rc = fpta_backup_read(in, &header, sizeof(header));
+  if (unlikely(rc != FPTA_SUCCESS))
+    goto bailout;
+  if (unlikely(header.signature != FPTA_DELTA_SIGNATURE ||
+               header.pagesize < 512 || header.pagesize > 65536 ||
+               header.changed > header.pages)) {
+    rc = FPTA_EINVAL;
+    goto bailout;
+  }
+
+  page = (char *)malloc(header.pagesize);
+  if (unlikely(page == nullptr)) {
+    rc = FPTA_ENOMEM;
+    goto bailout;
+  }
+
+  /* образ создается с правами доступа файла delta */
+  if (unlikely(fstat(in, &st) != 0)) {
+    rc = errno;
+    goto bailout;
+  }
+  out = open(image, O_RDWR | O_CREAT | O_CLOEXEC, st.st_mode & 0777);
+  if (unlikely(out < 0)) {
+    rc = errno;
+    goto bailout;
+  }
+
+  for (uint64_t n = 0; n < header.changed; ++n) {
+    uint64_t pgno;
+    rc = fpta_backup_read(in, &pgno, sizeof(pgno));
+    if (likely(rc == FPTA_SUCCESS))
+      rc = fpta_backup_read(in, page, header.pagesize);
+    if (unlikely(rc != FPTA_SUCCESS))
+      goto bailout;
+    if (unlikely(pgno >= header.pages)) {
+      rc = FPTA_EINVAL;
+      goto bailout;
+    }
+    if (unlikely(pwrite(out, page, header.pagesize,
+                        (off_t)(pgno * header.pagesize)) !=
+                 (ssize_t)header.pagesize)) {
+      rc = errno;
+      goto bailout;
+    }
+  }
+
+  /* размер образа соответствует снимку, в том числе при уменьшении */
+  if (unlikely(ftruncate(out, (off_t)(header.pages * header.pagesize)) != 0 ||
+               fsync(out) != 0))
+    rc = errno;
+
+bailout:
+  if (out >= 0 && unlikely(close(out) != 0) && rc == FPTA_SUCCESS)
+    rc = errno;
+  close(in);
+  free(page);
+  return rc;
+}
@@ -0,0 +1,305 @@
+/*
+ * Copyright 2016-2017 libfpta authors: please see AUTHORS file.
+ *
+ * This file is part of libfpta, aka "Fast Positive Tables".
+ *
+ * libfpta is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libfpta is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libfpta.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fast_positive/tables_internal.h"
+
+/* Журнал изменений строк, см. fpta_column_set_changelog().
+ *
+ * Журнал хранится в служебной таблице с целочисленными ключами, где
+ * под ключом 0 хранится номер последней добавленной записи, а остальные
+ * ключи являются номерами записей. Поэтому нумерация продолжается
+ * после удаления любого количества записей, а новые записи добавляются
+ * в конец посредством MDB_APPEND.
+ *
+ * Запись состоит из заголовка fpta_change_record, ключа PK в том виде,
+ * в котором он хранится в основной таблице, и следующей за ним строки.
+ * Строка выравнивается на 8 байт относительно начала записи. */
+
+struct fpta_change_record {
+  uint32_t kind;
+  uint32_t pk_length;
+  uint64_t txnid;
+};
+
+struct fpta_changelog {
+  fpta_txn *txn;
+  MDB_cursor *mdbx_cursor;
+  fpta_shove_t pk_shove;
+  uint64_t from_seq;
+  bool started;
+};
+
+static __inline size_t fpta_change_row_offset(size_t pk_length) {
+  return sizeof(fpta_change_record) + ((pk_length + 7) & ~(size_t)7);
+}
+
+static int fpta_changelog_last(fpta_txn *txn, MDB_dbi dbi, uint64_t &last) {
+  uint64_t meta_seq = 0;
+  MDB_val key, data;
+  key.iov_base = &meta_seq;
+  key.iov_len = sizeof(meta_seq);
+  int rc = mdbx_get(txn->mdbx_txn, dbi, &key, &data);
+  if (rc == MDB_NOTFOUND) {
+    last = 0;
+    return FPTA_SUCCESS;
+  }
+  if (unlikely(rc != MDB_SUCCESS))
+    return rc;
+  if (unlikely(data.iov_len != sizeof(uint64_t)))
+    return FPTA_INDEX_CORRUPTED;
+  memcpy(&last, data.iov_base, sizeof(uint64_t));
+  return FPTA_SUCCESS;
+}
+
+static int fpta_changelog_prepare(fpta_txn *txn, fpta_name *table_id,
+                                  fpta_level level, MDB_dbi &dbi) {
+  if (unlikely(!fpta_txn_validate(txn, level)))
+    return FPTA_EINVAL;
+
+  int rc = fpta_name_refresh_couple(txn, table_id, nullptr);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+  if (unlikely(!fpta_schema_changelog(table_id->table.def)))
+    return FPTA_NO_INDEX;
+
+  return fpta_open_changelog(txn, table_id, &dbi);
+}
+
+int fpta_changelog_append(fpta_txn *txn, fpta_name *table_id,
+                          fpta_change_kind kind, const MDB_val &pk_key,
+                          const fptu_ro &row) {
+  const fpta_shove_t *extra =
+      fpta_schema_extra_lookup(table_id->table.def, fpta_extra_changelog, 0);
+  assert(extra != nullptr);
+
+  MDB_dbi dbi;
+  int rc = fpta_open_changelog(txn, table_id, &dbi);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  uint64_t seq;
+  rc = fpta_changelog_last(txn, dbi, seq);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+  seq += 1;
+
+  const size_t row_offset = fpta_change_row_offset(pk_key.iov_len);
+  MDB_val key, data;
+  key.iov_base = &seq;
+  key.iov_len = sizeof(seq);
+  data.iov_base = nullptr;
+  data.iov_len = row_offset + row.total_bytes;
+  rc = mdbx_put(txn->mdbx_txn, dbi, &key, &data, MDB_APPEND | MDB_RESERVE);
+  if (unlikely(rc != MDB_SUCCESS))
+    return rc;
+
+  fpta_change_record header;
+  header.kind = kind;
+  header.pk_length = (uint32_t)pk_key.iov_len;
+  header.txnid = txn->data_version;
+  char *ptr = (char *)data.iov_base;
+  memset(ptr, 0, row_offset);
+  memcpy(ptr, &header, sizeof(header));
+  if (pk_key.iov_len)
+    memcpy(ptr + sizeof(header), pk_key.iov_base, pk_key.iov_len);
+  if (row.total_bytes)
+    memcpy(ptr + row_offset, row.units, row.total_bytes);
+
+  uint64_t meta_seq = 0;
+  key.iov_base = &meta_seq;
+  data.iov_base = &seq;
+  data.iov_len = sizeof(seq);
+  rc = mdbx_put(txn->mdbx_txn, dbi, &key, &data, 0);
+  if (unlikely(rc != MDB_SUCCESS))
+    return rc;
+
+  /* номера записей идут подряд, поэтому для соблюдения ограничения
+   * достаточно удалить одну запись, вышедшую за его пределы */
+  const uint32_t retention = fpta_extra_param(*extra);
+  if (retention && seq > retention) {
+    uint64_t expired_seq = seq - retention;
+    key.iov_base = &expired_seq;
+    rc = mdbx_del(txn->mdbx_txn, dbi, &key, nullptr);
+    if (unlikely(rc != MDB_SUCCESS && rc != MDB_NOTFOUND))
+      return rc;
+  }
+
+  return FPTA_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+
+int fpta_changelog_open(fpta_txn *txn, fpta_name *table_id, uint64_t from_seq,
+                        fpta_changelog **plog) {
+  if (unlikely(plog == nullptr))
+    return FPTA_EINVAL;
+  *plog = nullptr;
+
+  MDB_dbi dbi;
+  int rc = fpta_changelog_prepare(txn, table_id, fpta_read, dbi);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  fpta_changelog *log = (fpta_changelog *)calloc(1, sizeof(fpta_changelog));
+  if (unlikely(log == nullptr))
+    return FPTA_ENOMEM;
+
+  rc = mdbx_cursor_open(txn->mdbx_txn, dbi, &log->mdbx_cursor);
+  if (unlikely(rc != MDB_SUCCESS)) {
+    free(log);
+    return rc;
+  }
+
+  log->txn = txn;
+  log->pk_shove = table_id->table.pk;
+  /* под ключом 0 хранится номер последней записи */
+  log->from_seq = from_seq ? from_seq : 1;
+  log->started = false;
+  *plog = log;
+  return FPTA_SUCCESS;
+}
+
+int fpta_changelog_next(fpta_changelog *log, fpta_change *change) {
+  if (unlikely(log == nullptr || change == nullptr ||
+               log->mdbx_cursor == nullptr ||
+               !fpta_txn_validate(log->txn, fpta_read)))
+    return FPTA_EINVAL;
+
+  MDB_val key, data;
+  int rc;
+  if (log->started)
+    rc = mdbx_cursor_get(log->mdbx_cursor, &key, &data, MDB_NEXT);
+  else {
+    key.iov_base = &log->from_seq;
+    key.iov_len = sizeof(log->from_seq);
+    rc = mdbx_cursor_get(log->mdbx_cursor, &key, &data, MDB_SET_RANGE);
+    log->started = true;
+  }
+  if (unlikely(rc != MDB_SUCCESS))
+    return (rc == MDB_NOTFOUND) ? (int)FPTA_NODATA : rc;
+
+  fpta_change_record header;
+  if (unlikely(key.iov_len != sizeof(uint64_t) ||
+               data.iov_len < sizeof(header)))
+    return FPTA_INDEX_CORRUPTED;
+  memcpy(&header, data.iov_base, sizeof(header));
+  const size_t row_offset = fpta_change_row_offset(header.pk_length);
+  if (unlikely(data.iov_len < row_offset ||
+               header.kind < fpta_change_insert ||
+               header.kind > fpta_change_clear))
+    return FPTA_INDEX_CORRUPTED;
+
+  memcpy(&change->seq, key.iov_base, sizeof(uint64_t));
+  change->txnid = header.txnid;
+  change->kind = (fpta_change_kind)header.kind;
+  change->pk = fpta_value_null();
+  if (header.kind != fpta_change_clear) {
+    MDB_val pk_key;
+    pk_key.iov_base = (char *)data.iov_base + sizeof(header);
+    pk_key.iov_len = header.pk_length;
+    rc = fpta_index_key2value(log->pk_shove, pk_key, change->pk);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
+
+  change->row.sys.iov_len = data.iov_len - row_offset;
+  change->row.sys.iov_base =
+      change->row.sys.iov_len ? (char *)data.iov_base + row_offset : nullptr;
+  return FPTA_SUCCESS;
+}
+
+int fpta_changelog_close(fpta_changelog *log) {
+  if (unlikely(log == nullptr || log->mdbx_cursor == nullptr ||
+               !fpta_txn_check(log->txn, fpta_read)))
+    return FPTA_EINVAL;
+
+  mdbx_cursor_close(log->mdbx_cursor);
+  free(log);
+  return FPTA_SUCCESS;
+}
+
+int fpta_changelog_bounds(fpta_txn *txn, fpta_name *table_id, uint64_t *first,
+                          uint64_t *last) {
+  if (unlikely(first == nullptr || last == nullptr))
+    return FPTA_EINVAL;
+
+  MDB_dbi dbi;
+  int rc = fpta_changelog_prepare(txn, table_id, fpta_read, dbi);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  rc = fpta_changelog_last(txn, dbi, *last);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  MDB_cursor *mdbx_cursor;
+  rc = mdbx_cursor_open(txn->mdbx_txn, dbi, &mdbx_cursor);
+  if (unlikely(rc != MDB_SUCCESS))
+    return rc;
+
+  uint64_t first_seq = 1;
+  MDB_val key, data;
+  key.iov_base = &first_seq;
+  key.iov_len = sizeof(first_seq);
+  rc = mdbx_cursor_get(mdbx_cursor, &key, &data, MDB_SET_RANGE);
+  if (rc == MDB_SUCCESS) {
+    memcpy(first, key.iov_base, sizeof(uint64_t));
+  } else if (rc == MDB_NOTFOUND) {
+    *first = *last + 1;
+    rc = FPTA_SUCCESS;
+  }
+  mdbx_cursor_close(mdbx_cursor);
+  return rc;
+}
+
+int fpta_changelog_trim(fpta_txn *txn, fpta_name *table_id,
+                        uint64_t upto_seq) {
+  MDB_dbi dbi;
+  int rc = fpta_changelog_prepare(txn, table_id, fpta_write, dbi);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  MDB_cursor *mdbx_cursor;
+  rc = mdbx_cursor_open(txn->mdbx_txn, dbi, &mdbx_cursor);
+  if (unlikely(rc != MDB_SUCCESS))
+    return rc;
+
+  /* записи удаляются от самой старой, после удаления курсор уже стоит
+   * на следующей */
+  uint64_t first_seq = 1;
+  MDB_val key, data;
+  key.iov_base = &first_seq;
+  key.iov_len = sizeof(first_seq);
+  rc = mdbx_cursor_get(mdbx_cursor, &key, &data, MDB_SET_RANGE);
+  while (rc == MDB_SUCCESS) {
+    uint64_t seq;
+    memcpy(&seq, key.iov_base, sizeof(uint64_t));
+    if (seq > upto_seq)
+      break;
+    rc = mdbx_cursor_del(mdbx_cursor, 0);
+    if (unlikely(rc != MDB_SUCCESS))
+      break;
+    if (mdbx_cursor_eof(mdbx_cursor) == MDBX_RESULT_TRUE)
+      break;
+    rc = mdbx_cursor_get(mdbx_cursor, &key, &data, MDB_GET_CURRENT);
+  }
+
+  mdbx_cursor_close(mdbx_cursor);
+  return (rc == MDB_NOTFOUND) ? (int)FPTA_SUCCESS : rc;
+}
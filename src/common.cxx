@@ -19,33 +19,156 @@
 
 #include "fast_positive/tables_internal.h"
 
-static int fpta_db_lock(fpta_db *db, fpta_level level) {
+#include <sched.h>
+
+/* Изменения схемы координируются с остальными транзакциями без общей
+ * блокировки чтения-записи, захват которой приводит к "пинг-понгу"
+ * кэш-линии между всеми ядрами при старте каждой транзакции.
+ *
+ * Вместо этого транзакции регистрируются в слоте своего потока, а также
+ * проверяют флаг изменения схемы, который меняется только при изменении
+ * схемы. Транзакция изменения схемы захватывает мьютекс, выставляет флаг
+ * и дожидается освобождения всех слотов. При последовательно согласованном
+ * порядке операций либо транзакция увидит флаг и будет ждать на мьютексе,
+ * либо изменяющий схему дождется её завершения.
+ *
+ * Точно также, но с ограничением времени ожидания, приостанавливаются
+ * транзакции для изменения размера БД, см. fpta_geometry_adjust(). */
+
+static unsigned fpta_elapsed_ms(const struct timespec &since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  int64_t ms = (int64_t)(now.tv_sec - since.tv_sec) * 1000 +
+               (now.tv_nsec - since.tv_nsec) / 1000000;
+  return (ms > 0) ? (unsigned)ms : 0;
+}
+
+/* Слот закрепляется за потоком при первой транзакции и освобождается
+ * при завершении потока, поэтому пока одновременно существует не более
+ * fpta_epoch_slots потоков, каждый из них использует собственный слот.
+ * Остальные потоки распределяются по уже занятым слотам по кругу: это
+ * не нарушает координацию, так как слот является счетчиком транзакций,
+ * но возвращает конкуренцию за кэш-линию между такими потоками. */
+static std::atomic<bool> fpta_epoch_owned[fpta_epoch_slots];
+
+struct fpta_epoch_slot_owner {
+  unsigned index;
+  bool owned;
+
+  fpta_epoch_slot_owner() : index(0), owned(false) {
+    for (unsigned i = 0; i < fpta_epoch_slots; ++i) {
+      if (!fpta_epoch_owned[i].load(std::memory_order_relaxed) &&
+          !fpta_epoch_owned[i].exchange(true, std::memory_order_acquire)) {
+        index = i;
+        owned = true;
+        return;
+      }
+    }
+    static std::atomic<unsigned> sequence;
+    index = sequence.fetch_add(1, std::memory_order_relaxed) % fpta_epoch_slots;
+  }
+
+  ~fpta_epoch_slot_owner() {
+    if (owned)
+      fpta_epoch_owned[index].store(false, std::memory_order_release);
+  }
+};
+
+static unsigned fpta_epoch_slot_index(void) {
+  static thread_local fpta_epoch_slot_owner slot;
+  return slot.index;
+}
+
+/* Дожидается освобождения всех слотов, но не дольше timeout_ms,
+ * при нулевом значении время ожидания не ограничено. */
+static bool fpta_db_drain(fpta_db *db, unsigned timeout_ms) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < fpta_epoch_slots; ++i) {
+    for (unsigned spins = 0; db->epoch_slots[i].active.load() != 0; ++spins) {
+      if (spins < 64)
+        sched_yield();
+      else if (timeout_ms && fpta_elapsed_ms(start) >= timeout_ms)
+        return false;
+      else
+        usleep(1000);
+    }
+  }
+  return true;
+}
+
+int fpta_db_lock(fpta_db *db, fpta_level level, unsigned &slot) {
   assert(level >= fpta_read && level <= fpta_schema);
 
+  if (level == fpta_schema && !db->alterable_schema)
+    return EPERM;
+  if (db->epoch_slots == nullptr)
+    return 0;
+
   int rc;
-  if (db->alterable_schema) {
-    if (level < fpta_schema)
-      rc = pthread_rwlock_rdlock(&db->schema_rwlock);
-    else
-      rc = pthread_rwlock_wrlock(&db->schema_rwlock);
-    assert(rc == 0);
-  } else {
-    rc = (level < fpta_schema) ? 0 : EPERM;
+  if (level < fpta_schema) {
+    slot = fpta_epoch_slot_index();
+    std::atomic<size_t> &active = db->epoch_slots[slot].active;
+    for (;;) {
+      active.fetch_add(1);
+      if (likely(!db->schema_writer.load()))
+        return 0;
+      active.fetch_sub(1);
+
+      /* дожидаемся завершения изменения схемы */
+      rc = pthread_mutex_lock(&db->schema_mutex);
+      if (unlikely(rc != 0))
+        return rc;
+      rc = pthread_mutex_unlock(&db->schema_mutex);
+      assert(rc == 0);
+    }
   }
 
-  return rc;
+  rc = pthread_mutex_lock(&db->schema_mutex);
+  if (unlikely(rc != 0))
+    return rc;
+  db->schema_writer.store(true);
+  fpta_db_drain(db, 0);
+  return 0;
 }
 
-static int fpta_db_unlock(fpta_db *db, fpta_level level) {
-  (void)level;
+/* Приостанавливает все транзакции процесса, но ожидает завершения
+ * уже запущенных не дольше timeout_ms. Освобождается посредством
+ * fpta_db_unlock() с уровнем fpta_schema. */
+static int fpta_db_exclusive(fpta_db *db, unsigned timeout_ms) {
+  assert(db->epoch_slots != nullptr);
+  int rc = pthread_mutex_lock(&db->schema_mutex);
+  if (unlikely(rc != 0))
+    return rc;
+  db->schema_writer.store(true);
+  if (likely(fpta_db_drain(db, timeout_ms)))
+    return 0;
+
+  db->schema_writer.store(false);
+  rc = pthread_mutex_unlock(&db->schema_mutex);
+  assert(rc == 0);
+  (void)rc;
+  return ETIMEDOUT;
+}
+
+int fpta_db_unlock(fpta_db *db, fpta_level level, unsigned slot) {
   assert(level >= fpta_read && level <= fpta_schema);
 
-  int rc;
-  if (db->alterable_schema) {
-    rc = pthread_rwlock_unlock(&db->schema_rwlock);
-  } else {
-    rc = (level < fpta_schema) ? 0 : ENOLCK;
+  if (db->epoch_slots == nullptr) {
+    int rc = (level < fpta_schema) ? 0 : ENOLCK;
+    assert(rc == 0);
+    return rc;
+  }
+
+  if (level < fpta_schema) {
+    size_t prev = db->epoch_slots[slot].active.fetch_sub(1);
+    assert(prev > 0);
+    (void)prev;
+    return 0;
   }
+
+  db->schema_writer.store(false);
+  int rc = pthread_mutex_unlock(&db->schema_mutex);
   assert(rc == 0);
   return rc;
 }
@@ -66,7 +189,10 @@ static void fpta_txn_free(fpta_db *db, fpta_txn *txn) {
   (void)db;
   if (likely(txn)) {
     assert(txn->db == db);
+    if (db->pkcache)
+      fpta_pkcache_release(txn);
     txn->db = nullptr;
+    free(txn->rowbuf.ptr);
     free(txn);
   }
 }
@@ -85,14 +211,148 @@ void fpta_cursor_free(fpta_db *db, fpta_cursor *cursor) {
     assert(cursor->db == db);
     (void)db;
     cursor->db = nullptr;
+    free(cursor->rowbuf.ptr);
+    free(cursor->prefix.data);
     free(cursor);
   }
 }
 
 //----------------------------------------------------------------------------
 
+/* Динамический размер БД, см. fpta_db_open_ex().
+ *
+ * Размер проверяется после завершения каждой пишущей транзакции и при
+ * необходимости изменяется посредством mdbx_env_set_mapsize(), что
+ * допустимо только при отсутствии транзакций в процессе. Поэтому все
+ * транзакции приостанавливаются через слоты читателей, а если этого
+ * не удалось добиться за fpta_remap_timeout_ms, то следующая попытка
+ * откладывается на fpta_remap_backoff_txns транзакций. При повторных
+ * неудачах отсрочка удваивается, чтобы длительная транзакция не приводила
+ * к регулярной приостановке всего процесса. По этой же причине при
+ * наличии длительных транзакций (см. fpta_transaction_longterm())
+ * попытка сразу считается неудачной, без ожидания. */
+
+/* Вычисляет требуемый размер БД, либо ноль если изменение не нужно. */
+static size_t fpta_geometry_target(const fpta_db *db,
+                                   const MDBX_envinfo &info) {
+  const size_t megabyte = 1 << 20;
+  const size_t lower = db->geometry.lower * megabyte;
+  const size_t upper = db->geometry.upper * megabyte;
+  const size_t step = db->geometry.growth_step * megabyte;
+  const size_t used = (info.me_last_pgno + 1) * (size_t)db->pagesize;
+  size_t target = info.me_mapsize;
+
+  if (target < upper && target - used < step) {
+    while (target < upper && target - used < step)
+      target += step;
+    return std::min(target, upper);
+  }
+
+  if (db->geometry.shrink_threshold &&
+      target - used > db->geometry.shrink_threshold * megabyte) {
+    target = std::max(lower, (used + step + megabyte - 1) & ~(megabyte - 1));
+    if (target < info.me_mapsize)
+      return target;
+  }
+
+  return 0;
+}
+
+/* Изменяет размер отображения БД, при этом оно может быть перемещено
+ * в адресном пространстве. Поэтому после изменения, в том числе
+ * неудачного, сбрасываются адреса строк в fpta_db_pkcache(). */
+static int fpta_geometry_remap(fpta_db *db, size_t size) {
+  int rc = mdbx_env_set_mapsize(db->mdbx_env, size);
+  fpta_pkcache_remapped(db);
+  return rc;
+}
+
+static int fpta_geometry_adjust(fpta_db *db) {
+  assert(db->geometry.growth_step > 0);
+  MDBX_envinfo info;
+  int rc = mdbx_env_info(db->mdbx_env, &info, sizeof(info));
+  if (unlikely(rc != MDB_SUCCESS))
+    return rc;
+  if (likely(fpta_geometry_target(db, info) == 0) ||
+      info.me_last_txnid < db->remap_backoff.load())
+    return FPTA_SUCCESS;
+
+  /* длительная транзакция удерживает слот, поэтому ожидание бесполезно */
+  rc = fpta_readers_longterm(db)
+           ? ETIMEDOUT
+           : fpta_db_exclusive(db, fpta_remap_timeout_ms);
+  if (rc == ETIMEDOUT) {
+    const unsigned failures = db->remap_failures.load();
+    const unsigned shift =
+        std::min(failures, (unsigned)fpta_remap_backoff_shift);
+    db->remap_backoff.store(info.me_last_txnid +
+                            ((uint64_t)fpta_remap_backoff_txns << shift));
+    db->remap_failures.store(failures + 1);
+    return FPTA_SUCCESS;
+  }
+  if (unlikely(rc != 0))
+    return rc;
+  db->remap_failures.store(0);
+
+  /* размер мог быть изменен другим потоком */
+  rc = mdbx_env_info(db->mdbx_env, &info, sizeof(info));
+  if (likely(rc == MDB_SUCCESS)) {
+    const size_t target = fpta_geometry_target(db, info);
+    if (target)
+      rc = fpta_geometry_remap(db, target);
+  }
+
+  int err = fpta_db_unlock(db, fpta_schema, 0);
+  assert(err == 0);
+  (void)err;
+  return rc;
+}
+
+/* Подхватывает размер БД, измененный другим процессом. Слот стартующей
+ * транзакции освобождается на время изменения и затем занимается
+ * повторно. Ожидание ограничено fpta_remap_timeout_ms, так как на это
+ * время блокируется старт всех транзакций процесса, а незавершенная
+ * транзакция может принадлежать и самому стартующему потоку. При
+ * неудаче возвращается FPTA_DB_RESIZED, и старт транзакции следует
+ * повторить позже. */
+static int fpta_geometry_adopt(fpta_db *db, fpta_level level,
+                               unsigned &slot) {
+  if (level == fpta_schema)
+    return fpta_geometry_remap(db, 0);
+
+  int err = fpta_db_unlock(db, level, slot);
+  assert(err == 0);
+  /* длительная транзакция удерживает слот, поэтому ожидание бесполезно */
+  int rc = fpta_readers_longterm(db)
+               ? ETIMEDOUT
+               : fpta_db_exclusive(db, fpta_remap_timeout_ms);
+  if (likely(rc == 0)) {
+    rc = fpta_geometry_remap(db, 0);
+    err = fpta_db_unlock(db, fpta_schema, 0);
+    assert(err == 0);
+  } else if (rc == ETIMEDOUT)
+    rc = FPTA_DB_RESIZED;
+
+  err = fpta_db_lock(db, level, slot);
+  assert(err == 0);
+  (void)err;
+  return rc;
+}
+
+//----------------------------------------------------------------------------
+
 int fpta_db_open(const char *path, fpta_durability durability, mode_t file_mode,
                  size_t megabytes, bool alterable_schema, fpta_db **pdb) {
+  fpta_db_geometry geometry;
+  geometry.lower = geometry.upper = megabytes;
+  geometry.growth_step = geometry.shrink_threshold = 0;
+  return fpta_db_open_ex(path, durability, file_mode, &geometry,
+                         alterable_schema, pdb);
+}
+
+int fpta_db_open_ex(const char *path, fpta_durability durability,
+                    mode_t file_mode, const fpta_db_geometry *geometry,
+                    bool alterable_schema, fpta_db **pdb) {
   if (unlikely(pdb == nullptr))
     return FPTA_EINVAL;
   *pdb = nullptr;
@@ -100,6 +360,15 @@ int fpta_db_open(const char *path, fpta_durability durability, mode_t file_mode,
   if (unlikely(path == nullptr || *path == '\0'))
     return FPTA_EINVAL;
 
+  if (unlikely(geometry == nullptr || geometry->upper < geometry->lower))
+    return FPTA_EINVAL;
+  const bool dynamic = geometry->upper > geometry->lower;
+  if (dynamic && unlikely(geometry->growth_step < 1))
+    return FPTA_EINVAL;
+  if (dynamic && unlikely(geometry->shrink_threshold &&
+                          geometry->shrink_threshold <= geometry->growth_step))
+    return FPTA_EINVAL;
+
   unsigned mdbx_flags = MDB_NOSUBDIR;
   switch (durability) {
   default:
@@ -111,6 +380,8 @@ int fpta_db_open(const char *path, fpta_durability durability, mode_t file_mode,
     mdbx_flags |= MDBX_LIFORECLAIM | MDBX_COALESCE;
     break;
   case fpta_lazy:
+  case fpta_sync_group:
+  case fpta_sync_deferred:
     mdbx_flags |=
         MDBX_LIFORECLAIM | MDBX_COALESCE | MDB_NOSYNC | MDB_NOMETASYNC;
     break;
@@ -126,7 +397,12 @@ int fpta_db_open(const char *path, fpta_durability durability, mode_t file_mode,
 
   int rc = pthread_mutex_init(&db->dbi_mutex, nullptr);
   if (unlikely(rc != 0)) {
-    int err = pthread_rwlock_destroy(&db->schema_rwlock);
+    free(db);
+    return (fpta_error)rc;
+  }
+  rc = pthread_mutex_init(&db->keyfilter_mutex, nullptr);
+  if (unlikely(rc != 0)) {
+    int err = pthread_mutex_destroy(&db->dbi_mutex);
     assert(err == 0);
     (void)err;
     free(db);
@@ -134,12 +410,30 @@ int fpta_db_open(const char *path, fpta_durability durability, mode_t file_mode,
   }
 
   db->alterable_schema = alterable_schema;
-  if (db->alterable_schema) {
-    rc = pthread_rwlock_init(&db->schema_rwlock, nullptr);
+  db->file_mode = file_mode;
+  db->geometry = *geometry;
+  if (!dynamic)
+    db->geometry.growth_step = db->geometry.shrink_threshold = 0;
+  /* учет транзакций нужен для изменения схемы и размера БД */
+  const bool tracking = alterable_schema || dynamic;
+  if (tracking) {
+    rc = pthread_mutex_init(&db->schema_mutex, nullptr);
     if (unlikely(rc != 0)) {
+      int err = pthread_mutex_destroy(&db->keyfilter_mutex);
+      assert(err == 0);
+      err = pthread_mutex_destroy(&db->dbi_mutex);
+      assert(err == 0);
+      (void)err;
       free(db);
       return (fpta_error)rc;
     }
+    db->schema_writer.store(false);
+    db->epoch_slots =
+        (fpta_epoch_slot *)calloc(fpta_epoch_slots, sizeof(fpta_epoch_slot));
+    if (unlikely(db->epoch_slots == nullptr)) {
+      rc = FPTA_ENOMEM;
+      goto bailout;
+    }
   }
 
   rc = mdbx_env_create(&db->mdbx_env);
@@ -158,7 +452,7 @@ int fpta_db_open(const char *path, fpta_durability durability, mode_t file_mode,
   if (unlikely(rc != MDB_SUCCESS))
     goto bailout;
 
-  rc = mdbx_env_set_mapsize(db->mdbx_env, megabytes * (1 << 20));
+  rc = mdbx_env_set_mapsize(db->mdbx_env, geometry->lower * (1 << 20));
   if (unlikely(rc != MDB_SUCCESS))
     goto bailout;
 
@@ -166,21 +460,58 @@ int fpta_db_open(const char *path, fpta_durability durability, mode_t file_mode,
   if (unlikely(rc != MDB_SUCCESS))
     goto bailout;
 
+  if (dynamic) {
+    MDBX_stat stat;
+    rc = mdbx_env_stat(db->mdbx_env, &stat, sizeof(stat));
+    if (unlikely(rc != MDB_SUCCESS))
+      goto bailout;
+    db->pagesize = stat.ms_psize;
+  }
+
+  rc = fpta_writer_init(db);
+  if (unlikely(rc != FPTA_SUCCESS))
+    goto bailout;
+
+  rc = fpta_readers_init(db);
+  if (unlikely(rc != FPTA_SUCCESS))
+    goto bailout;
+
+  db->durability = durability;
+  if (durability == fpta_sync_group || durability == fpta_sync_deferred) {
+    rc = fpta_durable_init(db, durability == fpta_sync_deferred);
+    if (unlikely(rc != FPTA_SUCCESS))
+      goto bailout;
+  }
+
+  if (dynamic && durability != fpta_readonly) {
+    /* размер существующей БД может не соответствовать геометрии */
+    rc = fpta_geometry_adjust(db);
+    if (unlikely(rc != FPTA_SUCCESS)) {
+      fpta_durable_destroy(db);
+      goto bailout;
+    }
+  }
+
   *pdb = db;
   return FPTA_SUCCESS;
 
 bailout:
+  fpta_writer_destroy(db);
+  fpta_readers_destroy(db);
   if (db->mdbx_env) {
     int err = mdbx_env_close_ex(db->mdbx_env, true /* don't touch/save/sync */);
     assert(err == MDB_SUCCESS);
     (void)err;
   }
 
-  int err = pthread_mutex_destroy(&db->dbi_mutex);
+  int err = pthread_mutex_destroy(&db->keyfilter_mutex);
   assert(err == 0);
-  if (alterable_schema) {
-    err = pthread_rwlock_destroy(&db->schema_rwlock);
+  err = pthread_mutex_destroy(&db->dbi_mutex);
+  assert(err == 0);
+  if (tracking) {
+    err = pthread_mutex_destroy(&db->schema_mutex);
     assert(err == 0);
+    free(db->epoch_slots);
   }
   (void)err;
 
@@ -192,32 +523,44 @@ int fpta_db_close(fpta_db *db) {
   if (unlikely(!fpta_db_validate(db)))
     return FPTA_EINVAL;
 
-  int rc = fpta_db_lock(db, db->alterable_schema ? fpta_schema : fpta_write);
+  const fpta_level level = db->alterable_schema ? fpta_schema : fpta_write;
+  unsigned slot = 0;
+  int rc = fpta_db_lock(db, level, slot);
   if (unlikely(rc != 0))
     return (fpta_error)rc;
 
   rc = pthread_mutex_lock(&db->dbi_mutex);
   if (unlikely(rc != 0)) {
-    int err = fpta_db_unlock(db, fpta_schema);
+    int err = fpta_db_unlock(db, level, slot);
     assert(err == 0);
     (void)err;
     return (fpta_error)rc;
   }
 
+  /* фоновый поток отложенного сохранения должен быть остановлен
+   * до закрытия mdbx */
+  fpta_durable_destroy(db);
   rc = (fpta_error)mdbx_env_close_ex(db->mdbx_env, false);
   assert(rc == MDB_SUCCESS);
   db->mdbx_env = nullptr;
+  fpta_keyfilter_destroy(db);
+  fpta_pkcache_destroy(db);
+  fpta_writer_destroy(db);
+  fpta_readers_destroy(db);
 
   int err = pthread_mutex_unlock(&db->dbi_mutex);
   assert(err == 0);
   err = pthread_mutex_destroy(&db->dbi_mutex);
   assert(err == 0);
+  err = pthread_mutex_destroy(&db->keyfilter_mutex);
+  assert(err == 0);
 
-  err = fpta_db_unlock(db, db->alterable_schema ? fpta_schema : fpta_write);
+  err = fpta_db_unlock(db, level, slot);
   assert(err == 0);
-  if (db->alterable_schema) {
-    err = pthread_rwlock_destroy(&db->schema_rwlock);
+  if (db->epoch_slots) {
+    err = pthread_mutex_destroy(&db->schema_mutex);
     assert(err == 0);
+    free(db->epoch_slots);
   }
   (void)err;
 
@@ -238,7 +581,18 @@ int fpta_transaction_begin(fpta_db *db, fpta_level level, fpta_txn **ptxn) {
   if (unlikely(!fpta_db_validate(db)))
     return FPTA_EINVAL;
 
-  int err = fpta_db_lock(db, level);
+  int err;
+  if (level >= fpta_write && db->geometry.growth_step &&
+      db->durability != fpta_readonly) {
+    /* запас места обеспечивается до начала записи, так как транзакцию,
+     * которой не хватило места, можно только отменить; на результат
+     * не влияет */
+    err = fpta_geometry_adjust(db);
+    (void)err;
+  }
+
+  unsigned slot = 0;
+  err = fpta_db_lock(db, level, slot);
   if (unlikely(err != 0))
     return (fpta_error)err;
 
@@ -247,22 +601,42 @@ int fpta_transaction_begin(fpta_db *db, fpta_level level, fpta_txn **ptxn) {
   if (unlikely(txn == nullptr))
     goto bailout;
 
-  rc = mdbx_txn_begin(db->mdbx_env, nullptr,
-                      (level == fpta_read) ? (unsigned)MDB_RDONLY : 0u,
-                      &txn->mdbx_txn);
+  for (;;) {
+    rc = mdbx_txn_begin(db->mdbx_env, nullptr,
+                        (level == fpta_read) ? (unsigned)MDB_RDONLY : 0u,
+                        &txn->mdbx_txn);
+    if (likely(rc != FPTA_DB_RESIZED) || db->epoch_slots == nullptr)
+      break;
+    /* размер БД увеличен другим процессом */
+    rc = fpta_geometry_adopt(db, level, slot);
+    if (unlikely(rc != MDB_SUCCESS))
+      goto bailout;
+  }
   if (unlikely(rc != MDB_SUCCESS))
     goto bailout;
+  txn->epoch_slot = slot;
+
+  if (level >= fpta_write) {
+    rc = fpta_keyfilter_acquire(db);
+    if (unlikely(rc != FPTA_SUCCESS)) {
+      err = mdbx_txn_abort(txn->mdbx_txn);
+      assert(err == MDB_SUCCESS);
+      goto bailout;
+    }
+  }
 
   mdbx_canary canary;
   txn->data_version = mdbx_canary_get(txn->mdbx_txn, &canary);
   txn->schema_version = canary.v;
   assert(txn->schema_version <= txn->data_version);
+  if (level >= fpta_write && db->pkcache)
+    fpta_pkcache_begin(txn);
 
   *ptxn = txn;
   return FPTA_SUCCESS;
 
 bailout:
-  err = fpta_db_unlock(db, level);
+  err = fpta_db_unlock(db, level, slot);
   assert(err == 0);
   (void)err;
   fpta_txn_free(db, txn);
@@ -271,13 +645,32 @@ bailout:
 }
 
 int fpta_transaction_end(fpta_txn *txn, bool abort) {
-  if (unlikely(!fpta_txn_validate(txn, fpta_read)))
+  if (unlikely(!fpta_txn_check(txn, fpta_read)))
     return FPTA_EINVAL;
 
   int rc;
+  const bool cancelled = fpta_txn_cancelled(txn);
+  if (txn->longterm)
+    fpta_readers_unregister(txn);
+
+  if (unlikely(txn->savepoint != nullptr)) {
+    /* фиксируем или отменяем все незавершенные точки сохранения */
+    rc = fpta_savepoint_unwind(txn, abort);
+    if (unlikely(rc != FPTA_SUCCESS) && !abort) {
+      fpta_transaction_end(txn, true);
+      return rc;
+    }
+  }
+
+  /* транзакция могла быть уже отменена fpta_inconsistent_abort(),
+   * которая в этом случае сама освобождает фильтры ключей */
+  const bool keyfilters_held =
+      txn->level >= fpta_write && txn->mdbx_txn != nullptr;
   if (txn->level == fpta_read) {
     // TODO: reuse txn with mdbx_txn_reset(), but pool needed...
     rc = mdbx_txn_commit(txn->mdbx_txn);
+    if (unlikely(cancelled))
+      rc = FPTA_TXN_CANCELLED;
   } else if (!abort) {
     if (txn->level == fpta_schema && txn->schema_version == txn->data_version) {
       rc = mdbx_canary_put(txn->mdbx_txn, nullptr);
@@ -294,14 +687,152 @@ int fpta_transaction_end(fpta_txn *txn, bool abort) {
   }
   txn->mdbx_txn = nullptr;
 
-  int err = fpta_db_unlock(txn->db, txn->level);
+  if (keyfilters_held) {
+    /* блокировка mdbx уже освобождена, но следующий писатель процесса
+     * получит фильтры и fpta_db_pkcache() только после учета
+     * результата фиксации */
+    if (!abort && rc == MDB_SUCCESS) {
+      fpta_keyfilter_commit(txn);
+      if (txn->db->pkcache)
+        fpta_pkcache_commit(txn);
+    } else
+      fpta_keyfilter_abort(txn);
+    fpta_keyfilter_release(txn->db);
+  }
+
+  fpta_db *db = txn->db;
+  const bool writer = txn->level >= fpta_write;
+  const bool committed = writer && !abort && rc == MDB_SUCCESS;
+  const uint64_t txnid = txn->data_version;
+  int err = fpta_db_unlock(db, txn->level, txn->epoch_slot);
   assert(err == 0);
   (void)err;
-  fpta_txn_free(txn->db, txn);
+  fpta_txn_free(db, txn);
 
+  if (writer && db->geometry.growth_step) {
+    /* размер также проверяется перед стартом следующей пишущей
+     * транзакции, здесь же он обновляется без задержки для нее */
+    err = fpta_geometry_adjust(db);
+    (void)err;
+  }
+
+  if (committed) {
+    fpta_readers_check(db);
+    if (db->durable) {
+      fpta_durable_commit(db, txnid);
+      /* ожидаем сохранения на диск уже после освобождения блокировок,
+       * чтобы следующие писатели попадали в этот же сброс */
+      if (db->durability == fpta_sync_group)
+        rc = fpta_durable_wait(db, txnid);
+    }
+  }
   return (fpta_error)rc;
 }
 
+//----------------------------------------------------------------------------
+
+/* Точки сохранения реализованы посредством вложенных транзакций mdbx.
+ * На время действия точки сохранения транзакция fpta работает через
+ * вложенную транзакцию, а родительская запоминается в стеке. */
+
+static void fpta_savepoint_pop(fpta_txn *txn) {
+  fpta_savepoint *savepoint = txn->savepoint;
+  txn->mdbx_txn = savepoint->parent;
+  txn->savepoint = savepoint->prev;
+  free(savepoint);
+}
+
+int fpta_savepoint_unwind(fpta_txn *txn, bool abort) {
+  int rc = FPTA_SUCCESS;
+  while (txn->savepoint) {
+    if (abort) {
+      /* отмена родительской транзакции отменяет и вложенные */
+      fpta_savepoint_pop(txn);
+    } else {
+      rc = fpta_savepoint_release(txn);
+      if (unlikely(rc != FPTA_SUCCESS))
+        abort = true;
+    }
+  }
+  return rc;
+}
+
+int fpta_savepoint_begin(fpta_txn *txn) {
+  if (unlikely(!fpta_txn_validate(txn, fpta_write)))
+    return FPTA_EINVAL;
+  /* изменение схемы внутри вложенной транзакции не поддерживается,
+   * так как при отмене mdbx закроет открытые в ней дескрипторы таблиц */
+  if (unlikely(txn->level != fpta_write))
+    return FPTA_EINVAL;
+  if (unlikely(txn->mdbx_txn == nullptr))
+    return FPTA_BAD_TXN;
+  /* mdbx не поддерживает вложенные транзакции в режиме MDB_WRITEMAP */
+  if (unlikely(txn->db->durability == fpta_async))
+    return FPTA_ENOIMP;
+
+  /* дескрипторы таблиц открываются заранее в основной транзакции,
+   * иначе открытые внутри точки сохранения будут закрыты при её отмене */
+  if (txn->savepoint == nullptr) {
+    int rc = fpta_dbi_preopen(txn);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
+
+  fpta_savepoint *savepoint =
+      (fpta_savepoint *)malloc(sizeof(fpta_savepoint));
+  if (unlikely(savepoint == nullptr))
+    return FPTA_ENOMEM;
+
+  MDB_txn *nested;
+  int rc = mdbx_txn_begin(txn->db->mdbx_env, txn->mdbx_txn, 0, &nested);
+  if (unlikely(rc != MDB_SUCCESS)) {
+    free(savepoint);
+    return rc;
+  }
+
+  savepoint->prev = txn->savepoint;
+  savepoint->parent = txn->mdbx_txn;
+  txn->savepoint = savepoint;
+  txn->mdbx_txn = nested;
+  return FPTA_SUCCESS;
+}
+
+int fpta_savepoint_rollback(fpta_txn *txn) {
+  if (unlikely(!fpta_txn_validate(txn, fpta_write)))
+    return FPTA_EINVAL;
+  if (unlikely(txn->savepoint == nullptr))
+    return FPTA_EINVAL;
+
+  /* вложенная транзакция могла быть уже отменена посредством
+   * fpta_inconsistent_abort() */
+  int rc = MDB_SUCCESS;
+  if (txn->mdbx_txn)
+    rc = mdbx_txn_abort(txn->mdbx_txn);
+  fpta_savepoint_pop(txn);
+  fpta_keyfilter_abort(txn);
+  return rc;
+}
+
+int fpta_savepoint_release(fpta_txn *txn) {
+  if (unlikely(!fpta_txn_validate(txn, fpta_write)))
+    return FPTA_EINVAL;
+  if (unlikely(txn->savepoint == nullptr))
+    return FPTA_EINVAL;
+
+  if (unlikely(txn->mdbx_txn == nullptr)) {
+    /* изменения уже отменены посредством fpta_inconsistent_abort() */
+    fpta_savepoint_pop(txn);
+    fpta_keyfilter_abort(txn);
+    return FPTA_BAD_TXN;
+  }
+
+  int rc = mdbx_txn_commit(txn->mdbx_txn);
+  fpta_savepoint_pop(txn);
+  if (unlikely(rc != MDB_SUCCESS))
+    fpta_keyfilter_abort(txn);
+  return rc;
+}
+
 int fpta_transaction_versions(fpta_txn *txn, uint64_t *data,
                               uint64_t *schema_version) {
   if (unlikely(!fpta_txn_validate(txn, fpta_read)))
@@ -331,6 +862,9 @@ int fpta_inconsistent_abort(fpta_txn *txn, int errnum) {
    * мы выполнили лишь часть операций. В таких случаях можно лишь
    * прервать/откатить всю транзакцию, что и делает эта функция.
    *
+   * Внутри точки сохранения отменяется только вложенная транзакция,
+   * а родительская остается доступной после fpta_savepoint_rollback().
+   *
    * Однако, могут быть ошибки отката транзакции, что потенциально является
    * более серьезной проблемой. */
 
@@ -341,5 +875,8 @@ int fpta_inconsistent_abort(fpta_txn *txn, int errnum) {
     errnum = FPTA_WANNA_DIE;
   }
   txn->mdbx_txn = nullptr;
+  fpta_keyfilter_abort(txn);
+  if (txn->savepoint == nullptr)
+    fpta_keyfilter_release(txn->db);
   return errnum;
 }
@@ -33,7 +33,9 @@ bool fpta_cursor_validate(const fpta_cursor *cursor, fpta_level min_level) {
 }
 
 int fpta_cursor_close(fpta_cursor *cursor) {
-  if (unlikely(!fpta_cursor_validate(cursor, fpta_read)))
+  /* курсоры отмененной транзакции также должны быть закрыты */
+  if (unlikely(cursor == nullptr || cursor->mdbx_cursor == nullptr ||
+               !fpta_txn_check(cursor->txn, fpta_read)))
     return FPTA_EINVAL;
 
   mdbx_cursor_close(cursor->mdbx_cursor);
@@ -41,9 +43,11 @@ int fpta_cursor_close(fpta_cursor *cursor) {
   return FPTA_SUCCESS;
 }
 
-int fpta_cursor_open(fpta_txn *txn, fpta_name *column_id, fpta_value range_from,
-                     fpta_value range_to, const fpta_filter *filter,
-                     fpta_cursor_options op, fpta_cursor **pcursor) {
+static int fpta_cursor_open_ex(fpta_txn *txn, fpta_name *column_id,
+                               fpta_value range_from, fpta_value range_to,
+                               const fpta_filter *filter,
+                               fpta_cursor_options op, bool skip_expired,
+                               fpta_cursor **pcursor) {
   if (unlikely(pcursor == nullptr))
     return FPTA_EINVAL;
   *pcursor = nullptr;
@@ -106,17 +110,35 @@ int fpta_cursor_open(fpta_txn *txn, fpta_name *column_id, fpta_value range_from,
   cursor->index.column_order = (unsigned)column_id->column.num;
   cursor->index.mdbx_dbi = column_id->mdbx_dbi;
 
+  cursor->expiry.column = skip_expired ? fpta_schema_expiry(table_id->table.def)
+                                       : -1;
+  if (cursor->expiry.column >= 0) {
+    cursor->expiry.now = fptu_now_coarse();
+    if ((unsigned)cursor->expiry.column == cursor->index.column_order) {
+      /* Курсор по индексу TTL-колонки: достаточно сдвинуть нижнюю границу
+       * диапазона за текущий момент времени, тогда все устаревшие строки
+       * окажутся вне диапазона без проверки каждой из них. */
+      if (range_from.type != fpta_datetime ||
+          range_from.datetime.fixedpoint <= cursor->expiry.now.fixedpoint) {
+        fptu_time bound = cursor->expiry.now;
+        bound.fixedpoint += 1;
+        range_from = fpta_value_datetime(bound);
+      }
+      cursor->expiry.column = -1;
+    }
+  }
+
   if (range_from.type != fpta_begin) {
-    rc = fpta_index_value2key(cursor->index.shove, range_from,
-                              cursor->range_from_key, true);
+    rc = fpta_index_value2key(table_id->table.def, cursor->index.column_order,
+                              range_from, cursor->range_from_key, true);
     if (unlikely(rc != FPTA_SUCCESS))
       goto bailout;
     assert(cursor->range_from_key.mdbx.iov_base != nullptr);
   }
 
   if (range_to.type != fpta_end) {
-    rc = fpta_index_value2key(cursor->index.shove, range_to,
-                              cursor->range_to_key, true);
+    rc = fpta_index_value2key(table_id->table.def, cursor->index.column_order,
+                              range_to, cursor->range_to_key, true);
     if (unlikely(rc != FPTA_SUCCESS))
       goto bailout;
     assert(cursor->range_to_key.mdbx.iov_base != nullptr);
@@ -143,6 +165,161 @@ bailout:
   return rc;
 }
 
+int fpta_cursor_open(fpta_txn *txn, fpta_name *column_id, fpta_value range_from,
+                     fpta_value range_to, const fpta_filter *filter,
+                     fpta_cursor_options op, fpta_cursor **pcursor) {
+  return fpta_cursor_open_ex(txn, column_id, range_from, range_to, filter, op,
+                             true, pcursor);
+}
+
+/* Устанавливает границы диапазона курсора по префиксу ключа.
+ *
+ * Ключи, начинающиеся с префикса (либо заканчивающиеся им для индексов
+ * last2first), образуют диапазон от самого префикса до его "преемника",
+ * т.е. префикса с увеличенным на единицу последним (либо первым)
+ * байтом, не равным 0xFF, за вычетом последующих (предыдущих) байтов.
+ * Если все байты префикса равны 0xFF, то диапазон не ограничен сверху.
+ *
+ * Ключи длиннее fpta_max_keylen хранятся в индексе усеченными и с хешем
+ * остатка, поэтому для длинного префикса диапазон строится по сохраняемой
+ * части, а весь префикс копируется для проверки значений колонки. */
+static int fpta_cursor_prefix_bounds(fpta_cursor *cursor,
+                                     const fpta_value &prefix) {
+  const fpta_table_schema *def = cursor->table_id->table.def;
+  const unsigned column = cursor->index.column_order;
+  const bool reverse = fpta_index_is_reverse(cursor->index.shove);
+  fpta_key &from = cursor->range_from_key;
+  fpta_key &to = cursor->range_to_key;
+
+  const fpta_shove_t *expression =
+      fpta_schema_extra_lookup(def, fpta_extra_expression, (int)column);
+  if (expression || (fpta_shove2type(def->columns[column]) & fptu_farray)) {
+    /* значения ключей вычисляются по выражению либо соответствуют
+     * элементам массива, поэтому не могут быть сверены с префиксом */
+    if (unlikely(prefix.binary_length > fpta_max_keylen))
+      return FPTA_EVALUE;
+    if (expression) {
+      /* префикс преобразуется так же, как значения колонки */
+      int rc = fpta_index_expr_value2key(def->columns[column], expression,
+                                         prefix, from);
+      if (unlikely(rc != FPTA_SUCCESS))
+        return rc;
+      if (unlikely(from.mdbx.iov_len > fpta_max_keylen))
+        return FPTA_EVALUE;
+    }
+  }
+
+  if (!expression) {
+    const uint8_t *bytes = (const uint8_t *)prefix.binary_data;
+    size_t length = prefix.binary_length;
+    if (length > fpta_max_keylen) {
+      cursor->prefix.data = malloc(length);
+      if (unlikely(cursor->prefix.data == nullptr))
+        return FPTA_ENOMEM;
+      memcpy(cursor->prefix.data, bytes, length);
+      cursor->prefix.length = length;
+      if (reverse)
+        bytes += length - fpta_max_keylen;
+      length = fpta_max_keylen;
+    }
+    from.mdbx.iov_base = from.place.longkey_msb.head;
+    from.mdbx.iov_len = length;
+    if (length)
+      memcpy(from.mdbx.iov_base, bytes, length);
+  }
+
+  uint8_t *const succ = (uint8_t *)to.place.longkey_msb.head;
+  const uint8_t *const bytes = (const uint8_t *)from.mdbx.iov_base;
+  size_t length = from.mdbx.iov_len;
+  if (!reverse) {
+    while (length > 0 && bytes[length - 1] == 0xFF)
+      --length;
+    if (length > 0) {
+      memcpy(succ, bytes, length);
+      succ[length - 1] += 1;
+      to.mdbx.iov_base = succ;
+      to.mdbx.iov_len = length;
+    }
+  } else {
+    size_t skip = 0;
+    while (skip < length && bytes[skip] == 0xFF)
+      ++skip;
+    if (skip < length) {
+      memcpy(succ, bytes + skip, length - skip);
+      succ[0] += 1;
+      to.mdbx.iov_base = succ;
+      to.mdbx.iov_len = length - skip;
+    }
+  }
+  return FPTA_SUCCESS;
+}
+
+/* Сверяет значение ключевой колонки с длинным префиксом. */
+static bool fpta_cursor_prefix_match(const fpta_cursor *cursor,
+                                     const fptu_ro &row) {
+  const fptu_field *field =
+      fptu_lookup_ro(row, cursor->index.column_order,
+                     fpta_shove2type(cursor->index.shove));
+  const fpta_value value = fpta_field2value(field);
+  if (value.binary_length < cursor->prefix.length)
+    return false;
+
+  const uint8_t *bytes = (const uint8_t *)value.binary_data;
+  if (fpta_index_is_reverse(cursor->index.shove))
+    bytes += value.binary_length - cursor->prefix.length;
+  return memcmp(bytes, cursor->prefix.data, cursor->prefix.length) == 0;
+}
+
+int fpta_cursor_open_prefix(fpta_txn *txn, fpta_name *column_id,
+                            fpta_value prefix, const fpta_filter *filter,
+                            fpta_cursor_options op, fpta_cursor **pcursor) {
+  if (unlikely(pcursor == nullptr))
+    return FPTA_EINVAL;
+  *pcursor = nullptr;
+
+  if (unlikely(prefix.type != fpta_string && prefix.type != fpta_binary))
+    return FPTA_ETYPE;
+  if (unlikely(prefix.binary_data == nullptr && prefix.binary_length))
+    return FPTA_EINVAL;
+
+  fpta_cursor *cursor;
+  int rc = fpta_cursor_open_ex(txn, column_id, fpta_value_begin(),
+                               fpta_value_end(), filter,
+                               (fpta_cursor_options)(op | fpta_dont_fetch),
+                               true, &cursor);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  const fptu_type type = fpta_shove2keytype(cursor->index.shove);
+  if (unlikely(!fpta_index_is_ordered(cursor->index.shove))) {
+    rc = FPTA_NO_INDEX;
+    goto bailout;
+  }
+  if (unlikely(type < fptu_96 || type == fptu_nested ||
+               (type == fptu_cstr) != (prefix.type == fpta_string))) {
+    rc = FPTA_ETYPE;
+    goto bailout;
+  }
+
+  rc = fpta_cursor_prefix_bounds(cursor, prefix);
+  if (unlikely(rc != FPTA_SUCCESS))
+    goto bailout;
+
+  cursor->options = op;
+  if ((op & fpta_dont_fetch) == 0) {
+    rc = fpta_cursor_move(cursor, fpta_first);
+    if (unlikely(rc != MDB_SUCCESS))
+      goto bailout;
+  }
+
+  *pcursor = cursor;
+  return FPTA_SUCCESS;
+
+bailout:
+  fpta_cursor_close(cursor);
+  return rc;
+}
+
 //----------------------------------------------------------------------------
 
 static int fpta_cursor_seek(fpta_cursor *cursor, MDB_cursor_op mdbx_seek_op,
@@ -291,18 +468,40 @@ static int fpta_cursor_seek(fpta_cursor *cursor, MDB_cursor_op mdbx_seek_op,
       goto eof;
     }
 
-    if (!cursor->filter)
+    if (!cursor->filter && cursor->expiry.column < 0)
       return FPTA_SUCCESS;
 
+    MDB_val pk_key;
     if (fpta_index_is_secondary(cursor->index.shove)) {
-      MDB_val pk_key = mdbx_data.sys;
+      pk_key = mdbx_data.sys;
       rc = mdbx_get(cursor->txn->mdbx_txn, cursor->table_id->mdbx_dbi, &pk_key,
                     &mdbx_data.sys);
       if (unlikely(rc != MDB_SUCCESS))
         return (rc != MDB_NOTFOUND) ? rc : (int)FPTA_INDEX_CORRUPTED;
+    } else
+      pk_key = cursor->current;
+
+    if (cursor->expiry.column >= 0 &&
+        fpta_row_is_expired(mdbx_data, (unsigned)cursor->expiry.column,
+                            cursor->expiry.now))
+      goto next;
+
+    if (!cursor->filter && !cursor->prefix.data)
+      return FPTA_SUCCESS;
+
+    if (fpta_schema_pk_stripped(cursor->table_id->table.def)) {
+      /* фильтр и префикс могут ссылаться на PK, поэтому проверяется
+       * полная строка */
+      rc = fpta_row_materialize(cursor->table_id, pk_key, mdbx_data,
+                                cursor->rowbuf);
+      if (unlikely(rc != FPTA_SUCCESS))
+        return rc;
     }
 
-    if (fpta_filter_match(cursor->filter, mdbx_data))
+    if (cursor->prefix.data && !fpta_cursor_prefix_match(cursor, mdbx_data))
+      goto next;
+
+    if (!cursor->filter || fpta_filter_match(cursor->filter, mdbx_data))
       return FPTA_SUCCESS;
 
   next:
@@ -451,6 +650,13 @@ int fpta_cursor_move(fpta_cursor *cursor, fpta_seek_operations op) {
                           nullptr);
 }
 
+int fpta_cursor_step(fpta_cursor *cursor) {
+  assert(cursor->is_filled());
+  const MDB_cursor_op step_op =
+      fpta_cursor_is_descending(cursor->options) ? MDB_PREV : MDB_NEXT;
+  return fpta_cursor_seek(cursor, step_op, step_op, nullptr, nullptr);
+}
+
 int fpta_cursor_locate(fpta_cursor *cursor, bool exactly, const fpta_value *key,
                        const fptu_ro *row) {
   if (unlikely(!fpta_cursor_validate(cursor, fpta_read)))
@@ -481,7 +687,8 @@ int fpta_cursor_locate(fpta_cursor *cursor, bool exactly, const fpta_value *key,
   if (key) {
     /* Поиск по значению проиндексированной колонки, конвертируем его в ключ
      * для поиска по индексу. Дополнительных данных для поиска нет. */
-    rc = fpta_index_value2key(cursor->index.shove, *key, seek_key, false);
+    rc = fpta_index_value2key(cursor->table_id->table.def,
+                              cursor->index.column_order, *key, seek_key);
     if (unlikely(rc != FPTA_SUCCESS)) {
       cursor->set_poor();
       return rc;
@@ -490,8 +697,8 @@ int fpta_cursor_locate(fpta_cursor *cursor, bool exactly, const fpta_value *key,
   } else {
     /* Поиск по "образу" строки, получаем из строки-кортежа значение
      * проиндексированной колонки в формате ключа для поиска по индексу. */
-    rc = fpta_index_row2key(cursor->index.shove, cursor->index.column_order,
-                            *row, seek_key, false);
+    rc = fpta_index_row2key(cursor->table_id->table.def,
+                            cursor->index.column_order, *row, seek_key);
     if (unlikely(rc != FPTA_SUCCESS)) {
       cursor->set_poor();
       return rc;
@@ -642,7 +849,7 @@ int fpta_cursor_count(fpta_cursor *cursor, size_t *pcount, size_t limit) {
   int rc = fpta_cursor_move(cursor, fpta_first);
   while (rc == FPTA_SUCCESS && count < limit) {
     ++count;
-    rc = fpta_cursor_move(cursor, fpta_next);
+    rc = fpta_cursor_step(cursor);
   }
 
   if (rc == FPTA_NODATA) {
@@ -654,6 +861,194 @@ int fpta_cursor_count(fpta_cursor *cursor, size_t *pcount, size_t limit) {
   return rc;
 }
 
+//----------------------------------------------------------------------------
+
+int fpta_cursor_fetch(fpta_cursor *cursor, MDB_val &pk_key, fptu_ro &row) {
+  if (fpta_index_is_primary(cursor->index.shove))
+    return mdbx_cursor_get(cursor->mdbx_cursor, &pk_key, &row.sys,
+                           MDB_GET_CURRENT);
+
+  int rc = mdbx_cursor_get(cursor->mdbx_cursor, &cursor->current, &pk_key,
+                           MDB_GET_CURRENT);
+  if (unlikely(rc != MDB_SUCCESS))
+    return rc;
+
+  rc = mdbx_get(cursor->txn->mdbx_txn, cursor->table_id->mdbx_dbi, &pk_key,
+                &row.sys);
+  if (unlikely(rc != MDB_SUCCESS))
+    return (rc != MDB_NOTFOUND) ? rc : (int)FPTA_INDEX_CORRUPTED;
+  return FPTA_SUCCESS;
+}
+
+struct fpta_topk_item {
+  fpta_value value;
+  fptu_ro row;
+  MDB_val pk_key;
+  /* порядковый номер строки в курсоре, для сохранения порядка при
+   * равных значениях */
+  size_t seq;
+};
+
+/* Сравнивает значения одной колонки, т.е. одинакового типа. */
+static int fpta_topk_cmp(const fpta_value &a, const fpta_value &b) {
+  assert(a.type == b.type);
+  switch (a.type) {
+  case fpta_signed_int:
+    return fptu_cmp2int(a.sint, b.sint);
+  case fpta_unsigned_int:
+    return fptu_cmp2int(a.uint, b.uint);
+  case fpta_float_point:
+    return fptu_cmp2int(a.fp, b.fp);
+  case fpta_datetime:
+    return fptu_cmp2int(a.datetime.fixedpoint, b.datetime.fixedpoint);
+  default: {
+    assert(a.type == fpta_string || a.type == fpta_binary);
+    const size_t shortest =
+        (a.binary_length < b.binary_length) ? a.binary_length : b.binary_length;
+    const int diff = memcmp(a.binary_data, b.binary_data, shortest);
+    return diff ? diff : fptu_cmp2int(a.binary_length, b.binary_length);
+  }
+  }
+}
+
+static __inline size_t fpta_topk_align(size_t bytes) {
+  return (bytes + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+}
+
+/* Восстанавливает исключенный PK для отобранных строк, размещая их копии
+ * подряд в буфере курсора. */
+static int fpta_topk_materialize(fpta_cursor *cursor, fpta_topk_item *items,
+                                 size_t count) {
+  size_t total = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const size_t bytes = fpta_row_materialize_bytes(items[i].row);
+    if (unlikely(bytes == 0))
+      return FPTA_EOOPS;
+    total += fpta_topk_align(bytes);
+  }
+
+  if (cursor->rowbuf.size < total) {
+    void *ptr = realloc(cursor->rowbuf.ptr, total);
+    if (unlikely(ptr == nullptr))
+      return FPTA_ENOMEM;
+    cursor->rowbuf.ptr = ptr;
+    cursor->rowbuf.size = total;
+  }
+
+  uint8_t *place = (uint8_t *)cursor->rowbuf.ptr;
+  for (size_t i = 0; i < count; ++i) {
+    fpta_rowbuf rowbuf;
+    rowbuf.ptr = place;
+    rowbuf.size = fpta_row_materialize_bytes(items[i].row);
+    int rc = fpta_row_materialize(cursor->table_id, items[i].pk_key,
+                                  items[i].row, rowbuf);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+    assert(rowbuf.ptr == place);
+    place += fpta_topk_align(rowbuf.size);
+  }
+  return FPTA_SUCCESS;
+}
+
+int fpta_topk(fpta_cursor *cursor, fpta_name *column_id,
+              fpta_cursor_options order, size_t limit, fptu_ro *rows,
+              size_t *pcount) {
+  if (unlikely(pcount == nullptr))
+    return FPTA_EINVAL;
+  *pcount = 0;
+
+  if (unlikely(!fpta_cursor_validate(cursor, fpta_read)))
+    return FPTA_EINVAL;
+  if (unlikely(order != fpta_ascending && order != fpta_descending))
+    return FPTA_EINVAL;
+  if (unlikely(rows == nullptr && limit > 0))
+    return FPTA_EINVAL;
+  if (unlikely(limit > SIZE_MAX / sizeof(fpta_topk_item)))
+    return FPTA_EINVAL;
+  if (unlikely(!fpta_id_validate(column_id, fpta_column)))
+    return FPTA_EINVAL;
+
+  fpta_name *table_id = column_id->column.table;
+  if (unlikely(table_id->shove != cursor->table_id->shove))
+    return FPTA_EINVAL;
+  int rc = fpta_name_refresh_couple(cursor->txn, table_id, column_id);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  const fptu_type type = fpta_shove2type(column_id->shove);
+  if (unlikely(type == fptu_nested || (type & fptu_farray)))
+    return FPTA_ETYPE;
+
+  fpta_topk_item *heap = nullptr;
+  if (limit > 0) {
+    heap = (fpta_topk_item *)malloc(limit * sizeof(fpta_topk_item));
+    if (unlikely(heap == nullptr))
+      return FPTA_ENOMEM;
+  }
+
+  const fpta_table_schema *def = cursor->table_id->table.def;
+  const unsigned column = (unsigned)column_id->column.num;
+  /* значение исключенного из строк PK восстанавливается из ключа */
+  const bool pk_from_key = column == 0 && fpta_schema_pk_stripped(def);
+  const bool descending = order == fpta_descending;
+  /* Элемент a предшествует b в результате. Вершиной кучи с таким
+   * критерием является худший из отобранных элементов. */
+  const auto precedes = [descending](const fpta_topk_item &a,
+                                     const fpta_topk_item &b) {
+    const int cmp = fpta_topk_cmp(a.value, b.value);
+    if (cmp != 0)
+      return descending ? cmp > 0 : cmp < 0;
+    return a.seq < b.seq;
+  };
+
+  size_t used = 0, seq = 0;
+  rc = (limit > 0) ? fpta_cursor_move(cursor, fpta_first) : (int)FPTA_NODATA;
+  while (rc == FPTA_SUCCESS) {
+    fpta_topk_item item;
+    rc = fpta_cursor_fetch(cursor, item.pk_key, item.row);
+    if (unlikely(rc != FPTA_SUCCESS))
+      break;
+
+    if (pk_from_key) {
+      rc = fpta_index_key2value(cursor->table_id->table.pk, item.pk_key,
+                                item.value);
+      if (unlikely(rc != FPTA_SUCCESS))
+        break;
+    } else {
+      item.value = fpta_field2value(fptu_lookup_ro(item.row, column, type));
+    }
+
+    item.seq = seq++;
+    if (item.value.type != fpta_null) {
+      if (used < limit) {
+        heap[used++] = item;
+        std::push_heap(heap, heap + used, precedes);
+      } else if (precedes(item, heap[0])) {
+        std::pop_heap(heap, heap + used, precedes);
+        heap[used - 1] = item;
+        std::push_heap(heap, heap + used, precedes);
+      }
+    }
+    rc = fpta_cursor_step(cursor);
+  }
+  cursor->set_poor();
+
+  if (rc == FPTA_NODATA) {
+    std::sort_heap(heap, heap + used, precedes);
+    rc = fpta_schema_pk_stripped(def)
+             ? fpta_topk_materialize(cursor, heap, used)
+             : (int)FPTA_SUCCESS;
+    if (likely(rc == FPTA_SUCCESS)) {
+      for (size_t i = 0; i < used; ++i)
+        rows[i] = heap[i].row;
+      *pcount = used;
+    }
+  }
+
+  free(heap);
+  return rc;
+}
+
 int fpta_cursor_dups(fpta_cursor *cursor, size_t *pdups) {
   if (unlikely(pdups == nullptr))
     return FPTA_EINVAL;
@@ -689,19 +1084,19 @@ int fpta_cursor_get(fpta_cursor *cursor, fptu_ro *row) {
   if (unlikely(!cursor->is_filled()))
     return cursor->unladed_state();
 
-  if (fpta_index_is_primary(cursor->index.shove))
-    return mdbx_cursor_get(cursor->mdbx_cursor, &cursor->current, &row->sys,
-                           MDB_GET_CURRENT);
-
   MDB_val pk_key;
-  int rc = mdbx_cursor_get(cursor->mdbx_cursor, &cursor->current, &pk_key,
-                           MDB_GET_CURRENT);
+  int rc = fpta_cursor_fetch(cursor, pk_key, *row);
   if (unlikely(rc != MDB_SUCCESS))
     return rc;
 
-  rc = mdbx_get(cursor->txn->mdbx_txn, cursor->table_id->mdbx_dbi, &pk_key,
-                &row->sys);
-  return (rc != MDB_NOTFOUND) ? rc : (int)FPTA_INDEX_CORRUPTED;
+  if (fpta_schema_pk_stripped(cursor->table_id->table.def)) {
+    rc = fpta_row_materialize(cursor->table_id, pk_key, *row, cursor->rowbuf);
+    if (unlikely(rc != FPTA_SUCCESS)) {
+      row->total_bytes = 0;
+      row->units = nullptr;
+    }
+  }
+  return rc;
 }
 
 int fpta_cursor_key(fpta_cursor *cursor, fpta_value *key) {
@@ -724,12 +1119,30 @@ int fpta_cursor_delete(fpta_cursor *cursor) {
   if (unlikely(!cursor->is_filled()))
     return cursor->unladed_state();
 
+  const bool changelog = fpta_schema_changelog(cursor->table_id->table.def);
   if (!fpta_table_has_secondary(cursor->table_id)) {
+    /* курсор открыт по PK, ключ которого после удаления станет
+     * недоступен, поэтому для журнала он копируется */
+    MDB_val pk_key = cursor->current;
+    if (changelog)
+      pk_key.iov_base =
+          memcpy(alloca(pk_key.iov_len), pk_key.iov_base, pk_key.iov_len);
+
+    fpta_pk_changed(cursor->txn, cursor->table_id, pk_key);
     int rc = mdbx_cursor_del(cursor->mdbx_cursor, 0);
     if (unlikely(rc != FPTA_SUCCESS)) {
       cursor->set_poor();
       return rc;
     }
+
+    if (changelog) {
+      rc = fpta_changelog_append(cursor->txn, cursor->table_id,
+                                 fpta_change_delete, pk_key, fptu_ro());
+      if (unlikely(rc != FPTA_SUCCESS)) {
+        cursor->set_poor();
+        return fpta_inconsistent_abort(cursor->txn, rc);
+      }
+    }
   } else {
     MDB_val pk_key;
     if (fpta_index_is_primary(cursor->index.shove)) {
@@ -761,6 +1174,7 @@ int fpta_cursor_delete(fpta_cursor *cursor) {
     old.sys.iov_base = buffer;
     old.sys.iov_len = likely_enough;
 
+    fpta_pk_changed(cursor->txn, cursor->table_id, pk_key);
     int rc = mdbx_replace(cursor->txn->mdbx_txn, cursor->table_id->mdbx_dbi,
                           &pk_key, nullptr, &old.sys, MDB_CURRENT);
     if (unlikely(rc == MDBX_RESULT_TRUE)) {
@@ -774,8 +1188,24 @@ int fpta_cursor_delete(fpta_cursor *cursor) {
       return rc;
     }
 
+    MDB_val stepover_key = cursor->current;
+    if (fpta_shove_is_multivalued(cursor->index.shove)) {
+      /* Из мульти-индекса, по которому открыт курсор, сначала удаляются
+       * пары для остальных элементов массива, что может переместить
+       * данные внутри страниц, поэтому ключ и PK копируются. */
+      stepover_key.iov_base = memcpy(alloca(stepover_key.iov_len),
+                                     stepover_key.iov_base,
+                                     stepover_key.iov_len);
+      pk_key.iov_base =
+          memcpy(alloca(pk_key.iov_len), pk_key.iov_base, pk_key.iov_len);
+    } else if (changelog) {
+      /* PK требуется для журнала после удаления из индексов */
+      pk_key.iov_base =
+          memcpy(alloca(pk_key.iov_len), pk_key.iov_base, pk_key.iov_len);
+    }
+
     rc = fpta_secondary_remove(cursor->txn, cursor->table_id, pk_key, old,
-                               cursor->index.column_order);
+                               cursor->index.column_order, &stepover_key);
     if (unlikely(rc != MDB_SUCCESS)) {
       cursor->set_poor();
       return fpta_inconsistent_abort(cursor->txn, rc);
@@ -788,6 +1218,15 @@ int fpta_cursor_delete(fpta_cursor *cursor) {
         return fpta_inconsistent_abort(cursor->txn, rc);
       }
     }
+
+    if (changelog) {
+      rc = fpta_changelog_append(cursor->txn, cursor->table_id,
+                                 fpta_change_delete, pk_key, fptu_ro());
+      if (unlikely(rc != FPTA_SUCCESS)) {
+        cursor->set_poor();
+        return fpta_inconsistent_abort(cursor->txn, rc);
+      }
+    }
   }
 
   if (fpta_cursor_is_descending(cursor->options)) {
@@ -808,6 +1247,437 @@ int fpta_cursor_delete(fpta_cursor *cursor) {
 
 //----------------------------------------------------------------------------
 
+/* Пакет отложенных удалений для fpta_delete_range().
+ *
+ * Копии ключей накапливаются в общем буфере, а после заполнения пакета
+ * сортируются по индексам и порядку ключей внутри каждого индекса. Такое
+ * удаление затрагивает страницы b-tree последовательно, вместо случайного
+ * доступа при построчном удалении через fpta_cursor_delete(). */
+struct fpta_purge_item {
+  unsigned index;
+  unsigned fk_len, pk_len;
+  size_t fk_offset, pk_offset;
+};
+
+struct fpta_purge_batch {
+  fpta_purge_batch(const fpta_purge_batch &) = delete;
+  fpta_purge_batch()
+      : arena(nullptr), arena_size(0), arena_used(0), items(nullptr),
+        items_size(0), items_used(0), rows(0) {}
+  ~fpta_purge_batch() {
+    free(arena);
+    free(items);
+  }
+
+  char *arena;
+  size_t arena_size, arena_used;
+  fpta_purge_item *items;
+  size_t items_size, items_used;
+  size_t rows;
+
+  MDB_val fk(const fpta_purge_item &item) const {
+    MDB_val val;
+    val.iov_base = arena + item.fk_offset;
+    val.iov_len = item.fk_len;
+    return val;
+  }
+
+  MDB_val pk(const fpta_purge_item &item) const {
+    MDB_val val;
+    val.iov_base = arena + item.pk_offset;
+    val.iov_len = item.pk_len;
+    return val;
+  }
+
+  int store(const MDB_val &val, size_t &offset) {
+    if (unlikely(arena_used + val.iov_len > arena_size)) {
+      size_t wanna = arena_size ? arena_size * 2 : 4096 * 16;
+      while (wanna < arena_used + val.iov_len)
+        wanna += wanna;
+      char *ptr = (char *)realloc(arena, wanna);
+      if (unlikely(!ptr))
+        return FPTA_ENOMEM;
+      arena = ptr;
+      arena_size = wanna;
+    }
+    offset = arena_used;
+    if (val.iov_len)
+      memcpy(arena + arena_used, val.iov_base, val.iov_len);
+    arena_used += val.iov_len;
+    return FPTA_SUCCESS;
+  }
+
+  int add(unsigned index, const MDB_val &fk_key, size_t pk_offset,
+          size_t pk_len) {
+    if (unlikely(items_used == items_size)) {
+      size_t wanna =
+          items_size ? items_size * 2 : (size_t)fpta_purge_batch_rows;
+      fpta_purge_item *ptr =
+          (fpta_purge_item *)realloc(items, wanna * sizeof(fpta_purge_item));
+      if (unlikely(!ptr))
+        return FPTA_ENOMEM;
+      items = ptr;
+      items_size = wanna;
+    }
+
+    fpta_purge_item &item = items[items_used];
+    item.index = index;
+    item.fk_len = (unsigned)fk_key.iov_len;
+    item.pk_len = (unsigned)pk_len;
+    item.pk_offset = pk_offset;
+    int rc = store(fk_key, item.fk_offset);
+    if (likely(rc == FPTA_SUCCESS))
+      ++items_used;
+    return rc;
+  }
+
+  void reset() {
+    arena_used = 0;
+    items_used = 0;
+    rows = 0;
+  }
+};
+
+static int fpta_purge_flush(fpta_txn *txn, const MDB_dbi *dbi,
+                            fpta_purge_batch &batch) {
+  MDB_txn *mdbx_txn = txn->mdbx_txn;
+  std::sort(batch.items, batch.items + batch.items_used,
+            [&](const fpta_purge_item &a, const fpta_purge_item &b) {
+              if (a.index != b.index)
+                return a.index < b.index;
+              const MDB_val a_fk = batch.fk(a), b_fk = batch.fk(b);
+              int cmp = mdbx_cmp(mdbx_txn, dbi[a.index], &a_fk, &b_fk);
+              if (cmp == 0 && a.index > 0) {
+                const MDB_val a_pk = batch.pk(a), b_pk = batch.pk(b);
+                cmp = mdbx_dcmp(mdbx_txn, dbi[a.index], &a_pk, &b_pk);
+              }
+              return cmp < 0;
+            });
+
+  for (size_t i = 0; i < batch.items_used; ++i) {
+    const fpta_purge_item &item = batch.items[i];
+    MDB_val fk_key = batch.fk(item);
+    MDB_val pk_key = batch.pk(item);
+    /* для первичного индекса fk_key совпадает с pk_key, а сама строка
+     * удаляется без уточнения по данным (PK в этом случае уникален) */
+    int rc = mdbx_del(mdbx_txn, dbi[item.index], &fk_key,
+                      item.index ? &pk_key : nullptr);
+    if (unlikely(rc != MDB_SUCCESS))
+      return (rc != MDB_NOTFOUND) ? rc : (int)FPTA_INDEX_CORRUPTED;
+  }
+
+  batch.reset();
+  return FPTA_SUCCESS;
+}
+
+/* Удаляет из мульти-индекса, по которому открыт курсор, пары строки
+ * для всех элементов массива, кроме текущего. */
+static int fpta_purge_multi(fpta_txn *txn, MDB_dbi dbi, fpta_cursor *cursor,
+                            const fptu_ro &row, MDB_val pk_key) {
+  const unsigned column = cursor->index.column_order;
+  fpta_keyset keyset;
+  int rc = fpta_index_row2keys(cursor->index.shove, column, row, keyset);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  /* ключ курсора может быть перемещен при удалении, поэтому текущий
+   * элемент определяется заранее */
+  size_t current = keyset.count;
+  for (size_t i = 0; i < keyset.count && current == keyset.count; ++i)
+    if (fpta_is_same(keyset.keys[i].mdbx, cursor->current))
+      current = i;
+  if (unlikely(current == keyset.count))
+    return FPTA_INDEX_CORRUPTED;
+
+  for (size_t i = 0; i < keyset.count; ++i) {
+    MDB_val &key = keyset.keys[i].mdbx;
+    if (keyset.contains(key, i) ||
+        fpta_is_same(key, keyset.keys[current].mdbx))
+      continue;
+    rc = mdbx_del(txn->mdbx_txn, dbi, &key, &pk_key);
+    if (unlikely(rc != MDB_SUCCESS))
+      return (rc != MDB_NOTFOUND) ? rc : (int)FPTA_INDEX_CORRUPTED;
+  }
+  return FPTA_SUCCESS;
+}
+
+/* Удаляет не более limit строк из диапазона курсора, открытого
+ * посредством fpta_cursor_open_ex() в порядке возрастания ключей.
+ * Строка учитывается однократно, в том числе при переборе по мульти-индексу,
+ * где она могла бы встретиться для нескольких элементов массива. */
+static int fpta_cursor_purge(fpta_cursor *cursor, size_t limit,
+                             size_t *deleted) {
+  fpta_txn *txn = cursor->txn;
+  fpta_name *table_id = cursor->table_id;
+  int rc;
+  if (unlikely(table_id->mdbx_dbi < 1)) {
+    rc = fpta_open_table(txn, table_id);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
+
+  MDB_dbi dbi[fpta_max_indexes];
+  rc = fpta_open_secondaries(txn, table_id, dbi);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  /* Записи в индексе, по которому идет перебор, удаляются сразу через
+   * курсор. Удаление из остальных индексов откладывается и выполняется
+   * пакетами. Строки из основной таблицы при переборе по вторичному индексу
+   * также удаляются пакетно, но только при уникальном PK, так как иначе
+   * для удаления конкретного дубликата потребовалось бы копировать строку. */
+  const unsigned scan = cursor->index.column_order;
+  const bool scan_multi = fpta_shove_is_multivalued(cursor->index.shove);
+  const bool defer_primary =
+      scan != 0 && fpta_index_is_unique(table_id->table.pk);
+  const bool has_secondary = fpta_table_has_secondary(table_id);
+  const bool changelog = fpta_schema_changelog(table_id->table.def);
+  fpta_purge_batch batch;
+
+  rc = (limit > 0) ? fpta_cursor_move(cursor, fpta_first) : (int)FPTA_NODATA;
+  while (rc == FPTA_SUCCESS) {
+    fptu_ro row;
+    MDB_val pk_key;
+    if (scan == 0) {
+      rc = mdbx_cursor_get(cursor->mdbx_cursor, &pk_key, &row.sys,
+                           MDB_GET_CURRENT);
+      if (unlikely(rc != MDB_SUCCESS))
+        break;
+    } else {
+      rc = mdbx_cursor_get(cursor->mdbx_cursor, &cursor->current, &pk_key,
+                           MDB_GET_CURRENT);
+      if (unlikely(rc != MDB_SUCCESS))
+        break;
+      rc = mdbx_get(txn->mdbx_txn, dbi[0], &pk_key, &row.sys);
+      if (unlikely(rc != MDB_SUCCESS)) {
+        rc = (rc != MDB_NOTFOUND) ? rc : (int)FPTA_INDEX_CORRUPTED;
+        break;
+      }
+    }
+
+    if (defer_primary || has_secondary) {
+      size_t pk_offset;
+      rc = batch.store(pk_key, pk_offset);
+      if (unlikely(rc != FPTA_SUCCESS))
+        break;
+
+      if (defer_primary) {
+        rc = batch.add(0, pk_key, pk_offset, pk_key.iov_len);
+        if (unlikely(rc != FPTA_SUCCESS))
+          break;
+      }
+
+      for (unsigned i = 1; i < table_id->table.def->count; ++i) {
+        const auto shove = table_id->table.def->columns[i];
+        if (fpta_shove2index(shove) == fpta_index_none)
+          break;
+        if (i == scan || !fpta_index_row_match(table_id->table.def, i, row))
+          continue;
+
+        if (fpta_shove_is_multivalued(shove)) {
+          fpta_keyset keyset;
+          rc = fpta_index_row2keys(shove, i, row, keyset);
+          for (size_t k = 0; rc == FPTA_SUCCESS && k < keyset.count; ++k) {
+            if (!keyset.contains(keyset.keys[k].mdbx, k))
+              rc = batch.add(i, keyset.keys[k].mdbx, pk_offset,
+                             pk_key.iov_len);
+          }
+          if (unlikely(rc != FPTA_SUCCESS))
+            break;
+          continue;
+        }
+
+        fpta_key fk_key;
+        rc = fpta_index_row2key(table_id->table.def, i, row, fk_key);
+        if (unlikely(rc != FPTA_SUCCESS))
+          break;
+        rc = batch.add(i, fk_key.mdbx, pk_offset, pk_key.iov_len);
+        if (unlikely(rc != FPTA_SUCCESS))
+          break;
+      }
+      if (unlikely(rc != FPTA_SUCCESS))
+        break;
+    }
+
+    fpta_pk_changed(txn, table_id, pk_key);
+    fpta_key pk_copy;
+    if (scan_multi) {
+      /* В мульти-индексе строка встречается для каждого элемента массива,
+       * поэтому пары остальных элементов удаляются сразу, иначе курсор
+       * вернулся бы к уже удаленной строке. При этом данные внутри страниц
+       * могут быть перемещены, поэтому PK копируется. */
+      assert(pk_key.iov_len <= sizeof(pk_copy.place));
+      pk_key.iov_base = memcpy(&pk_copy.place, pk_key.iov_base, pk_key.iov_len);
+      rc = fpta_purge_multi(txn, dbi[scan], cursor, row, pk_key);
+      if (unlikely(rc != FPTA_SUCCESS))
+        break;
+    }
+
+    /* ключ PK копируется для журнала, так как после удаления строки
+     * pk_key может указывать на освобожденное место в странице */
+    fpta_key changelog_key;
+    if (changelog) {
+      assert(pk_key.iov_len <= sizeof(changelog_key.place));
+      changelog_key.mdbx.iov_len = pk_key.iov_len;
+      changelog_key.mdbx.iov_base =
+          memcpy(&changelog_key.place, pk_key.iov_base, pk_key.iov_len);
+    }
+
+    if (scan != 0 && !defer_primary) {
+      rc = mdbx_del(txn->mdbx_txn, dbi[0], &pk_key, &row.sys);
+      if (unlikely(rc != MDB_SUCCESS)) {
+        rc = (rc != MDB_NOTFOUND) ? rc : (int)FPTA_INDEX_CORRUPTED;
+        break;
+      }
+    }
+
+    rc = mdbx_cursor_del(cursor->mdbx_cursor, 0);
+    if (unlikely(rc != MDB_SUCCESS))
+      break;
+    *deleted += 1;
+
+    if (changelog) {
+      rc = fpta_changelog_append(txn, table_id, fpta_change_delete,
+                                 changelog_key.mdbx, fptu_ro());
+      if (unlikely(rc != FPTA_SUCCESS))
+        break;
+    }
+
+    if (++batch.rows >= fpta_purge_batch_rows) {
+      rc = fpta_purge_flush(txn, dbi, batch);
+      if (unlikely(rc != FPTA_SUCCESS))
+        break;
+    }
+
+    if (*deleted >= limit ||
+        mdbx_cursor_eof(cursor->mdbx_cursor) == MDBX_RESULT_TRUE) {
+      rc = FPTA_NODATA;
+      break;
+    }
+    /* после удаления курсор уже стоит на следующей записи, которую
+     * остается проверить на соответствие диапазону и фильтру */
+    rc = fpta_cursor_seek(cursor, MDB_GET_CURRENT, MDB_NEXT, nullptr, nullptr);
+  }
+
+  if (rc == FPTA_NODATA)
+    rc = fpta_purge_flush(txn, dbi, batch);
+  return rc;
+}
+
+static int fpta_cursor_purge_close(fpta_cursor *cursor, int rc,
+                                   size_t deleted) {
+  fpta_txn *txn = cursor->txn;
+  fpta_cursor_close(cursor);
+  if (unlikely(rc != FPTA_SUCCESS && deleted > 0)) {
+    /* часть строк уже удалена, поэтому для согласованности
+     * индексов и данных транзакция прерывается */
+    return fpta_inconsistent_abort(txn, rc);
+  }
+  return rc;
+}
+
+int fpta_delete_range(fpta_txn *txn, fpta_name *column_id,
+                      fpta_value range_from, fpta_value range_to,
+                      const fpta_filter *filter, size_t *deleted) {
+  if (unlikely(deleted == nullptr))
+    return FPTA_EINVAL;
+  *deleted = 0;
+
+  if (unlikely(!fpta_txn_validate(txn, fpta_write)))
+    return FPTA_EINVAL;
+  if (unlikely(!fpta_id_validate(column_id, fpta_column)))
+    return FPTA_EINVAL;
+
+  const fpta_index_type index = fpta_shove2index(column_id->shove);
+  if (unlikely(index == fpta_index_none))
+    return FPTA_NO_INDEX;
+  /* устаревшие по TTL строки удаляются наравне с остальными */
+  fpta_cursor *cursor;
+  int rc = fpta_cursor_open_ex(txn, column_id, range_from, range_to, filter,
+                               fpta_index_is_ordered(index)
+                                   ? fpta_ascending_dont_fetch
+                                   : fpta_unsorted_dont_fetch,
+                               false, &cursor);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  rc = fpta_cursor_purge(cursor, SIZE_MAX, deleted);
+  return fpta_cursor_purge_close(cursor, rc, *deleted);
+}
+
+int fpta_expire(fpta_txn *txn, fpta_name *table_id, fptu_time now,
+                size_t budget, size_t *expired) {
+  size_t deleted = 0;
+  if (expired)
+    *expired = 0;
+
+  if (unlikely(!fpta_txn_validate(txn, fpta_write)))
+    return FPTA_EINVAL;
+
+  int rc = fpta_name_refresh_couple(txn, table_id, nullptr);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  const int column = fpta_schema_expiry(table_id->table.def);
+  if (unlikely(column < 0))
+    return FPTA_NO_INDEX;
+
+  fpta_name column_id;
+  rc = fpta_table_column_get(table_id, (unsigned)column, &column_id);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  /* строка устарела, если значение TTL-колонки не больше now,
+   * т.е. удаляется диапазон [begin, now + 1) */
+  fptu_time bound = now;
+  bound.fixedpoint += 1;
+  fpta_cursor *cursor;
+  rc = fpta_cursor_open_ex(txn, &column_id, fpta_value_begin(),
+                           fpta_value_datetime(bound), nullptr,
+                           fpta_ascending_dont_fetch, false, &cursor);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  rc = fpta_cursor_purge(cursor, budget, &deleted);
+  if (expired)
+    *expired = deleted;
+  return fpta_cursor_purge_close(cursor, rc, deleted);
+}
+
+//----------------------------------------------------------------------------
+
+/* Проверяет, что обновленная строка останется в той же позиции курсора,
+ * в том числе не выпадет из частичного индекса, и возвращает ключ этой
+ * позиции. Для мульти-индекса достаточно наличия в массиве текущего
+ * элемента, а ключ копируется, так как при обновлении пар остальных
+ * элементов данные внутри страниц могут быть перемещены. */
+static int fpta_cursor_update_key(fpta_cursor *cursor, const fptu_ro &row,
+                                  fpta_key &column_key) {
+  const fpta_table_schema *def = cursor->table_id->table.def;
+  const unsigned column = cursor->index.column_order;
+  if (fpta_shove_is_multivalued(cursor->index.shove)) {
+    fpta_keyset keyset;
+    int rc = fpta_index_row2keys(def->columns[column], column, row, keyset);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+    if (!keyset.contains(cursor->current))
+      return FPTA_KEY_MISMATCH;
+    assert(cursor->current.iov_len <= sizeof(column_key.place));
+    column_key.mdbx.iov_len = cursor->current.iov_len;
+    column_key.mdbx.iov_base = memcpy(
+        &column_key.place, cursor->current.iov_base, cursor->current.iov_len);
+  } else {
+    int rc = fpta_index_row2key(def, column, row, column_key);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+    if (!fpta_is_same(cursor->current, column_key.mdbx))
+      return FPTA_KEY_MISMATCH;
+  }
+
+  return fpta_index_row_match(def, column, row) ? FPTA_SUCCESS
+                                                : FPTA_KEY_MISMATCH;
+}
+
 int fpta_cursor_validate_update(fpta_cursor *cursor, fptu_ro new_row_value) {
   if (unlikely(!fpta_cursor_validate(cursor, fpta_write)))
     return FPTA_EINVAL;
@@ -816,14 +1686,10 @@ int fpta_cursor_validate_update(fpta_cursor *cursor, fptu_ro new_row_value) {
     return cursor->unladed_state();
 
   fpta_key column_key;
-  int rc = fpta_index_row2key(cursor->index.shove, cursor->index.column_order,
-                              new_row_value, column_key, false);
+  int rc = fpta_cursor_update_key(cursor, new_row_value, column_key);
   if (unlikely(rc != FPTA_SUCCESS))
     return rc;
 
-  if (!fpta_is_same(cursor->current, column_key.mdbx))
-    return FPTA_KEY_MISMATCH;
-
   if (!fpta_table_has_secondary(cursor->table_id))
     return FPTA_SUCCESS;
 
@@ -844,12 +1710,6 @@ int fpta_cursor_validate_update(fpta_cursor *cursor, fptu_ro new_row_value) {
   if (unlikely(rc != MDB_SUCCESS))
     return rc;
 
-  fpta_key new_pk_key;
-  rc = fpta_index_row2key(cursor->table_id->table.pk, 0, new_row_value,
-                          new_pk_key, false);
-  if (unlikely(rc != FPTA_SUCCESS))
-    return rc;
-
   rc = mdbx_get(cursor->txn->mdbx_txn, cursor->table_id->mdbx_dbi,
                 &present_pk_key, &present_row.sys);
   if (unlikely(rc != MDB_SUCCESS))
@@ -867,15 +1727,27 @@ int fpta_cursor_update(fpta_cursor *cursor, fptu_ro new_row_value) {
     return cursor->unladed_state();
 
   fpta_key column_key;
-  int rc = fpta_index_row2key(cursor->index.shove, cursor->index.column_order,
-                              new_row_value, column_key, false);
+  int rc = fpta_cursor_update_key(cursor, new_row_value, column_key);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  fpta_key new_pk_key;
+  rc = fpta_index_row2key(cursor->table_id->table.pk, 0, new_row_value,
+                          new_pk_key, false);
   if (unlikely(rc != FPTA_SUCCESS))
     return rc;
 
-  if (!fpta_is_same(cursor->current, column_key.mdbx))
-    return FPTA_KEY_MISMATCH;
+  if (fpta_schema_pk_stripped(cursor->table_id->table.def)) {
+    /* ключи уже получены из исходной строки, а сохраняется она без PK */
+    const size_t bytes = fpta_row_strip_bytes(new_row_value);
+    rc = fpta_row_strip(cursor->table_id, new_row_value, alloca(bytes), bytes);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
 
+  const bool changelog = fpta_schema_changelog(cursor->table_id->table.def);
   if (!fpta_table_has_secondary(cursor->table_id)) {
+    fpta_pk_changed(cursor->txn, cursor->table_id, new_pk_key.mdbx);
     rc = mdbx_cursor_put(cursor->mdbx_cursor, &column_key.mdbx,
                          &new_row_value.sys, MDB_CURRENT | MDB_NODUPDATA);
     if (likely(rc == MDB_SUCCESS) &&
@@ -885,9 +1757,20 @@ int fpta_cursor_update(fpta_cursor *cursor, fptu_ro new_row_value) {
       rc = mdbx_cursor_get(cursor->mdbx_cursor, &cursor->current, nullptr,
                            MDB_GET_CURRENT);
     }
-    if (unlikely(rc != MDB_SUCCESS))
+    if (unlikely(rc != MDB_SUCCESS)) {
       cursor->set_poor();
-    return rc;
+      return rc;
+    }
+    if (changelog) {
+      rc = fpta_changelog_append(cursor->txn, cursor->table_id,
+                                 fpta_change_update, new_pk_key.mdbx,
+                                 new_row_value);
+      if (unlikely(rc != FPTA_SUCCESS)) {
+        cursor->set_poor();
+        return fpta_inconsistent_abort(cursor->txn, rc);
+      }
+    }
+    return FPTA_SUCCESS;
   }
 
   MDB_val old_pk_key;
@@ -900,6 +1783,12 @@ int fpta_cursor_update(fpta_cursor *cursor, fptu_ro new_row_value) {
       cursor->set_poor();
       return (rc != MDB_NOTFOUND) ? rc : (int)FPTA_INDEX_CORRUPTED;
     }
+    if (fpta_shove_is_multivalued(cursor->index.shove)) {
+      /* пары для других элементов массива могут быть перемещены внутри
+       * страниц при обновлении мульти-индекса, поэтому PK копируется */
+      old_pk_key.iov_base = memcpy(alloca(old_pk_key.iov_len),
+                                   old_pk_key.iov_base, old_pk_key.iov_len);
+    }
   }
 
   /* Здесь не очевидный момент при обновлении с изменением PK:
@@ -929,12 +1818,6 @@ int fpta_cursor_update(fpta_cursor *cursor, fptu_ro new_row_value) {
     return (rc != MDB_NOTFOUND) ? rc : (int)FPTA_INDEX_CORRUPTED;
   }
 
-  fpta_key new_pk_key;
-  rc = fpta_index_row2key(cursor->table_id->table.pk, 0, new_row_value,
-                          new_pk_key, false);
-  if (unlikely(rc != FPTA_SUCCESS))
-    return rc;
-
 #if 0 /* LY: в данный момент нет необходимости */
   if (old_pk_key.iov_len > 0 &&
       mdbx_is_dirty(cursor->txn->mdbx_txn, old_pk_key.iov_base) !=
@@ -945,9 +1828,21 @@ int fpta_cursor_update(fpta_cursor *cursor, fptu_ro new_row_value) {
   }
 #endif
 
+  if (changelog) {
+    /* при изменении PK его прежнее значение требуется для журнала уже
+     * после удаления строки из основной таблицы, поэтому копируется */
+    old_pk_key.iov_base = memcpy(alloca(old_pk_key.iov_len),
+                                 old_pk_key.iov_base, old_pk_key.iov_len);
+  }
+
+  fpta_pk_changed(cursor->txn, cursor->table_id, old_pk_key);
+  fpta_pk_changed(cursor->txn, cursor->table_id, new_pk_key.mdbx);
+
+  /* в мульти-индексе пара текущего элемента, в том числе при изменении PK,
+   * обновляется ниже через курсор */
   rc = fpta_secondary_upsert(cursor->txn, cursor->table_id, old_pk_key, old,
                              new_pk_key.mdbx, new_row_value,
-                             cursor->index.column_order);
+                             cursor->index.column_order, &column_key.mdbx);
   if (unlikely(rc != MDB_SUCCESS)) {
     cursor->set_poor();
     return fpta_inconsistent_abort(cursor->txn, rc);
@@ -969,6 +1864,7 @@ int fpta_cursor_update(fpta_cursor *cursor, fptu_ro new_row_value) {
       cursor->set_poor();
       return fpta_inconsistent_abort(cursor->txn, rc);
     }
+    fpta_key_inserted(cursor->txn, cursor->table_id, 0, new_pk_key.mdbx);
 
     rc = mdbx_cursor_put(cursor->mdbx_cursor, &column_key.mdbx,
                          &new_pk_key.mdbx, MDB_CURRENT | MDB_NODUPDATA);
@@ -991,5 +1887,21 @@ int fpta_cursor_update(fpta_cursor *cursor, fptu_ro new_row_value) {
     return fpta_inconsistent_abort(cursor->txn, rc);
   }
 
+  if (changelog) {
+    /* изменение PK регистрируется как удаление и вставка строки */
+    if (pk_changed)
+      rc = fpta_changelog_append(cursor->txn, cursor->table_id,
+                                 fpta_change_delete, old_pk_key, fptu_ro());
+    if (likely(rc == FPTA_SUCCESS))
+      rc = fpta_changelog_append(
+          cursor->txn, cursor->table_id,
+          pk_changed ? fpta_change_insert : fpta_change_update,
+          new_pk_key.mdbx, new_row_value);
+    if (unlikely(rc != FPTA_SUCCESS)) {
+      cursor->set_poor();
+      return fpta_inconsistent_abort(cursor->txn, rc);
+    }
+  }
+
   return FPTA_SUCCESS;
 }
@@ -291,6 +291,147 @@ int fpta_upsert_column(fptu_rw *pt, const fpta_name *column_id,
 
 //----------------------------------------------------------------------------
 
+size_t fpta_row_strip_bytes(const fptu_ro &row) {
+  const char *error = nullptr;
+  const size_t bytes = fptu_check_and_get_buffer_size(row, 0, 0, &error);
+  return likely(error == nullptr) ? bytes : 0;
+}
+
+int fpta_row_strip(const fpta_name *table_id, fptu_ro &row, void *buffer,
+                   size_t bytes) {
+  assert(fpta_schema_pk_stripped(table_id->table.def));
+  if (unlikely(bytes == 0))
+    return FPTA_EINVAL;
+
+  fptu_rw *pt = fptu_fetch(row, buffer, bytes, 0);
+  if (unlikely(pt == nullptr))
+    return FPTA_EINVAL;
+
+  if (unlikely(fptu_erase(pt, 0, fpta_shove2type(table_id->table.pk)) < 1))
+    return FPTA_COLUMN_MISSING;
+
+  row = fptu_take(pt);
+  return FPTA_SUCCESS;
+}
+
+size_t fpta_row_materialize_bytes(const fptu_ro &row) {
+  const char *error = nullptr;
+  const size_t bytes = fptu_check_and_get_buffer_size(row, 1, 256 / 8, &error);
+  return likely(error == nullptr) ? bytes : 0;
+}
+
+int fpta_row_materialize(const fpta_name *table_id, const MDB_val &pk_key,
+                         fptu_ro &row, fpta_rowbuf &rowbuf) {
+  assert(fpta_schema_pk_stripped(table_id->table.def));
+  const size_t bytes = fpta_row_materialize_bytes(row);
+  if (unlikely(bytes == 0))
+    return FPTA_EOOPS;
+
+  if (rowbuf.size < bytes) {
+    void *ptr = realloc(rowbuf.ptr, bytes);
+    if (unlikely(ptr == nullptr))
+      return FPTA_ENOMEM;
+    rowbuf.ptr = ptr;
+    rowbuf.size = bytes;
+  }
+
+  fptu_rw *pt = fptu_fetch(row, rowbuf.ptr, rowbuf.size, 1);
+  if (unlikely(pt == nullptr))
+    return FPTA_EOOPS;
+
+  /* Допускаются только типы, для которых ключ является точной копией
+   * значения (см. fpta_index_row2key), поэтому значение восстанавливается
+   * непосредственно из ключа. */
+  const fptu_type type = fpta_shove2type(table_id->table.pk);
+  int rc;
+  switch (type) {
+  default:
+    return FPTA_EOOPS;
+
+  case fptu_uint16:
+    if (unlikely(pk_key.iov_len != sizeof(uint32_t)))
+      return FPTA_INDEX_CORRUPTED;
+    rc = fptu_upsert_uint16(pt, 0, *(uint32_t *)pk_key.iov_base);
+    break;
+
+  case fptu_int32:
+    if (unlikely(pk_key.iov_len != sizeof(int32_t)))
+      return FPTA_INDEX_CORRUPTED;
+    rc = fptu_upsert_int32(pt, 0, *(int32_t *)pk_key.iov_base);
+    break;
+
+  case fptu_uint32:
+    if (unlikely(pk_key.iov_len != sizeof(uint32_t)))
+      return FPTA_INDEX_CORRUPTED;
+    rc = fptu_upsert_uint32(pt, 0, *(uint32_t *)pk_key.iov_base);
+    break;
+
+  case fptu_fp32:
+    if (unlikely(pk_key.iov_len != sizeof(float)))
+      return FPTA_INDEX_CORRUPTED;
+    rc = fptu_upsert_fp32(pt, 0, *(float *)pk_key.iov_base);
+    break;
+
+  case fptu_int64:
+    if (unlikely(pk_key.iov_len != sizeof(int64_t)))
+      return FPTA_INDEX_CORRUPTED;
+    rc = fptu_upsert_int64(pt, 0, *(int64_t *)pk_key.iov_base);
+    break;
+
+  case fptu_uint64:
+    if (unlikely(pk_key.iov_len != sizeof(uint64_t)))
+      return FPTA_INDEX_CORRUPTED;
+    rc = fptu_upsert_uint64(pt, 0, *(uint64_t *)pk_key.iov_base);
+    break;
+
+  case fptu_fp64:
+    if (unlikely(pk_key.iov_len != sizeof(double)))
+      return FPTA_INDEX_CORRUPTED;
+    rc = fptu_upsert_fp64(pt, 0, *(double *)pk_key.iov_base);
+    break;
+
+  case fptu_datetime: {
+    if (unlikely(pk_key.iov_len != sizeof(uint64_t)))
+      return FPTA_INDEX_CORRUPTED;
+    fptu_time datetime;
+    datetime.fixedpoint = *(uint64_t *)pk_key.iov_base;
+    rc = fptu_upsert_datetime(pt, 0, datetime);
+  } break;
+
+  case fptu_96:
+    if (unlikely(pk_key.iov_len != 96 / 8))
+      return FPTA_INDEX_CORRUPTED;
+    rc = fptu_upsert_96(pt, 0, pk_key.iov_base);
+    break;
+
+  case fptu_128:
+    if (unlikely(pk_key.iov_len != 128 / 8))
+      return FPTA_INDEX_CORRUPTED;
+    rc = fptu_upsert_128(pt, 0, pk_key.iov_base);
+    break;
+
+  case fptu_160:
+    if (unlikely(pk_key.iov_len != 160 / 8))
+      return FPTA_INDEX_CORRUPTED;
+    rc = fptu_upsert_160(pt, 0, pk_key.iov_base);
+    break;
+
+  case fptu_256:
+    if (unlikely(pk_key.iov_len != 256 / 8))
+      return FPTA_INDEX_CORRUPTED;
+    rc = fptu_upsert_256(pt, 0, pk_key.iov_base);
+    break;
+  }
+
+  if (unlikely(rc != FPTU_OK))
+    return FPTA_EOOPS;
+
+  row = fptu_take_noshrink(pt);
+  return FPTA_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+
 int fpta_validate_put(fpta_txn *txn, fpta_name *table_id, fptu_ro row_value,
                       fpta_put_options op) {
   if (unlikely(op < fpta_insert || op > fpta_upsert))
@@ -312,9 +453,15 @@ int fpta_validate_put(fpta_txn *txn, fpta_name *table_id, fptu_ro row_value,
   }
 
   fptu_ro present_row;
-  int rows_with_same_key;
-  rc = mdbx_get_ex(txn->mdbx_txn, table_id->mdbx_dbi, &pk_key.mdbx,
-                   &present_row.sys, &rows_with_same_key);
+  int rows_with_same_key = 0;
+  if (op == fpta_insert && fpta_index_is_unique(table_id->table.pk) &&
+      !fpta_key_maybe_exists(txn, table_id, 0, table_id->mdbx_dbi,
+                             pk_key.mdbx))
+    /* фильтр гарантирует отсутствие строки с таким PK */
+    rc = MDB_NOTFOUND;
+  else
+    rc = mdbx_get_ex(txn->mdbx_txn, table_id->mdbx_dbi, &pk_key.mdbx,
+                     &present_row.sys, &rows_with_same_key);
   if (rc != MDB_SUCCESS) {
     if (unlikely(rc != MDB_NOTFOUND))
       return rc;
@@ -347,8 +494,16 @@ int fpta_validate_put(fpta_txn *txn, fpta_name *table_id, fptu_ro row_value,
   }
 
   if (present_row.sys.iov_base) {
-    if (present_row.total_bytes == row_value.total_bytes &&
-        !memcmp(present_row.units, row_value.units, present_row.total_bytes))
+    fptu_ro stored_value = row_value;
+    if (fpta_schema_pk_stripped(table_id->table.def)) {
+      /* строка хранится без PK, поэтому сравнивается в таком же виде */
+      const size_t bytes = fpta_row_strip_bytes(row_value);
+      rc = fpta_row_strip(table_id, stored_value, alloca(bytes), bytes);
+      if (unlikely(rc != FPTA_SUCCESS))
+        return rc;
+    }
+    if (present_row.total_bytes == stored_value.total_bytes &&
+        !memcmp(present_row.units, stored_value.units, present_row.total_bytes))
       /* если полный дубликат записи */
       return MDB_KEYEXIST;
   }
@@ -393,9 +548,38 @@ int fpta_put(fpta_txn *txn, fpta_name *table_id, fptu_ro row,
       return rc;
   }
 
-  if (!fpta_table_has_secondary(table_id))
-    return mdbx_put(txn->mdbx_txn, table_id->mdbx_dbi, &pk_key.mdbx, &row.sys,
-                    flags);
+  if (fpta_schema_pk_stripped(table_id->table.def)) {
+    /* PK уже есть в ключе, поэтому в строке он не сохраняется. При этом
+     * pk_key по-прежнему ссылается на исходную строку, а для обновления
+     * вторичных индексов достаточно строки без PK. */
+    const size_t bytes = fpta_row_strip_bytes(row);
+    rc = fpta_row_strip(table_id, row, alloca(bytes), bytes);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
+
+  /* для журнала изменений при fpta_upsert требуется знать о наличии
+   * предыдущей версии строки, поэтому используется mdbx_replace() */
+  const bool changelog = fpta_schema_changelog(table_id->table.def);
+  if (!fpta_table_has_secondary(table_id) &&
+      (!changelog || op != fpta_upsert ||
+       !fpta_index_is_unique(table_id->table.pk))) {
+    rc = mdbx_put(txn->mdbx_txn, table_id->mdbx_dbi, &pk_key.mdbx, &row.sys,
+                  flags);
+    if (unlikely(rc != MDB_SUCCESS))
+      return rc;
+    fpta_key_inserted(txn, table_id, 0, pk_key.mdbx);
+    fpta_pk_changed(txn, table_id, pk_key.mdbx);
+    if (changelog) {
+      rc = fpta_changelog_append(
+          txn, table_id,
+          (op == fpta_update) ? fpta_change_update : fpta_change_insert,
+          pk_key.mdbx, row);
+      if (unlikely(rc != FPTA_SUCCESS))
+        return fpta_inconsistent_abort(txn, rc);
+    }
+    return FPTA_SUCCESS;
+  }
 
   fptu_ro old;
 #if defined(NDEBUG) && !defined(_MSC_VER)
@@ -417,11 +601,24 @@ int fpta_put(fpta_txn *txn, fpta_name *table_id, fptu_ro row,
   }
   if (unlikely(rc != MDB_SUCCESS))
     return rc;
+  fpta_key_inserted(txn, table_id, 0, pk_key.mdbx);
+  fpta_pk_changed(txn, table_id, pk_key.mdbx);
 
-  rc = fpta_secondary_upsert(txn, table_id, pk_key.mdbx, old, pk_key.mdbx, row,
-                             0);
-  if (unlikely(rc != MDB_SUCCESS))
-    return fpta_inconsistent_abort(txn, rc);
+  if (fpta_table_has_secondary(table_id)) {
+    rc = fpta_secondary_upsert(txn, table_id, pk_key.mdbx, old, pk_key.mdbx,
+                               row, 0);
+    if (unlikely(rc != MDB_SUCCESS))
+      return fpta_inconsistent_abort(txn, rc);
+  }
+
+  if (changelog) {
+    rc = fpta_changelog_append(
+        txn, table_id,
+        old.sys.iov_base ? fpta_change_update : fpta_change_insert,
+        pk_key.mdbx, row);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return fpta_inconsistent_abort(txn, rc);
+  }
 
   return FPTA_SUCCESS;
 }
@@ -447,6 +644,7 @@ int fpta_delete(fpta_txn *txn, fpta_name *table_id, fptu_ro row) {
   rc = mdbx_del(txn->mdbx_txn, table_id->mdbx_dbi, &key.mdbx, &row.sys);
   if (unlikely(rc != MDB_SUCCESS))
     return rc;
+  fpta_pk_changed(txn, table_id, key.mdbx);
 
   if (fpta_table_has_secondary(table_id)) {
     rc = fpta_secondary_remove(txn, table_id, key.mdbx, row, 0);
@@ -454,6 +652,60 @@ int fpta_delete(fpta_txn *txn, fpta_name *table_id, fptu_ro row) {
       return fpta_inconsistent_abort(txn, rc);
   }
 
+  if (fpta_schema_changelog(table_id->table.def)) {
+    rc = fpta_changelog_append(txn, table_id, fpta_change_delete, key.mdbx,
+                               fptu_ro());
+    if (unlikely(rc != FPTA_SUCCESS))
+      return fpta_inconsistent_abort(txn, rc);
+  }
+
+  return FPTA_SUCCESS;
+}
+
+int fpta_table_clear(fpta_txn *txn, fpta_name *table_id) {
+  if (unlikely(!fpta_txn_validate(txn, fpta_write)))
+    return FPTA_EINVAL;
+
+  int rc = fpta_name_refresh_couple(txn, table_id, nullptr);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  if (unlikely(table_id->mdbx_dbi < 1)) {
+    rc = fpta_open_table(txn, table_id);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
+
+  MDB_dbi dbi[fpta_max_indexes];
+  rc = fpta_open_secondaries(txn, table_id, dbi);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  /* Таблицы очищаются без удаления самих dbi-хендлов, поэтому схема и кэш
+   * хендлов остаются в силе, а затраты пропорциональны количеству страниц,
+   * а не строк. */
+  for (size_t i = 0; i < table_id->table.def->count; ++i) {
+    if (fpta_shove2index(table_id->table.def->columns[i]) == fpta_index_none)
+      break;
+    assert(i < fpta_max_indexes);
+    rc = mdbx_drop(txn->mdbx_txn, dbi[i], 0);
+    if (unlikely(rc != MDB_SUCCESS))
+      return (i > 0) ? fpta_inconsistent_abort(txn, rc) : rc;
+  }
+  if (txn->db->pkcache)
+    fpta_pkcache_cleared(txn);
+
+  if (fpta_schema_changelog(table_id->table.def)) {
+    /* сам журнал сохраняется, а потребители получают запись об очистке */
+    MDB_val empty_key;
+    empty_key.iov_base = nullptr;
+    empty_key.iov_len = 0;
+    rc = fpta_changelog_append(txn, table_id, fpta_change_clear, empty_key,
+                               fptu_ro());
+    if (unlikely(rc != FPTA_SUCCESS))
+      return fpta_inconsistent_abort(txn, rc);
+  }
+
   return FPTA_SUCCESS;
 }
 
@@ -480,7 +732,8 @@ int fpta_get(fpta_txn *txn, fpta_name *column_id,
     return FPTA_NO_INDEX;
 
   fpta_key column_key;
-  rc = fpta_index_value2key(column_id->shove, *column_value, column_key, false);
+  rc = fpta_index_value2key(table_id->table.def, column_id->column.num,
+                            *column_value, column_key);
   if (unlikely(rc != FPTA_SUCCESS))
     return rc;
 
@@ -490,18 +743,314 @@ int fpta_get(fpta_txn *txn, fpta_name *column_id,
       return rc;
   }
 
-  if (fpta_index_is_primary(index))
-    return mdbx_get(txn->mdbx_txn, column_id->mdbx_dbi, &column_key.mdbx,
-                    &row->sys);
+  if (!fpta_key_maybe_exists(txn, table_id, (unsigned)column_id->column.num,
+                             column_id->mdbx_dbi, column_key.mdbx))
+    return MDB_NOTFOUND;
 
   MDB_val pk_key;
-  rc = mdbx_get(txn->mdbx_txn, column_id->mdbx_dbi, &column_key.mdbx, &pk_key);
+  if (fpta_index_is_primary(index)) {
+    pk_key = column_key.mdbx;
+    rc = fpta_pk_get(txn, table_id, pk_key, *row);
+  } else {
+    rc = mdbx_get(txn->mdbx_txn, column_id->mdbx_dbi, &column_key.mdbx,
+                  &pk_key);
+    if (unlikely(rc != MDB_SUCCESS))
+      return rc;
+
+    rc = fpta_pk_get(txn, table_id, pk_key, *row);
+    if (unlikely(rc == MDB_NOTFOUND))
+      return FPTA_INDEX_CORRUPTED;
+  }
+
+  if (likely(rc == MDB_SUCCESS) &&
+      fpta_schema_pk_stripped(table_id->table.def)) {
+    rc = fpta_row_materialize(table_id, pk_key, *row, txn->rowbuf);
+    if (unlikely(rc != FPTA_SUCCESS)) {
+      row->units = nullptr;
+      row->total_bytes = 0;
+    }
+  }
+
+  if (likely(rc == MDB_SUCCESS)) {
+    const int expiry = fpta_schema_expiry(table_id->table.def);
+    if (expiry >= 0 &&
+        fpta_row_is_expired(*row, (unsigned)expiry, fptu_now_coarse())) {
+      /* устаревшая строка не видна, хотя еще не удалена */
+      row->units = nullptr;
+      row->total_bytes = 0;
+      rc = MDB_NOTFOUND;
+    }
+  }
+
+  return rc;
+}
+
+//----------------------------------------------------------------------------
+
+static int fpta_value_add(fpta_value &value, const fpta_value &delta) {
+  switch (value.type) {
+  default:
+    return FPTA_ETYPE;
+
+  case fpta_float_point:
+    if (unlikely(delta.type != fpta_float_point))
+      return FPTA_ETYPE;
+    value.fp += delta.fp;
+    return FPTA_SUCCESS;
+
+  case fpta_signed_int:
+    switch (delta.type) {
+    default:
+      return FPTA_ETYPE;
+    case fpta_signed_int:
+      if (unlikely(delta.sint > 0 && value.sint > INT64_MAX - delta.sint))
+        return FPTA_EVALUE;
+      if (unlikely(delta.sint < 0 && value.sint < INT64_MIN - delta.sint))
+        return FPTA_EVALUE;
+      value.sint += delta.sint;
+      return FPTA_SUCCESS;
+    case fpta_unsigned_int:
+      /* разность INT64_MAX - value.sint всегда помещается в uint64_t */
+      if (unlikely(delta.uint > (uint64_t)INT64_MAX - (uint64_t)value.sint))
+        return FPTA_EVALUE;
+      value.sint = (int64_t)((uint64_t)value.sint + delta.uint);
+      return FPTA_SUCCESS;
+    }
+
+  case fpta_unsigned_int:
+    switch (delta.type) {
+    default:
+      return FPTA_ETYPE;
+    case fpta_signed_int:
+      if (delta.sint < 0) {
+        const uint64_t subtrahend = 0 - (uint64_t)delta.sint;
+        if (unlikely(value.uint < subtrahend))
+          return FPTA_EVALUE;
+        value.uint -= subtrahend;
+        return FPTA_SUCCESS;
+      }
+    /* no break here */
+    case fpta_unsigned_int:
+      if (unlikely(value.uint > UINT64_MAX - delta.uint))
+        return FPTA_EVALUE;
+      value.uint += delta.uint;
+      return FPTA_SUCCESS;
+    }
+  }
+}
+
+int fpta_column_add(fpta_txn *txn, fpta_name *column_id,
+                    const fpta_value *pk_value, fpta_value delta,
+                    fpta_value *result) {
+  if (unlikely(pk_value == nullptr))
+    return FPTA_EINVAL;
+  if (unlikely(!fpta_id_validate(column_id, fpta_column)))
+    return FPTA_EINVAL;
+  if (unlikely(!fpta_txn_validate(txn, fpta_write)))
+    return FPTA_EINVAL;
+
+  fpta_name *table_id = column_id->column.table;
+  int rc = fpta_name_refresh_couple(txn, table_id, column_id);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  /* изменение значения первичного ключа не является "инкрементом",
+   * а для не-уникального PK целевая строка не определена однозначно */
+  const unsigned col = (unsigned)column_id->column.num;
+  if (unlikely(col == 0))
+    return FPTA_EINVAL;
+  if (unlikely(!fpta_index_is_unique(table_id->table.pk)))
+    return FPTA_NO_INDEX;
+
+  fpta_value zero;
+  switch (fpta_shove2type(column_id->shove)) {
+  default:
+    return FPTA_ETYPE;
+  case fptu_uint16:
+  case fptu_uint32:
+  case fptu_uint64:
+    zero = fpta_value_uint(0);
+    break;
+  case fptu_int32:
+  case fptu_int64:
+    zero = fpta_value_sint(0);
+    break;
+  case fptu_fp32:
+  case fptu_fp64:
+    zero = fpta_value_float(0);
+    break;
+  }
+
+  fpta_key pk_key;
+  rc = fpta_index_value2key(table_id->table.pk, *pk_value, pk_key, false);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  if (unlikely(table_id->mdbx_dbi < 1)) {
+    rc = fpta_open_table(txn, table_id);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
+
+  const fpta_shove_t shove = column_id->shove;
+  const bool indexed = fpta_shove2index(shove) != fpta_index_none;
+  MDB_dbi dbi[fpta_max_indexes];
+  if (indexed) {
+    assert(col < fpta_max_indexes);
+    rc = fpta_open_secondaries(txn, table_id, dbi);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
+
+  /* Единственный поиск строки по PK, после которого обновление выполняется
+   * в текущей позиции курсора посредством MDB_CURRENT. */
+  MDB_cursor *mdbx_cursor;
+  rc = mdbx_cursor_open(txn->mdbx_txn, table_id->mdbx_dbi, &mdbx_cursor);
   if (unlikely(rc != MDB_SUCCESS))
     return rc;
 
-  rc = mdbx_get(txn->mdbx_txn, table_id->mdbx_dbi, &pk_key, &row->sys);
-  if (unlikely(rc == MDB_NOTFOUND))
-    return FPTA_INDEX_CORRUPTED;
+  fptu_ro present;
+  rc = mdbx_cursor_get(mdbx_cursor, &pk_key.mdbx, &present.sys, MDB_SET_KEY);
+  if (unlikely(rc != MDB_SUCCESS))
+    goto bailout;
+
+  {
+    const fptu_field *field =
+        fptu_lookup_ro(present, col, fpta_shove2type(shove));
+    fpta_value value = field ? fpta_field2value(field) : zero;
+    rc = fpta_value_add(value, delta);
+    if (unlikely(rc != FPTA_SUCCESS))
+      goto bailout;
+
+    const char *error = nullptr;
+    const size_t bytes = fptu_check_and_get_buffer_size(
+        present, 1, sizeof(fptu_payload), &error);
+    if (unlikely(error != nullptr)) {
+      rc = FPTA_EOOPS;
+      goto bailout;
+    }
+
+    fptu_rw *row = fptu_fetch(present, alloca(bytes), bytes, 1);
+    if (unlikely(row == nullptr)) {
+      rc = FPTA_EOOPS;
+      goto bailout;
+    }
+
+    /* диапазон нового значения проверяется по тем же правилам,
+     * что и при явном обновлении колонки */
+    rc = fpta_upsert_column(row, column_id, value);
+    if (unlikely(rc != FPTA_SUCCESS))
+      goto bailout;
+    if (fpta_shove2type(shove) == fptu_fp32)
+      value.fp = (float)value.fp;
+
+    fptu_ro updated = fptu_take_noshrink(row);
+    if (fpta_schema_extra_lookup(table_id->table.def, fpta_extra_partial,
+                                 -1) ||
+        fpta_schema_extra_lookup(table_id->table.def, fpta_extra_expression,
+                                 -1)) {
+      /* Изменение значения может повлиять на попадание строки в частичные
+       * индексы и на ключи индексов по выражениям от других колонок,
+       * поэтому обновляются все вторичные индексы по копии исходной
+       * строки, которая будет перезаписана "на месте". */
+      rc = fpta_check_constraints(txn, table_id, present, updated, 0);
+      if (unlikely(rc != FPTA_SUCCESS))
+        goto bailout;
+
+      fptu_ro origin;
+      origin.total_bytes = present.total_bytes;
+      origin.units = (const fptu_unit *)memcpy(alloca(present.total_bytes),
+                                               present.units,
+                                               present.total_bytes);
+      rc = mdbx_cursor_put(mdbx_cursor, &pk_key.mdbx, &updated.sys,
+                           MDB_CURRENT);
+      if (unlikely(rc != MDB_SUCCESS))
+        goto bailout;
+      fpta_pk_changed(txn, table_id, pk_key.mdbx);
+
+      mdbx_cursor_close(mdbx_cursor);
+      rc = fpta_secondary_upsert(txn, table_id, pk_key.mdbx, origin,
+                                 pk_key.mdbx, updated, 0);
+      if (unlikely(rc != MDB_SUCCESS))
+        return fpta_inconsistent_abort(txn, rc);
+      if (fpta_schema_changelog(table_id->table.def)) {
+        rc = fpta_changelog_append(txn, table_id, fpta_change_update,
+                                   pk_key.mdbx, updated);
+        if (unlikely(rc != FPTA_SUCCESS))
+          return fpta_inconsistent_abort(txn, rc);
+      }
+      if (result)
+        *result = value;
+      return FPTA_SUCCESS;
+    }
+
+    fpta_key fk_key_old, fk_key_new;
+    if (indexed) {
+      /* старый ключ копируется, так как при обновлении "на месте"
+       * данные строки под курсором будут перезаписаны */
+      rc = fpta_index_row2key(shove, col, present, fk_key_old, true);
+      if (unlikely(rc != FPTA_SUCCESS))
+        goto bailout;
+      rc = fpta_index_row2key(shove, col, updated, fk_key_new, false);
+      if (unlikely(rc != FPTA_SUCCESS))
+        goto bailout;
+
+      if (fpta_index_is_unique(shove) &&
+          !fpta_is_same(fk_key_old.mdbx, fk_key_new.mdbx)) {
+        /* проверка ограничения уникальности до каких-либо изменений */
+        MDB_val pk_exist;
+        rc = fpta_key_maybe_exists(txn, table_id, col, dbi[col],
+                                   fk_key_new.mdbx)
+                 ? mdbx_get(txn->mdbx_txn, dbi[col], &fk_key_new.mdbx,
+                            &pk_exist)
+                 : MDB_NOTFOUND;
+        if (unlikely(rc != MDB_NOTFOUND)) {
+          rc = (rc == MDB_SUCCESS) ? MDB_KEYEXIST : rc;
+          goto bailout;
+        }
+      }
+    }
+
+    rc = mdbx_cursor_put(mdbx_cursor, &pk_key.mdbx, &updated.sys, MDB_CURRENT);
+    if (unlikely(rc != MDB_SUCCESS))
+      goto bailout;
+    fpta_pk_changed(txn, table_id, pk_key.mdbx);
+
+    if (indexed && !fpta_is_same(fk_key_old.mdbx, fk_key_new.mdbx)) {
+      rc = mdbx_del(txn->mdbx_txn, dbi[col], &fk_key_old.mdbx, &pk_key.mdbx);
+      if (unlikely(rc != MDB_SUCCESS)) {
+        mdbx_cursor_close(mdbx_cursor);
+        return fpta_inconsistent_abort(
+            txn, (rc != MDB_NOTFOUND) ? rc : (int)FPTA_INDEX_CORRUPTED);
+      }
+      rc = mdbx_put(txn->mdbx_txn, dbi[col], &fk_key_new.mdbx, &pk_key.mdbx,
+                    fpta_index_is_unique(shove)
+                        ? MDB_NODUPDATA | MDB_NOOVERWRITE
+                        : MDB_NODUPDATA);
+      if (unlikely(rc != MDB_SUCCESS)) {
+        mdbx_cursor_close(mdbx_cursor);
+        return fpta_inconsistent_abort(txn, rc);
+      }
+      if (fpta_index_is_unique(shove))
+        fpta_key_inserted(txn, table_id, col, fk_key_new.mdbx);
+    }
+
+    if (fpta_schema_changelog(table_id->table.def)) {
+      mdbx_cursor_close(mdbx_cursor);
+      rc = fpta_changelog_append(txn, table_id, fpta_change_update,
+                                 pk_key.mdbx, updated);
+      if (unlikely(rc != FPTA_SUCCESS))
+        return fpta_inconsistent_abort(txn, rc);
+      if (result)
+        *result = value;
+      return FPTA_SUCCESS;
+    }
+
+    if (result)
+      *result = value;
+  }
 
+bailout:
+  mdbx_cursor_close(mdbx_cursor);
   return rc;
 }
@@ -0,0 +1,303 @@
+/*
+ * Copyright 2016-2017 libfpta authors: please see AUTHORS file.
+ *
+ * This file is part of libfpta, aka "Fast Positive Tables".
+ *
+ * libfpta is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libfpta is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libfpta.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fast_positive/tables_internal.h"
+
+/* Отложенное сохранение на диск для режимов fpta_sync_group
+ * и fpta_sync_deferred.
+ *
+ * В обоих режимах транзакции фиксируются в mdbx без сброса на диск,
+ * а здесь учитываются номера последней зафиксированной и последней
+ * сохраненной на диск транзакций.
+ *
+ * В режиме fpta_sync_group каждый писатель после фиксации ожидает
+ * сохранения своей транзакции. Сброс выполняет один из ожидающих
+ * ("лидер"), а остальные ждут его завершения. Так как mdbx_env_sync()
+ * сохраняет все зафиксированные к этому моменту транзакции, то один
+ * fdatasync() обслуживает всех писателей, успевших завершить транзакции
+ * пока выполнялся предыдущий сброс.
+ *
+ * В режиме fpta_sync_deferred писатели не ждут, а сброс выполняет
+ * фоновый поток при достижении заданной задержки или количества
+ * несохраненных транзакций. Ограничение по объему несохраненных данных
+ * обеспечивается самой mdbx, см. mdbx_env_set_syncbytes(). Ожидающие
+ * в fpta_db_wait_durable() при необходимости выполняют сброс сами,
+ * не дожидаясь фонового потока. */
+
+struct fpta_durable {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  /* последняя зафиксированная и последняя сохраненная транзакции */
+  uint64_t committed;
+  uint64_t durable;
+  /* выполняется сброс на диск */
+  bool syncing;
+
+  /* фоновый поток режима fpta_sync_deferred */
+  bool deferred, stop;
+  pthread_t thread;
+  pthread_cond_t wakeup;
+  fpta_durability_limits limits;
+  /* количество и время фиксации первой из несохраненных транзакций */
+  size_t pending;
+  struct timespec pending_since;
+};
+
+static void fpta_durable_lock(fpta_durable *durable) {
+  int err = pthread_mutex_lock(&durable->mutex);
+  assert(err == 0);
+  (void)err;
+}
+
+static void fpta_durable_unlock(fpta_durable *durable) {
+  int err = pthread_mutex_unlock(&durable->mutex);
+  assert(err == 0);
+  (void)err;
+}
+
+/* Выполняет сброс на диск всех зафиксированных транзакций, вызывается
+ * с захваченным мьютексом, который освобождается на время сброса. */
+static int fpta_durable_sync(fpta_db *db, fpta_durable *durable) {
+  assert(!durable->syncing);
+  const uint64_t target = durable->committed;
+  const size_t pending = durable->pending;
+  durable->syncing = true;
+  fpta_durable_unlock(durable);
+  int rc = mdbx_env_sync(db->mdbx_env, true);
+  fpta_durable_lock(durable);
+
+  durable->syncing = false;
+  if (likely(rc == MDB_SUCCESS)) {
+    if (durable->durable < target)
+      durable->durable = target;
+    /* учитываем зафиксированные во время сброса */
+    durable->pending -= pending;
+    if (durable->pending)
+      clock_gettime(CLOCK_REALTIME, &durable->pending_since);
+  }
+  pthread_cond_broadcast(&durable->cond);
+  return rc;
+}
+
+static void fpta_durable_deadline(const fpta_durable *durable,
+                                  struct timespec &deadline) {
+  deadline = durable->pending_since;
+  deadline.tv_sec += durable->limits.max_lag_ms / 1000;
+  deadline.tv_nsec += (durable->limits.max_lag_ms % 1000) * 1000000l;
+  if (deadline.tv_nsec >= 1000000000l) {
+    deadline.tv_sec += 1;
+    deadline.tv_nsec -= 1000000000l;
+  }
+}
+
+static bool fpta_durable_overdue(const fpta_durable *durable) {
+  if (durable->limits.max_unsynced_txns &&
+      durable->pending >= durable->limits.max_unsynced_txns)
+    return true;
+
+  struct timespec deadline, now;
+  fpta_durable_deadline(durable, deadline);
+  clock_gettime(CLOCK_REALTIME, &now);
+  return now.tv_sec > deadline.tv_sec ||
+         (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec);
+}
+
+static void *fpta_durable_thread(void *arg) {
+  fpta_db *db = (fpta_db *)arg;
+  fpta_durable *durable = db->durable;
+
+  fpta_durable_lock(durable);
+  while (!durable->stop) {
+    if (durable->syncing) {
+      pthread_cond_wait(&durable->cond, &durable->mutex);
+    } else if (durable->pending == 0) {
+      pthread_cond_wait(&durable->wakeup, &durable->mutex);
+    } else if (fpta_durable_overdue(durable)) {
+      /* при ошибке повторяем попытку не ранее чем через max_lag_ms,
+       * ожидающие в fpta_db_wait_durable() получат ошибку сами */
+      if (fpta_durable_sync(db, durable) != MDB_SUCCESS)
+        clock_gettime(CLOCK_REALTIME, &durable->pending_since);
+    } else {
+      struct timespec deadline;
+      fpta_durable_deadline(durable, deadline);
+      pthread_cond_timedwait(&durable->wakeup, &durable->mutex, &deadline);
+    }
+  }
+  fpta_durable_unlock(durable);
+  return nullptr;
+}
+
+int fpta_durable_init(fpta_db *db, bool deferred) {
+  assert(db->durable == nullptr);
+  fpta_durable *durable = (fpta_durable *)calloc(1, sizeof(fpta_durable));
+  if (unlikely(durable == nullptr))
+    return FPTA_ENOMEM;
+
+  /* все транзакции до открытия БД считаются сохраненными */
+  MDB_txn *mdbx_txn;
+  int rc = mdbx_txn_begin(db->mdbx_env, nullptr, MDB_RDONLY, &mdbx_txn);
+  if (unlikely(rc != MDB_SUCCESS)) {
+    free(durable);
+    return rc;
+  }
+  mdbx_canary canary;
+  durable->committed = durable->durable = mdbx_canary_get(mdbx_txn, &canary);
+  mdbx_txn_abort(mdbx_txn);
+
+  rc = pthread_mutex_init(&durable->mutex, nullptr);
+  if (unlikely(rc != 0)) {
+    free(durable);
+    return rc;
+  }
+
+  rc = pthread_cond_init(&durable->cond, nullptr);
+  if (unlikely(rc != 0))
+    goto bailout_mutex;
+
+  if (deferred) {
+    durable->deferred = true;
+    durable->limits.max_lag_ms = fpta_durable_default_lag_ms;
+    durable->limits.max_unsynced_txns = fpta_durable_default_txns;
+    rc = pthread_cond_init(&durable->wakeup, nullptr);
+    if (unlikely(rc != 0))
+      goto bailout_cond;
+
+    db->durable = durable;
+    rc = pthread_create(&durable->thread, nullptr, fpta_durable_thread, db);
+    if (unlikely(rc != 0)) {
+      db->durable = nullptr;
+      int err = pthread_cond_destroy(&durable->wakeup);
+      assert(err == 0);
+      (void)err;
+      goto bailout_cond;
+    }
+  }
+
+  db->durable = durable;
+  return FPTA_SUCCESS;
+
+bailout_cond:
+  pthread_cond_destroy(&durable->cond);
+bailout_mutex:
+  pthread_mutex_destroy(&durable->mutex);
+  free(durable);
+  return rc;
+}
+
+void fpta_durable_destroy(fpta_db *db) {
+  fpta_durable *durable = db->durable;
+  if (durable) {
+    int err;
+    if (durable->deferred) {
+      fpta_durable_lock(durable);
+      durable->stop = true;
+      pthread_cond_signal(&durable->wakeup);
+      fpta_durable_unlock(durable);
+      err = pthread_join(durable->thread, nullptr);
+      assert(err == 0);
+      err = pthread_cond_destroy(&durable->wakeup);
+      assert(err == 0);
+    }
+
+    assert(!durable->syncing);
+    err = pthread_cond_destroy(&durable->cond);
+    assert(err == 0);
+    err = pthread_mutex_destroy(&durable->mutex);
+    assert(err == 0);
+    (void)err;
+    free(durable);
+    db->durable = nullptr;
+  }
+}
+
+void fpta_durable_commit(fpta_db *db, uint64_t txnid) {
+  fpta_durable *durable = db->durable;
+  fpta_durable_lock(durable);
+  if (durable->committed < txnid)
+    durable->committed = txnid;
+  if (durable->deferred) {
+    if (durable->pending++ == 0) {
+      clock_gettime(CLOCK_REALTIME, &durable->pending_since);
+      pthread_cond_signal(&durable->wakeup);
+    } else if (durable->pending == durable->limits.max_unsynced_txns) {
+      pthread_cond_signal(&durable->wakeup);
+    }
+  }
+  fpta_durable_unlock(durable);
+}
+
+int fpta_durable_wait(fpta_db *db, uint64_t txnid) {
+  fpta_durable *durable = db->durable;
+  int rc = pthread_mutex_lock(&durable->mutex);
+  if (unlikely(rc != 0))
+    return rc;
+
+  if (unlikely(txnid > durable->committed))
+    rc = FPTA_EINVAL;
+
+  while (rc == FPTA_SUCCESS && durable->durable < txnid) {
+    if (durable->syncing)
+      rc = pthread_cond_wait(&durable->cond, &durable->mutex);
+    else
+      /* становимся лидером и сохраняем все зафиксированное */
+      rc = fpta_durable_sync(db, durable);
+  }
+
+  fpta_durable_unlock(durable);
+  return rc;
+}
+
+//----------------------------------------------------------------------------
+
+int fpta_db_durability_limits(fpta_db *db,
+                              const fpta_durability_limits *limits) {
+  if (unlikely(!fpta_db_validate(db) || limits == nullptr))
+    return FPTA_EINVAL;
+  if (unlikely(db->durable == nullptr || !db->durable->deferred))
+    return FPTA_EINVAL;
+  if (unlikely(limits->max_lag_ms < 1))
+    return FPTA_EINVAL;
+
+  int rc = mdbx_env_set_syncbytes(db->mdbx_env, limits->max_unsynced_bytes);
+  if (unlikely(rc != MDB_SUCCESS))
+    return rc;
+
+  fpta_durable *durable = db->durable;
+  fpta_durable_lock(durable);
+  durable->limits = *limits;
+  pthread_cond_signal(&durable->wakeup);
+  fpta_durable_unlock(durable);
+  return FPTA_SUCCESS;
+}
+
+int fpta_db_wait_durable(fpta_db *db, uint64_t txn_id) {
+  if (unlikely(!fpta_db_validate(db)))
+    return FPTA_EINVAL;
+
+  if (db->durable)
+    return fpta_durable_wait(db, txn_id);
+
+  switch (db->durability) {
+  case fpta_readonly:
+  case fpta_sync:
+    return FPTA_SUCCESS;
+  default:
+    return mdbx_env_sync(db->mdbx_env, true);
+  }
+}
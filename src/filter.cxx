@@ -342,3 +342,136 @@ tail_recursion:
     return true;
   }
 }
+
+//----------------------------------------------------------------------------
+
+bool fpta_predicate_validate(const fpta_shove_t *predicate, size_t words,
+                             size_t count, bool &refers_pk) {
+  /* Узлы перебираются последовательно с подсчетом количества ожидаемых
+   * поддеревьев, которое должно обнулиться ровно на последнем слове. */
+  refers_pk = false;
+  size_t expected = 1, i = 0;
+  while (i < words) {
+    if (unlikely(expected == 0))
+      return false;
+    --expected;
+
+    const fpta_shove_t node = predicate[i++];
+    switch (fpta_predicate_type(node)) {
+    default:
+      return false;
+
+    case fpta_node_not:
+      expected += 1;
+      break;
+
+    case fpta_node_or:
+    case fpta_node_and:
+      expected += 2;
+      break;
+
+    case fpta_node_lt:
+    case fpta_node_gt:
+    case fpta_node_le:
+    case fpta_node_ge:
+    case fpta_node_eq:
+    case fpta_node_ne:
+      if (unlikely(fpta_predicate_column(node) >= count))
+        return false;
+      if (fpta_predicate_column(node) == 0)
+        refers_pk = true;
+      switch (fpta_predicate_value_type(node)) {
+      default:
+        return false;
+      case fpta_null:
+      case fpta_signed_int:
+      case fpta_unsigned_int:
+      case fpta_datetime:
+      case fpta_float_point:
+      case fpta_string:
+      case fpta_binary:
+        break;
+      }
+      if (unlikely(fpta_predicate_value_words(node) > words - i))
+        return false;
+      i += fpta_predicate_value_words(node);
+      break;
+    }
+  }
+
+  return i == words && expected == 0;
+}
+
+void fpta_predicate_renumber(fpta_shove_t *predicate, size_t words,
+                             const unsigned *renum) {
+  for (size_t i = 0; i < words;) {
+    const fpta_shove_t node = predicate[i++];
+    switch (fpta_predicate_type(node)) {
+    case fpta_node_not:
+    case fpta_node_or:
+    case fpta_node_and:
+      break;
+    default:
+      predicate[i - 1] = fpta_predicate_node(
+          fpta_predicate_type(node), fpta_predicate_value_type(node),
+          renum[fpta_predicate_column(node)], fpta_predicate_length(node));
+      i += fpta_predicate_value_words(node);
+      break;
+    }
+  }
+}
+
+static __hot const fpta_shove_t *
+fpta_predicate_eval(const fpta_shove_t *node, const fpta_table_schema *def,
+                    const fptu_ro &row, bool &result) {
+  const fpta_shove_t head = *node++;
+  const int type = fpta_predicate_type(head);
+  switch (type) {
+  case fpta_node_not:
+    node = fpta_predicate_eval(node, def, row, result);
+    result = !result;
+    return node;
+
+  case fpta_node_or:
+  case fpta_node_and: {
+    bool a, b;
+    node = fpta_predicate_eval(node, def, row, a);
+    node = fpta_predicate_eval(node, def, row, b);
+    result = (type == fpta_node_or) ? (a || b) : (a && b);
+    return node;
+  }
+
+  default: {
+    const unsigned column = fpta_predicate_column(head);
+    fpta_value value;
+    value.type = fpta_predicate_value_type(head);
+    value.binary_length = fpta_predicate_length(head);
+    switch (value.type) {
+    case fpta_null:
+      value.uint = 0;
+      break;
+    case fpta_string:
+    case fpta_binary:
+      value.binary_data = (void *)node;
+      break;
+    default:
+      value.uint = *node;
+      break;
+    }
+    node += fpta_predicate_value_words(head);
+
+    const fptu_field *field = fptu_lookup_ro(
+        row, column, fpta_shove2type(def->columns[column]));
+    result = (fpta_filter_cmp(field, value) & type) != 0;
+    return node;
+  }
+  }
+}
+
+__hot bool fpta_predicate_match(const fpta_shove_t *predicate,
+                                const fpta_table_schema *def,
+                                const fptu_ro &row) {
+  bool result;
+  fpta_predicate_eval(predicate, def, row, result);
+  return result;
+}
@@ -170,7 +170,7 @@ static int fpta_idxcmp_mad(const MDB_val *a, const MDB_val *b) {
 }
 
 __hot MDB_cmp_func *fpta_index_shove2comparator(fpta_shove_t shove) {
-  fptu_type type = fpta_shove2type(shove);
+  fptu_type type = fpta_shove2keytype(shove);
   fpta_index_type index = fpta_shove2index(shove);
 
   switch (type) {
@@ -274,7 +274,7 @@ static __hot int fpta_normalize_key(fpta_shove_t shove, fpta_key &key,
 //----------------------------------------------------------------------------
 
 static __inline unsigned shove2dbiflags(fpta_shove_t shove) {
-  fptu_type type = fpta_shove2type(shove);
+  fptu_type type = fpta_shove2keytype(shove);
   fpta_index_type index = fpta_shove2index(shove);
   assert(type != fptu_null);
   assert(index != fpta_index_none);
@@ -413,7 +413,7 @@ static bool fpta_index_unordered_is_compat(fptu_type data_type,
 }
 
 bool fpta_index_is_compat(fpta_shove_t shove, const fpta_value &value) {
-  fptu_type type = fpta_shove2type(shove);
+  fptu_type type = fpta_shove2keytype(shove);
   fpta_index_type index = fpta_shove2index(shove);
 
   if (fpta_index_is_ordered(index))
@@ -430,7 +430,7 @@ int fpta_index_value2key(fpta_shove_t shove, const fpta_value &value,
                value.type == fpta_null))
     return FPTA_ETYPE;
 
-  fptu_type type = fpta_shove2type(shove);
+  fptu_type type = fpta_shove2keytype(shove);
   fpta_index_type index = fpta_shove2index(shove);
 
   if (unlikely(index == fpta_index_none || type == fptu_null))
@@ -641,7 +641,7 @@ int __fpta_index_value2key(fpta_shove_t shove, const fpta_value *value,
 
 int fpta_index_key2value(fpta_shove_t shove, const MDB_val &mdbx,
                          fpta_value &value) {
-  fptu_type type = fpta_shove2type(shove);
+  fptu_type type = fpta_shove2keytype(shove);
   fpta_index_type index = fpta_shove2index(shove);
 
   if (type > fptu_fp64 && !fpta_index_is_ordered(index)) {
@@ -790,8 +790,11 @@ __hot int fpta_index_row2key(fpta_shove_t shove, size_t column,
 #endif
 
   fptu_type type = fpta_shove2type(shove);
-  const fptu_field *field = fptu_lookup_ro(row, (unsigned)column, type);
+  if (unlikely(type & fptu_farray))
+    /* для мульти-индекса следует использовать fpta_index_row2keys() */
+    return FPTA_ETYPE;
 
+  const fptu_field *field = fptu_lookup_ro(row, (unsigned)column, type);
   if (unlikely(field == nullptr))
     return FPTA_COLUMN_MISSING;
 
@@ -878,3 +881,366 @@ __hot int fpta_index_row2key(fpta_shove_t shove, size_t column,
 
   return fpta_normalize_key(shove, key, copy);
 }
+
+//----------------------------------------------------------------------------
+
+static __inline uint64_t fpta_datetime_trunc(uint64_t fixedpoint,
+                                             uint64_t seconds) {
+  const uint64_t utc = fixedpoint >> 32;
+  return (utc - utc % seconds) << 32;
+}
+
+/* Возвращает для символа Unicode соответствующий символ простой свертки
+ * регистра (simple case folding) для латиницы, греческого алфавита,
+ * кириллицы и армянского алфавита, либо исходный символ. */
+static uint32_t fpta_casefold_char(uint32_t c) {
+  if (c < 0x80)
+    return (c >= 'A' && c <= 'Z') ? c + 'a' - 'A' : c;
+
+  /* Latin-1 Supplement и Latin Extended-A */
+  if (c >= 0xC0 && c <= 0xDE && c != 0xD7)
+    return c + 32;
+  if ((c >= 0x100 && c <= 0x12F) || (c >= 0x132 && c <= 0x137) ||
+      (c >= 0x14A && c <= 0x177))
+    return c | 1;
+  if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E))
+    return (c & 1) ? c + 1 : c;
+  if (c == 0x178)
+    return 0xFF;
+  if (c == 0x17F)
+    return 's';
+
+  /* греческий алфавит */
+  if ((c >= 0x391 && c <= 0x3A1) || (c >= 0x3A3 && c <= 0x3AB))
+    return c + 32;
+  if (c == 0x386)
+    return 0x3AC;
+  if (c >= 0x388 && c <= 0x38A)
+    return c + 37;
+  if (c == 0x38C)
+    return 0x3CC;
+  if (c == 0x38E || c == 0x38F)
+    return c + 63;
+  if (c == 0x3C2)
+    return 0x3C3;
+
+  /* кириллица */
+  if (c >= 0x410 && c <= 0x42F)
+    return c + 32;
+  if (c >= 0x400 && c <= 0x40F)
+    return c + 80;
+  if ((c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF) ||
+      (c >= 0x4D0 && c <= 0x52F))
+    return c | 1;
+  if (c == 0x4C0)
+    return 0x4CF;
+  if (c >= 0x4C1 && c <= 0x4CE)
+    return (c & 1) ? c + 1 : c;
+
+  /* армянский алфавит */
+  if (c >= 0x531 && c <= 0x556)
+    return c + 48;
+
+  return c;
+}
+
+/* Выполняет свертку регистра строки UTF-8. Свертка не увеличивает длину
+ * символов в байтах, поэтому результат помещается в буфер исходного
+ * размера. Некорректные последовательности копируются без изменений.
+ * Возвращает длину результата. */
+static size_t fpta_casefold_utf8(const uint8_t *src, size_t length,
+                                 uint8_t *dst) {
+  uint8_t *const begin = dst;
+  const uint8_t *const end = src + length;
+  while (src < end) {
+    const uint8_t lead = *src;
+    if (lead < 0x80) {
+      *dst++ = (lead >= 'A' && lead <= 'Z') ? lead + 'a' - 'A' : lead;
+      ++src;
+      continue;
+    }
+
+    /* все сворачиваемые символы кодируются двумя байтами, а остальные
+     * последовательности (включая неканонические) копируются побайтно */
+    if ((lead & 0xE0) != 0xC0 || lead < 0xC2 || end - src < 2 ||
+        (src[1] & 0xC0) != 0x80) {
+      *dst++ = *src++;
+      continue;
+    }
+
+    const uint32_t c = (uint32_t)(lead & 0x1F) << 6 | (src[1] & 0x3F);
+    const uint32_t folded = fpta_casefold_char(c);
+    if (folded < 0x80) {
+      *dst++ = (uint8_t)folded;
+    } else {
+      *dst++ = (uint8_t)(0xC0 | folded >> 6);
+      *dst++ = (uint8_t)(0x80 | (folded & 0x3F));
+    }
+    src += 2;
+  }
+  return dst - begin;
+}
+
+/* Формирует ключ по выражению fpta_expr_lowercase, fpta_expr_casefold
+ * или fpta_expr_prefix для строки или бинарного значения. */
+static int fpta_index_bytes_expr2key(fpta_shove_t shove, unsigned expression,
+                                     uint64_t param, const void *data,
+                                     size_t length, fpta_key &key) {
+  if (expression == fpta_expr_prefix) {
+    key.mdbx.mv_size = (length > param) ? (size_t)param : length;
+    key.mdbx.mv_data = (void *)data;
+    return fpta_normalize_key(shove, key, true);
+  }
+
+  assert(expression == fpta_expr_lowercase ||
+         expression == fpta_expr_casefold);
+  uint8_t local[fpta_max_keylen];
+  uint8_t *lower =
+      (length <= sizeof(local)) ? local : (uint8_t *)malloc(length);
+  if (unlikely(lower == nullptr))
+    return FPTA_ENOMEM;
+
+  if (expression == fpta_expr_casefold)
+    length = fpta_casefold_utf8((const uint8_t *)data, length, lower);
+  else
+    for (size_t i = 0; i < length; ++i) {
+      const uint8_t c = ((const uint8_t *)data)[i];
+      lower[i] = (c >= 'A' && c <= 'Z') ? (uint8_t)(c + 'a' - 'A') : c;
+    }
+
+  key.mdbx.mv_size = length;
+  key.mdbx.mv_data = lower;
+  int rc = fpta_normalize_key(shove, key, true);
+  if (lower != local)
+    free(lower);
+  return rc;
+}
+
+int fpta_index_expr_value2key(fpta_shove_t shove,
+                              const fpta_shove_t *expression,
+                              const fpta_value &value, fpta_key &key) {
+  const unsigned kind = fpta_extra_param(expression[0]);
+  const uint64_t param = expression[1];
+  if (kind == fpta_expr_extractor || kind == fpta_expr_nested_path ||
+      value.type == fpta_shoved)
+    /* значение уже вычислено */
+    return fpta_index_value2key(shove, value, key, true);
+
+  if (unlikely(!fpta_index_is_compat(shove, value)))
+    return FPTA_ETYPE;
+
+  switch (kind) {
+  case fpta_expr_datetime_trunc:
+    assert(value.type == fpta_datetime);
+    key.place.u64 = fpta_datetime_trunc(value.datetime.fixedpoint, param);
+    key.mdbx.mv_size = sizeof(key.place.u64);
+    key.mdbx.mv_data = &key.place.u64;
+    return FPTA_SUCCESS;
+
+  case fpta_expr_lowercase:
+  case fpta_expr_casefold:
+  case fpta_expr_prefix:
+    if (unlikely(value.binary_data == nullptr) && value.binary_length)
+      return FPTA_EINVAL;
+    return fpta_index_bytes_expr2key(shove, kind, param, value.binary_data,
+                                     value.binary_length, key);
+
+  default:
+    return FPTA_SCHEMA_CORRUPTED;
+  }
+}
+
+__hot int fpta_index_expr_row2key(fpta_shove_t shove,
+                                  const fpta_shove_t *expression,
+                                  size_t column, const fptu_ro &row,
+                                  fpta_key &key) {
+#ifndef NDEBUG
+  fpta_pollute(&key, sizeof(key), 0);
+#endif
+
+  const unsigned kind = fpta_extra_param(expression[0]);
+  const uint64_t param = expression[1];
+  if (kind == fpta_expr_extractor) {
+    void *context;
+    fpta_key_extractor *extractor = fpta_key_extractor_lookup(param, &context);
+    if (unlikely(extractor == nullptr))
+      return FPTA_ENOIMP;
+
+    fpta_value value;
+    int rc = extractor(context, &row, &value);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+    return fpta_index_value2key(shove, value, key, true);
+  }
+
+  const fptu_type type = fpta_shove2type(shove);
+  if (kind == fpta_expr_nested_path) {
+    /* спускаемся по вложенным кортежам до конечного поля */
+    const unsigned depth = fpta_path_depth(param);
+    const fptu_field *field =
+        fptu_lookup_ro(row, fpta_path_column(param), fptu_nested);
+    for (unsigned level = 0; level < depth && field; ++level)
+      field = fptu_lookup_ro(fptu_field_nested(field),
+                             fpta_path_step(param, level),
+                             (level + 1 < depth) ? fptu_nested : type);
+    if (unlikely(field == nullptr))
+      return FPTA_COLUMN_MISSING;
+    return fpta_index_value2key(shove, fpta_field2value(field), key, true);
+  }
+
+  const fptu_field *field = fptu_lookup_ro(row, (unsigned)column, type);
+  if (unlikely(field == nullptr))
+    return FPTA_COLUMN_MISSING;
+
+  const fptu_payload *payload = fptu_field_payload(field);
+  switch (kind) {
+  case fpta_expr_datetime_trunc:
+    assert(type == fptu_datetime);
+    key.place.u64 = fpta_datetime_trunc(payload->u64, param);
+    key.mdbx.mv_size = sizeof(key.place.u64);
+    key.mdbx.mv_data = &key.place.u64;
+    return FPTA_SUCCESS;
+
+  case fpta_expr_lowercase:
+  case fpta_expr_casefold:
+  case fpta_expr_prefix:
+    if (type == fptu_cstr)
+      return fpta_index_bytes_expr2key(shove, kind, param, payload->cstr,
+                                       strlen(payload->cstr), key);
+    assert(type == fptu_opaque);
+    return fpta_index_bytes_expr2key(shove, kind, param, payload->other.data,
+                                     payload->other.varlen.opaque_bytes, key);
+
+  default:
+    return FPTA_SCHEMA_CORRUPTED;
+  }
+}
+
+//----------------------------------------------------------------------------
+
+/* Элементы массива размещаются в поле последовательно: значения
+ * фиксированного размера вплотную друг к другу, а строки - друг за другом
+ * с терминирующими нулями. */
+static int fpta_array_item2value(fptu_type type, const uint8_t *&item,
+                                 const uint8_t *end, fpta_value &value) {
+  size_t bytes;
+  switch (type) {
+  default:
+    return FPTA_ETYPE;
+  case fptu_uint16:
+    bytes = 2;
+    break;
+  case fptu_int32:
+  case fptu_uint32:
+  case fptu_fp32:
+    bytes = 4;
+    break;
+  case fptu_int64:
+  case fptu_uint64:
+  case fptu_fp64:
+  case fptu_datetime:
+    bytes = 8;
+    break;
+  case fptu_96:
+    bytes = 96 / 8;
+    break;
+  case fptu_128:
+    bytes = 128 / 8;
+    break;
+  case fptu_160:
+    bytes = 160 / 8;
+    break;
+  case fptu_256:
+    bytes = 256 / 8;
+    break;
+  case fptu_cstr: {
+    const void *zero = memchr(item, 0, end - item);
+    if (unlikely(zero == nullptr))
+      return FPTA_DATALEN_MISMATCH;
+    bytes = (const uint8_t *)zero - item + 1;
+  } break;
+  }
+
+  if (unlikely(bytes > (size_t)(end - item)))
+    return FPTA_DATALEN_MISMATCH;
+
+  switch (type) {
+  case fptu_uint16:
+    value = fpta_value_uint(*(const uint16_t *)item);
+    break;
+  case fptu_int32:
+    value = fpta_value_sint(*(const int32_t *)item);
+    break;
+  case fptu_uint32:
+    value = fpta_value_uint(*(const uint32_t *)item);
+    break;
+  case fptu_fp32:
+    value = fpta_value_float(*(const float *)item);
+    break;
+  case fptu_int64:
+    value = fpta_value_sint(*(const int64_t *)item);
+    break;
+  case fptu_uint64:
+    value = fpta_value_uint(*(const uint64_t *)item);
+    break;
+  case fptu_fp64:
+    value = fpta_value_float(*(const double *)item);
+    break;
+  case fptu_datetime: {
+    fptu_time datetime;
+    datetime.fixedpoint = *(const uint64_t *)item;
+    value = fpta_value_datetime(datetime);
+  } break;
+  case fptu_cstr:
+    value = fpta_value_string((const char *)item, bytes - 1);
+    break;
+  default:
+    value = fpta_value_binary(item, bytes);
+    break;
+  }
+
+  item += bytes;
+  return FPTA_SUCCESS;
+}
+
+int fpta_index_row2keys(fpta_shove_t shove, size_t column, const fptu_ro &row,
+                        fpta_keyset &keyset) {
+  assert(fpta_shove_is_multivalued(shove));
+  keyset.count = 0;
+
+  const fptu_field *field =
+      fptu_lookup_ro(row, (unsigned)column, fpta_shove2type(shove));
+  if (field == nullptr)
+    /* отсутствующий массив равнозначен пустому */
+    return FPTA_SUCCESS;
+
+  const fptu_payload *payload = fptu_field_payload(field);
+  const size_t length = payload->other.varlen.array_length;
+  if (length > sizeof(keyset.local) / sizeof(keyset.local[0])) {
+    fpta_key *keys = (fpta_key *)malloc(sizeof(fpta_key) * length);
+    if (unlikely(keys == nullptr))
+      return FPTA_ENOMEM;
+    if (keyset.keys != keyset.local)
+      free(keyset.keys);
+    keyset.keys = keys;
+  }
+
+  /* ключи копируются, так как для каждого элемента формируется значение,
+   * которое может быть размещено только внутри fpta_key */
+  const fptu_type type = fpta_shove2keytype(shove);
+  const fpta_shove_t item_shove = (shove & ~fpta_column_typeid_mask) | type;
+  const uint8_t *item = (const uint8_t *)payload->other.data;
+  const uint8_t *const end = item + units2bytes(payload->other.varlen.brutto);
+  while (keyset.count < length) {
+    fpta_value value;
+    int rc = fpta_array_item2value(type, item, end, value);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+    rc = fpta_index_value2key(item_shove, value, keyset.keys[keyset.count],
+                              true);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+    keyset.count += 1;
+  }
+  return FPTA_SUCCESS;
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright 2016-2017 libfpta authors: please see AUTHORS file.
+ *
+ * This file is part of libfpta, aka "Fast Positive Tables".
+ *
+ * libfpta is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libfpta is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libfpta.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fast_positive/tables_internal.h"
+
+/* Фильтр Блума для отрицательных поисков по уникальным индексам.
+ *
+ * Фильтр содержит надмножество ключей индекса: ключи только добавляются,
+ * а удаленные остаются в фильтре до его перестроения. Поэтому ответ
+ * "ключа нет" всегда достоверен, а ложноположительные ответы лишь
+ * приводят к обычному поиску в индексе.
+ *
+ * Фильтры существуют только внутри процесса и используются лишь пишущими
+ * транзакциями, которые выполняются строго по одной. Однако результат
+ * фиксации известен только после освобождения блокировки mdbx, поэтому
+ * пишущая транзакция дополнительно удерживает keyfilter_mutex до учета
+ * этого результата, иначе следующий писатель мог бы использовать фильтр
+ * одновременно с его освобождением при отмене. Изменения данных,
+ * сделанные другими процессами, обнаруживаются по номеру транзакции:
+ * номер пишущей транзакции на единицу больше номера последней
+ * зафиксированной, поэтому пропуск номера означает, что фильтр устарел.
+ * Устаревший фильтр перестраивается при первом использовании, в том
+ * числе после открытия БД. */
+
+enum {
+  /* количество бит на ключ и хеш-функций, что дает порядка 1%
+   * ложноположительных ответов при заполнении до ожидаемого размера */
+  fpta_keyfilter_bits_per_key = 10,
+  fpta_keyfilter_hashes = 7,
+  fpta_keyfilter_seed = 2017
+};
+
+static fpta_keyfilter *fpta_keyfilter_find(fpta_db *db,
+                                           fpta_shove_t table_shove,
+                                           unsigned column) {
+  for (fpta_keyfilter *filter = db->keyfilters; filter;
+       filter = filter->next)
+    if (filter->table_shove == table_shove && filter->column == column)
+      return filter;
+  return nullptr;
+}
+
+static bool fpta_keyfilter_fresh(const fpta_keyfilter *filter,
+                                 const fpta_txn *txn) {
+  return filter->bits != nullptr &&
+         filter->schema_version == txn->schema_version &&
+         (filter->txnid == txn->data_version ||
+          filter->txnid + 1 == txn->data_version);
+}
+
+static void fpta_keyfilter_set(fpta_keyfilter *filter, const MDB_val &key) {
+  const uint64_t hash = t1ha(key.iov_base, key.iov_len, fpta_keyfilter_seed);
+  const uint64_t step = (hash >> 32) | 1;
+  for (unsigned i = 0; i < fpta_keyfilter_hashes; ++i) {
+    const uint64_t bit = (hash + i * step) & filter->mask;
+    filter->bits[bit >> 6] |= UINT64_C(1) << (bit & 63);
+  }
+}
+
+static bool fpta_keyfilter_test(const fpta_keyfilter *filter,
+                                const MDB_val &key) {
+  const uint64_t hash = t1ha(key.iov_base, key.iov_len, fpta_keyfilter_seed);
+  const uint64_t step = (hash >> 32) | 1;
+  for (unsigned i = 0; i < fpta_keyfilter_hashes; ++i) {
+    const uint64_t bit = (hash + i * step) & filter->mask;
+    if ((filter->bits[bit >> 6] & (UINT64_C(1) << (bit & 63))) == 0)
+      return false;
+  }
+  return true;
+}
+
+/* Размещает пустой фильтр, достаточный для заданного количества ключей. */
+static int fpta_keyfilter_reset(fpta_keyfilter *filter, size_t keys) {
+  size_t bits = 64 * 8;
+  while (bits < keys * fpta_keyfilter_bits_per_key && bits < SIZE_MAX / 2)
+    bits <<= 1;
+
+  if (filter->bits == nullptr || filter->mask + 1 != bits) {
+    uint64_t *place = (uint64_t *)malloc(bits / 8);
+    if (unlikely(place == nullptr))
+      return FPTA_ENOMEM;
+    free(filter->bits);
+    filter->bits = place;
+    filter->mask = bits - 1;
+  }
+
+  memset(filter->bits, 0, bits / 8);
+  filter->count = 0;
+  return FPTA_SUCCESS;
+}
+
+/* Перестраивает фильтр по текущему содержимому индекса, включая
+ * изменения текущей транзакции. */
+static int fpta_keyfilter_rebuild(fpta_txn *txn, fpta_keyfilter *filter,
+                                  MDB_dbi dbi) {
+  size_t keys = (filter->count > filter->expected) ? filter->count
+                                                   : filter->expected;
+  MDB_cursor *mdbx_cursor;
+  int rc = mdbx_cursor_open(txn->mdbx_txn, dbi, &mdbx_cursor);
+  if (unlikely(rc != MDB_SUCCESS))
+    return rc;
+
+  for (;;) {
+    rc = fpta_keyfilter_reset(filter, keys);
+    if (unlikely(rc != FPTA_SUCCESS))
+      break;
+
+    MDB_val mdbx_key, mdbx_data;
+    rc = mdbx_cursor_get(mdbx_cursor, &mdbx_key, &mdbx_data, MDB_FIRST);
+    while (rc == MDB_SUCCESS) {
+      fpta_keyfilter_set(filter, mdbx_key);
+      filter->count += 1;
+      rc = mdbx_cursor_get(mdbx_cursor, &mdbx_key, &mdbx_data,
+                           MDB_NEXT_NODUP);
+    }
+    if (unlikely(rc != MDB_NOTFOUND))
+      break;
+
+    rc = FPTA_SUCCESS;
+    if (filter->count <= keys)
+      break;
+    /* ключей оказалось больше ожидаемого, размер удваивается с запасом */
+    keys = filter->count * 2;
+  }
+
+  mdbx_cursor_close(mdbx_cursor);
+  if (unlikely(rc != FPTA_SUCCESS)) {
+    free(filter->bits);
+    filter->bits = nullptr;
+    return rc;
+  }
+
+  filter->schema_version = txn->schema_version;
+  filter->txnid = txn->data_version;
+  filter->built_txnid = txn->data_version;
+  return FPTA_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+
+bool fpta_keyfilter_lookup(fpta_txn *txn, fpta_name *table_id,
+                           unsigned column, MDB_dbi dbi, const MDB_val &key) {
+  assert(txn->level >= fpta_write);
+  fpta_keyfilter *filter =
+      fpta_keyfilter_find(txn->db, table_id->shove, column);
+  if (filter == nullptr)
+    return true;
+
+  if (unlikely(!fpta_keyfilter_fresh(filter, txn) ||
+               filter->count > (filter->mask + 1) /
+                                   (fpta_keyfilter_bits_per_key / 2))) {
+    /* при ошибке перестроения выполняется обычный поиск */
+    if (unlikely(fpta_keyfilter_rebuild(txn, filter, dbi) != FPTA_SUCCESS))
+      return true;
+  }
+
+  return fpta_keyfilter_test(filter, key);
+}
+
+void fpta_keyfilter_update(fpta_txn *txn, fpta_name *table_id,
+                           unsigned column, const MDB_val &key) {
+  assert(txn->level >= fpta_write);
+  fpta_keyfilter *filter =
+      fpta_keyfilter_find(txn->db, table_id->shove, column);
+  /* устаревший фильтр не обновляется, так как будет перестроен
+   * при следующем использовании, уже с учетом этого ключа */
+  if (filter && fpta_keyfilter_fresh(filter, txn)) {
+    fpta_keyfilter_set(filter, key);
+    filter->count += 1;
+  }
+}
+
+void fpta_keyfilter_commit(fpta_txn *txn) {
+  for (fpta_keyfilter *filter = txn->db->keyfilters; filter;
+       filter = filter->next)
+    if (fpta_keyfilter_fresh(filter, txn))
+      filter->txnid = txn->data_version;
+}
+
+void fpta_keyfilter_abort(fpta_txn *txn) {
+  /* Фильтры, построенные внутри отменяемой транзакции, могли не получить
+   * ключи, которые были удалены до построения, но вернутся при отмене. */
+  for (fpta_keyfilter *filter = txn->db->keyfilters; filter;
+       filter = filter->next)
+    if (filter->bits && filter->built_txnid == txn->data_version) {
+      free(filter->bits);
+      filter->bits = nullptr;
+    }
+}
+
+int fpta_keyfilter_acquire(fpta_db *db) {
+  return pthread_mutex_lock(&db->keyfilter_mutex);
+}
+
+void fpta_keyfilter_release(fpta_db *db) {
+  int err = pthread_mutex_unlock(&db->keyfilter_mutex);
+  assert(err == 0);
+  (void)err;
+}
+
+void fpta_keyfilter_destroy(fpta_db *db) {
+  while (db->keyfilters) {
+    fpta_keyfilter *filter = db->keyfilters;
+    db->keyfilters = filter->next;
+    free(filter->bits);
+    free(filter);
+  }
+}
+
+//----------------------------------------------------------------------------
+
+int fpta_index_keyfilter(fpta_txn *txn, fpta_name *column_id,
+                         size_t expected_keys) {
+  if (unlikely(!fpta_txn_validate(txn, fpta_write)))
+    return FPTA_EINVAL;
+  if (unlikely(!fpta_id_validate(column_id, fpta_column)))
+    return FPTA_EINVAL;
+
+  fpta_name *table_id = column_id->column.table;
+  int rc = fpta_name_refresh_couple(txn, table_id, column_id);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  const fpta_index_type index = fpta_shove2index(column_id->shove);
+  if (unlikely(index == fpta_index_none || !fpta_index_is_unique(index)))
+    return FPTA_NO_INDEX;
+
+  fpta_db *db = txn->db;
+  const unsigned column = (unsigned)column_id->column.num;
+  fpta_keyfilter *filter = fpta_keyfilter_find(db, table_id->shove, column);
+  if (expected_keys == 0) {
+    /* отключение фильтра */
+    for (fpta_keyfilter **scan = &db->keyfilters; *scan;
+         scan = &(*scan)->next) {
+      if (*scan == filter) {
+        *scan = filter->next;
+        free(filter->bits);
+        free(filter);
+        break;
+      }
+    }
+    return FPTA_SUCCESS;
+  }
+
+  if (filter == nullptr) {
+    filter = (fpta_keyfilter *)calloc(1, sizeof(fpta_keyfilter));
+    if (unlikely(filter == nullptr))
+      return FPTA_ENOMEM;
+    filter->table_shove = table_id->shove;
+    filter->column = column;
+    filter->next = db->keyfilters;
+    db->keyfilters = filter;
+  }
+
+  /* фильтр будет (пере)построен при первом использовании */
+  filter->expected = expected_keys;
+  free(filter->bits);
+  filter->bits = nullptr;
+  filter->count = 0;
+  return FPTA_SUCCESS;
+}
@@ -66,6 +66,9 @@ static const char *__fpta_errstr(int errnum) {
   case FPTA_WANNA_DIE:
     return "FPTA: Failure while transaction rollback (wanna die)";
 
+  case FPTA_TXN_CANCELLED:
+    return "FPTA: Transaction was cancelled as a laggard reader";
+
   case FPTA_EINVAL /* EINVAL */:
     return "FPTA: Invalid argument";
   case FPTA_ENOMEM /* ENOMEM */:
@@ -183,6 +186,10 @@ __cold string to_string(const fpta_durability durability) {
     return "mode-lazy";
   case fpta_async:
     return "mode-async";
+  case fpta_sync_group:
+    return "mode-sync-group";
+  case fpta_sync_deferred:
+    return "mode-sync-deferred";
   }
 }
 
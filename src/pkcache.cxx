@@ -0,0 +1,365 @@
+/*
+ * Copyright 2016-2017 libfpta authors: please see AUTHORS file.
+ *
+ * This file is part of libfpta, aka "Fast Positive Tables".
+ *
+ * libfpta is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libfpta is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libfpta.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fast_positive/tables_internal.h"
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+/* Хеш-таблица для точечного поиска строк по неупорядоченным уникальным
+ * первичным ключам, см. fpta_db_pkcache().
+ *
+ * Ключи неупорядоченных индексов не длиннее 64 бит (либо само значение,
+ * либо его t1ha-хеш), поэтому элемент таблицы хранит ключ целиком вместе
+ * с адресом строки внутри отображения БД и копией самой строки, если она
+ * не длиннее fpta_pkcache_row_max.
+ *
+ * Адрес строки действителен только для того снимка данных, в котором
+ * он был получен, и только до перемещения отображения при изменении
+ * размера БД (см. fpta_pkcache_remapped()). Страница с предыдущей версией
+ * строки может быть использована повторно, как только её не удерживают
+ * читатели, причем это происходит при изменении любой строки страницы.
+ * Поэтому читающие транзакции других снимков получают не адрес, а копию
+ * строки в памяти транзакции, действительную до её завершения.
+ *
+ * Копия пригодна для другого снимка, если между ним и снимком, в котором
+ * строка была сохранена, ключ не изменялся. Для этого в каждой корзине
+ * хранится номер транзакции последнего изменения любого из попадающих
+ * в неё ключей, который пишущие транзакции процесса обновляют через
+ * fpta_pk_changed() до фиксации. Очистка таблиц и изменение схемы
+ * аналогично сдвигают общую нижнюю границу floor для всех корзин.
+ *
+ * Изменения других процессов (и других экземпляров fpta_db) не видны,
+ * поэтому tracked хранит номер транзакции, до которого все изменения
+ * учтены. Он продвигается при фиксации пишущих транзакций процесса,
+ * а пропуск номера при старте пишущей транзакции означает изменения
+ * извне, после чего сохраненные ранее строки считаются устаревшими.
+ * Копии используются, только если оба снимка не новее tracked, так
+ * что без собственных писателей таблица работает лишь в пределах
+ * снимка. Все эти изменения выполняются пишущими транзакциями под
+ * keyfilter_mutex, т.е. строго по одной.
+ *
+ * Адресация открытая, с корзинами по два элемента. Каждый элемент
+ * защищен собственным счетчиком версий (seqlock): при записи счетчик
+ * нечетный, а поиск только читает элемент и проверяет, что счетчик
+ * не изменился. Таким образом, поиск не изменяет разделяемую кэш-линию,
+ * а при конкуренции потоков поиск считается промахом, а сохранение
+ * пропускается. */
+
+struct fpta_pkcache_entry {
+  std::atomic<uint32_t> version;
+  uint32_t remaps;
+  uint64_t txnid;
+  fpta_shove_t table_shove;
+  uint64_t key;
+  size_t key_size;
+  const void *data;
+  size_t data_size;
+  uint64_t copy[fpta_pkcache_row_max / sizeof(uint64_t)];
+};
+
+struct fpta_pkcache_bucket {
+  /* номер транзакции последнего изменения ключей корзины */
+  std::atomic<uint64_t> changed;
+  fpta_pkcache_entry entries[2];
+};
+
+struct fpta_pkcache {
+  size_t mask;
+  /* изменяется только при приостановленных транзакциях */
+  uint32_t remaps;
+  std::atomic<uint64_t> tracked;
+  std::atomic<uint64_t> floor;
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+  fpta_pkcache_bucket buckets[1];
+};
+
+/* Блок памяти транзакции для копий строк. */
+struct fpta_pkcache_copies {
+  fpta_pkcache_copies *next;
+  unsigned depth;
+  size_t used;
+  uint64_t space[(fpta_pkcache_copies_chunk - sizeof(void *) * 3) /
+                 sizeof(uint64_t)];
+};
+
+static __inline fpta_pkcache_bucket *
+fpta_pkcache_bucket_of(fpta_pkcache *cache, fpta_shove_t table_shove,
+                       uint64_t key) {
+  /* перемешивание по мотивам финализатора MurmurHash3 */
+  uint64_t hash = (key ^ table_shove) * UINT64_C(0xff51afd7ed558ccd);
+  hash ^= hash >> 33;
+  return &cache->buckets[hash & cache->mask];
+}
+
+static __inline uint64_t fpta_pkcache_key(const MDB_val &pk_key) {
+  uint64_t key = 0;
+  memcpy(&key, pk_key.iov_base, pk_key.iov_len);
+  return key;
+}
+
+static __inline size_t fpta_pkcache_align(size_t bytes) {
+  return (bytes + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+}
+
+/* Проверяет, что строка из снимка stored совпадает с ее версией
+ * в снимке current. */
+static bool fpta_pkcache_unchanged(const fpta_pkcache *cache,
+                                   const fpta_pkcache_bucket *bucket,
+                                   uint64_t stored, uint64_t current) {
+  if (std::max(stored, current) >
+      cache->tracked.load(std::memory_order_acquire))
+    return false;
+  const uint64_t stale =
+      std::max(cache->floor.load(std::memory_order_relaxed),
+               bucket->changed.load(std::memory_order_relaxed));
+  return stale <= std::min(stored, current);
+}
+
+static void *fpta_pkcache_copy_place(fpta_txn *txn, size_t bytes) {
+  fpta_pkcache_copies *chunk = txn->pkcache_copies;
+  if (chunk == nullptr || chunk->used + bytes > sizeof(chunk->space)) {
+    const unsigned depth = chunk ? chunk->depth + 1 : 1;
+    if (depth > fpta_pkcache_copies_max / fpta_pkcache_copies_chunk)
+      return nullptr;
+    fpta_pkcache_copies *fresh =
+        (fpta_pkcache_copies *)malloc(sizeof(fpta_pkcache_copies));
+    if (unlikely(fresh == nullptr))
+      return nullptr;
+    fresh->next = chunk;
+    fresh->depth = depth;
+    fresh->used = 0;
+    txn->pkcache_copies = chunk = fresh;
+  }
+  void *place = (uint8_t *)chunk->space + chunk->used;
+  chunk->used += bytes;
+  return place;
+}
+
+bool fpta_pkcache_lookup(fpta_txn *txn, fpta_name *table_id,
+                         const MDB_val &pk_key, fptu_ro &row) {
+  assert(txn->level == fpta_read && pk_key.iov_len <= sizeof(uint64_t));
+  fpta_pkcache *cache = txn->db->pkcache;
+  const uint64_t key = fpta_pkcache_key(pk_key);
+  const fpta_pkcache_bucket *bucket =
+      fpta_pkcache_bucket_of(cache, table_id->shove, key);
+
+  for (unsigned i = 0; i < 2; ++i) {
+    const fpta_pkcache_entry *entry = &bucket->entries[i];
+    const uint32_t version = entry->version.load(std::memory_order_acquire);
+    if (version & 1)
+      continue;
+    const bool match = entry->table_shove == table_id->shove &&
+                       entry->key == key && entry->key_size == pk_key.iov_len;
+    const uint64_t txnid = entry->txnid;
+    const bool mapped = txnid == txn->data_version &&
+                        entry->remaps == cache->remaps;
+    const void *data = entry->data;
+    const size_t data_size = entry->data_size;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!match || entry->version.load(std::memory_order_relaxed) != version)
+      continue;
+
+    if (mapped) {
+      row.sys.iov_base = (void *)data;
+      row.sys.iov_len = data_size;
+      txn->pkcache_hits += 1;
+      return true;
+    }
+
+    if (data_size > fpta_pkcache_row_max ||
+        !fpta_pkcache_unchanged(cache, bucket, txnid, txn->data_version))
+      break;
+    void *place = fpta_pkcache_copy_place(txn, fpta_pkcache_align(data_size));
+    if (unlikely(place == nullptr))
+      break;
+    memcpy(place, entry->copy, data_size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (entry->version.load(std::memory_order_relaxed) != version) {
+      txn->pkcache_copies->used -= fpta_pkcache_align(data_size);
+      break;
+    }
+    row.sys.iov_base = place;
+    row.sys.iov_len = data_size;
+    txn->pkcache_hits += 1;
+    return true;
+  }
+
+  txn->pkcache_misses += 1;
+  return false;
+}
+
+void fpta_pkcache_store(fpta_txn *txn, fpta_name *table_id,
+                        const MDB_val &pk_key, const fptu_ro &row) {
+  assert(txn->level == fpta_read && pk_key.iov_len <= sizeof(uint64_t));
+  fpta_pkcache *cache = txn->db->pkcache;
+  const uint64_t key = fpta_pkcache_key(pk_key);
+  fpta_pkcache_bucket *bucket =
+      fpta_pkcache_bucket_of(cache, table_id->shove, key);
+
+  /* замещается элемент с тем же ключом, иначе от более старого снимка */
+  fpta_pkcache_entry *entry = &bucket->entries[0];
+  if (!(entry->table_shove == table_id->shove && entry->key == key) &&
+      (bucket->entries[1].txnid < entry->txnid ||
+       (bucket->entries[1].table_shove == table_id->shove &&
+        bucket->entries[1].key == key)))
+    entry = &bucket->entries[1];
+
+  uint32_t version = entry->version.load(std::memory_order_relaxed);
+  if ((version & 1) ||
+      !entry->version.compare_exchange_strong(version, version + 1,
+                                              std::memory_order_acquire))
+    return;
+  std::atomic_thread_fence(std::memory_order_release);
+  entry->txnid = txn->data_version;
+  entry->remaps = cache->remaps;
+  entry->table_shove = table_id->shove;
+  entry->key = key;
+  entry->key_size = pk_key.iov_len;
+  entry->data = row.sys.iov_base;
+  entry->data_size = row.sys.iov_len;
+  if (row.sys.iov_len <= fpta_pkcache_row_max)
+    memcpy(entry->copy, row.sys.iov_base, row.sys.iov_len);
+  entry->version.store(version + 2, std::memory_order_release);
+}
+
+void fpta_pkcache_release(fpta_txn *txn) {
+  fpta_pkcache *cache = txn->db->pkcache;
+  if (txn->pkcache_hits)
+    cache->hits.fetch_add(txn->pkcache_hits, std::memory_order_relaxed);
+  if (txn->pkcache_misses)
+    cache->misses.fetch_add(txn->pkcache_misses, std::memory_order_relaxed);
+  while (txn->pkcache_copies) {
+    fpta_pkcache_copies *chunk = txn->pkcache_copies;
+    txn->pkcache_copies = chunk->next;
+    free(chunk);
+  }
+}
+
+void fpta_pkcache_begin(fpta_txn *txn) {
+  assert(txn->level >= fpta_write);
+  fpta_pkcache *cache = txn->db->pkcache;
+  /* номер пишущей транзакции на единицу больше последней
+   * зафиксированной, поэтому пропуск означает изменения извне */
+  const uint64_t last = txn->data_version - 1;
+  uint64_t floor = cache->floor.load(std::memory_order_relaxed);
+  if (cache->tracked.load(std::memory_order_relaxed) != last) {
+    if (floor < last)
+      cache->floor.store(floor = last, std::memory_order_relaxed);
+    cache->tracked.store(last, std::memory_order_release);
+  }
+  /* изменения схемы не отслеживаются по ключам */
+  if (txn->level == fpta_schema && floor < txn->data_version)
+    cache->floor.store(txn->data_version, std::memory_order_release);
+}
+
+void fpta_pkcache_commit(fpta_txn *txn) {
+  assert(txn->level >= fpta_write);
+  txn->db->pkcache->tracked.store(txn->data_version,
+                                  std::memory_order_release);
+}
+
+void fpta_pkcache_changed(fpta_txn *txn, fpta_name *table_id,
+                          const MDB_val &pk_key) {
+  assert(txn->level >= fpta_write && pk_key.iov_len <= sizeof(uint64_t));
+  fpta_pkcache *cache = txn->db->pkcache;
+  fpta_pkcache_bucket_of(cache, table_id->shove, fpta_pkcache_key(pk_key))
+      ->changed.store(txn->data_version, std::memory_order_release);
+}
+
+void fpta_pkcache_cleared(fpta_txn *txn) {
+  assert(txn->level >= fpta_write);
+  fpta_pkcache *cache = txn->db->pkcache;
+  if (cache->floor.load(std::memory_order_relaxed) < txn->data_version)
+    cache->floor.store(txn->data_version, std::memory_order_release);
+}
+
+void fpta_pkcache_remapped(fpta_db *db) {
+  if (db->pkcache)
+    db->pkcache->remaps += 1;
+}
+
+void fpta_pkcache_destroy(fpta_db *db) {
+  if (db->pkcache) {
+    for (size_t i = 0; i <= db->pkcache->mask; ++i)
+      db->pkcache->buckets[i].~fpta_pkcache_bucket();
+    free(db->pkcache);
+    db->pkcache = nullptr;
+  }
+}
+
+//----------------------------------------------------------------------------
+
+int fpta_db_pkcache(fpta_db *db, size_t entries) {
+  if (unlikely(!fpta_db_validate(db)))
+    return FPTA_EINVAL;
+  if (unlikely(entries < 2 || entries > SIZE_MAX / 2 /
+                                            sizeof(fpta_pkcache_entry)))
+    return FPTA_EINVAL;
+  if (unlikely(db->pkcache != nullptr))
+    return EEXIST;
+
+  size_t size = 2;
+  while (size < entries)
+    size <<= 1;
+  const size_t buckets = size / 2;
+
+  fpta_pkcache *cache = (fpta_pkcache *)malloc(
+      sizeof(fpta_pkcache) + (buckets - 1) * sizeof(fpta_pkcache_bucket));
+  if (unlikely(cache == nullptr))
+    return FPTA_ENOMEM;
+
+  cache->mask = buckets - 1;
+  cache->remaps = 0;
+  new (&cache->tracked) std::atomic<uint64_t>(0);
+  new (&cache->floor) std::atomic<uint64_t>(0);
+  new (&cache->hits) std::atomic<uint64_t>(0);
+  new (&cache->misses) std::atomic<uint64_t>(0);
+  for (size_t i = 0; i < buckets; ++i) {
+    fpta_pkcache_bucket *bucket = new (&cache->buckets[i]) fpta_pkcache_bucket;
+    bucket->changed.store(0, std::memory_order_relaxed);
+    for (unsigned n = 0; n < 2; ++n) {
+      fpta_pkcache_entry *entry = &bucket->entries[n];
+      entry->version.store(0, std::memory_order_relaxed);
+      entry->remaps = 0;
+      /* пустой элемент не соответствует ни одной таблице */
+      entry->txnid = 0;
+      entry->table_shove = 0;
+      entry->key = 0;
+    }
+  }
+
+  db->pkcache = cache;
+  return FPTA_SUCCESS;
+}
+
+int fpta_db_pkcache_info(fpta_db *db, fpta_pkcache_info *info) {
+  if (unlikely(!fpta_db_validate(db) || info == nullptr))
+    return FPTA_EINVAL;
+
+  memset(info, 0, sizeof(fpta_pkcache_info));
+  if (db->pkcache) {
+    info->entries = (db->pkcache->mask + 1) * 2;
+    info->hits = db->pkcache->hits.load(std::memory_order_relaxed);
+    info->misses = db->pkcache->misses.load(std::memory_order_relaxed);
+  }
+  return FPTA_SUCCESS;
+}
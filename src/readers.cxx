@@ -0,0 +1,300 @@
+/*
+ * Copyright 2016-2017 libfpta authors: please see AUTHORS file.
+ *
+ * This file is part of libfpta, aka "Fast Positive Tables".
+ *
+ * libfpta is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libfpta is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libfpta.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fast_positive/tables_internal.h"
+
+/* Учет длительных читающих транзакций, см. fpta_transaction_longterm().
+ *
+ * Отмеченные транзакции собраны в список, по которому определяется
+ * отставание самой старой из них и применяется политика отмены
+ * отстающих. Отмена выполняется в потоке пишущей транзакции, поэтому
+ * транзакция только помечается как отмененная, а её mdbx-транзакцию
+ * завершает владелец при вызове fpta_transaction_end().
+ *
+ * После фиксации пишущей транзакции отстающие транзакции отменяются
+ * при достижении заданного заполнения БД, но удерживаемые ими страницы
+ * освобождаются только после их завершения. При исчерпании места mdbx
+ * вызывает fpta_readers_oomkick(), и слот читателя отмененной транзакции
+ * сразу освобождается, т.е. удерживаемые ею страницы становятся
+ * доступными уже для текущей пишущей транзакции. */
+
+struct fpta_readers {
+  pthread_mutex_t mutex;
+  fpta_longterm *head;
+  size_t count;
+  /* политика отмены отстающих транзакций */
+  unsigned space_threshold;
+  uint64_t max_lag;
+  fpta_laggard_callback *callback;
+  void *context;
+  /* количество отмененных транзакций */
+  uint64_t cancelled;
+};
+
+static void fpta_readers_lock(fpta_readers *readers) {
+  int err = pthread_mutex_lock(&readers->mutex);
+  assert(err == 0);
+  (void)err;
+}
+
+static void fpta_readers_unlock(fpta_readers *readers) {
+  int err = pthread_mutex_unlock(&readers->mutex);
+  assert(err == 0);
+  (void)err;
+}
+
+static unsigned fpta_readers_age_ms(const struct timespec &since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  int64_t ms = (int64_t)(now.tv_sec - since.tv_sec) * 1000 +
+               (now.tv_nsec - since.tv_nsec) / 1000000;
+  return (ms > 0) ? (unsigned)ms : 0;
+}
+
+/* Отменяет отстающую транзакцию с согласия функции политики,
+ * вызывается с захваченным мьютексом. */
+static bool fpta_readers_cancel(fpta_readers *readers,
+                                fpta_longterm *longterm, uint64_t lag) {
+  if (longterm->cancelled.load())
+    return true;
+  if (lag < readers->max_lag)
+    return false;
+  if (readers->callback &&
+      !readers->callback(readers->context, longterm->txn, lag,
+                         fpta_readers_age_ms(longterm->since)))
+    return false;
+
+  longterm->cancelled.store(true);
+  readers->cancelled += 1;
+  return true;
+}
+
+/* Вызывается mdbx при исчерпании места, если самый старый читатель
+ * удерживает страницы. Слот читателя освобождается, только если все
+ * длительные транзакции этого снимка отменены. */
+static int fpta_readers_oomkick(MDB_env *env, int pid, mdbx_tid_t tid,
+                                uint64_t txn, unsigned gap, int retry) {
+  (void)tid;
+  if (retry < 0)
+    /* уведомление о завершении цикла ожидания */
+    return 0;
+  if (pid != getpid())
+    return -1;
+
+  fpta_db *db = (fpta_db *)mdbx_env_get_userctx(env);
+  fpta_readers *readers = db->readers;
+  bool found = false, cancelled = true;
+  fpta_readers_lock(readers);
+  if (readers->space_threshold) {
+    for (fpta_longterm *longterm = readers->head; longterm;
+         longterm = longterm->next) {
+      if (longterm->txn->data_version == txn) {
+        found = true;
+        if (!fpta_readers_cancel(readers, longterm, gap))
+          cancelled = false;
+      }
+    }
+  }
+  fpta_readers_unlock(readers);
+  return (found && cancelled) ? 1 : -1;
+}
+
+int fpta_readers_init(fpta_db *db) {
+  assert(db->readers == nullptr);
+  fpta_readers *readers = (fpta_readers *)calloc(1, sizeof(fpta_readers));
+  if (unlikely(readers == nullptr))
+    return FPTA_ENOMEM;
+
+  int rc = pthread_mutex_init(&readers->mutex, nullptr);
+  if (unlikely(rc != 0)) {
+    free(readers);
+    return rc;
+  }
+
+  db->readers = readers;
+  return FPTA_SUCCESS;
+}
+
+void fpta_readers_destroy(fpta_db *db) {
+  fpta_readers *readers = db->readers;
+  if (readers) {
+    assert(readers->head == nullptr && readers->count == 0);
+    int err = pthread_mutex_destroy(&readers->mutex);
+    assert(err == 0);
+    (void)err;
+    free(readers);
+    db->readers = nullptr;
+  }
+}
+
+void fpta_readers_unregister(fpta_txn *txn) {
+  fpta_readers *readers = txn->db->readers;
+  fpta_longterm *longterm = txn->longterm;
+
+  fpta_readers_lock(readers);
+  for (fpta_longterm **ptr = &readers->head;; ptr = &(*ptr)->next) {
+    assert(*ptr != nullptr);
+    if (*ptr == longterm) {
+      *ptr = longterm->next;
+      break;
+    }
+  }
+  readers->count -= 1;
+  fpta_readers_unlock(readers);
+
+  txn->longterm = nullptr;
+  free(longterm);
+}
+
+bool fpta_readers_longterm(fpta_db *db) {
+  fpta_readers *readers = db->readers;
+  fpta_readers_lock(readers);
+  const bool present = readers->count > 0;
+  fpta_readers_unlock(readers);
+  return present;
+}
+
+void fpta_readers_check(fpta_db *db) {
+  fpta_readers *readers = db->readers;
+  fpta_readers_lock(readers);
+  if (readers->space_threshold) {
+    for (fpta_longterm *longterm = readers->head; longterm;
+         longterm = longterm->next) {
+      int percent = 0;
+      int lag = mdbx_txn_straggler(longterm->txn->mdbx_txn, &percent);
+      if (unlikely(lag < 0))
+        continue;
+      /* заполнение БД одно для всех транзакций */
+      if ((unsigned)percent < readers->space_threshold)
+        break;
+      fpta_readers_cancel(readers, longterm, (unsigned)lag);
+    }
+  }
+  fpta_readers_unlock(readers);
+}
+
+//----------------------------------------------------------------------------
+
+int fpta_transaction_longterm(fpta_txn *txn) {
+  if (unlikely(!fpta_txn_validate(txn, fpta_read)))
+    return FPTA_EINVAL;
+  if (unlikely(txn->level != fpta_read))
+    return FPTA_EINVAL;
+  if (txn->longterm)
+    return FPTA_SUCCESS;
+
+  fpta_longterm *longterm =
+      (fpta_longterm *)calloc(1, sizeof(fpta_longterm));
+  if (unlikely(longterm == nullptr))
+    return FPTA_ENOMEM;
+  longterm->txn = txn;
+  longterm->cancelled.store(false);
+  clock_gettime(CLOCK_MONOTONIC, &longterm->since);
+  txn->longterm = longterm;
+
+  fpta_readers *readers = txn->db->readers;
+  fpta_readers_lock(readers);
+  longterm->next = readers->head;
+  readers->head = longterm;
+  readers->count += 1;
+  fpta_readers_unlock(readers);
+  return FPTA_SUCCESS;
+}
+
+int fpta_db_readers_info(fpta_db *db, fpta_readers_info *info) {
+  if (unlikely(!fpta_db_validate(db) || info == nullptr))
+    return FPTA_EINVAL;
+
+  memset(info, 0, sizeof(fpta_readers_info));
+  fpta_readers *readers = db->readers;
+  fpta_readers_lock(readers);
+  info->longterm = readers->count;
+  info->cancelled = readers->cancelled;
+
+  fpta_longterm *oldest = nullptr;
+  for (fpta_longterm *longterm = readers->head; longterm;
+       longterm = longterm->next) {
+    if (oldest == nullptr ||
+        longterm->txn->data_version < oldest->txn->data_version)
+      oldest = longterm;
+  }
+
+  if (oldest) {
+    int percent = 0;
+    int lag = mdbx_txn_straggler(oldest->txn->mdbx_txn, &percent);
+    if (unlikely(lag < 0)) {
+      fpta_readers_unlock(readers);
+      return lag;
+    }
+    info->oldest_txnid = oldest->txn->data_version;
+    info->oldest_lag = (unsigned)lag;
+    info->oldest_age_ms = fpta_readers_age_ms(oldest->since);
+    info->last_txnid = info->oldest_txnid + info->oldest_lag;
+    info->space_used_percent = (unsigned)percent;
+  }
+  fpta_readers_unlock(readers);
+
+  if (oldest == nullptr) {
+    /* длительных транзакций нет, получаем сведения через временную,
+     * которая учитывается в слоте потока, чтобы размер БД не был
+     * изменен во время ее выполнения */
+    unsigned slot = 0;
+    int rc = fpta_db_lock(db, fpta_read, slot);
+    if (unlikely(rc != 0))
+      return rc;
+    MDB_txn *mdbx_txn;
+    rc = mdbx_txn_begin(db->mdbx_env, nullptr, MDB_RDONLY, &mdbx_txn);
+    if (likely(rc == MDB_SUCCESS)) {
+      mdbx_canary canary;
+      info->last_txnid = mdbx_canary_get(mdbx_txn, &canary);
+      int percent = 0;
+      rc = mdbx_txn_straggler(mdbx_txn, &percent);
+      mdbx_txn_abort(mdbx_txn);
+      if (likely(rc >= 0)) {
+        info->space_used_percent = (unsigned)percent;
+        rc = FPTA_SUCCESS;
+      }
+    }
+    int err = fpta_db_unlock(db, fpta_read, slot);
+    assert(err == 0);
+    (void)err;
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
+  return FPTA_SUCCESS;
+}
+
+int fpta_db_laggard_policy(fpta_db *db, unsigned space_threshold,
+                           uint64_t max_lag, fpta_laggard_callback *callback,
+                           void *context) {
+  if (unlikely(!fpta_db_validate(db) || space_threshold > 100))
+    return FPTA_EINVAL;
+
+  fpta_readers *readers = db->readers;
+  fpta_readers_lock(readers);
+  readers->space_threshold = space_threshold;
+  readers->max_lag = max_lag;
+  readers->callback = callback;
+  readers->context = context;
+  fpta_readers_unlock(readers);
+
+  mdbx_env_set_oomfunc(db->mdbx_env,
+                       space_threshold ? fpta_readers_oomkick : nullptr);
+  return FPTA_SUCCESS;
+}
@@ -19,6 +19,9 @@
 
 #include "fast_positive/tables_internal.h"
 
+#include <atomic>
+#include <mutex>
+
 static __inline fpta_shove_t fpta_dbi_shove(const fpta_shove_t table_shove,
                                             const size_t index_id) {
   assert(table_shove > fpta_flag_table);
@@ -241,27 +244,118 @@ int fpta_open_secondaries(fpta_txn *txn, fpta_name *table_id,
   return FPTA_SUCCESS;
 }
 
+static int fpta_changelog_dbi_open(fpta_txn *txn, fpta_shove_t table_shove,
+                                   MDB_dbi *handle, unsigned dbi_flags) {
+  const auto key_shove = fpta_column_shove(0, fptu_uint64, fpta_primary);
+  const auto data_shove = fpta_column_shove(0, fptu_opaque, fpta_primary);
+  return fpta_dbi_open(txn, fpta_dbi_shove(table_shove, fpta_changelog_index),
+                       handle, dbi_flags, key_shove, data_shove);
+}
+
+int fpta_open_changelog(fpta_txn *txn, fpta_name *table_id, MDB_dbi *handle) {
+  assert(fpta_id_validate(table_id, fpta_table));
+  assert(fpta_schema_changelog(table_id->table.def));
+  return fpta_changelog_dbi_open(txn, table_id->shove, handle, 0);
+}
+
 //----------------------------------------------------------------------------
 
 void fpta_column_set_init(fpta_column_set *column_set) {
   column_set->count = 0;
   column_set->shoves[0] = 0;
+  column_set->extra_count = 0;
 }
 
-int fpta_column_describe(const char *column_name, enum fptu_type data_type,
-                         fpta_index_type index_type,
-                         fpta_column_set *column_set) {
+static int fpta_column_set_lookup(const fpta_column_set *column_set,
+                                  const char *column_name) {
   if (unlikely(!fpta_validate_name(column_name)))
+    return -1;
+
+  const fpta_shove_t shove = fpta_shove_name(column_name, fpta_column);
+  for (size_t i = 0; i < column_set->count; ++i) {
+    if (column_set->shoves[i] && fpta_shove_eq(column_set->shoves[i], shove))
+      return (int)i;
+  }
+  return -1;
+}
+
+static int fpta_column_set_extra_add(fpta_column_set *column_set,
+                                     unsigned kind, unsigned column,
+                                     uint32_t param,
+                                     const fpta_shove_t *payload,
+                                     size_t words) {
+  assert(column < column_set->count);
+  if (unlikely(column_set->extra_count > fpta_max_schema_extra))
     return FPTA_EINVAL;
+  if (unlikely(words > 255 ||
+               column_set->extra_count + 1 + words > fpta_max_schema_extra))
+    return FPTA_TOOMANY;
 
-  if (unlikely(data_type == fptu_null ||
-               data_type == (fptu_null | fptu_farray) ||
-               data_type > (fptu_nested /* TODO: | fptu_farray */)))
+  for (size_t i = 0; i < column_set->extra_count;
+       i += 1 + fpta_extra_words(column_set->extra[i])) {
+    if (fpta_extra_kind(column_set->extra[i]) == kind &&
+        fpta_extra_column(column_set->extra[i]) == column)
+      return EEXIST;
+  }
+
+  fpta_shove_t *extra = column_set->extra + column_set->extra_count;
+  extra[0] = fpta_extra_header(kind, column, words, param);
+  if (words)
+    memcpy(extra + 1, payload, words * sizeof(fpta_shove_t));
+  column_set->extra_count += (unsigned)(1 + words);
+  return FPTA_SUCCESS;
+}
+
+/* Проверяет допустимость типа данных колонки с учетом вида индекса.
+ * Колонки-массивы допускаются для числовых типов, fptu_datetime,
+ * двоичных значений фиксированного размера и строк, а индексироваться
+ * могут только вторичным индексом с повторами. Для элементов массивов
+ * fptu_opaque и fptu_nested не определено представление в виде ключа,
+ * поэтому такие массивы отвергаются. */
+static int fpta_column_type_validate(fptu_type data_type,
+                                     fpta_index_type index_type) {
+  if (data_type & fptu_farray) {
+    data_type = (fptu_type)(data_type & ~fptu_farray);
+    switch (data_type) {
+    default:
+      return FPTA_EINVAL;
+    case fptu_opaque:
+    case fptu_nested:
+      return FPTA_ETYPE;
+    case fptu_uint16:
+    case fptu_int32:
+    case fptu_uint32:
+    case fptu_fp32:
+    case fptu_int64:
+    case fptu_uint64:
+    case fptu_fp64:
+    case fptu_datetime:
+    case fptu_96:
+    case fptu_128:
+    case fptu_160:
+    case fptu_256:
+    case fptu_cstr:
+      break;
+    }
+    if (index_type != fpta_index_none &&
+        (!fpta_index_is_secondary(index_type) ||
+         fpta_index_is_unique(index_type)))
+      return FPTA_EINVAL;
+  } else if (unlikely(data_type == fptu_null || data_type > fptu_nested))
     return FPTA_EINVAL;
 
   if (index_type && data_type < fptu_96 && fpta_index_is_reverse(index_type))
     return FPTA_EINVAL;
 
+  return FPTA_SUCCESS;
+}
+
+int fpta_column_describe(const char *column_name, enum fptu_type data_type,
+                         fpta_index_type index_type,
+                         fpta_column_set *column_set) {
+  if (unlikely(!fpta_validate_name(column_name)))
+    return FPTA_EINVAL;
+
   switch (index_type) {
   default:
     return FPTA_EINVAL;
@@ -287,6 +381,10 @@ int fpta_column_describe(const char *column_name, enum fptu_type data_type,
   }
   assert(index_type != (fpta_index_type)fpta_flag_table);
 
+  int rc = fpta_column_type_validate(data_type, index_type);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
   if (unlikely(column_set == nullptr || column_set->count > fpta_max_cols))
     return FPTA_EINVAL;
 
@@ -320,6 +418,393 @@ int fpta_column_describe(const char *column_name, enum fptu_type data_type,
   return FPTA_SUCCESS;
 }
 
+int fpta_column_describe_expiry(const char *column_name,
+                                fpta_column_set *column_set) {
+  if (unlikely(column_set == nullptr || column_set->count > fpta_max_cols))
+    return FPTA_EINVAL;
+
+  const int column = fpta_column_set_lookup(column_set, column_name);
+  if (unlikely(column < 0))
+    return FPTA_COLUMN_MISSING;
+
+  fpta_shove_t &shove = column_set->shoves[column];
+  if (unlikely(fpta_shove2type(shove) != fptu_datetime))
+    return FPTA_ETYPE;
+
+  const fpta_index_type index = fpta_shove2index(shove);
+  if (index == fpta_index_none) {
+    /* для эффективного удаления устаревших строк требуется
+     * упорядоченный индекс, поэтому добавляем его */
+    if (column_set->shoves[0] && !fpta_index_is_unique(column_set->shoves[0]))
+      return FPTA_EINVAL;
+    shove |= fpta_secondary_withdups;
+  } else if (unlikely(!fpta_index_is_ordered(index)))
+    return FPTA_EINVAL;
+
+  return fpta_column_set_extra_add(column_set, fpta_extra_expiry,
+                                   (unsigned)column, 0, nullptr, 0);
+}
+
+static int fpta_predicate_serialize(const fpta_filter *filter,
+                                    const fpta_column_set *column_set,
+                                    fpta_shove_t *predicate, size_t room,
+                                    size_t &words) {
+  if (unlikely(filter == nullptr))
+    return FPTA_EINVAL;
+  if (unlikely(words >= room))
+    return FPTA_TOOMANY;
+
+  switch (filter->type) {
+  default:
+    /* функторы не могут быть сохранены в схеме */
+    return FPTA_EINVAL;
+
+  case fpta_node_not:
+    predicate[words++] = fpta_predicate_node(filter->type, fpta_null, 0, 0);
+    return fpta_predicate_serialize(filter->node_not, column_set, predicate,
+                                    room, words);
+
+  case fpta_node_or:
+  case fpta_node_and: {
+    predicate[words++] = fpta_predicate_node(filter->type, fpta_null, 0, 0);
+    int rc = fpta_predicate_serialize(filter->node_and.a, column_set,
+                                      predicate, room, words);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+    return fpta_predicate_serialize(filter->node_and.b, column_set, predicate,
+                                    room, words);
+  }
+
+  case fpta_node_lt:
+  case fpta_node_gt:
+  case fpta_node_le:
+  case fpta_node_ge:
+  case fpta_node_eq:
+  case fpta_node_ne:
+    break;
+  }
+
+  /* колонка задается посредством fpta_name, у которого до создания
+   * таблицы известно только имя, поэтому ищем по имени */
+  const fpta_name *left_id = filter->node_cmp.left_id;
+  if (unlikely(left_id == nullptr))
+    return FPTA_EINVAL;
+  unsigned column = 0;
+  while (column < column_set->count &&
+         !fpta_shove_eq(column_set->shoves[column], left_id->shove))
+    ++column;
+  if (unlikely(column == column_set->count))
+    return FPTA_COLUMN_MISSING;
+
+  const fpta_value &value = filter->node_cmp.right_value;
+  uint32_t length = 0;
+  switch (value.type) {
+  default:
+    return FPTA_EINVAL;
+  case fpta_null:
+  case fpta_signed_int:
+  case fpta_unsigned_int:
+  case fpta_datetime:
+  case fpta_float_point:
+    break;
+  case fpta_string:
+  case fpta_binary:
+    if (unlikely(value.binary_data == nullptr && value.binary_length))
+      return FPTA_EINVAL;
+    length = value.binary_length;
+    break;
+  }
+
+  const fpta_shove_t node =
+      fpta_predicate_node(filter->type, value.type, column, length);
+  const size_t value_words = fpta_predicate_value_words(node);
+  if (unlikely(value_words >= room - words))
+    return FPTA_TOOMANY;
+
+  predicate[words++] = node;
+  if (length) {
+    predicate[words + value_words - 1] = 0;
+    memcpy(predicate + words, value.binary_data, length);
+  } else if (value_words)
+    predicate[words] = value.uint;
+  words += value_words;
+  return FPTA_SUCCESS;
+}
+
+int fpta_column_describe_partial(const char *column_name,
+                                 const fpta_filter *predicate,
+                                 fpta_column_set *column_set) {
+  if (unlikely(column_set == nullptr || column_set->count > fpta_max_cols))
+    return FPTA_EINVAL;
+
+  const int column = fpta_column_set_lookup(column_set, column_name);
+  if (unlikely(column < 0))
+    return FPTA_COLUMN_MISSING;
+
+  const fpta_shove_t shove = column_set->shoves[column];
+  if (unlikely(fpta_shove2index(shove) == fpta_index_none ||
+               !fpta_index_is_secondary(shove)))
+    return FPTA_EINVAL;
+
+  fpta_shove_t serialized[255];
+  size_t words = 0;
+  int rc = fpta_predicate_serialize(predicate, column_set, serialized,
+                                    sizeof(serialized) / sizeof(serialized[0]),
+                                    words);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  return fpta_column_set_extra_add(column_set, fpta_extra_partial,
+                                   (unsigned)column, 0, serialized, words);
+}
+
+/* Значение PK может быть исключено из строк, только если оно точно
+ * восстанавливается из ключа: для типов фиксированного размера без
+ * хеширования, а также при уникальности PK. */
+static int fpta_pk_strip_validate(fpta_shove_t pk) {
+  if (unlikely(fpta_shove2index(pk) == fpta_index_none ||
+               !fpta_index_is_primary(pk) || !fpta_index_is_unique(pk)))
+    return FPTA_EINVAL;
+
+  switch (fpta_shove2type(pk)) {
+  default:
+    return FPTA_ETYPE;
+  case fptu_uint16:
+  case fptu_int32:
+  case fptu_uint32:
+  case fptu_fp32:
+  case fptu_int64:
+  case fptu_uint64:
+  case fptu_fp64:
+  case fptu_datetime:
+    return FPTA_SUCCESS;
+  case fptu_96:
+  case fptu_128:
+  case fptu_160:
+  case fptu_256:
+    return fpta_index_is_ordered(pk) ? FPTA_SUCCESS : FPTA_ETYPE;
+  }
+}
+
+int fpta_column_set_strip_pk(fpta_column_set *column_set) {
+  if (unlikely(column_set == nullptr || column_set->count > fpta_max_cols))
+    return FPTA_EINVAL;
+  if (unlikely(column_set->count < 1 || !column_set->shoves[0]))
+    return FPTA_EINVAL;
+
+  int rc = fpta_pk_strip_validate(column_set->shoves[0]);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  return fpta_column_set_extra_add(column_set, fpta_extra_pk_stripped, 0, 0,
+                                   nullptr, 0);
+}
+
+int fpta_column_set_changelog(fpta_column_set *column_set, unsigned retention) {
+  if (unlikely(column_set == nullptr || column_set->count > fpta_max_cols))
+    return FPTA_EINVAL;
+  if (unlikely(column_set->count < 1 || !column_set->shoves[0]))
+    return FPTA_EINVAL;
+
+  return fpta_column_set_extra_add(column_set, fpta_extra_changelog, 0,
+                                   retention, nullptr, 0);
+}
+
+/* Проверяет применимость выражения к индексу колонки. */
+static int fpta_expression_validate(const fpta_shove_t *def, size_t count,
+                                    unsigned column, unsigned expression,
+                                    uint64_t param) {
+  const fpta_shove_t shove = def[column];
+  if (unlikely(fpta_shove2index(shove) == fpta_index_none ||
+               !fpta_index_is_secondary(shove)))
+    return FPTA_EINVAL;
+
+  const fptu_type type = fpta_shove2type(shove);
+  switch (expression) {
+  default:
+    return FPTA_EINVAL;
+
+  case fpta_expr_lowercase:
+  case fpta_expr_casefold:
+    if (unlikely(type != fptu_cstr))
+      return FPTA_ETYPE;
+    return (param == 0) ? FPTA_SUCCESS : FPTA_EINVAL;
+
+  case fpta_expr_prefix:
+    if (unlikely(type != fptu_cstr && type != fptu_opaque))
+      return FPTA_ETYPE;
+    return (param > 0 && param <= fpta_max_keylen) ? FPTA_SUCCESS
+                                                   : FPTA_EINVAL;
+
+  case fpta_expr_datetime_trunc:
+    if (unlikely(type != fptu_datetime))
+      return FPTA_ETYPE;
+    return (param > 0 && param <= UINT32_MAX) ? FPTA_SUCCESS : FPTA_EINVAL;
+
+  case fpta_expr_extractor:
+    if (unlikely(type == fptu_nested || (type & fptu_farray)))
+      return FPTA_ETYPE;
+    return (param != 0) ? FPTA_SUCCESS : FPTA_EINVAL;
+
+  case fpta_expr_nested_path: {
+    if (unlikely(type == fptu_nested || (type & fptu_farray)))
+      return FPTA_ETYPE;
+    const unsigned source = fpta_path_column(param);
+    const unsigned depth = fpta_path_depth(param);
+    if (unlikely(source >= count || source == column || depth < 1 ||
+                 depth > fpta_max_nested_depth ||
+                 (param >> (fpta_path_step_shift +
+                            fpta_path_step_bits * depth)) != 0))
+      return FPTA_EINVAL;
+    for (unsigned level = 0; level < depth; ++level)
+      if (unlikely(fpta_path_step(param, level) >= fpta_max_cols))
+        return FPTA_EINVAL;
+    return (fpta_shove2type(def[source]) == fptu_nested) ? FPTA_SUCCESS
+                                                         : FPTA_ETYPE;
+  }
+  }
+}
+
+static int fpta_column_set_expression_add(fpta_column_set *column_set,
+                                          const char *column_name,
+                                          unsigned expression,
+                                          fpta_shove_t param) {
+  if (unlikely(column_set == nullptr || column_set->count > fpta_max_cols))
+    return FPTA_EINVAL;
+
+  const int column = fpta_column_set_lookup(column_set, column_name);
+  if (unlikely(column < 0))
+    return FPTA_COLUMN_MISSING;
+
+  int rc = fpta_expression_validate(column_set->shoves, column_set->count,
+                                    (unsigned)column, expression, param);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  return fpta_column_set_extra_add(column_set, fpta_extra_expression,
+                                   (unsigned)column, expression, &param, 1);
+}
+
+int fpta_column_describe_expression(const char *column_name,
+                                    enum fpta_index_expression expression,
+                                    unsigned param,
+                                    fpta_column_set *column_set) {
+  if (unlikely(expression == fpta_expr_extractor ||
+               expression == fpta_expr_nested_path))
+    return FPTA_EINVAL;
+
+  return fpta_column_set_expression_add(column_set, column_name, expression,
+                                        param);
+}
+
+int fpta_column_describe_extractor(const char *column_name,
+                                   const char *extractor_name,
+                                   fpta_column_set *column_set) {
+  if (unlikely(!fpta_validate_name(extractor_name)))
+    return FPTA_EINVAL;
+
+  return fpta_column_set_expression_add(
+      column_set, column_name, fpta_expr_extractor,
+      fpta_shove_name(extractor_name, fpta_column));
+}
+
+int fpta_column_describe_collation(const char *column_name,
+                                   enum fpta_collation collation,
+                                   fpta_column_set *column_set) {
+  switch (collation) {
+  default:
+    return FPTA_EINVAL;
+
+  case fpta_collation_binary: {
+    if (unlikely(column_set == nullptr || column_set->count > fpta_max_cols))
+      return FPTA_EINVAL;
+    const int column = fpta_column_set_lookup(column_set, column_name);
+    if (unlikely(column < 0))
+      return FPTA_COLUMN_MISSING;
+    const fpta_shove_t shove = column_set->shoves[column];
+    if (unlikely(fpta_shove2index(shove) == fpta_index_none))
+      return FPTA_EINVAL;
+    return (fpta_shove2type(shove) == fptu_cstr) ? FPTA_SUCCESS : FPTA_ETYPE;
+  }
+
+  case fpta_collation_ascii_ci:
+    return fpta_column_set_expression_add(column_set, column_name,
+                                          fpta_expr_lowercase, 0);
+  case fpta_collation_utf8_ci:
+    return fpta_column_set_expression_add(column_set, column_name,
+                                          fpta_expr_casefold, 0);
+  }
+}
+
+int fpta_column_describe_nested(const char *column_name,
+                                const char *nested_column_name,
+                                const unsigned *path, size_t depth,
+                                fpta_column_set *column_set) {
+  if (unlikely(column_set == nullptr || column_set->count > fpta_max_cols))
+    return FPTA_EINVAL;
+  if (unlikely(path == nullptr || depth < 1 || depth > fpta_max_nested_depth))
+    return FPTA_EINVAL;
+  for (size_t i = 0; i < depth; ++i)
+    if (unlikely(path[i] >= fpta_max_cols))
+      return FPTA_EINVAL;
+
+  const int source = fpta_column_set_lookup(column_set, nested_column_name);
+  if (unlikely(source < 0))
+    return FPTA_COLUMN_MISSING;
+
+  return fpta_column_set_expression_add(
+      column_set, column_name, fpta_expr_nested_path,
+      fpta_path_pack((unsigned)source, path, depth));
+}
+
+/* Реестр функций извлечения ключа. Элементы только добавляются,
+ * а счетчик увеличивается после заполнения очередного элемента,
+ * поэтому поиск выполняется без блокировки. */
+static struct fpta_key_extractor_entry {
+  fpta_shove_t name;
+  fpta_key_extractor *extractor;
+  void *context;
+} fpta_key_extractors[fpta_max_key_extractors];
+static std::atomic<unsigned> fpta_key_extractors_count;
+static std::mutex fpta_key_extractors_mutex;
+
+int fpta_key_extractor_register(const char *name,
+                                fpta_key_extractor *extractor,
+                                void *context) {
+  if (unlikely(!fpta_validate_name(name) || extractor == nullptr))
+    return FPTA_EINVAL;
+
+  const fpta_shove_t shove = fpta_shove_name(name, fpta_column);
+  std::lock_guard<std::mutex> guard(fpta_key_extractors_mutex);
+  const unsigned count = fpta_key_extractors_count.load();
+  for (unsigned i = 0; i < count; ++i) {
+    if (fpta_key_extractors[i].name == shove)
+      return EEXIST;
+  }
+
+  if (unlikely(count >= fpta_max_key_extractors))
+    return FPTA_TOOMANY;
+
+  fpta_key_extractors[count].name = shove;
+  fpta_key_extractors[count].extractor = extractor;
+  fpta_key_extractors[count].context = context;
+  fpta_key_extractors_count.store(count + 1, std::memory_order_release);
+  return FPTA_SUCCESS;
+}
+
+fpta_key_extractor *fpta_key_extractor_lookup(fpta_shove_t name,
+                                              void **context) {
+  const unsigned count =
+      fpta_key_extractors_count.load(std::memory_order_acquire);
+  for (unsigned i = 0; i < count; ++i) {
+    if (fpta_key_extractors[i].name == name) {
+      *context = fpta_key_extractors[i].context;
+      return fpta_key_extractors[i].extractor;
+    }
+  }
+  return nullptr;
+}
+
 static int fpta_column_def_validate(const fpta_shove_t *def, size_t count) {
   if (unlikely(count < 1))
     return FPTA_EINVAL;
@@ -370,16 +855,125 @@ static int fpta_column_def_validate(const fpta_shove_t *def, size_t count) {
     assert((index_type & fpta_column_index_mask) == index_type);
     assert(index_type != (fpta_index_type)fpta_flag_table);
 
-    fptu_type data_type = fpta_shove2type(shove);
-    if (data_type < fptu_uint16 || data_type == (fptu_null | fptu_farray) ||
-        data_type > (fptu_nested /* TODO: | fptu_farray */))
+    int rc = fpta_column_type_validate(fpta_shove2type(shove), index_type);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
+
+  // FIXME: check for distinctness.
+  return FPTA_SUCCESS;
+}
+
+static bool fpta_extra_layout_validate(const fpta_shove_t *extra,
+                                       size_t extra_count, size_t count) {
+  size_t i = 0;
+  while (i < extra_count) {
+    const fpta_shove_t header = extra[i];
+    if (unlikely(fpta_extra_kind(header) == fpta_extra_end ||
+                 fpta_extra_kind(header) > fpta_extra_kind_last))
       return false;
+    if (unlikely(fpta_extra_column(header) >= count))
+      return false;
+    i += 1 + fpta_extra_words(header);
+  }
+  return i == extra_count;
+}
+
+static int fpta_extra_def_validate(const fpta_shove_t *def, size_t count,
+                                   const fpta_shove_t *extra,
+                                   size_t extra_count) {
+  if (unlikely(extra_count > fpta_max_schema_extra))
+    return FPTA_TOOMANY;
+  if (unlikely(!fpta_extra_layout_validate(extra, extra_count, count)))
+    return FPTA_EINVAL;
 
-    if (index_type && data_type < fptu_96 && fpta_index_is_reverse(index_type))
+  bool have_expiry = false, have_pk_stripped = false, have_changelog = false;
+  bool partial_refers_pk = false;
+  unsigned expiry_column = 0;
+  for (size_t i = 0; i < extra_count; i += 1 + fpta_extra_words(extra[i])) {
+    const fpta_shove_t header = extra[i];
+    const fpta_shove_t shove = def[fpta_extra_column(header)];
+    switch (fpta_extra_kind(header)) {
+    default:
       return FPTA_EINVAL;
+
+    case fpta_extra_expiry:
+      if (unlikely(have_expiry || fpta_extra_words(header) != 0))
+        return FPTA_EINVAL;
+      if (unlikely(fpta_shove2type(shove) != fptu_datetime))
+        return FPTA_ETYPE;
+      if (unlikely(fpta_shove2index(shove) == fpta_index_none ||
+                   !fpta_index_is_ordered(shove)))
+        return FPTA_EINVAL;
+      have_expiry = true;
+      expiry_column = fpta_extra_column(header);
+      break;
+
+    case fpta_extra_pk_stripped: {
+      if (unlikely(have_pk_stripped || fpta_extra_words(header) != 0 ||
+                   fpta_extra_column(header) != 0))
+        return FPTA_EINVAL;
+      int rc = fpta_pk_strip_validate(shove);
+      if (unlikely(rc != FPTA_SUCCESS))
+        return rc;
+      have_pk_stripped = true;
+    } break;
+
+    case fpta_extra_partial: {
+      if (unlikely(fpta_shove2index(shove) == fpta_index_none ||
+                   !fpta_index_is_secondary(shove)))
+        return FPTA_EINVAL;
+      bool refers_pk;
+      if (unlikely(!fpta_predicate_validate(extra + i + 1,
+                                            fpta_extra_words(header), count,
+                                            refers_pk)))
+        return FPTA_EINVAL;
+      partial_refers_pk |= refers_pk;
+    } break;
+
+    case fpta_extra_expression: {
+      if (unlikely(fpta_extra_words(header) != 1))
+        return FPTA_EINVAL;
+      int rc = fpta_expression_validate(def, count, fpta_extra_column(header),
+                                        fpta_extra_param(header),
+                                        extra[i + 1]);
+      if (unlikely(rc != FPTA_SUCCESS))
+        return rc;
+    } break;
+
+    case fpta_extra_changelog: {
+      if (unlikely(have_changelog || fpta_extra_words(header) != 0 ||
+                   fpta_extra_column(header) != 0))
+        return FPTA_EINVAL;
+      /* служебная таблица журнала занимает последний номер среди dbi
+       * таблицы, поэтому он не должен использоваться индексами */
+      size_t indexes = 0;
+      while (indexes < count &&
+             fpta_shove2index(def[indexes]) != fpta_index_none)
+        ++indexes;
+      if (unlikely(indexes >= fpta_changelog_index))
+        return FPTA_TOOMANY;
+      have_changelog = true;
+    } break;
+    }
+  }
+
+  /* проверка TTL и предикатов частичных индексов выполняется в том числе
+   * по хранимым строкам, в которых PK может отсутствовать */
+  if (unlikely(have_pk_stripped &&
+               ((have_expiry && expiry_column == 0) || partial_refers_pk)))
+    return FPTA_EINVAL;
+
+  /* для удаления устаревших строк в индексе TTL-колонки должны быть
+   * все строки таблицы с исходными значениями колонки */
+  if (unlikely(have_expiry)) {
+    for (size_t i = 0; i < extra_count; i += 1 + fpta_extra_words(extra[i]))
+      if ((fpta_extra_kind(extra[i]) == fpta_extra_partial ||
+           fpta_extra_kind(extra[i]) == fpta_extra_expression) &&
+          fpta_extra_column(extra[i]) == expiry_column)
+        return FPTA_EINVAL;
   }
 
-  // FIXME: check for distinctness.
   return FPTA_SUCCESS;
 }
 
@@ -390,15 +984,65 @@ int fpta_column_set_validate(fpta_column_set *column_set) {
     return FPTA_EINVAL;
   if (unlikely(column_set->count > fpta_max_cols))
     return FPTA_TOOMANY;
+  if (unlikely(column_set->extra_count > fpta_max_schema_extra))
+    return FPTA_TOOMANY;
+  if (unlikely(!fpta_extra_layout_validate(
+          column_set->extra, column_set->extra_count, column_set->count)))
+    return FPTA_EINVAL;
 
-  /* сортируем описание колонок, так чтобы неиндексируемые были в конце */
-  std::stable_sort(column_set->shoves + 1,
-                   column_set->shoves + column_set->count,
-                   [](const fpta_shove_t &left, const fpta_shove_t &right) {
-                     return fpta_shove2index(left) > fpta_shove2index(right);
+  for (size_t i = 0; i < column_set->extra_count;
+       i += 1 + fpta_extra_words(column_set->extra[i])) {
+    bool refers_pk;
+    if (fpta_extra_kind(column_set->extra[i]) == fpta_extra_partial &&
+        unlikely(!fpta_predicate_validate(
+            column_set->extra + i + 1, fpta_extra_words(column_set->extra[i]),
+            column_set->count, refers_pk)))
+      return FPTA_EINVAL;
+  }
+
+  /* сортируем описание колонок, так чтобы неиндексируемые были в конце,
+   * с перенумерацией колонок в дополнительном описании */
+  unsigned order[fpta_max_cols];
+  for (unsigned i = 0; i < column_set->count; ++i)
+    order[i] = i;
+  std::stable_sort(order + 1, order + column_set->count,
+                   [column_set](const unsigned left, const unsigned right) {
+                     return fpta_shove2index(column_set->shoves[left]) >
+                            fpta_shove2index(column_set->shoves[right]);
                    });
 
-  return fpta_column_def_validate(column_set->shoves, column_set->count);
+  fpta_shove_t sorted[fpta_max_cols];
+  unsigned renum[fpta_max_cols];
+  for (unsigned i = 0; i < column_set->count; ++i) {
+    sorted[i] = column_set->shoves[order[i]];
+    renum[order[i]] = i;
+  }
+  memcpy(column_set->shoves, sorted, column_set->count * sizeof(fpta_shove_t));
+
+  for (size_t i = 0; i < column_set->extra_count;
+       i += 1 + fpta_extra_words(column_set->extra[i])) {
+    const fpta_shove_t header = column_set->extra[i];
+    column_set->extra[i] = fpta_extra_header(
+        fpta_extra_kind(header), renum[fpta_extra_column(header)],
+        fpta_extra_words(header), fpta_extra_param(header));
+    if (fpta_extra_kind(header) == fpta_extra_partial)
+      fpta_predicate_renumber(column_set->extra + i + 1,
+                              fpta_extra_words(header), renum);
+    else if (fpta_extra_kind(header) == fpta_extra_expression &&
+             fpta_extra_param(header) == fpta_expr_nested_path &&
+             fpta_extra_words(header) == 1 &&
+             fpta_path_column(column_set->extra[i + 1]) < column_set->count)
+      column_set->extra[i + 1] = fpta_path_renumber(
+          column_set->extra[i + 1],
+          renum[fpta_path_column(column_set->extra[i + 1])]);
+  }
+
+  int rc = fpta_column_def_validate(column_set->shoves, column_set->count);
+  if (unlikely(rc != FPTA_SUCCESS))
+    return rc;
+
+  return fpta_extra_def_validate(column_set->shoves, column_set->count,
+                                 column_set->extra, column_set->extra_count);
 }
 
 //----------------------------------------------------------------------------
@@ -418,7 +1062,9 @@ bool fpta_schema_validate(const MDB_val def) {
   if (unlikely(schema->count > fpta_max_cols))
     return false;
 
-  if (unlikely(def.mv_size != fpta_table_schema_size(schema->count)))
+  if (unlikely(def.mv_size < fpta_table_schema_size(schema->count) ||
+               def.mv_size > fpta_table_schema_size(schema->count,
+                                                    fpta_max_schema_extra)))
     return false;
 
   if (unlikely(schema->version == 0))
@@ -433,20 +1079,33 @@ bool fpta_schema_validate(const MDB_val def) {
   if (unlikely(checksum != schema->checksum))
     return false;
 
+  if (unlikely(FPTA_SUCCESS !=
+               fpta_column_def_validate(schema->columns, schema->count)))
+    return false;
+
+  const size_t extra_count =
+      (def.mv_size - fpta_table_schema_size(schema->count)) /
+      sizeof(fpta_shove_t);
   return FPTA_SUCCESS ==
-         fpta_column_def_validate(schema->columns, schema->count);
+         fpta_extra_def_validate(schema->columns, schema->count,
+                                 schema->columns + schema->count, extra_count);
 }
 
 static int fpta_schema_dup(const MDB_val data, fpta_table_schema **def) {
   assert(data.mv_size >= fpta_table_schema_size(1) &&
-         data.mv_size <= sizeof(fpta_table_schema));
+         data.mv_size <=
+             fpta_table_schema_size(fpta_max_cols, fpta_max_schema_extra));
   assert(def != nullptr);
 
-  fpta_table_schema *schema = (fpta_table_schema *)realloc(*def, data.mv_size);
+  /* копия дополняется нулевым словом, которое завершает
+   * последовательность элементов дополнительного описания */
+  fpta_table_schema *schema = (fpta_table_schema *)realloc(
+      *def, data.mv_size + sizeof(fpta_shove_t));
   if (unlikely(schema == nullptr))
     return FPTA_ENOMEM;
 
   *def = (fpta_table_schema *)memcpy(schema, data.mv_data, data.mv_size);
+  *(fpta_shove_t *)((char *)schema + data.mv_size) = fpta_extra_end;
   return FPTA_SUCCESS;
 }
 
@@ -540,6 +1199,65 @@ int fpta_schema_fetch(fpta_txn *txn, fpta_schema_info *info) {
   return (rc == MDB_NOTFOUND) ? (int)FPTA_SUCCESS : rc;
 }
 
+int fpta_dbi_preopen(fpta_txn *txn) {
+  assert(fpta_txn_validate(txn, fpta_write));
+  fpta_db *db = txn->db;
+  if (likely(db->dbi_preopened == txn->schema_version))
+    return FPTA_SUCCESS;
+
+  int rc;
+  if (db->schema_dbi < 1) {
+    rc = fpta_schema_open(txn, false);
+    if (rc != MDB_SUCCESS)
+      /* схема еще не создана, поэтому открывать нечего */
+      return (rc == MDB_NOTFOUND) ? (int)FPTA_SUCCESS : rc;
+  }
+
+  MDB_cursor *mdbx_cursor;
+  rc = mdbx_cursor_open(txn->mdbx_txn, db->schema_dbi, &mdbx_cursor);
+  if (rc != MDB_SUCCESS)
+    return rc;
+
+  fpta_table_schema *def = nullptr;
+  MDB_val mdbx_data, mdbx_key;
+  rc = mdbx_cursor_get(mdbx_cursor, &mdbx_key, &mdbx_data, MDB_FIRST);
+  while (rc == MDB_SUCCESS) {
+    if (!fpta_schema_validate(mdbx_data)) {
+      rc = FPTA_SCHEMA_CORRUPTED;
+      break;
+    }
+    rc = fpta_schema_dup(mdbx_data, &def);
+    if (unlikely(rc != FPTA_SUCCESS))
+      break;
+
+    const fpta_shove_t pk =
+        def->columns[0] & (fpta_column_typeid_mask | fpta_column_index_mask);
+    for (size_t i = 0; rc == FPTA_SUCCESS && i < def->count; ++i) {
+      if (fpta_shove2index(def->columns[i]) == fpta_index_none)
+        break;
+      const auto data_shove =
+          i ? pk : fpta_column_shove(0, fptu_nested, fpta_primary);
+      MDB_dbi dbi;
+      rc = fpta_dbi_open(txn, fpta_dbi_shove(def->shove, i), &dbi, 0,
+                         i ? def->columns[i] : pk, data_shove);
+    }
+    if (rc == FPTA_SUCCESS && fpta_schema_changelog(def)) {
+      MDB_dbi dbi;
+      rc = fpta_changelog_dbi_open(txn, def->shove, &dbi, 0);
+    }
+    if (unlikely(rc != FPTA_SUCCESS))
+      break;
+    rc = mdbx_cursor_get(mdbx_cursor, &mdbx_key, &mdbx_data, MDB_NEXT);
+  }
+
+  mdbx_cursor_close(mdbx_cursor);
+  fpta_schema_free(def);
+  if (rc != MDB_NOTFOUND)
+    return rc;
+  db->dbi_preopened = txn->schema_version;
+  return FPTA_SUCCESS;
+}
+
 //----------------------------------------------------------------------------
 
 static int fpta_name_init(fpta_name *id, const char *name,
@@ -784,6 +1502,17 @@ int fpta_table_create(fpta_txn *txn, const char *table_name,
       return EEXIST;
   }
 
+  bool changelog = false;
+  for (size_t i = 0; i < column_set->extra_count;
+       i += 1 + fpta_extra_words(column_set->extra[i]))
+    changelog |= fpta_extra_kind(column_set->extra[i]) == fpta_extra_changelog;
+  if (changelog) {
+    int err = fpta_changelog_dbi_open(txn, table_shove,
+                                      &dbi[fpta_changelog_index], 0);
+    if (err != MDB_NOTFOUND)
+      return EEXIST;
+  }
+
   for (size_t i = 0; i < column_set->count; ++i) {
     const auto shove = column_set->shoves[i];
     const auto index = fpta_shove2index(shove);
@@ -801,18 +1530,28 @@ int fpta_table_create(fpta_txn *txn, const char *table_name,
       goto bailout;
   }
 
-  fpta_table_schema def;
-  MDB_val data;
-  data.mv_data = &def;
-  data.mv_size = fpta_table_schema_size(column_set->count);
+  if (changelog) {
+    rc = fpta_changelog_dbi_open(txn, table_shove, &dbi[fpta_changelog_index],
+                                 MDB_INTEGERKEY | MDB_CREATE);
+    if (rc != MDB_SUCCESS)
+      goto bailout;
+  }
 
-  def.signature = FTPA_SCHEMA_SIGNATURE;
-  def.count = column_set->count;
-  def.version = txn->data_version;
-  def.shove = table_shove;
-  memcpy(def.columns, column_set->shoves, sizeof(fpta_shove_t) * def.count);
-  def.checksum = t1ha(&def.signature, data.mv_size - sizeof(def.checksum),
-                      FTPA_SCHEMA_CHECKSEED);
+  fpta_table_schema *def;
+  MDB_val data;
+  data.mv_size =
+      fpta_table_schema_size(column_set->count, column_set->extra_count);
+  data.mv_data = def = (fpta_table_schema *)alloca(data.mv_size);
+
+  def->signature = FTPA_SCHEMA_SIGNATURE;
+  def->count = column_set->count;
+  def->version = txn->data_version;
+  def->shove = table_shove;
+  memcpy(def->columns, column_set->shoves, sizeof(fpta_shove_t) * def->count);
+  memcpy(def->columns + def->count, column_set->extra,
+         sizeof(fpta_shove_t) * column_set->extra_count);
+  def->checksum = t1ha(&def->signature, data.mv_size - sizeof(def->checksum),
+                       FTPA_SCHEMA_CHECKSEED);
 
   MDB_val key;
   key.mv_size = sizeof(table_shove);
@@ -825,7 +1564,9 @@ int fpta_table_create(fpta_txn *txn, const char *table_name,
   return FPTA_SUCCESS;
 
 bailout:
-  for (size_t i = 0; i < fpta_max_indexes && dbi[i] > 0; ++i) {
+  for (size_t i = 0; i < fpta_max_indexes; ++i) {
+    if (dbi[i] < 1)
+      continue;
     fpta_dbicache_remove(db, fpta_dbi_shove(table_shove, i));
     int err = mdbx_drop(txn->mdbx_txn, dbi[i], 1);
     if (unlikely(err != MDB_SUCCESS))
@@ -876,12 +1617,21 @@ int fpta_table_drop(fpta_txn *txn, const char *table_name) {
       return rc;
   }
 
+  if (fpta_schema_changelog(def)) {
+    rc = fpta_changelog_dbi_open(txn, table_shove, &dbi[fpta_changelog_index],
+                                 0);
+    if (rc != MDB_SUCCESS && rc != MDB_NOTFOUND)
+      return rc;
+  }
+
   rc = mdbx_del(txn->mdbx_txn, db->schema_dbi, &key, nullptr);
   if (rc != MDB_SUCCESS)
     return rc;
 
   txn->schema_version = txn->data_version;
-  for (size_t i = 0; i < fpta_max_indexes && dbi[i] > 0; ++i) {
+  for (size_t i = 0; i < fpta_max_indexes; ++i) {
+    if (dbi[i] < 1)
+      continue;
     fpta_dbicache_remove(db, fpta_dbi_shove(table_shove, i));
     int err = mdbx_drop(txn->mdbx_txn, dbi[i], 1);
     if (unlikely(err != MDB_SUCCESS))
@@ -19,6 +19,55 @@
 
 #include "fast_positive/tables_internal.h"
 
+/* Обновляет мульти-индекс колонки-массива по старой и новой версиям строки,
+ * любая из которых может отсутствовать (nullptr). При неизменном PK пары
+ * для элементов, присутствующих в обеих версиях, не затрагиваются.
+ * Пара для элемента keep, на которой может стоять курсор, не удаляется
+ * и не добавляется, а обрабатывается вызывающей стороной, в том числе
+ * при изменении PK. Повторы элементов внутри массива учитываются
+ * однократно. */
+static int fpta_secondary_multi(fpta_txn *txn, MDB_dbi dbi, fpta_shove_t shove,
+                                size_t column, MDB_val pk_key_old,
+                                const fptu_ro *row_old, MDB_val pk_key_new,
+                                const fptu_ro *row_new, const MDB_val *keep) {
+  fpta_keyset keys_old, keys_new;
+  int rc;
+  if (row_old) {
+    rc = fpta_index_row2keys(shove, column, *row_old, keys_old);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
+  if (row_new) {
+    rc = fpta_index_row2keys(shove, column, *row_new, keys_new);
+    if (unlikely(rc != FPTA_SUCCESS))
+      return rc;
+  }
+
+  const bool pk_same = pk_key_old.iov_base == pk_key_new.iov_base ||
+                       fpta_is_same(pk_key_old, pk_key_new);
+  for (size_t i = 0; i < keys_old.count; ++i) {
+    MDB_val &key = keys_old.keys[i].mdbx;
+    if (keys_old.contains(key, i) || (pk_same && keys_new.contains(key)) ||
+        (keep && fpta_is_same(key, *keep)))
+      continue;
+    rc = mdbx_del(txn->mdbx_txn, dbi, &key, &pk_key_old);
+    if (unlikely(rc != MDB_SUCCESS))
+      return (rc != MDB_NOTFOUND) ? rc : (int)FPTA_INDEX_CORRUPTED;
+  }
+
+  for (size_t i = 0; i < keys_new.count; ++i) {
+    MDB_val &key = keys_new.keys[i].mdbx;
+    if (keys_new.contains(key, i) || (pk_same && keys_old.contains(key)) ||
+        (keep && fpta_is_same(key, *keep)))
+      continue;
+    rc = mdbx_put(txn->mdbx_txn, dbi, &key, &pk_key_new, MDB_NODUPDATA);
+    if (unlikely(rc != MDB_SUCCESS))
+      return rc;
+  }
+
+  return FPTA_SUCCESS;
+}
+
 int fpta_check_constraints(fpta_txn *txn, fpta_name *table_id,
                            const fptu_ro &row_old, const fptu_ro &row_new,
                            unsigned stepover) {
@@ -35,21 +84,30 @@ int fpta_check_constraints(fpta_txn *txn, fpta_name *table_id,
     assert(i < fpta_max_indexes);
     if (i == stepover || !fpta_index_is_unique(index))
       continue;
+    if (!fpta_index_row_match(table_id->table.def, i, row_new))
+      /* новая строка не попадает в частичный индекс */
+      continue;
 
     fpta_key fk_key_new;
-    rc = fpta_index_row2key(shove, i, row_new, fk_key_new, false);
+    rc = fpta_index_row2key(table_id->table.def, i, row_new, fk_key_new);
     if (unlikely(rc != MDB_SUCCESS))
       return rc;
 
-    if (row_old.sys.iov_base) {
+    if (row_old.sys.iov_base &&
+        fpta_index_row_match(table_id->table.def, i, row_old)) {
       fpta_key fk_key_old;
-      rc = fpta_index_row2key(shove, i, row_old, fk_key_old, false);
+      rc = fpta_index_row2key(table_id->table.def, i, row_old, fk_key_old);
       if (unlikely(rc != MDB_SUCCESS))
         return rc;
       if (fpta_is_same(fk_key_old.mdbx, fk_key_new.mdbx))
         continue;
     }
 
+    if (!fpta_key_maybe_exists(txn, table_id, (unsigned)i, dbi[i],
+                               fk_key_new.mdbx))
+      /* фильтр гарантирует отсутствие ключа в индексе */
+      continue;
+
     MDB_val pk_exist;
     rc = mdbx_get(txn->mdbx_txn, dbi[i], &fk_key_new.mdbx, &pk_exist);
     if (unlikely(rc != MDB_NOTFOUND))
@@ -62,7 +120,7 @@ int fpta_check_constraints(fpta_txn *txn, fpta_name *table_id,
 int fpta_secondary_upsert(fpta_txn *txn, fpta_name *table_id,
                           MDB_val pk_key_old, const fptu_ro &row_old,
                           MDB_val pk_key_new, const fptu_ro &row_new,
-                          unsigned stepover) {
+                          unsigned stepover, const MDB_val *stepover_key) {
   MDB_dbi dbi[fpta_max_indexes];
   int rc = fpta_open_secondaries(txn, table_id, dbi);
   if (unlikely(rc != FPTA_SUCCESS))
@@ -74,17 +132,42 @@ int fpta_secondary_upsert(fpta_txn *txn, fpta_name *table_id,
     if (index == fpta_index_none)
       break;
     assert(i < fpta_max_indexes);
-    if (i == stepover)
+    /* Для мульти-индекса вызывающая сторона обрабатывает только пару
+     * stepover_key, а пары остальных элементов обновляются здесь. */
+    if (i == stepover && !fpta_shove_is_multivalued(shove))
+      continue;
+
+    /* Для частичного индекса учитываем попадание в него старой и новой
+     * версий строки, а строки вне индекса рассматриваем как отсутствующие */
+    const bool new_match =
+        fpta_index_row_match(table_id->table.def, i, row_new);
+    const bool old_match =
+        row_old.sys.iov_base &&
+        fpta_index_row_match(table_id->table.def, i, row_old);
+    if (!old_match && !new_match)
+      continue;
+
+    if (fpta_shove_is_multivalued(shove)) {
+      rc = fpta_secondary_multi(txn, dbi[i], shove, i, pk_key_old,
+                                old_match ? &row_old : nullptr, pk_key_new,
+                                new_match ? &row_new : nullptr,
+                                (i == stepover) ? stepover_key : nullptr);
+      if (unlikely(rc != MDB_SUCCESS))
+        return rc;
       continue;
+    }
 
     fpta_key fk_key_new;
-    rc = fpta_index_row2key(shove, i, row_new, fk_key_new, false);
-    if (unlikely(rc != MDB_SUCCESS))
-      return rc;
+    if (new_match) {
+      rc = fpta_index_row2key(table_id->table.def, i, row_new, fk_key_new);
+      if (unlikely(rc != MDB_SUCCESS))
+        return rc;
+    }
 
-    if (row_old.sys.iov_base == nullptr) {
+    if (!old_match) {
       /* Старой версии нет, выполняется добавление новой строки */
-      assert(pk_key_old.iov_base == pk_key_new.iov_base);
+      assert(row_old.sys.iov_base ||
+             pk_key_old.iov_base == pk_key_new.iov_base);
       /* Вставляем новую пару в secondary индекс */
       rc =
           mdbx_put(txn->mdbx_txn, dbi[i], &fk_key_new.mdbx, &pk_key_new,
@@ -92,16 +175,27 @@ int fpta_secondary_upsert(fpta_txn *txn, fpta_name *table_id,
                                                : MDB_NODUPDATA);
       if (unlikely(rc != MDB_SUCCESS))
         return rc;
+      if (fpta_index_is_unique(index))
+        fpta_key_inserted(txn, table_id, (unsigned)i, fk_key_new.mdbx);
 
       continue;
     }
     /* else: Выполняется обновление существующей строки */
 
     fpta_key fk_key_old;
-    rc = fpta_index_row2key(shove, i, row_old, fk_key_old, false);
+    rc = fpta_index_row2key(table_id->table.def, i, row_old, fk_key_old);
     if (unlikely(rc != MDB_SUCCESS))
       return rc;
 
+    if (!new_match) {
+      /* Новая версия строки не попадает в частичный индекс,
+       * удаляем из него пару со старым значением. */
+      rc = mdbx_del(txn->mdbx_txn, dbi[i], &fk_key_old.mdbx, &pk_key_old);
+      if (unlikely(rc != MDB_SUCCESS))
+        return (rc != MDB_NOTFOUND) ? rc : (int)FPTA_INDEX_CORRUPTED;
+      continue;
+    }
+
     if (!fpta_is_same(fk_key_old.mdbx, fk_key_new.mdbx)) {
       /* Изменилось значение индексированного поля, выполняем удаление
        * из индекса пары со старым значением и добавляем пару с новым. */
@@ -112,6 +206,8 @@ int fpta_secondary_upsert(fpta_txn *txn, fpta_name *table_id,
                     MDB_NODUPDATA);
       if (unlikely(rc != MDB_SUCCESS))
         return rc;
+      if (fpta_index_is_unique(index))
+        fpta_key_inserted(txn, table_id, (unsigned)i, fk_key_new.mdbx);
       continue;
     }
 
@@ -138,7 +234,8 @@ int fpta_secondary_upsert(fpta_txn *txn, fpta_name *table_id,
 }
 
 int fpta_secondary_remove(fpta_txn *txn, fpta_name *table_id, MDB_val &pk_key,
-                          const fptu_ro &row_old, unsigned stepover) {
+                          const fptu_ro &row_old, unsigned stepover,
+                          const MDB_val *stepover_key) {
   MDB_dbi dbi[fpta_max_indexes];
   int rc = fpta_open_secondaries(txn, table_id, dbi);
   if (unlikely(rc != FPTA_SUCCESS))
@@ -150,11 +247,22 @@ int fpta_secondary_remove(fpta_txn *txn, fpta_name *table_id, MDB_val &pk_key,
     if (index == fpta_index_none)
       break;
     assert(i < fpta_max_indexes);
-    if (i == stepover)
+    if ((i == stepover && !fpta_shove_is_multivalued(shove)) ||
+        !fpta_index_row_match(table_id->table.def, i, row_old))
       continue;
 
+    if (fpta_shove_is_multivalued(shove)) {
+      /* пара stepover_key удаляется вызывающей стороной */
+      rc = fpta_secondary_multi(txn, dbi[i], shove, i, pk_key, &row_old,
+                                pk_key, nullptr,
+                                (i == stepover) ? stepover_key : nullptr);
+      if (unlikely(rc != MDB_SUCCESS))
+        return rc;
+      continue;
+    }
+
     fpta_key fk_key_old;
-    rc = fpta_index_row2key(shove, i, row_old, fk_key_old, false);
+    rc = fpta_index_row2key(table_id->table.def, i, row_old, fk_key_old);
     if (unlikely(rc != MDB_SUCCESS))
       return rc;
 
@@ -0,0 +1,274 @@
+/*
+ * Copyright 2016-2017 libfpta authors: please see AUTHORS file.
+ *
+ * This file is part of libfpta, aka "Fast Positive Tables".
+ *
+ * libfpta is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libfpta is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libfpta.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fast_positive/tables_internal.h"
+
+/* Планировщик пишущих транзакций, см. fpta_db_write().
+ *
+ * Запросы ставятся в очередь своего класса приоритета. Выделенного
+ * потока нет: один из ожидающих вызывающих потоков становится
+ * исполнителем и выполняет одну "единицу работы", т.е. одну пишущую
+ * транзакцию, после чего роль исполнителя переходит к следующему
+ * ожидающему. Поэтому ни один поток не выполняет чужие запросы дольше
+ * одной транзакции после завершения своего.
+ *
+ * Интерактивные запросы выполняются по одному в порядке поступления
+ * и всегда раньше пакетных, но после fpta_writer_burst интерактивных
+ * транзакций подряд выполняется одна пакетная, чтобы пакетные запросы
+ * не голодали. Пакетные запросы объединяются по fpta_writer_batch_max
+ * в одну транзакцию, каждый внутри своей точки сохранения, поэтому
+ * ошибка запроса отменяет только его изменения. В режиме fpta_async
+ * точки сохранения недоступны, и при ошибке общая транзакция отменяется,
+ * а запросы пакета выполняются повторно, каждый в своей транзакции.
+ * Таким образом, время ожидания интерактивного запроса ограничено одной
+ * пакетной транзакцией. */
+
+struct fpta_write_request {
+  fpta_write_request *next;
+  fpta_write_closure *closure;
+  void *context;
+  fpta_write_priority priority;
+  struct timespec enqueued;
+  int rc;
+  bool done;
+};
+
+struct fpta_writer {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  fpta_write_request *head[fpta_write_priorities];
+  fpta_write_request **tail[fpta_write_priorities];
+  /* роль исполнителя занята */
+  bool active;
+  /* количество интерактивных транзакций подряд */
+  unsigned burst;
+  fpta_write_stats stats;
+};
+
+static uint64_t fpta_writer_elapsed_us(const struct timespec &since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  int64_t us = (int64_t)(now.tv_sec - since.tv_sec) * 1000000 +
+               (now.tv_nsec - since.tv_nsec) / 1000;
+  return (us > 0) ? (uint64_t)us : 0;
+}
+
+int fpta_writer_init(fpta_db *db) {
+  assert(db->writer == nullptr);
+  fpta_writer *writer = (fpta_writer *)calloc(1, sizeof(fpta_writer));
+  if (unlikely(writer == nullptr))
+    return FPTA_ENOMEM;
+
+  int rc = pthread_mutex_init(&writer->mutex, nullptr);
+  if (unlikely(rc != 0)) {
+    free(writer);
+    return rc;
+  }
+
+  rc = pthread_cond_init(&writer->cond, nullptr);
+  if (unlikely(rc != 0)) {
+    int err = pthread_mutex_destroy(&writer->mutex);
+    assert(err == 0);
+    (void)err;
+    free(writer);
+    return rc;
+  }
+
+  for (unsigned i = 0; i < fpta_write_priorities; ++i)
+    writer->tail[i] = &writer->head[i];
+  db->writer = writer;
+  return FPTA_SUCCESS;
+}
+
+void fpta_writer_destroy(fpta_db *db) {
+  fpta_writer *writer = db->writer;
+  if (writer) {
+    assert(!writer->active && !writer->head[fpta_write_interactive] &&
+           !writer->head[fpta_write_batch]);
+    int err = pthread_cond_destroy(&writer->cond);
+    assert(err == 0);
+    err = pthread_mutex_destroy(&writer->mutex);
+    assert(err == 0);
+    (void)err;
+    free(writer);
+    db->writer = nullptr;
+  }
+}
+
+/* Извлекает из очереди запросы для очередной транзакции. */
+static size_t fpta_writer_take(fpta_writer *writer,
+                               fpta_write_request **batch) {
+  fpta_write_priority priority = fpta_write_interactive;
+  if (writer->head[fpta_write_interactive] == nullptr ||
+      (writer->head[fpta_write_batch] && writer->burst >= fpta_writer_burst))
+    priority = fpta_write_batch;
+  writer->burst = (priority == fpta_write_interactive) ? writer->burst + 1 : 0;
+
+  const size_t limit =
+      (priority == fpta_write_batch) ? (size_t)fpta_writer_batch_max : 1;
+  size_t count = 0;
+  while (count < limit && writer->head[priority]) {
+    fpta_write_request *request = writer->head[priority];
+    writer->head[priority] = request->next;
+    if (writer->head[priority] == nullptr)
+      writer->tail[priority] = &writer->head[priority];
+    writer->stats.queued[priority] -= 1;
+
+    const uint64_t wait_us = fpta_writer_elapsed_us(request->enqueued);
+    writer->stats.wait_total_us[priority] += wait_us;
+    if (writer->stats.wait_max_us[priority] < wait_us)
+      writer->stats.wait_max_us[priority] = wait_us;
+    batch[count++] = request;
+  }
+  return count;
+}
+
+/* Выполняет запросы в одной транзакции, возвращает количество
+ * выполненных транзакций. */
+static unsigned fpta_writer_execute(fpta_db *db, fpta_write_request **batch,
+                                    size_t count) {
+  fpta_txn *txn = nullptr;
+  int rc = fpta_transaction_begin(db, fpta_write, &txn);
+  if (unlikely(rc != FPTA_SUCCESS)) {
+    for (size_t i = 0; i < count; ++i)
+      batch[i]->rc = rc;
+    return 0;
+  }
+
+  const bool isolated = count > 1 && db->durability != fpta_async;
+  for (size_t i = 0; i < count; ++i) {
+    if (isolated) {
+      rc = fpta_savepoint_begin(txn);
+      if (likely(rc == FPTA_SUCCESS)) {
+        rc = batch[i]->closure(txn, batch[i]->context);
+        if (likely(rc == FPTA_SUCCESS))
+          rc = fpta_savepoint_release(txn);
+        else {
+          int err = fpta_savepoint_rollback(txn);
+          if (unlikely(err != FPTA_SUCCESS)) {
+            /* состояние транзакции неизвестно, отменяется весь пакет */
+            fpta_transaction_end(txn, true);
+            for (size_t j = 0; j < count; ++j)
+              batch[j]->rc = (j == i) ? rc : err;
+            return 1;
+          }
+        }
+      }
+      batch[i]->rc = rc;
+      continue;
+    }
+
+    rc = batch[i]->closure(txn, batch[i]->context);
+    if (unlikely(rc != FPTA_SUCCESS)) {
+      fpta_transaction_end(txn, true);
+      if (count == 1) {
+        batch[0]->rc = rc;
+        return 1;
+      }
+
+      /* выполняем запросы пакета по отдельности */
+      unsigned txns = 1;
+      for (size_t j = 0; j < count; ++j)
+        txns += fpta_writer_execute(db, &batch[j], 1);
+      return txns;
+    }
+    batch[i]->rc = FPTA_SUCCESS;
+  }
+
+  /* результат фиксации получают запросы, изменения которых сохранены */
+  rc = fpta_transaction_end(txn, false);
+  for (size_t i = 0; i < count; ++i)
+    if (batch[i]->rc == FPTA_SUCCESS)
+      batch[i]->rc = rc;
+  return 1;
+}
+
+int fpta_db_write(fpta_db *db, fpta_write_priority priority,
+                  fpta_write_closure *closure, void *context) {
+  if (unlikely(!fpta_db_validate(db) || closure == nullptr))
+    return FPTA_EINVAL;
+  if (unlikely(priority != fpta_write_interactive &&
+               priority != fpta_write_batch))
+    return FPTA_EINVAL;
+
+  fpta_write_request request;
+  request.next = nullptr;
+  request.closure = closure;
+  request.context = context;
+  request.priority = priority;
+  request.rc = FPTA_SUCCESS;
+  request.done = false;
+  clock_gettime(CLOCK_MONOTONIC, &request.enqueued);
+
+  fpta_writer *writer = db->writer;
+  int rc = pthread_mutex_lock(&writer->mutex);
+  if (unlikely(rc != 0))
+    return rc;
+
+  *writer->tail[priority] = &request;
+  writer->tail[priority] = &request.next;
+  writer->stats.queued[priority] += 1;
+
+  while (!request.done) {
+    if (writer->active) {
+      rc = pthread_cond_wait(&writer->cond, &writer->mutex);
+      assert(rc == 0);
+      continue;
+    }
+
+    /* становимся исполнителем на одну транзакцию */
+    fpta_write_request *batch[fpta_writer_batch_max];
+    const size_t count = fpta_writer_take(writer, batch);
+    assert(count > 0);
+    writer->active = true;
+    rc = pthread_mutex_unlock(&writer->mutex);
+    assert(rc == 0);
+
+    const unsigned txns = fpta_writer_execute(db, batch, count);
+
+    rc = pthread_mutex_lock(&writer->mutex);
+    assert(rc == 0);
+    writer->active = false;
+    writer->stats.transactions += txns;
+    for (size_t i = 0; i < count; ++i) {
+      writer->stats.executed[batch[i]->priority] += 1;
+      batch[i]->done = true;
+    }
+    pthread_cond_broadcast(&writer->cond);
+  }
+
+  rc = pthread_mutex_unlock(&writer->mutex);
+  assert(rc == 0);
+  (void)rc;
+  return request.rc;
+}
+
+int fpta_db_write_stats(fpta_db *db, fpta_write_stats *stats) {
+  if (unlikely(!fpta_db_validate(db) || stats == nullptr))
+    return FPTA_EINVAL;
+
+  fpta_writer *writer = db->writer;
+  int rc = pthread_mutex_lock(&writer->mutex);
+  if (unlikely(rc != 0))
+    return rc;
+  *stats = writer->stats;
+  rc = pthread_mutex_unlock(&writer->mutex);
+  assert(rc == 0);
+  return rc;
+}
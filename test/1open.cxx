@@ -20,6 +20,8 @@
 #include "fast_positive/tables_internal.h"
 #include <gtest/gtest.h>
 
+#include "tools.hpp"
+
 static const char testdb_name[] = "ut_create.fpta";
 static const char testdb_name_lck[] = "ut_create.fpta-lock";
 
@@ -63,8 +65,319 @@ TEST(Open, Trivia) {
   EXPECT_EQ(FPTA_SUCCESS, fpta_db_close(db));
   ASSERT_TRUE(unlink(testdb_name) == 0);
   ASSERT_TRUE(unlink(testdb_name_lck) == 0);
+
+  EXPECT_EQ(FPTA_SUCCESS,
+            fpta_db_open(testdb_name, fpta_sync_group, 0644, 1, false, &db));
+  EXPECT_NE(nullptr, db);
+  EXPECT_EQ(FPTA_SUCCESS, fpta_db_close(db));
+  ASSERT_TRUE(unlink(testdb_name) == 0);
+  ASSERT_TRUE(unlink(testdb_name_lck) == 0);
+
+  EXPECT_EQ(FPTA_SUCCESS, fpta_db_open(testdb_name, fpta_sync_deferred, 0644,
+                                       1, false, &db));
+  EXPECT_NE(nullptr, db);
+  EXPECT_EQ(FPTA_SUCCESS, fpta_db_close(db));
+  ASSERT_TRUE(unlink(testdb_name) == 0);
+  ASSERT_TRUE(unlink(testdb_name_lck) == 0);
+}
+
+//----------------------------------------------------------------------------
+
+/* Проверки операций над файлом БД целиком. */
+class DatabaseFile : public db_fixture {
+protected:
+  DatabaseFile() : db_fixture(testdb_name, testdb_name_lck) {}
+};
+
+TEST_F(DatabaseFile, DynamicGeometry) {
+  /* Проверка динамического размера БД.
+   *
+   * Сценарий:
+   *  1. Проверяем контроль аргументов fpta_db_open_ex().
+   *  2. Создаем БД минимального размера с возможностью роста.
+   *  3. Вставляем строки небольшими транзакциями, суммарно в несколько
+   *     раз больше начального размера, все транзакции должны быть
+   *     успешными за счет автоматического увеличения размера,
+   *     а запрос сведений о читателях не должен мешать его изменению.
+   *  4. Удаляем все строки и проверяем, что БД остается работоспособной
+   *     после возможного уменьшения размера. */
+  fpta_db_geometry geometry;
+  geometry.lower = 2;
+  geometry.upper = 1;
+  geometry.growth_step = 1;
+  geometry.shrink_threshold = 0;
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_open_ex(testdb_name, fpta_lazy, 0644,
+                                         &geometry, true, &db));
+  geometry.lower = 1;
+  geometry.upper = 16;
+  geometry.growth_step = 0;
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_open_ex(testdb_name, fpta_lazy, 0644,
+                                         &geometry, true, &db));
+  geometry.growth_step = 1;
+  geometry.shrink_threshold = 1;
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_open_ex(testdb_name, fpta_lazy, 0644,
+                                         &geometry, true, &db));
+  EXPECT_EQ(FPTA_EINVAL,
+            fpta_db_open_ex(testdb_name, fpta_lazy, 0644, nullptr, true, &db));
+  EXPECT_EQ(nullptr, db);
+
+  geometry.shrink_threshold = 4;
+  EXPECT_EQ(FPTA_SUCCESS, fpta_db_open_ex(testdb_name, fpta_lazy, 0644,
+                                          &geometry, true, &db));
+  ASSERT_NE(nullptr, db);
+
+  fpta_name table, col_pk, col_payload;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Geometry"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_payload, "payload"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("payload", fptu_cstr,
+                                          fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Geometry", &def));
+
+  fpta_txn *txn = nullptr;
+  const std::string payload(1000, 'x');
+  fptu_rw *pt = fptu_alloc(2, payload.size() + 16);
+  ASSERT_NE(nullptr, pt);
+  const unsigned txns = 60, rows = 50;
+  for (unsigned t = 0; t < txns; ++t) {
+    ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+    for (unsigned n = 0; n < rows; ++n) {
+      ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+      ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk,
+                                            fpta_value_uint(t * rows + n)));
+      ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_payload,
+                                            fpta_value_str(payload)));
+      ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+    }
+    ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+    txn = nullptr;
+
+    // сведения о читателях запрашиваются через временную транзакцию
+    fpta_readers_info info;
+    ASSERT_EQ(FPTA_OK, fpta_db_readers_info(db, &info));
+    EXPECT_EQ(0u, info.longterm);
+  }
+
+  struct stat st;
+  ASSERT_EQ(0, stat(testdb_name, &st));
+  EXPECT_LT((off_t)(geometry.lower << 20), st.st_size);
+
+  // удаляем все строки, после чего размер может быть уменьшен
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_table_clear(txn, &table));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(42)));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_payload, fpta_value_str(payload)));
+  ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  free(pt);
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_payload);
 }
 
+static const char testdb_copy[] = "ut_copy.fpta";
+static const char testdb_copy_lck[] = "ut_copy.fpta-lock";
+
+TEST_F(DatabaseFile, HotCopy) {
+  /* Проверка копирования БД без остановки работы.
+   *
+   * Сценарий:
+   *  1. Создаем БД с таблицей и заполняем её.
+   *  2. При открытой в этом же потоке читающей транзакции создаем
+   *     обычную копию, а затем компактную с ограничением скорости.
+   *  3. Открываем каждую из копий и проверяем наличие строк.
+   *  4. Проверяем, что копирование в существующий файл отвергается. */
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("payload", fptu_cstr,
+                                          fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_lazy));
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_schema, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_table_create(txn, "Copy", &def));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name table, col_pk, col_payload;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Copy"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_payload, "payload"));
+
+  const unsigned rows = 1000;
+  const std::string payload(100, 'x');
+  fptu_rw *pt = fptu_alloc(2, payload.size() + 16);
+  ASSERT_NE(nullptr, pt);
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  for (unsigned n = 0; n < rows; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_payload, fpta_value_str(payload)));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  free(pt);
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_payload);
+
+  fpta_txn *reader = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &reader));
+
+  for (unsigned flags = fpta_copy_default; flags <= fpta_copy_compact;
+       ++flags) {
+    SCOPED_TRACE("flags " + std::to_string(flags));
+    ASSERT_TRUE(unlink(testdb_copy) == 0 || errno == ENOENT);
+    ASSERT_TRUE(unlink(testdb_copy_lck) == 0 || errno == ENOENT);
+    const size_t limit = (flags & fpta_copy_compact) ? 4 << 20 : 0;
+    ASSERT_EQ(FPTA_OK, fpta_db_copy(db, testdb_copy, flags, limit));
+    EXPECT_NE(FPTA_OK, fpta_db_copy(db, testdb_copy, flags, limit));
+
+    fpta_db *copy = nullptr;
+    EXPECT_EQ(FPTA_SUCCESS,
+              fpta_db_open(testdb_copy, fpta_sync, 0644, 1, false, &copy));
+    ASSERT_NE(nullptr, copy);
+    ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Copy"));
+    ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+    ASSERT_EQ(FPTA_OK, fpta_transaction_begin(copy, fpta_read, &txn));
+    ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_pk));
+    for (unsigned n = 0; n < rows; n += rows / 10) {
+      fpta_value pk = fpta_value_uint(n);
+      fptu_ro row;
+      EXPECT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &pk, &row));
+    }
+    fpta_value pk = fpta_value_uint(rows);
+    fptu_ro row;
+    EXPECT_EQ(FPTA_NOTFOUND, fpta_get(txn, &col_pk, &pk, &row));
+    ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+    fpta_name_destroy(&table);
+    fpta_name_destroy(&col_pk);
+    ASSERT_EQ(FPTA_OK, fpta_db_close(copy));
+  }
+
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_copy(db, testdb_copy, 42, 0));
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_copy(db, nullptr, fpta_copy_default, 0));
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(reader, false));
+  ASSERT_NO_FATAL_FAILURE(close_db());
+  ASSERT_TRUE(unlink(testdb_copy) == 0);
+  ASSERT_TRUE(unlink(testdb_copy_lck) == 0);
+}
+
+TEST_F(DatabaseFile, DeltaBackup) {
+  /* Проверка разностного резервного копирования.
+   *
+   * Сценарий:
+   *  1. Заполняем таблицу и создаем первую (полную) delta.
+   *  2. Изменяем небольшую часть данных и создаем вторую delta,
+   *     которая должна быть существенно меньше первой.
+   *  3. Восстанавливаем образ из обеих delta, открываем его
+   *     и проверяем наличие строк обоих этапов. */
+  static const char digest[] = "ut_backup.digest";
+  static const char delta1[] = "ut_backup.delta1";
+  static const char delta2[] = "ut_backup.delta2";
+  for (const char *path :
+       {testdb_copy, testdb_copy_lck, digest, delta1, delta2})
+    ASSERT_TRUE(unlink(path) == 0 || errno == ENOENT);
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("payload", fptu_cstr,
+                                          fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_lazy, 4));
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_schema, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_table_create(txn, "Backup", &def));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name table, col_pk, col_payload;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Backup"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_payload, "payload"));
+
+  const std::string payload(200, 'x');
+  fptu_rw *pt = fptu_alloc(2, payload.size() + 16);
+  ASSERT_NE(nullptr, pt);
+  auto insert = [&](unsigned from, unsigned count) {
+    ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+    for (unsigned n = from; n < from + count; ++n) {
+      ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+      ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+      ASSERT_EQ(FPTA_OK,
+                fpta_upsert_column(pt, &col_payload, fpta_value_str(payload)));
+      ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+    }
+    ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  };
+
+  insert(0, 2000);
+  ASSERT_EQ(FPTA_OK, fpta_db_backup_delta(db, digest, delta1, 0));
+  EXPECT_NE(FPTA_OK, fpta_db_backup_delta(db, digest, delta1, 0));
+
+  insert(100000, 10);
+  ASSERT_EQ(FPTA_OK, fpta_db_backup_delta(db, digest, delta2, 16 << 20));
+  free(pt);
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_payload);
+  ASSERT_NO_FATAL_FAILURE(close_db());
+
+  struct stat st1, st2;
+  ASSERT_EQ(0, stat(delta1, &st1));
+  ASSERT_EQ(0, stat(delta2, &st2));
+  EXPECT_LT(st2.st_size * 4, st1.st_size);
+
+  // восстанавливаем образ из обеих delta
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_restore_delta(testdb_copy, digest));
+  ASSERT_TRUE(unlink(testdb_copy) == 0 || errno == ENOENT);
+  ASSERT_EQ(FPTA_OK, fpta_db_restore_delta(testdb_copy, delta1));
+  ASSERT_EQ(FPTA_OK, fpta_db_restore_delta(testdb_copy, delta2));
+
+  EXPECT_EQ(FPTA_SUCCESS,
+            fpta_db_open(testdb_copy, fpta_sync, 0644, 4, false, &db));
+  ASSERT_NE(nullptr, db);
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Backup"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  for (unsigned n : {0u, 1000u, 1999u, 100000u, 100009u}) {
+    fpta_value pk = fpta_value_uint(n);
+    fptu_ro row;
+    EXPECT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &pk, &row)) << n;
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  ASSERT_NO_FATAL_FAILURE(close_db());
+
+  for (const char *path :
+       {testdb_copy, testdb_copy_lck, digest, delta1, delta2})
+    ASSERT_TRUE(unlink(path) == 0);
+}
+
+//----------------------------------------------------------------------------
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -20,6 +20,9 @@
 #include "fast_positive/tables_internal.h"
 #include <gtest/gtest.h>
 
+#include <thread>
+#include <vector>
+
 static const char testdb_name[] = "ut_schema.fpta";
 static const char testdb_name_lck[] = "ut_schema.fpta-lock";
 
@@ -242,6 +245,118 @@ TEST(Schema, Base) {
   }
 }
 
+TEST(Schema, ArrayColumns) {
+  /* Проверка описания колонок-массивов и мульти-индексов.
+   *
+   * Сценарий:
+   *  - добавляем колонки-массивы допустимых и недопустимых типов.
+   *  - проверяем, что массивы индексируются только вторичным индексом
+   *    с повторами, а выражения для них не допускаются. */
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  EXPECT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary_unique, &def));
+
+  EXPECT_EQ(FPTA_EINVAL,
+            fpta_column_describe("tags", fptu_farray, fpta_index_none, &def));
+  EXPECT_EQ(FPTA_ETYPE,
+            fpta_column_describe("tags", (fptu_type)(fptu_opaque | fptu_farray),
+                                 fpta_index_none, &def));
+  EXPECT_EQ(FPTA_ETYPE,
+            fpta_column_describe("tags", (fptu_type)(fptu_nested | fptu_farray),
+                                 fpta_secondary_withdups, &def));
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_describe(
+                             "tags", (fptu_type)(fptu_uint32 | fptu_farray),
+                             fpta_secondary_unique, &def));
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_describe(
+                             "tags", (fptu_type)(fptu_uint32 | fptu_farray),
+                             fpta_primary_withdups, &def));
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_describe(
+                             "tags", (fptu_type)(fptu_uint32 | fptu_farray),
+                             fpta_secondary_withdups_reversed, &def));
+
+  EXPECT_EQ(FPTA_OK, fpta_column_describe(
+                         "tags", (fptu_type)(fptu_uint32 | fptu_farray),
+                         fpta_secondary_withdups, &def));
+  EXPECT_EQ(FPTA_OK, fpta_column_describe(
+                         "names", (fptu_type)(fptu_cstr | fptu_farray),
+                         fpta_secondary_withdups_reversed, &def));
+  EXPECT_EQ(FPTA_OK, fpta_column_describe(
+                         "hashes", (fptu_type)(fptu_128 | fptu_farray),
+                         fpta_secondary_withdups_unordered, &def));
+  EXPECT_EQ(FPTA_OK, fpta_column_describe(
+                         "dates", (fptu_type)(fptu_datetime | fptu_farray),
+                         fpta_index_none, &def));
+  EXPECT_EQ(FPTA_OK, fpta_column_describe(
+                         "weights", (fptu_type)(fptu_fp64 | fptu_farray),
+                         fpta_secondary_withdups, &def));
+  EXPECT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  EXPECT_EQ(FPTA_ETYPE, fpta_column_describe_expression(
+                            "names", fpta_expr_lowercase, 0, &def));
+  EXPECT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+}
+
+TEST(Schema, ConcurrentReaders) {
+  /* Проверка координации изменений схемы с конкурирующими транзакциями.
+   *
+   * Сценарий:
+   *  - несколько потоков непрерывно начинают и завершают транзакции
+   *    чтения, проверяя версию схемы.
+   *  - одновременно основной поток многократно создает и удаляет
+   *    таблицу, т.е. изменяет схему.
+   *  - версия схемы, видимая читателями, не должна уменьшаться. */
+  ASSERT_TRUE(unlink(testdb_name) == 0 || errno == ENOENT);
+  ASSERT_TRUE(unlink(testdb_name_lck) == 0 || errno == ENOENT);
+
+  fpta_db *db = nullptr;
+  EXPECT_EQ(FPTA_SUCCESS,
+            fpta_db_open(testdb_name, fpta_async, 0644, 1, true, &db));
+  ASSERT_NE(nullptr, db);
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  EXPECT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary_unique, &def));
+  EXPECT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  std::atomic<bool> done(false);
+  std::vector<std::thread> readers;
+  for (unsigned i = 0; i < 4; ++i) {
+    readers.emplace_back([db, &done]() {
+      uint64_t last_schema_version = 0;
+      while (!done.load()) {
+        fpta_txn *txn = nullptr;
+        EXPECT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+        uint64_t data_version, schema_version;
+        EXPECT_EQ(FPTA_OK, fpta_transaction_versions(txn, &data_version,
+                                                     &schema_version));
+        EXPECT_LE(last_schema_version, schema_version);
+        last_schema_version = schema_version;
+        EXPECT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+      }
+    });
+  }
+
+  for (unsigned n = 0; n < 20; ++n) {
+    fpta_txn *txn = nullptr;
+    EXPECT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_schema, &txn));
+    EXPECT_NE(nullptr, txn);
+    EXPECT_EQ(FPTA_OK, fpta_table_create(txn, "table", &def));
+    EXPECT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+    EXPECT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_schema, &txn));
+    EXPECT_NE(nullptr, txn);
+    EXPECT_EQ(FPTA_OK, fpta_table_drop(txn, "table"));
+    EXPECT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  }
+
+  done.store(true);
+  for (auto &reader : readers)
+    reader.join();
+  ASSERT_EQ(FPTA_SUCCESS, fpta_db_close(db));
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
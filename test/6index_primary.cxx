@@ -22,6 +22,9 @@
 
 #include "keygen.hpp"
 
+#include <atomic>
+#include <thread>
+
 /* Кол-во проверочных точек в диапазонах значений индексируемых типов.
  *
  * Значение не может быть больше чем 65536, так как это предел кол-ва
@@ -434,6 +437,527 @@ TYPED_TEST(PrimaryIndex, reverse_withdups) {
   TestPrimary<TypeParam::type, fpta_primary_withdups_reversed>();
 }
 
+//----------------------------------------------------------------------------
+
+/* Проверки особенностей первичного индекса в отдельной таблице. */
+class IndexPrimaryFeature : public db_fixture {
+protected:
+  IndexPrimaryFeature() : db_fixture(testdb_name, testdb_name_lck) {}
+};
+
+TEST_F(IndexPrimaryFeature, StrippedPrimaryKey) {
+  /* Проверка режима хранения строк без значения PK.
+   *
+   * Сценарий:
+   *  1. Проверяем отказ для неподходящих первичных ключей.
+   *  2. Создаем таблицу с PK и вторичным индексом, вставляем строки.
+   *  3. Проверяем что PK восстанавливается при чтении через fpta_get()
+   *     по обоим индексам, через курсоры, а также доступен фильтру.
+   *  4. Обновляем строки через курсор и удаляем часть строк. */
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_set_strip_pk(&def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("pk", fptu_cstr, fpta_primary, &def));
+  EXPECT_EQ(FPTA_ETYPE, fpta_column_set_strip_pk(&def));
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("pk", fptu_uint64,
+                                          fpta_primary_withdups, &def));
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_set_strip_pk(&def));
+
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("se", fptu_int64,
+                                          fpta_secondary_unique, &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("val", fptu_uint32, fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_strip_pk(&def));
+  EXPECT_EQ(EEXIST, fpta_column_set_strip_pk(&def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Stripped", &def));
+
+  fpta_txn *txn = nullptr;
+  fpta_name table, col_pk, col_se, col_val;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Stripped"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_se, "se"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_val, "val"));
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_pk));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_se));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_val));
+
+  fptu_rw *pt = fptu_alloc(3, 42);
+  ASSERT_NE(nullptr, pt);
+  for (unsigned n = 0; n < 100; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n * 7)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_se, fpta_value_sint(-(int)n)));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_val, fpta_value_uint(n)));
+    fptu_ro row = fptu_take_noshrink(pt);
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, row));
+    // повторная вставка той же строки должна распознаваться
+    EXPECT_EQ(MDB_KEYEXIST, fpta_validate_put(txn, &table, row, fpta_upsert));
+  }
+  free(pt);
+  pt = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  fptu_ro row;
+  fpta_value value, key = fpta_value_uint(42 * 7);
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(42u * 7, value.uint);
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_val, &value));
+  EXPECT_EQ(42u, value.uint);
+
+  key = fpta_value_sint(-17);
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_se, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(17u * 7, value.uint);
+
+  // фильтр по PK: pk < 70, т.е. 10 строк
+  fpta_filter filter;
+  filter.type = fpta_node_lt;
+  filter.node_cmp.left_id = &col_pk;
+  filter.node_cmp.right_value = fpta_value_uint(70);
+
+  fpta_name *columns[] = {&col_pk, &col_se};
+  for (fpta_name *column : columns) {
+    fpta_cursor *cursor = nullptr;
+    ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, column, fpta_value_begin(),
+                                        fpta_value_end(), &filter,
+                                        fpta_unsorted_dont_fetch, &cursor));
+    size_t count = 0;
+    ASSERT_EQ(FPTA_OK, fpta_cursor_count(cursor, &count, INT_MAX));
+    EXPECT_EQ(10u, count);
+    ASSERT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  }
+
+  // через курсор по вторичному индексу меняем val, с проверкой PK
+  fpta_cursor *cursor = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, &col_se, fpta_value_begin(),
+                                      fpta_value_end(), nullptr,
+                                      fpta_ascending, &cursor));
+  unsigned visited = 0;
+  for (int rc = fpta_cursor_move(cursor, fpta_first); rc == FPTA_OK;
+       rc = fpta_cursor_move(cursor, fpta_next)) {
+    ASSERT_EQ(FPTA_OK, fpta_cursor_get(cursor, &row));
+    fpta_value pk, se;
+    ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &pk));
+    ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_se, &se));
+    EXPECT_EQ((uint64_t)-se.sint * 7, pk.uint);
+
+    uint8_t buffer[256];
+    fptu_rw *updated = fptu_fetch(row, buffer, sizeof(buffer), 0);
+    ASSERT_NE(nullptr, updated);
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(updated, &col_val, fpta_value_uint(pk.uint)));
+    ASSERT_EQ(FPTA_OK, fpta_cursor_update(cursor, fptu_take(updated)));
+    ++visited;
+  }
+  EXPECT_EQ(100u, visited);
+  ASSERT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+
+  key = fpta_value_uint(99 * 7);
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_val, &value));
+  EXPECT_EQ(99u * 7, value.uint);
+  ASSERT_EQ(FPTA_OK, fpta_delete(txn, &table, row));
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_pk, &key, &row));
+  key = fpta_value_sint(-99);
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_se, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_se);
+  fpta_name_destroy(&col_val);
+}
+
+TEST_F(IndexPrimaryFeature, PrimaryKeyCache) {
+  /* Проверка хеш-таблицы для неупорядоченных PK.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с неупорядоченным уникальным PK-строкой,
+   *     включаем хеш-таблицу и вставляем строки.
+   *  2. Многократно читаем строки посредством fpta_get() по PK
+   *     и по вторичному индексу.
+   *  3. Изменяем и удаляем строки и проверяем, что последующие
+   *     читающие транзакции видят актуальные данные. */
+  fpta_name table, col_pk, col_num;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Hashed"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_num, "num"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("pk", fptu_cstr,
+                                          fpta_primary_unique_unordered,
+                                          &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("num", fptu_uint32,
+                                          fpta_secondary_unique, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_pkcache(db, 1));
+  ASSERT_EQ(FPTA_OK, fpta_db_pkcache(db, 100));
+  EXPECT_EQ(EEXIST, fpta_db_pkcache(db, 100));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Hashed", &def));
+
+  fpta_txn *txn = nullptr;
+  char pk[32];
+  fptu_rw *pt = fptu_alloc(2, 64);
+  ASSERT_NE(nullptr, pt);
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  for (unsigned n = 0; n < 500; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    snprintf(pk, sizeof(pk), "key-%u", n);
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_cstr(pk)));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_num, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  // повторное чтение должно давать те же строки, что и первое
+  fptu_ro row;
+  fpta_value key, value;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  for (unsigned pass = 0; pass < 3; ++pass) {
+    for (unsigned n = 0; n < 500; n += 7) {
+      snprintf(pk, sizeof(pk), "key-%u", n);
+      key = fpta_value_cstr(pk);
+      ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+      ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_num, &value));
+      EXPECT_EQ(n, value.uint);
+
+      key = fpta_value_uint(n);
+      ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_num, &key, &row));
+      ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+      EXPECT_EQ(0, strcmp(pk, value.str));
+    }
+  }
+  key = fpta_value_cstr("key-500");
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_pk, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  // изменения видны следующим читающим транзакциям
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_pk, fpta_value_cstr("key-7")));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_num, fpta_value_uint(777)));
+  ASSERT_EQ(FPTA_OK, fpta_update_row(txn, &table, fptu_take_noshrink(pt)));
+  key = fpta_value_cstr("key-14");
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_delete(txn, &table, row));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+  free(pt);
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  key = fpta_value_cstr("key-7");
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_num, &value));
+  EXPECT_EQ(777u, value.uint);
+  key = fpta_value_cstr("key-14");
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_pk, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_num);
+}
+
+TEST_F(IndexPrimaryFeature, PrimaryKeyCacheWithWrites) {
+  /* Проверка хеш-таблицы для неупорядоченных PK при одновременных
+   * изменениях и росте БД.
+   *
+   * Сценарий:
+   *  1. Создаем БД с динамическим размером и таблицу с неупорядоченным
+   *     уникальным PK-строкой, включаем хеш-таблицу.
+   *  2. В нескольких потоках многократно читаем строки по PK, так что
+   *     повторные чтения обслуживаются хеш-таблицей, и проверяем, что
+   *     в пределах транзакции возвращается одна и та же строка.
+   *  3. Одновременно в основном потоке изменяем строки и добавляем
+   *     объемные строки, из-за чего размер БД многократно увеличивается
+   *     с перемещением отображения.
+   *  4. После завершения изменений проверяем, что читаются последние
+   *     значения. */
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("pk", fptu_cstr,
+                                          fpta_primary_unique_unordered,
+                                          &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("num", fptu_uint32, fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("payload", fptu_opaque,
+                                          fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  fpta_db_geometry geometry;
+  geometry.lower = 1;
+  geometry.upper = 32;
+  geometry.growth_step = 1;
+  geometry.shrink_threshold = 0;
+  ASSERT_EQ(FPTA_SUCCESS, fpta_db_open_ex(db_name, fpta_async, 0644,
+                                          &geometry, true, &db));
+  ASSERT_NE(nullptr, db);
+  ASSERT_EQ(FPTA_OK, fpta_db_pkcache(db, 256));
+  ASSERT_NO_FATAL_FAILURE(create_table("Hashed", &def));
+
+  fpta_name table, col_pk, col_num, col_payload;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Hashed"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_num, "num"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_payload, "payload"));
+
+  // значение num для строки key-n всегда равно n по модулю 1000
+  const unsigned rows = 100, rounds = 30, bulk = 20;
+  char pk[32];
+  char payload[3000];
+  memset(payload, 42, sizeof(payload));
+  fptu_rw *pt = fptu_alloc(3, sizeof(payload) + 64);
+  ASSERT_NE(nullptr, pt);
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  for (unsigned n = 0; n < rows; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    snprintf(pk, sizeof(pk), "key-%u", n);
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_cstr(pk)));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_num, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  std::atomic<bool> done(false);
+  std::atomic<unsigned> hits(0);
+  std::vector<std::thread> readers;
+  for (unsigned r = 0; r < 2; ++r) {
+    readers.emplace_back([&, r]() {
+      fpta_name table_local, pk_local, num_local;
+      EXPECT_EQ(FPTA_OK, fpta_table_init(&table_local, "Hashed"));
+      EXPECT_EQ(FPTA_OK, fpta_column_init(&table_local, &pk_local, "pk"));
+      EXPECT_EQ(FPTA_OK, fpta_column_init(&table_local, &num_local, "num"));
+      char key_local[32];
+      while (!done.load()) {
+        fpta_txn *reader = nullptr;
+        ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &reader));
+        for (unsigned n = r; n < rows; n += 3) {
+          snprintf(key_local, sizeof(key_local), "key-%u", n);
+          const fpta_value key = fpta_value_cstr(key_local);
+          fptu_ro first, second;
+          fpta_value first_num, second_num;
+          ASSERT_EQ(FPTA_OK, fpta_get(reader, &pk_local, &key, &first));
+          ASSERT_EQ(FPTA_OK, fpta_get_column(first, &num_local, &first_num));
+          ASSERT_EQ(FPTA_OK, fpta_get(reader, &pk_local, &key, &second));
+          ASSERT_EQ(FPTA_OK,
+                    fpta_get_column(second, &num_local, &second_num));
+          EXPECT_EQ(n, first_num.uint % 1000);
+          EXPECT_EQ(first_num.uint, second_num.uint);
+          ASSERT_EQ(first.sys.iov_len, second.sys.iov_len);
+          EXPECT_EQ(0, memcmp(first.sys.iov_base, second.sys.iov_base,
+                              first.sys.iov_len));
+          hits += 1;
+        }
+        ASSERT_EQ(FPTA_OK, fpta_transaction_end(reader, false));
+      }
+      fpta_name_destroy(&table_local);
+      fpta_name_destroy(&pk_local);
+      fpta_name_destroy(&num_local);
+    });
+  }
+
+  for (unsigned round = 1; round <= rounds; ++round) {
+    ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+    for (unsigned n = 0; n < rows; ++n) {
+      ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+      snprintf(pk, sizeof(pk), "key-%u", n);
+      ASSERT_EQ(FPTA_OK,
+                fpta_upsert_column(pt, &col_pk, fpta_value_cstr(pk)));
+      ASSERT_EQ(FPTA_OK, fpta_upsert_column(
+                             pt, &col_num, fpta_value_uint(n + round * 1000)));
+      ASSERT_EQ(FPTA_OK, fpta_update_row(txn, &table, fptu_take_noshrink(pt)));
+    }
+    for (unsigned n = 0; n < bulk; ++n) {
+      ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+      snprintf(pk, sizeof(pk), "bulk-%u-%u", round, n);
+      ASSERT_EQ(FPTA_OK,
+                fpta_upsert_column(pt, &col_pk, fpta_value_cstr(pk)));
+      ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_num, fpta_value_uint(0)));
+      const fpta_value blob = fpta_value_binary(payload, sizeof(payload));
+      ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_payload, blob));
+      ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+    }
+    ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+    txn = nullptr;
+  }
+  done.store(true);
+  for (auto &reader : readers)
+    reader.join();
+  free(pt);
+  EXPECT_LT(0u, hits.load());
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  for (unsigned pass = 0; pass < 2; ++pass) {
+    for (unsigned n = 0; n < rows; ++n) {
+      snprintf(pk, sizeof(pk), "key-%u", n);
+      const fpta_value key = fpta_value_cstr(pk);
+      fptu_ro row;
+      fpta_value value;
+      ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+      ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_num, &value));
+      EXPECT_EQ(n + rounds * 1000, value.uint);
+    }
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_num);
+  fpta_name_destroy(&col_payload);
+}
+
+TEST_F(IndexPrimaryFeature, PrimaryKeyCacheAcrossCommits) {
+  /* Проверка использования хеш-таблицы для неупорядоченных PK
+   * после фиксации изменений.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с неупорядоченным уникальным PK-строкой,
+   *     включаем хеш-таблицу, вставляем строки и читаем их.
+   *  2. Изменяем и удаляем по одной строке и проверяем, что следующая
+   *     читающая транзакция находит в хеш-таблице остальные строки,
+   *     а для измененных получает актуальные данные.
+   *  3. Очищаем таблицу и проверяем, что строки больше не находятся. */
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("pk", fptu_cstr,
+                                          fpta_primary_unique_unordered,
+                                          &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("num", fptu_uint32, fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+  ASSERT_EQ(FPTA_OK, fpta_db_pkcache(db, 1024));
+  ASSERT_NO_FATAL_FAILURE(create_table("Hashed", &def));
+
+  fpta_name table, col_pk, col_num;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Hashed"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_num, "num"));
+
+  const unsigned rows = 10;
+  char pk[32];
+  fptu_rw *pt = fptu_alloc(2, 64);
+  ASSERT_NE(nullptr, pt);
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  for (unsigned n = 0; n < rows; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    snprintf(pk, sizeof(pk), "key-%u", n);
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_cstr(pk)));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_num, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  fptu_ro row;
+  fpta_value key, value;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  for (unsigned n = 0; n < rows; ++n) {
+    snprintf(pk, sizeof(pk), "key-%u", n);
+    key = fpta_value_cstr(pk);
+    ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  fpta_pkcache_info before, after;
+  ASSERT_EQ(FPTA_OK, fpta_db_pkcache_info(db, &before));
+  EXPECT_EQ(1024u, before.entries);
+  EXPECT_EQ(0u, before.hits);
+  EXPECT_EQ(rows, before.misses);
+
+  // изменяем key-1 и удаляем key-2, остальные строки не затрагиваются
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_pk, fpta_value_cstr("key-1")));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_num, fpta_value_uint(101)));
+  ASSERT_EQ(FPTA_OK, fpta_update_row(txn, &table, fptu_take_noshrink(pt)));
+  key = fpta_value_cstr("key-2");
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_delete(txn, &table, row));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+  free(pt);
+
+  /* строки из хеш-таблицы являются копиями и остаются действительными
+   * до завершения транзакции */
+  fptu_ro rows_read[rows];
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  for (unsigned n = 0; n < rows; ++n) {
+    snprintf(pk, sizeof(pk), "key-%u", n);
+    key = fpta_value_cstr(pk);
+    if (n == 2) {
+      EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_pk, &key, &rows_read[n]));
+      continue;
+    }
+    ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &rows_read[n]));
+  }
+  for (unsigned n = 0; n < rows; ++n) {
+    if (n == 2)
+      continue;
+    ASSERT_EQ(FPTA_OK, fpta_get_column(rows_read[n], &col_num, &value));
+    EXPECT_EQ((n == 1) ? 101u : n, value.uint);
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  /* промахи неизбежны для измененных ключей, а также для ключей,
+   * случайно попавших с ними в одну корзину */
+  ASSERT_EQ(FPTA_OK, fpta_db_pkcache_info(db, &after));
+  EXPECT_LE(rows - 4, after.hits - before.hits);
+  EXPECT_LE(2u, after.misses - before.misses);
+  EXPECT_EQ(rows, (after.hits - before.hits) + (after.misses - before.misses));
+
+  // очистка таблицы делает недействительными все копии
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_table_clear(txn, &table));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  for (unsigned n = 0; n < rows; ++n) {
+    snprintf(pk, sizeof(pk), "key-%u", n);
+    key = fpta_value_cstr(pk);
+    EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_pk, &key, &row));
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_num);
+}
+
+//----------------------------------------------------------------------------
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -19,6 +19,7 @@
 
 #include "fast_positive/tables_internal.h"
 #include <gtest/gtest.h>
+#include <thread>
 
 #include "keygen.hpp"
 
@@ -513,6 +514,964 @@ INSTANTIATE_TEST_CASE_P(
 TEST(IndexSecondary, GoogleTestCombine_IS_NOT_Supported_OnThisPlatform) {}
 #endif /* GTEST_HAS_COMBINE */
 
+//----------------------------------------------------------------------------
+
+/* Проверки разновидностей вторичных индексов, каждая со своей схемой. */
+class IndexSecondaryFeature : public db_fixture {
+protected:
+  IndexSecondaryFeature() : db_fixture(testdb_name, testdb_name_lck) {}
+};
+
+static bool filter_row_predicate_true(const fptu_ro *, void *, void *) {
+  return true;
+}
+
+static size_t count_via_cursor(fpta_txn *txn, fpta_name *column_id) {
+  fpta_cursor *cursor = nullptr;
+  size_t count = SIZE_MAX;
+  EXPECT_EQ(FPTA_OK, fpta_cursor_open(txn, column_id, fpta_value_begin(),
+                                      fpta_value_end(), nullptr,
+                                      fpta_unsorted_dont_fetch, &cursor));
+  if (cursor) {
+    EXPECT_EQ(FPTA_OK, fpta_cursor_count(cursor, &count, INT_MAX));
+    EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  }
+  return count;
+}
+
+TEST_F(IndexSecondaryFeature, PartialIndex) {
+  /* Проверка частичных вторичных индексов.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с PK и уникальным вторичным индексом, в который
+   *     попадают только строки с status == 1.
+   *  2. Вставляем строки и проверяем, что индекс содержит только
+   *     подходящие строки, а уникальность контролируется только среди них.
+   *  3. Изменяем status посредством fpta_update_row() и fpta_column_add(),
+   *     удаляем строки и проверяем согласованность индекса. */
+  fpta_name table, col_pk, col_status, col_ord;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Partial"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_status, "status"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_ord, "ord"));
+
+  fpta_filter pending;
+  pending.type = fpta_node_eq;
+  pending.node_cmp.left_id = &col_status;
+  pending.node_cmp.right_value = fpta_value_uint(1);
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("ord", fptu_int64,
+                                          fpta_secondary_unique, &def));
+  EXPECT_EQ(FPTA_COLUMN_MISSING,
+            fpta_column_describe_partial("ord", &pending, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("status", fptu_uint32,
+                                          fpta_index_none, &def));
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_describe_partial("pk", &pending, &def));
+  EXPECT_EQ(FPTA_EINVAL,
+            fpta_column_describe_partial("status", &pending, &def));
+
+  fpta_filter functor;
+  functor.type = fpta_node_fnrow;
+  functor.node_fnrow.context = nullptr;
+  functor.node_fnrow.arg = nullptr;
+  functor.node_fnrow.predicate = filter_row_predicate_true;
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_describe_partial("ord", &functor, &def));
+
+  ASSERT_EQ(FPTA_OK, fpta_column_describe_partial("ord", &pending, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Partial", &def));
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_pk));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_status));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_ord));
+
+  // в индекс попадает каждая десятая строка, при этом значения ord
+  // повторяются, но уникальны среди попадающих в индекс строк
+  fptu_rw *pt = fptu_alloc(3, 42);
+  ASSERT_NE(nullptr, pt);
+  for (unsigned n = 0; n < 100; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_status,
+                                          fpta_value_uint(n % 10 == 0)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_ord,
+                                 fpta_value_sint(n % 10 ? n % 10 : n)));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+  EXPECT_EQ(10u, count_via_cursor(txn, &col_ord));
+  EXPECT_EQ(100u, count_via_cursor(txn, &col_pk));
+
+  fptu_ro row;
+  fpta_value key = fpta_value_sint(20), value;
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_ord, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(20u, value.uint);
+  key = fpta_value_sint(21);
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_ord, &key, &row));
+
+  // строка без индексируемой колонки допустима, если не попадает в индекс
+  ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(1000)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_status, fpta_value_uint(0)));
+  EXPECT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+
+  // нарушение уникальности среди попадающих в индекс строк
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(1001)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_status, fpta_value_uint(1)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_ord, fpta_value_sint(20)));
+  EXPECT_EQ(MDB_KEYEXIST,
+            fpta_validate_insert_row(txn, &table, fptu_take_noshrink(pt)));
+
+  // строка 21 попадает в индекс, а строка 20 выпадает из него
+  ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(21)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_status, fpta_value_uint(1)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_ord, fpta_value_sint(21)));
+  EXPECT_EQ(FPTA_OK, fpta_update_row(txn, &table, fptu_take_noshrink(pt)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(20)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_status, fpta_value_uint(0)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_ord, fpta_value_sint(20)));
+  EXPECT_EQ(FPTA_OK, fpta_update_row(txn, &table, fptu_take_noshrink(pt)));
+  free(pt);
+  pt = nullptr;
+
+  EXPECT_EQ(10u, count_via_cursor(txn, &col_ord));
+  key = fpta_value_sint(21);
+  EXPECT_EQ(FPTA_OK, fpta_get(txn, &col_ord, &key, &row));
+  key = fpta_value_sint(20);
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_ord, &key, &row));
+
+  // счетчик также влияет на попадание строки в индекс
+  key = fpta_value_uint(31);
+  ASSERT_EQ(FPTA_OK, fpta_column_add(txn, &col_status, &key,
+                                     fpta_value_uint(1), &value));
+  EXPECT_EQ(1u, value.uint);
+  EXPECT_EQ(11u, count_via_cursor(txn, &col_ord));
+
+  // удаление строк, попадающих и не попадающих в индекс
+  key = fpta_value_uint(30);
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_delete(txn, &table, row));
+  key = fpta_value_uint(32);
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_delete(txn, &table, row));
+  EXPECT_EQ(10u, count_via_cursor(txn, &col_ord));
+  EXPECT_EQ(99u, count_via_cursor(txn, &col_pk));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_status);
+  fpta_name_destroy(&col_ord);
+}
+
+static int extract_parity(void *context, const fptu_ro *row,
+                          fpta_value *key_value) {
+  fpta_value pk;
+  int rc = fpta_get_column(*row, (const fpta_name *)context, &pk);
+  if (rc == FPTA_OK)
+    *key_value = fpta_value_uint(pk.uint & 1);
+  return rc;
+}
+
+static fpta_value unix_datetime(uint64_t utc) {
+  fptu_time datetime;
+  datetime.fixedpoint = utc << 32;
+  return fpta_value_datetime(datetime);
+}
+
+static size_t count_range(fpta_txn *txn, fpta_name *column_id,
+                          const fpta_value &from, const fpta_value &to) {
+  fpta_cursor *cursor = nullptr;
+  size_t count = SIZE_MAX;
+  EXPECT_EQ(FPTA_OK, fpta_cursor_open(txn, column_id, from, to, nullptr,
+                                      fpta_unsorted_dont_fetch, &cursor));
+  if (cursor) {
+    EXPECT_EQ(FPTA_OK, fpta_cursor_count(cursor, &count, INT_MAX));
+    EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  }
+  return count;
+}
+
+TEST_F(IndexSecondaryFeature, ExpressionIndex) {
+  /* Проверка индексов по выражениям.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с уникальным индексом по строке в нижнем регистре,
+   *     индексом по дате (время округляется до суток) и индексом по
+   *     четности PK, вычисляемой зарегистрированной функцией.
+   *  2. Вставляем строки и проверяем контроль уникальности без учета
+   *     регистра, а также поиск по исходным и вычисленным значениям.
+   *  3. Изменяем и удаляем строки, проверяя согласованность индексов. */
+  fpta_name table, col_pk, col_name, col_time, col_parity;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Expr"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_name, "name"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_time, "time"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_parity, "parity"));
+
+  EXPECT_EQ(FPTA_EINVAL,
+            fpta_key_extractor_register("bad name", extract_parity, &col_pk));
+  ASSERT_EQ(FPTA_OK,
+            fpta_key_extractor_register("parity", extract_parity, &col_pk));
+  EXPECT_EQ(EEXIST,
+            fpta_key_extractor_register("Parity", extract_parity, &col_pk));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("name", fptu_cstr,
+                                          fpta_secondary_unique, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("time", fptu_datetime,
+                                          fpta_secondary_withdups, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("parity", fptu_uint64,
+                                          fpta_secondary_withdups, &def));
+
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_describe_expression(
+                             "pk", fpta_expr_lowercase, 0, &def));
+  EXPECT_EQ(FPTA_ETYPE, fpta_column_describe_expression(
+                            "time", fpta_expr_lowercase, 0, &def));
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_describe_expression(
+                             "name", fpta_expr_prefix, 0, &def));
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_describe_expression(
+                             "name", fpta_expr_extractor, 0, &def));
+  EXPECT_EQ(FPTA_COLUMN_MISSING, fpta_column_describe_expression(
+                                     "nope", fpta_expr_lowercase, 0, &def));
+  EXPECT_EQ(FPTA_EINVAL,
+            fpta_column_describe_extractor("parity", "bad name", &def));
+
+  ASSERT_EQ(FPTA_OK, fpta_column_describe_expression(
+                         "name", fpta_expr_lowercase, 0, &def));
+  EXPECT_EQ(EEXIST, fpta_column_describe_expression(
+                        "name", fpta_expr_prefix, 4, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe_expression(
+                         "time", fpta_expr_datetime_trunc,
+                         fpta_expr_trunc_day, &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe_extractor("parity", "parity", &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Expr", &def));
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_pk));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_name));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_time));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_parity));
+
+  // строки через каждые 6 часов, т.е. по 4 строки в сутки,
+  // значение колонки parity в строках отсутствует
+  const uint32_t day = fpta_expr_trunc_day;
+  const uint32_t midnight = 1500000000 - 1500000000 % day;
+  char name[32];
+  fptu_rw *pt = fptu_alloc(3, 42);
+  ASSERT_NE(nullptr, pt);
+  for (unsigned n = 0; n < 10; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    snprintf(name, sizeof(name), "Name%u", n);
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_name, fpta_value_cstr(name)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_time,
+                                 unix_datetime(midnight + n * 6 * 3600)));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+
+  // уникальность без учета регистра
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(42)));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_name, fpta_value_cstr("NAME3")));
+  EXPECT_EQ(MDB_KEYEXIST,
+            fpta_validate_insert_row(txn, &table, fptu_take_noshrink(pt)));
+
+  // поиск по исходному и вычисленному значению
+  fptu_ro row;
+  fpta_value key = fpta_value_cstr("nAmE5"), value;
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_name, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(5u, value.uint);
+  key = fpta_value_cstr("name7");
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_name, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(7u, value.uint);
+
+  // границы диапазона также округляются до суток
+  EXPECT_EQ(4u, count_range(txn, &col_time,
+                            unix_datetime(midnight + day + 12345),
+                            unix_datetime(midnight + day * 2 + 42)));
+  EXPECT_EQ(2u, count_range(txn, &col_time,
+                            unix_datetime(midnight + day * 2 + 42),
+                            fpta_value_end()));
+  EXPECT_EQ(5u, count_range(txn, &col_parity, fpta_value_uint(1),
+                            fpta_value_end()));
+  EXPECT_EQ(10u, count_via_cursor(txn, &col_parity));
+
+  // смена регистра не меняет ключ, а удаление убирает строку из индексов
+  ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(5)));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_name, fpta_value_cstr("NAME5")));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_time, unix_datetime(midnight)));
+  EXPECT_EQ(FPTA_OK, fpta_update_row(txn, &table, fptu_take_noshrink(pt)));
+  free(pt);
+  pt = nullptr;
+
+  key = fpta_value_cstr("name5");
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_name, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_name, &value));
+  EXPECT_EQ(0, strcmp("NAME5", value.str));
+  EXPECT_EQ(5u, count_range(txn, &col_time, fpta_value_begin(),
+                            unix_datetime(midnight + day + 42)));
+
+  key = fpta_value_uint(3);
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_delete(txn, &table, row));
+  EXPECT_EQ(4u, count_range(txn, &col_parity, fpta_value_uint(1),
+                            fpta_value_end()));
+  EXPECT_EQ(9u, count_via_cursor(txn, &col_name));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  // конфликт уникальности без учета регистра при вставке и обновлении
+  // прерывает транзакцию, поэтому каждый случай в своей транзакции
+  pt = fptu_alloc(3, 42);
+  ASSERT_NE(nullptr, pt);
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(42)));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_name, fpta_value_cstr("nAmE4")));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_time, unix_datetime(midnight)));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  EXPECT_EQ(MDB_KEYEXIST,
+            fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  fpta_transaction_end(txn, true);
+
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(6)));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  EXPECT_EQ(MDB_KEYEXIST,
+            fpta_update_row(txn, &table, fptu_take_noshrink(pt)));
+  fpta_transaction_end(txn, true);
+  free(pt);
+  pt = nullptr;
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  key = fpta_value_uint(42);
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_pk, &key, &row));
+  key = fpta_value_cstr("NAME4");
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_name, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(4u, value.uint);
+  key = fpta_value_cstr("name6");
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_name, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(6u, value.uint);
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_name);
+  fpta_name_destroy(&col_time);
+  fpta_name_destroy(&col_parity);
+
+  // функция, упомянутая в схеме, но не зарегистрированная в процессе,
+  // допускается при создании таблицы, но не при изменении строк
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("nested", fptu_nested,
+                                          fpta_secondary_withdups, &def));
+  EXPECT_EQ(FPTA_ETYPE,
+            fpta_column_describe_extractor("nested", "parity", &def));
+
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("key", fptu_uint64,
+                                          fpta_secondary_withdups, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe_extractor("key", "unknown", &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+  ASSERT_NO_FATAL_FAILURE(create_table("Unbound", &def));
+
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Unbound"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_pk));
+  pt = fptu_alloc(1, 8);
+  ASSERT_NE(nullptr, pt);
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(1)));
+  EXPECT_EQ(FPTA_ENOIMP,
+            fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  fpta_transaction_end(txn, true);
+  free(pt);
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+}
+
+/* Формирует колонку-кортеж вида {city: cstr, geo: {zip: uint32}}. */
+static fpta_value make_address(fptu_rw *pt, const char *city, unsigned zip) {
+  fptu_rw *geo = fptu_alloc(1, 8);
+  EXPECT_NE(nullptr, geo);
+  EXPECT_EQ(FPTU_OK, fptu_upsert_uint32(geo, 0, zip));
+  EXPECT_EQ(FPTU_OK, fptu_clear(pt));
+  EXPECT_EQ(FPTU_OK, fptu_upsert_string(pt, 0, city, strlen(city)));
+  EXPECT_EQ(FPTU_OK, fptu_upsert_nested(pt, 1, fptu_take_noshrink(geo)));
+  free(geo);
+  const fptu_ro address = fptu_take_noshrink(pt);
+  return fpta_value_binary(address.sys.iov_base, address.sys.iov_len);
+}
+
+TEST_F(IndexSecondaryFeature, NestedPathIndex) {
+  /* Проверка индексов по полям вложенных кортежей.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с колонкой-кортежем address и индексами
+   *     по путям address.city и address.geo.zip.
+   *  2. Вставляем строки и проверяем поиск и диапазоны по значениям
+   *     полей внутри кортежей.
+   *  3. Изменяем и удаляем строки, проверяя согласованность индексов. */
+  fpta_name table, col_pk, col_address, col_city, col_zip;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Nested"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_address, "address"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_city, "city"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_zip, "zip"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("address", fptu_nested,
+                                          fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("city", fptu_cstr,
+                                          fpta_secondary_withdups, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("zip", fptu_uint32,
+                                          fpta_secondary_withdups, &def));
+
+  const unsigned city_path[] = {0};
+  const unsigned zip_path[] = {1, 0};
+  const unsigned deep_path[] = {1, 1, 1, 1, 1};
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_describe_expression(
+                             "city", fpta_expr_nested_path, 0, &def));
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_describe_nested("city", "address",
+                                                     city_path, 0, &def));
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_describe_nested("city", "address",
+                                                     deep_path, 5, &def));
+  EXPECT_EQ(FPTA_COLUMN_MISSING, fpta_column_describe_nested(
+                                     "city", "nope", city_path, 1, &def));
+  EXPECT_EQ(FPTA_ETYPE,
+            fpta_column_describe_nested("city", "zip", city_path, 1, &def));
+  EXPECT_EQ(FPTA_EINVAL,
+            fpta_column_describe_nested("pk", "address", city_path, 1, &def));
+
+  ASSERT_EQ(FPTA_OK, fpta_column_describe_nested("city", "address",
+                                                 city_path, 1, &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe_nested("zip", "address", zip_path, 2, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Nested", &def));
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_pk));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_address));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_city));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_zip));
+
+  // города по кругу, индексы (zip) от 100 до 109
+  static const char *const cities[] = {"Moscow", "Berlin", "Paris"};
+  fptu_rw *pt = fptu_alloc(2, 256);
+  ASSERT_NE(nullptr, pt);
+  fptu_rw *address = fptu_alloc(2, 64);
+  ASSERT_NE(nullptr, address);
+  for (unsigned n = 0; n < 10; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_address,
+                                 make_address(address, cities[n % 3],
+                                              100 + n)));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+
+  // поиск и диапазоны по значениям полей внутри кортежей
+  fptu_ro row;
+  fpta_value key = fpta_value_uint(105), value;
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_zip, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(5u, value.uint);
+  EXPECT_EQ(4u, count_range(txn, &col_city, fpta_value_cstr("Moscow"),
+                            fpta_value_cstr("Moscox")));
+  EXPECT_EQ(3u, count_range(txn, &col_zip, fpta_value_uint(102),
+                            fpta_value_uint(105)));
+  EXPECT_EQ(10u, count_via_cursor(txn, &col_city));
+
+  // перемещение строки в другой город меняет ключи индексов
+  ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(0)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_address,
+                                        make_address(address, "Paris", 200)));
+  EXPECT_EQ(FPTA_OK, fpta_update_row(txn, &table, fptu_take_noshrink(pt)));
+  free(address);
+  free(pt);
+  pt = nullptr;
+
+  EXPECT_EQ(3u, count_range(txn, &col_city, fpta_value_cstr("Moscow"),
+                            fpta_value_cstr("Moscox")));
+  EXPECT_EQ(4u, count_range(txn, &col_city, fpta_value_cstr("Paris"),
+                            fpta_value_cstr("Parit")));
+  key = fpta_value_uint(100);
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_zip, &key, &row));
+  key = fpta_value_uint(200);
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_zip, &key, &row));
+
+  ASSERT_EQ(FPTA_OK, fpta_delete(txn, &table, row));
+  EXPECT_EQ(3u, count_range(txn, &col_city, fpta_value_cstr("Paris"),
+                            fpta_value_cstr("Parit")));
+  EXPECT_EQ(9u, count_via_cursor(txn, &col_zip));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_address);
+  fpta_name_destroy(&col_city);
+  fpta_name_destroy(&col_zip);
+}
+
+TEST_F(IndexSecondaryFeature, KeyFilter) {
+  /* Проверка фильтров отрицательных поисков.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с уникальными PK и вторичным индексом, включаем
+   *     для них фильтры и вставляем строки.
+   *  2. Проверяем, что контроль уникальности и поиск работают как без
+   *     фильтров, в том числе в следующих транзакциях.
+   *  3. Удаляем строку и строим фильтр в транзакции, которая затем
+   *     отменяется, после чего строка снова должна обнаруживаться. */
+  fpta_name table, col_pk, col_uuid, col_note;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Dedup"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_uuid, "uuid"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_note, "note"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("uuid", fptu_cstr,
+                                          fpta_secondary_unique, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("note", fptu_cstr,
+                                          fpta_secondary_withdups, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Dedup", &def));
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  EXPECT_EQ(FPTA_EINVAL, fpta_index_keyfilter(txn, &col_pk, 1000));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  EXPECT_EQ(FPTA_NO_INDEX, fpta_index_keyfilter(txn, &col_note, 1000));
+  ASSERT_EQ(FPTA_OK, fpta_index_keyfilter(txn, &col_pk, 1000));
+  ASSERT_EQ(FPTA_OK, fpta_index_keyfilter(txn, &col_uuid, 1000));
+
+  char uuid[32];
+  fptu_rw *pt = fptu_alloc(3, 64);
+  ASSERT_NE(nullptr, pt);
+  for (unsigned n = 0; n < 100; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    snprintf(uuid, sizeof(uuid), "uuid-%u", n * 7);
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_uuid, fpta_value_cstr(uuid)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_note, fpta_value_cstr("note")));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  // дубликаты обнаруживаются в следующей транзакции
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(42)));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_uuid, fpta_value_cstr("uuid-new")));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_note, fpta_value_cstr("note")));
+  EXPECT_EQ(MDB_KEYEXIST,
+            fpta_validate_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(1000)));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_uuid, fpta_value_cstr("uuid-42")));
+  EXPECT_EQ(MDB_KEYEXIST,
+            fpta_validate_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_uuid, fpta_value_cstr("uuid-43")));
+  EXPECT_EQ(FPTA_OK,
+            fpta_validate_insert_row(txn, &table, fptu_take_noshrink(pt)));
+
+  fptu_ro row;
+  fpta_value key = fpta_value_cstr("uuid-42"), value;
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_uuid, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(6u, value.uint);
+  key = fpta_value_cstr("uuid-43");
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_uuid, &key, &row));
+
+  // удаление и повторное построение фильтра в отменяемой транзакции
+  key = fpta_value_uint(6);
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_delete(txn, &table, row));
+  ASSERT_EQ(FPTA_OK, fpta_index_keyfilter(txn, &col_uuid, 10));
+  key = fpta_value_cstr("uuid-42");
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_uuid, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, true));
+  txn = nullptr;
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_uuid, &key, &row));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_uuid, fpta_value_cstr("uuid-42")));
+  EXPECT_EQ(MDB_KEYEXIST,
+            fpta_validate_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  ASSERT_EQ(FPTA_OK, fpta_index_keyfilter(txn, &col_pk, 0));
+  ASSERT_EQ(FPTA_OK, fpta_index_keyfilter(txn, &col_uuid, 0));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+  free(pt);
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_uuid);
+  fpta_name_destroy(&col_note);
+}
+
+TEST_F(IndexSecondaryFeature, KeyFilterConcurrentAbort) {
+  /* Проверка передачи фильтров между пишущими транзакциями потоков.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с уникальным вторичным индексом и фильтром.
+   *  2. Один поток в цикле перестраивает фильтр и вставляет строку
+   *     в транзакции, которая затем отменяется, а при отмене построенный
+   *     в ней фильтр освобождается.
+   *  3. Одновременно другой поток вставляет и фиксирует строки, проверяя
+   *     контроль уникальности по ранее вставленным.
+   *  4. Проверяем, что в таблице только зафиксированные строки. */
+  fpta_name table, col_pk, col_uuid;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Handover"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_uuid, "uuid"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("uuid", fptu_cstr,
+                                          fpta_secondary_unique, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+  ASSERT_NO_FATAL_FAILURE(create_table("Handover", &def));
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_uuid));
+  ASSERT_EQ(FPTA_OK, fpta_index_keyfilter(txn, &col_uuid, 100));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  const unsigned rounds = 200;
+  auto writer = [&](bool aborting) {
+    fpta_name table_local, pk_local, uuid_local;
+    EXPECT_EQ(FPTA_OK, fpta_table_init(&table_local, "Handover"));
+    EXPECT_EQ(FPTA_OK, fpta_column_init(&table_local, &pk_local, "pk"));
+    EXPECT_EQ(FPTA_OK, fpta_column_init(&table_local, &uuid_local, "uuid"));
+    char uuid[32];
+    fptu_rw *pt = fptu_alloc(2, 64);
+    for (unsigned n = 0; n < rounds; ++n) {
+      fpta_txn *wtxn = nullptr;
+      EXPECT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &wtxn));
+      EXPECT_EQ(FPTA_OK,
+                fpta_name_refresh_couple(wtxn, &table_local, &uuid_local));
+      EXPECT_EQ(FPTU_OK, fptu_clear(pt));
+      if (aborting) {
+        /* фильтр будет перестроен при вставке и освобожден при отмене */
+        EXPECT_EQ(FPTA_OK, fpta_index_keyfilter(wtxn, &uuid_local, 100));
+        snprintf(uuid, sizeof(uuid), "aborted-%u", n);
+        EXPECT_EQ(FPTA_OK, fpta_upsert_column(pt, &pk_local,
+                                              fpta_value_uint(rounds + n)));
+      } else {
+        snprintf(uuid, sizeof(uuid), "uuid-%u", n);
+        EXPECT_EQ(FPTA_OK,
+                  fpta_upsert_column(pt, &pk_local, fpta_value_uint(n)));
+      }
+      EXPECT_EQ(FPTA_OK,
+                fpta_upsert_column(pt, &uuid_local, fpta_value_cstr(uuid)));
+      EXPECT_EQ(FPTA_OK,
+                fpta_insert_row(wtxn, &table_local, fptu_take_noshrink(pt)));
+      if (!aborting && n > 0) {
+        snprintf(uuid, sizeof(uuid), "uuid-%u", n - 1);
+        EXPECT_EQ(FPTA_OK, fpta_upsert_column(pt, &pk_local,
+                                              fpta_value_uint(rounds * 2)));
+        EXPECT_EQ(FPTA_OK,
+                  fpta_upsert_column(pt, &uuid_local, fpta_value_cstr(uuid)));
+        EXPECT_EQ(MDB_KEYEXIST,
+                  fpta_validate_insert_row(wtxn, &table_local,
+                                           fptu_take_noshrink(pt)));
+      }
+      EXPECT_EQ(FPTA_OK, fpta_transaction_end(wtxn, aborting));
+    }
+    free(pt);
+    fpta_name_destroy(&table_local);
+    fpta_name_destroy(&pk_local);
+    fpta_name_destroy(&uuid_local);
+  };
+  std::thread aborter(writer, true);
+  std::thread inserter(writer, false);
+  aborter.join();
+  inserter.join();
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_pk));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_uuid));
+  EXPECT_EQ(rounds, count_via_cursor(txn, &col_pk));
+  EXPECT_EQ(rounds, count_via_cursor(txn, &col_uuid));
+  fptu_ro row;
+  fpta_value key = fpta_value_cstr("uuid-0");
+  EXPECT_EQ(FPTA_OK, fpta_get(txn, &col_uuid, &key, &row));
+  key = fpta_value_cstr("aborted-0");
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_uuid, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_index_keyfilter(txn, &col_uuid, 0));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_uuid);
+}
+
+TEST_F(IndexSecondaryFeature, Collation) {
+  /* Проверка правил сравнения строк в индексах.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с уникальными индексами без учета регистра
+   *     для ASCII и для UTF-8.
+   *  2. Вставляем строки и проверяем контроль уникальности и поиск
+   *     по значениям в другом регистре. */
+  fpta_name table, col_pk, col_login, col_code;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Collate"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_login, "login"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_code, "code"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("login", fptu_cstr,
+                                          fpta_secondary_unique, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("code", fptu_cstr,
+                                          fpta_secondary_unique, &def));
+
+  EXPECT_EQ(FPTA_ETYPE, fpta_column_describe_collation(
+                            "pk", fpta_collation_binary, &def));
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_describe_collation(
+                             "login", (fpta_collation)42, &def));
+  EXPECT_EQ(FPTA_OK, fpta_column_describe_collation(
+                         "login", fpta_collation_binary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe_collation(
+                         "login", fpta_collation_utf8_ci, &def));
+  EXPECT_EQ(EEXIST, fpta_column_describe_collation(
+                        "login", fpta_collation_ascii_ci, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe_collation(
+                         "code", fpta_collation_ascii_ci, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Collate", &def));
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  static const char *const logins[] = {"Привет", "ΣΟΦΙΑ", "Ÿves", "Łódź"};
+  static const char *const codes[] = {"ABC", "Код", "КОД", "abd"};
+  fptu_rw *pt = fptu_alloc(3, 64);
+  ASSERT_NE(nullptr, pt);
+  for (unsigned n = 0; n < 4; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_login, fpta_value_cstr(logins[n])));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_code, fpta_value_cstr(codes[n])));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+
+  // уникальность без учета регистра
+  ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(42)));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_login, fpta_value_cstr("пРИВЕТ")));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_code, fpta_value_cstr("x")));
+  EXPECT_EQ(MDB_KEYEXIST,
+            fpta_validate_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  ASSERT_EQ(FPTA_OK,
+            fpta_upsert_column(pt, &col_login, fpta_value_cstr("new")));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_code, fpta_value_cstr("Abc")));
+  EXPECT_EQ(MDB_KEYEXIST,
+            fpta_validate_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  free(pt);
+
+  // поиск по значению в другом регистре
+  static const char *const lookups[] = {"привет", "σοφια", "ÿVES", "łÓdŹ"};
+  fptu_ro row;
+  fpta_value key, value;
+  for (unsigned n = 0; n < 4; ++n) {
+    key = fpta_value_cstr(lookups[n]);
+    ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_login, &key, &row));
+    ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+    EXPECT_EQ(n, value.uint);
+    ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_login, &value));
+    EXPECT_EQ(0, strcmp(logins[n], value.str));
+  }
+
+  // для ASCII-правил регистр кириллицы учитывается
+  key = fpta_value_cstr("abc");
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_code, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(0u, value.uint);
+  key = fpta_value_cstr("КОД");
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_code, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(2u, value.uint);
+  key = fpta_value_cstr("кОД");
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_code, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_login);
+  fpta_name_destroy(&col_code);
+}
+
+TEST_F(IndexSecondaryFeature, ArrayIndex) {
+  /* Проверка мульти-индексов по колонкам-массивам.
+   *
+   * В libfptu пока нет функций для формирования массивов, поэтому
+   * проверяется только обработка строк без колонок-массивов.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с PK и мульти-индексами по массивам uint32,
+   *     строк и fp64.
+   *  2. Вставляем строки без массивов и проверяем, что они не попадают
+   *     в мульти-индексы, а получить строку по мульти-индексу нельзя.
+   *  3. Обновляем и удаляем строки, в том числе посредством
+   *     fpta_delete_range() по мульти-индексу, проверяя согласованность
+   *     индексов. */
+  fpta_name table, col_pk, col_tags, col_names, col_weights;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Arrays"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_tags, "tags"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_names, "names"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_weights, "weights"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe(
+                         "tags", (fptu_type)(fptu_uint32 | fptu_farray),
+                         fpta_secondary_withdups, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe(
+                         "names", (fptu_type)(fptu_cstr | fptu_farray),
+                         fpta_secondary_withdups, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe(
+                         "weights", (fptu_type)(fptu_fp64 | fptu_farray),
+                         fpta_secondary_withdups, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+  ASSERT_NO_FATAL_FAILURE(create_table("Arrays", &def));
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_pk));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_tags));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_names));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_weights));
+
+  fptu_rw *pt = fptu_alloc(1, 16);
+  ASSERT_NE(nullptr, pt);
+  for (unsigned n = 0; n < 10; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+  EXPECT_EQ(10u, count_via_cursor(txn, &col_pk));
+  EXPECT_EQ(0u, count_via_cursor(txn, &col_tags));
+  EXPECT_EQ(0u, count_via_cursor(txn, &col_names));
+  EXPECT_EQ(0u, count_via_cursor(txn, &col_weights));
+
+  // по мульти-индексу нельзя получить единственную строку
+  fptu_ro row;
+  fpta_value key = fpta_value_uint(5);
+  EXPECT_EQ(FPTA_NO_INDEX, fpta_get(txn, &col_tags, &key, &row));
+
+  // обновление и удаление не затрагивают мульти-индексы
+  ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(5)));
+  ASSERT_EQ(FPTA_OK, fpta_update_row(txn, &table, fptu_take_noshrink(pt)));
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_delete(txn, &table, row));
+  EXPECT_EQ(9u, count_via_cursor(txn, &col_pk));
+  EXPECT_EQ(0u, count_via_cursor(txn, &col_tags));
+
+  // строки без массивов не попадают в диапазон мульти-индекса
+  size_t deleted = SIZE_MAX;
+  ASSERT_EQ(FPTA_OK, fpta_delete_range(txn, &col_tags, fpta_value_begin(),
+                                       fpta_value_end(), nullptr, &deleted));
+  EXPECT_EQ(0u, deleted);
+  ASSERT_EQ(FPTA_OK,
+            fpta_delete_range(txn, &col_names, fpta_value_cstr("a"),
+                              fpta_value_cstr("z"), nullptr, &deleted));
+  EXPECT_EQ(0u, deleted);
+  EXPECT_EQ(9u, count_via_cursor(txn, &col_pk));
+  free(pt);
+  pt = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_tags);
+  fpta_name_destroy(&col_names);
+  fpta_name_destroy(&col_weights);
+}
+
+//----------------------------------------------------------------------------
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -20,6 +20,7 @@
 #include "fast_positive/tables_internal.h"
 #include <algorithm>
 #include <gtest/gtest.h>
+#include <map>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
@@ -1687,6 +1688,673 @@ TEST(CursorSecondaryDups, GoogleTestCombine_IS_NOT_Supported_OnThisPlatform) {}
 
 #endif /* GTEST_HAS_COMBINE */
 
+//----------------------------------------------------------------------------
+
+/* Проверки выборок курсором по вторичному индексу со своей схемой. */
+class CursorSecondaryFeature : public db_fixture {
+protected:
+  CursorSecondaryFeature() : db_fixture(testdb_name, testdb_name_lck) {}
+};
+
+static size_t count_prefix(fpta_txn *txn, fpta_name *column_id,
+                           const fpta_value &prefix, fpta_cursor_options op) {
+  fpta_cursor *cursor = nullptr;
+  size_t count = SIZE_MAX;
+  EXPECT_EQ(FPTA_OK, fpta_cursor_open_prefix(txn, column_id, prefix, nullptr,
+                                             op, &cursor));
+  if (cursor) {
+    EXPECT_EQ(FPTA_OK, fpta_cursor_count(cursor, &count, INT_MAX));
+    EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  }
+  return count;
+}
+
+TEST_F(CursorSecondaryFeature, PrefixCursor) {
+  /* Проверка курсоров с выборкой по префиксу ключа.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с обычным и обратным (last2first) индексами
+   *     по строковым колонкам.
+   *  2. Вставляем строки, включая длинные значения, ключи которых
+   *     хранятся в индексе усеченными.
+   *  3. Проверяем выборки по префиксам, включая пустой, граничный (0xFF)
+   *     и длинный префиксы, а также сортировку по-убыванию. */
+  fpta_name table, col_pk, col_name, col_host, col_hash;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Prefix"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_name, "name"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_host, "host"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_hash, "hash"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("name", fptu_cstr,
+                                          fpta_secondary_withdups, &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("host", fptu_cstr,
+                                 fpta_secondary_withdups_reversed, &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("hash", fptu_cstr,
+                                 fpta_secondary_withdups_unordered, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Prefix", &def));
+
+  fpta_txn *txn = nullptr;
+  const std::string longkey(fpta_max_keylen + 4, 'x');
+  const std::string names[] = {"app",
+                               "apple",
+                               "application",
+                               "apply",
+                               "banana",
+                               "\xff\xff",
+                               longkey + "A",
+                               longkey + "B",
+                               longkey.substr(0, fpta_max_keylen) + "yyyy"};
+  static const char *const hosts[] = {
+      "example.com", "www.example.com", "mail.example.com",
+      "notexample.com", "example.org", "www.example.org",
+      "mx.ExAmple.com", "com", "localhost"};
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  fptu_rw *pt = fptu_alloc(4, 256);
+  ASSERT_NE(nullptr, pt);
+  for (unsigned n = 0; n < 9; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_name,
+                                          fpta_value_cstr(names[n].c_str())));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_host, fpta_value_cstr(hosts[n])));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_hash, fpta_value_cstr(hosts[n])));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+  free(pt);
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+
+  // недопустимые типы и индексы
+  fpta_cursor *cursor = nullptr;
+  EXPECT_EQ(FPTA_NO_INDEX,
+            fpta_cursor_open_prefix(txn, &col_hash, fpta_value_cstr("www"),
+                                    nullptr, fpta_unsorted, &cursor));
+  EXPECT_EQ(FPTA_ETYPE,
+            fpta_cursor_open_prefix(txn, &col_pk, fpta_value_cstr("1"),
+                                    nullptr, fpta_unsorted, &cursor));
+  EXPECT_EQ(FPTA_ETYPE,
+            fpta_cursor_open_prefix(txn, &col_name, fpta_value_binary("a", 1),
+                                    nullptr, fpta_unsorted, &cursor));
+  EXPECT_EQ(FPTA_ETYPE,
+            fpta_cursor_open_prefix(txn, &col_name, fpta_value_uint(1),
+                                    nullptr, fpta_unsorted, &cursor));
+  EXPECT_EQ(nullptr, cursor);
+
+  // префиксы для индекса first2last
+  EXPECT_EQ(4u, count_prefix(txn, &col_name, fpta_value_cstr("app"),
+                             fpta_ascending_dont_fetch));
+  EXPECT_EQ(3u, count_prefix(txn, &col_name, fpta_value_cstr("appl"),
+                             fpta_descending_dont_fetch));
+  EXPECT_EQ(1u, count_prefix(txn, &col_name, fpta_value_cstr("b"),
+                             fpta_unsorted_dont_fetch));
+  EXPECT_EQ(0u, count_prefix(txn, &col_name, fpta_value_cstr("c"),
+                             fpta_ascending_dont_fetch));
+  EXPECT_EQ(9u, count_prefix(txn, &col_name, fpta_value_cstr(""),
+                             fpta_ascending_dont_fetch));
+  EXPECT_EQ(1u, count_prefix(txn, &col_name, fpta_value_cstr("\xff"),
+                             fpta_ascending_dont_fetch));
+
+  // длинные префиксы, превышающие сохраняемую в индексе часть ключа
+  EXPECT_EQ(3u, count_prefix(txn, &col_name,
+                             fpta_value_string(longkey.data(), 8),
+                             fpta_ascending_dont_fetch));
+  EXPECT_EQ(2u, count_prefix(txn, &col_name, fpta_value_cstr(longkey.c_str()),
+                             fpta_ascending_dont_fetch));
+  const std::string longprefix = longkey + "B";
+  EXPECT_EQ(1u, count_prefix(txn, &col_name,
+                             fpta_value_cstr(longprefix.c_str()),
+                             fpta_descending_dont_fetch));
+
+  // для индекса last2first выбираются строки по окончанию значения
+  EXPECT_EQ(2u, count_prefix(txn, &col_host, fpta_value_cstr(".example.com"),
+                             fpta_ascending_dont_fetch));
+  EXPECT_EQ(4u, count_prefix(txn, &col_host, fpta_value_cstr("example.com"),
+                             fpta_descending_dont_fetch));
+  EXPECT_EQ(6u, count_prefix(txn, &col_host, fpta_value_cstr("com"),
+                             fpta_ascending_dont_fetch));
+
+  // позиционирование сразу при открытии курсора
+  fptu_ro row;
+  fpta_value value;
+  ASSERT_EQ(FPTA_OK, fpta_cursor_open_prefix(txn, &col_name,
+                                             fpta_value_cstr("appl"), nullptr,
+                                             fpta_descending, &cursor));
+  ASSERT_NE(nullptr, cursor);
+  ASSERT_EQ(FPTA_OK, fpta_cursor_get(cursor, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(3u, value.uint);
+  ASSERT_EQ(FPTA_OK, fpta_cursor_move(cursor, fpta_last));
+  ASSERT_EQ(FPTA_OK, fpta_cursor_get(cursor, &row));
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(1u, value.uint);
+  EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  cursor = nullptr;
+  EXPECT_EQ(FPTA_NODATA,
+            fpta_cursor_open_prefix(txn, &col_host, fpta_value_cstr(".net"),
+                                    nullptr, fpta_ascending, &cursor));
+  EXPECT_EQ(nullptr, cursor);
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_name);
+  fpta_name_destroy(&col_host);
+  fpta_name_destroy(&col_hash);
+}
+
+TEST_F(CursorSecondaryFeature, TopK) {
+  /* Проверка выборки первых K строк по значениям неиндексированной
+   * колонки.
+   *
+   * Сценарий:
+   *  1. Создаем две одинаковые таблицы, во второй из которых строки
+   *     хранятся без значения PK.
+   *  2. Вставляем строки, часть из которых без значения score.
+   *  3. Для обеих таблиц сверяем результаты fpta_topk() с эталонной
+   *     сортировкой, в том числе с диапазоном курсора, при равных
+   *     значениях и упорядочении по PK. */
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  static const char *const tables[] = {"TopK", "TopKs"};
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_schema, &txn));
+  for (unsigned stripped = 0; stripped < 2; ++stripped) {
+    fpta_column_set def;
+    fpta_column_set_init(&def);
+    ASSERT_EQ(FPTA_OK,
+              fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+    ASSERT_EQ(FPTA_OK, fpta_column_describe("grp", fptu_uint32,
+                                            fpta_secondary_withdups, &def));
+    ASSERT_EQ(FPTA_OK, fpta_column_describe("score", fptu_fp64,
+                                            fpta_index_none, &def));
+    ASSERT_EQ(FPTA_OK,
+              fpta_column_describe("name", fptu_cstr, fpta_index_none, &def));
+    if (stripped) {
+      ASSERT_EQ(FPTA_OK, fpta_column_set_strip_pk(&def));
+    }
+    ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+    ASSERT_EQ(FPTA_OK, fpta_table_create(txn, tables[stripped], &def));
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  for (unsigned stripped = 0; stripped < 2; ++stripped) {
+    SCOPED_TRACE(tables[stripped]);
+    fpta_name table, col_pk, col_grp, col_score, col_name;
+    ASSERT_EQ(FPTA_OK, fpta_table_init(&table, tables[stripped]));
+    ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+    ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_grp, "grp"));
+    ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_score, "score"));
+    ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_name, "name"));
+
+    // score = (n * 37) % 100 без повторов, у каждой 10-й строки нет score
+    ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+    fptu_rw *pt = fptu_alloc(4, 64);
+    ASSERT_NE(nullptr, pt);
+    std::vector<std::pair<double, unsigned>> scores;
+    std::vector<std::pair<std::string, unsigned>> names;
+    for (unsigned n = 0; n < 100; ++n) {
+      const std::string name = std::to_string(n * 7 % 100);
+      ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+      ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+      ASSERT_EQ(FPTA_OK,
+                fpta_upsert_column(pt, &col_grp, fpta_value_uint(n % 4)));
+      ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_name,
+                                            fpta_value_cstr(name.c_str())));
+      names.push_back(std::make_pair(name, n));
+      if (n % 10 != 9) {
+        const double score = n * 37 % 100;
+        ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_score,
+                                              fpta_value_float(score)));
+        scores.push_back(std::make_pair(score, n));
+      }
+      ASSERT_EQ(FPTA_OK,
+                fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+    }
+    free(pt);
+    ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+    txn = nullptr;
+    std::sort(scores.begin(), scores.end());
+    std::sort(names.begin(), names.end());
+
+    ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+    fpta_cursor *cursor = nullptr;
+    ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, &col_pk, fpta_value_begin(),
+                                        fpta_value_end(), nullptr,
+                                        fpta_unsorted_dont_fetch, &cursor));
+    ASSERT_NE(nullptr, cursor);
+
+    fptu_ro rows[100];
+    size_t count;
+    fpta_value value;
+    EXPECT_EQ(FPTA_EINVAL,
+              fpta_topk(cursor, &col_score, fpta_unsorted, 5, rows, &count));
+    EXPECT_EQ(FPTA_OK,
+              fpta_topk(cursor, &col_score, fpta_ascending, 0, rows, &count));
+    EXPECT_EQ(0u, count);
+
+    // наибольшие значения
+    ASSERT_EQ(FPTA_OK,
+              fpta_topk(cursor, &col_score, fpta_descending, 5, rows, &count));
+    ASSERT_EQ(5u, count);
+    for (size_t i = 0; i < count; ++i) {
+      ASSERT_EQ(FPTA_OK, fpta_get_column(rows[i], &col_pk, &value));
+      EXPECT_EQ(scores[scores.size() - 1 - i].second, value.uint);
+    }
+
+    // все строки со значением score, по-возрастанию
+    ASSERT_EQ(FPTA_OK,
+              fpta_topk(cursor, &col_score, fpta_ascending, 100, rows, &count));
+    ASSERT_EQ(scores.size(), count);
+    for (size_t i = 0; i < count; ++i) {
+      ASSERT_EQ(FPTA_OK, fpta_get_column(rows[i], &col_pk, &value));
+      EXPECT_EQ(scores[i].second, value.uint);
+    }
+
+    // строковая колонка
+    ASSERT_EQ(FPTA_OK,
+              fpta_topk(cursor, &col_name, fpta_ascending, 7, rows, &count));
+    ASSERT_EQ(7u, count);
+    for (size_t i = 0; i < count; ++i) {
+      ASSERT_EQ(FPTA_OK, fpta_get_column(rows[i], &col_name, &value));
+      EXPECT_EQ(names[i].first, std::string(value.str, value.binary_length));
+    }
+
+    // при равных значениях сохраняется порядок курсора
+    ASSERT_EQ(FPTA_OK,
+              fpta_topk(cursor, &col_grp, fpta_descending, 3, rows, &count));
+    ASSERT_EQ(3u, count);
+    for (size_t i = 0; i < count; ++i) {
+      ASSERT_EQ(FPTA_OK, fpta_get_column(rows[i], &col_pk, &value));
+      EXPECT_EQ(3 + i * 4, value.uint);
+    }
+    EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+    cursor = nullptr;
+
+    // курсор с диапазоном по вторичному индексу, упорядочение по PK
+    ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, &col_grp, fpta_value_uint(1),
+                                        fpta_value_uint(2), nullptr,
+                                        fpta_unsorted_dont_fetch, &cursor));
+    ASSERT_NE(nullptr, cursor);
+    ASSERT_EQ(FPTA_OK,
+              fpta_topk(cursor, &col_pk, fpta_descending, 4, rows, &count));
+    ASSERT_EQ(4u, count);
+    for (size_t i = 0; i < count; ++i) {
+      ASSERT_EQ(FPTA_OK, fpta_get_column(rows[i], &col_pk, &value));
+      EXPECT_EQ(97 - i * 4, value.uint);
+      ASSERT_EQ(FPTA_OK, fpta_get_column(rows[i], &col_grp, &value));
+      EXPECT_EQ(1u, value.uint);
+    }
+    EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+    ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+    txn = nullptr;
+
+    fpta_name_destroy(&table);
+    fpta_name_destroy(&col_pk);
+    fpta_name_destroy(&col_grp);
+    fpta_name_destroy(&col_score);
+    fpta_name_destroy(&col_name);
+  }
+}
+
+TEST_F(CursorSecondaryFeature, Aggregate) {
+  /* Проверка агрегатных функций по строкам курсора.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с PK, вторичным индексом и неиндексированными
+   *     колонками разных типов, вставляем строки, часть из которых без
+   *     некоторых значений.
+   *  2. Сверяем результаты fpta_cursor_aggregate() с вычисленными в тесте,
+   *     в том числе по диапазонам, пустому диапазону и только min/max
+   *     по колонке индекса курсора.
+   *  3. Проверяем контроль типов и переполнения суммы. */
+  fpta_name table, col_pk, col_grp, col_val, col_ratio, col_when, col_big;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Aggregate"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_grp, "grp"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_val, "val"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_ratio, "ratio"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_when, "when"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_big, "big"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("grp", fptu_uint32,
+                                          fpta_secondary_withdups, &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("val", fptu_int64, fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("ratio", fptu_fp64, fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("when", fptu_datetime,
+                                          fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("big", fptu_uint64, fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Aggregate", &def));
+
+  fpta_txn *txn = nullptr;
+  // у каждой 7-й строки нет значения val, big только у первых трех
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  fptu_rw *pt = fptu_alloc(6, 64);
+  ASSERT_NE(nullptr, pt);
+  int64_t val_sum = 0, grp2_sum = 0;
+  size_t val_count = 0;
+  for (unsigned n = 0; n < 50; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_grp, fpta_value_uint(n % 5)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_ratio, fpta_value_float(n / 4.0)));
+    fptu_time when;
+    when.fixedpoint = 1000 + n * 3 % 50;
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_when, fpta_value_datetime(when)));
+    if (n % 7) {
+      const int64_t val = (int64_t)n - 20;
+      ASSERT_EQ(FPTA_OK,
+                fpta_upsert_column(pt, &col_val, fpta_value_sint(val)));
+      val_sum += val;
+      val_count += 1;
+      if (n % 5 == 2)
+        grp2_sum += val;
+    }
+    if (n < 3) {
+      ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_big,
+                                            fpta_value_uint(UINT64_MAX / 2)));
+    }
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+  free(pt);
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  fpta_cursor *cursor = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, &col_pk, fpta_value_begin(),
+                                      fpta_value_end(), nullptr,
+                                      fpta_unsorted_dont_fetch, &cursor));
+  ASSERT_NE(nullptr, cursor);
+
+  // все строки
+  fpta_aggregate all[] = {
+      {nullptr, fpta_aggregate_count, fpta_value_null()},
+      {&col_val, fpta_aggregate_count, fpta_value_null()},
+      {&col_val, fpta_aggregate_sum, fpta_value_null()},
+      {&col_val, fpta_aggregate_min, fpta_value_null()},
+      {&col_val, fpta_aggregate_max, fpta_value_null()},
+      {&col_ratio, fpta_aggregate_avg, fpta_value_null()},
+      {&col_ratio, fpta_aggregate_sum, fpta_value_null()},
+      {&col_when, fpta_aggregate_min, fpta_value_null()},
+      {&col_pk, fpta_aggregate_max, fpta_value_null()},
+      {&col_big, fpta_aggregate_count, fpta_value_null()}};
+  ASSERT_EQ(FPTA_OK, fpta_cursor_aggregate(cursor, all, 10));
+  EXPECT_EQ(fpta_unsigned_int, all[0].result.type);
+  EXPECT_EQ(50u, all[0].result.uint);
+  EXPECT_EQ(val_count, all[1].result.uint);
+  EXPECT_EQ(fpta_signed_int, all[2].result.type);
+  EXPECT_EQ(val_sum, all[2].result.sint);
+  EXPECT_EQ(-19, all[3].result.sint);
+  EXPECT_EQ(28, all[4].result.sint);
+  EXPECT_EQ(fpta_float_point, all[5].result.type);
+  EXPECT_DOUBLE_EQ(49 / 8.0, all[5].result.fp);
+  EXPECT_DOUBLE_EQ(49 * 50 / 8.0, all[6].result.fp);
+  EXPECT_EQ(fpta_datetime, all[7].result.type);
+  EXPECT_EQ(1000u, all[7].result.datetime.fixedpoint);
+  EXPECT_EQ(49u, all[8].result.uint);
+  EXPECT_EQ(3u, all[9].result.uint);
+
+  // переполнение суммы и недопустимые запросы
+  fpta_aggregate bad = {&col_big, fpta_aggregate_sum, fpta_value_null()};
+  EXPECT_EQ(FPTA_EVALUE, fpta_cursor_aggregate(cursor, &bad, 1));
+  bad.column_id = &col_when;
+  EXPECT_EQ(FPTA_ETYPE, fpta_cursor_aggregate(cursor, &bad, 1));
+  bad.column_id = nullptr;
+  EXPECT_EQ(FPTA_EINVAL, fpta_cursor_aggregate(cursor, &bad, 1));
+  bad.function = (fpta_aggregate_function)42;
+  EXPECT_EQ(FPTA_EINVAL, fpta_cursor_aggregate(cursor, &bad, 1));
+  EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  cursor = nullptr;
+
+  // только min/max по колонке индекса курсора в диапазоне
+  fpta_aggregate bounds[] = {
+      {&col_pk, fpta_aggregate_max, fpta_value_null()},
+      {&col_pk, fpta_aggregate_min, fpta_value_null()}};
+  ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, &col_pk, fpta_value_uint(10),
+                                      fpta_value_uint(20), nullptr,
+                                      fpta_descending_dont_fetch, &cursor));
+  ASSERT_EQ(FPTA_OK, fpta_cursor_aggregate(cursor, bounds, 2));
+  EXPECT_EQ(19u, bounds[0].result.uint);
+  EXPECT_EQ(10u, bounds[1].result.uint);
+  EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  cursor = nullptr;
+
+  // пустой диапазон
+  ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, &col_pk, fpta_value_uint(100),
+                                      fpta_value_uint(200), nullptr,
+                                      fpta_unsorted_dont_fetch, &cursor));
+  ASSERT_EQ(FPTA_OK, fpta_cursor_aggregate(cursor, bounds, 2));
+  EXPECT_EQ(fpta_null, bounds[0].result.type);
+  EXPECT_EQ(fpta_null, bounds[1].result.type);
+  ASSERT_EQ(FPTA_OK, fpta_cursor_aggregate(cursor, all, 3));
+  EXPECT_EQ(0u, all[0].result.uint);
+  EXPECT_EQ(0u, all[1].result.uint);
+  EXPECT_EQ(fpta_null, all[2].result.type);
+  EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  cursor = nullptr;
+
+  // диапазон по вторичному индексу
+  ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, &col_grp, fpta_value_uint(2),
+                                      fpta_value_uint(3), nullptr,
+                                      fpta_unsorted_dont_fetch, &cursor));
+  fpta_aggregate grp2[] = {
+      {&col_val, fpta_aggregate_sum, fpta_value_null()},
+      {&col_grp, fpta_aggregate_max, fpta_value_null()},
+      {nullptr, fpta_aggregate_count, fpta_value_null()}};
+  ASSERT_EQ(FPTA_OK, fpta_cursor_aggregate(cursor, grp2, 3));
+  EXPECT_EQ(grp2_sum, grp2[0].result.sint);
+  EXPECT_EQ(2u, grp2[1].result.uint);
+  EXPECT_EQ(10u, grp2[2].result.uint);
+  EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_grp);
+  fpta_name_destroy(&col_val);
+  fpta_name_destroy(&col_ratio);
+  fpta_name_destroy(&col_when);
+  fpta_name_destroy(&col_big);
+}
+
+struct group_collector {
+  std::map<std::string, std::pair<uint64_t, int64_t>> groups;
+  std::vector<std::string> order;
+  size_t stop_after;
+};
+
+static std::string group_name(const fpta_value *group) {
+  switch (group->type) {
+  case fpta_null:
+    return "<null>";
+  case fpta_unsigned_int:
+    return std::to_string(group->uint);
+  default:
+    return std::string(group->str, group->binary_length);
+  }
+}
+
+static int group_collect(void *context, const fpta_value *group,
+                         const fpta_aggregate *aggregates, size_t count) {
+  group_collector *collector = (group_collector *)context;
+  EXPECT_EQ(2u, count);
+  const std::string name = group_name(group);
+  EXPECT_EQ(0u, collector->groups.count(name));
+  collector->groups[name] = std::make_pair(
+      aggregates[0].result.uint,
+      (aggregates[1].result.type == fpta_null) ? INT64_MIN
+                                               : aggregates[1].result.sint);
+  collector->order.push_back(name);
+  return (collector->order.size() == collector->stop_after) ? 42 : 0;
+}
+
+TEST_F(CursorSecondaryFeature, GroupAggregate) {
+  /* Проверка группировки с агрегатными функциями.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с PK, вторичным индексом по колонке группировки
+   *     и неиндексированной строковой колонкой, у части строк которой
+   *     нет значения.
+   *  2. Группируем по колонке индекса курсора (потоковая группировка)
+   *     и сверяем порядок групп и результаты.
+   *  3. Группируем по неиндексированной колонке через курсор по PK
+   *     (группировка через хеш-таблицу), в том числе строки без значения.
+   *  4. Проверяем прерывание группировки из функции обратного вызова
+   *     и контроль аргументов. */
+  fpta_name table, col_pk, col_grp, col_tag, col_val;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "GroupAggregate"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_grp, "grp"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_tag, "tag"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_val, "val"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("grp", fptu_uint32,
+                                          fpta_secondary_withdups, &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("tag", fptu_cstr, fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("val", fptu_int64, fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("GroupAggregate", &def));
+
+  fpta_txn *txn = nullptr;
+  // у каждой 4-й строки нет значения tag
+  static const char *const tags[] = {"alpha", "beta", "gamma"};
+  std::map<std::string, std::pair<uint64_t, int64_t>> by_grp, by_tag;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  fptu_rw *pt = fptu_alloc(4, 64);
+  ASSERT_NE(nullptr, pt);
+  for (unsigned n = 0; n < 60; ++n) {
+    const unsigned grp = (n * 7) % 6;
+    const int64_t val = (int64_t)n - 30;
+    const std::string tag = (n % 4) ? tags[n % 3] : "<null>";
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_grp, fpta_value_uint(grp)));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_val, fpta_value_sint(val)));
+    if (n % 4) {
+      ASSERT_EQ(FPTA_OK,
+                fpta_upsert_column(pt, &col_tag, fpta_value_cstr(tags[n % 3])));
+    }
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+
+    auto &g = by_grp[std::to_string(grp)];
+    g.first += 1;
+    g.second = (g.first == 1) ? val : std::max(g.second, val);
+    auto &t = by_tag[tag];
+    t.first += 1;
+    t.second = (t.first == 1) ? val : std::max(t.second, val);
+  }
+  free(pt);
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  fpta_aggregate aggregates[] = {
+      {nullptr, fpta_aggregate_count, fpta_value_null()},
+      {&col_val, fpta_aggregate_max, fpta_value_null()}};
+
+  // потоковая группировка по колонке индекса курсора
+  fpta_cursor *cursor = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, &col_grp, fpta_value_begin(),
+                                      fpta_value_end(), nullptr,
+                                      fpta_descending_dont_fetch, &cursor));
+  ASSERT_NE(nullptr, cursor);
+  group_collector collector;
+  collector.stop_after = 0;
+  ASSERT_EQ(FPTA_OK, fpta_group_aggregate(cursor, &col_grp, aggregates, 2,
+                                          group_collect, &collector));
+  EXPECT_EQ(by_grp, collector.groups);
+  const std::vector<std::string> descending = {"5", "4", "3", "2", "1", "0"};
+  EXPECT_EQ(descending, collector.order);
+
+  // прерывание из функции обратного вызова
+  collector.groups.clear();
+  collector.order.clear();
+  collector.stop_after = 2;
+  EXPECT_EQ(42, fpta_group_aggregate(cursor, &col_grp, aggregates, 2,
+                                     group_collect, &collector));
+  EXPECT_EQ(2u, collector.order.size());
+  EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  cursor = nullptr;
+
+  // группировка через хеш-таблицу, включая строки без значения
+  ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, &col_pk, fpta_value_begin(),
+                                      fpta_value_end(), nullptr,
+                                      fpta_ascending_dont_fetch, &cursor));
+  collector.groups.clear();
+  collector.order.clear();
+  collector.stop_after = 0;
+  ASSERT_EQ(FPTA_OK, fpta_group_aggregate(cursor, &col_tag, aggregates, 2,
+                                          group_collect, &collector));
+  EXPECT_EQ(by_tag, collector.groups);
+  // группы выдаются в порядке появления
+  const std::vector<std::string> first_seen = {"<null>", "beta", "gamma",
+                                               "alpha"};
+  EXPECT_EQ(first_seen, collector.order);
+
+  // та же колонка группировки, но через курсор по вторичному индексу
+  collector.groups.clear();
+  collector.order.clear();
+  ASSERT_EQ(FPTA_OK, fpta_group_aggregate(cursor, &col_grp, aggregates, 2,
+                                          group_collect, &collector));
+  EXPECT_EQ(by_grp, collector.groups);
+
+  // недопустимые аргументы
+  EXPECT_EQ(FPTA_EINVAL, fpta_group_aggregate(cursor, &col_grp, aggregates, 2,
+                                              nullptr, &collector));
+  EXPECT_EQ(FPTA_EINVAL, fpta_group_aggregate(cursor, &table, aggregates, 2,
+                                              group_collect, &collector));
+  EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_grp);
+  fpta_name_destroy(&col_tag);
+  fpta_name_destroy(&col_val);
+}
+
+//----------------------------------------------------------------------------
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
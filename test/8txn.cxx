@@ -0,0 +1,665 @@
+/*
+ * Copyright 2016-2017 libfpta authors: please see AUTHORS file.
+ *
+ * This file is part of libfpta, aka "Fast Positive Tables".
+ *
+ * libfpta is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libfpta is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libfpta.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fast_positive/tables_internal.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#include "tools.hpp"
+
+#define TEST_DB_DIR "/dev/shm/"
+
+static const char testdb_name[] = TEST_DB_DIR "ut_txn.fpta";
+static const char testdb_name_lck[] = TEST_DB_DIR "ut_txn.fpta-lock";
+
+/* Проверки режимов фиксации, планировщика записи, точек сохранения
+ * и контроля читающих транзакций. */
+class Transaction : public db_fixture {
+protected:
+  Transaction() : db_fixture(testdb_name, testdb_name_lck) {}
+};
+
+TEST_F(Transaction, GroupCommit) {
+  /* Проверка групповой фиксации в режиме fpta_sync_group.
+   *
+   * Сценарий:
+   *  1. Создаем БД в режиме fpta_sync_group и таблицу.
+   *  2. Несколько потоков одновременно вставляют строки, каждую в своей
+   *     транзакции, проверяя успешность фиксации.
+   *  3. Переоткрываем БД и проверяем наличие всех строк. */
+  fpta_name table, col_pk, col_writer;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "GroupCommit"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_writer, "writer"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("writer", fptu_uint32,
+                                          fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_sync_group));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("GroupCommit", &def));
+
+  fpta_txn *txn = nullptr;
+  const unsigned writers = 4, rows_per_writer = 10;
+  std::vector<std::thread> threads;
+  for (unsigned w = 0; w < writers; ++w) {
+    threads.emplace_back([&, w]() {
+      fpta_name table_local, pk_local, writer_local;
+      EXPECT_EQ(FPTA_OK, fpta_table_init(&table_local, "GroupCommit"));
+      EXPECT_EQ(FPTA_OK, fpta_column_init(&table_local, &pk_local, "pk"));
+      EXPECT_EQ(FPTA_OK,
+                fpta_column_init(&table_local, &writer_local, "writer"));
+      fptu_rw *pt = fptu_alloc(2, 16);
+      for (unsigned n = 0; n < rows_per_writer; ++n) {
+        fpta_txn *wtxn = nullptr;
+        EXPECT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &wtxn));
+        EXPECT_EQ(FPTU_OK, fptu_clear(pt));
+        EXPECT_EQ(FPTA_OK,
+                  fpta_upsert_column(pt, &pk_local,
+                                     fpta_value_uint(w * rows_per_writer + n)));
+        EXPECT_EQ(FPTA_OK,
+                  fpta_upsert_column(pt, &writer_local, fpta_value_uint(w)));
+        EXPECT_EQ(FPTA_OK, fpta_insert_row(wtxn, &table_local,
+                                           fptu_take_noshrink(pt)));
+        EXPECT_EQ(FPTA_OK, fpta_transaction_end(wtxn, false));
+      }
+      free(pt);
+      fpta_name_destroy(&table_local);
+      fpta_name_destroy(&pk_local);
+      fpta_name_destroy(&writer_local);
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+  ASSERT_NO_FATAL_FAILURE(close_db());
+
+  // после переоткрытия должны быть видны все строки
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_sync_group));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  fpta_cursor *cursor = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, &col_pk, fpta_value_begin(),
+                                      fpta_value_end(), nullptr,
+                                      fpta_unsorted_dont_fetch, &cursor));
+  size_t count = 0;
+  EXPECT_EQ(FPTA_OK, fpta_cursor_count(cursor, &count, INT_MAX));
+  EXPECT_EQ(writers * rows_per_writer, count);
+  EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_writer);
+}
+
+TEST_F(Transaction, DeferredDurability) {
+  /* Проверка отложенного сохранения в режиме fpta_sync_deferred.
+   *
+   * Сценарий:
+   *  1. Создаем БД в режиме fpta_sync_deferred и задаем ограничения.
+   *  2. Фиксируем несколько транзакций, запоминая их номера, и ожидаем
+   *     сохранения последней посредством fpta_db_wait_durable().
+   *  3. Даем фоновому потоку сохранить следующую транзакцию по задержке.
+   *  4. Проверяем контроль аргументов, в том числе для других режимов. */
+  fpta_name table, col_pk;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Deferred"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_sync_deferred));
+
+  fpta_durability_limits limits;
+  limits.max_unsynced_bytes = 1 << 20;
+  limits.max_lag_ms = 10;
+  limits.max_unsynced_txns = 100;
+  EXPECT_EQ(FPTA_OK, fpta_db_durability_limits(db, &limits));
+  limits.max_lag_ms = 0;
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_durability_limits(db, &limits));
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_durability_limits(db, nullptr));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Deferred", &def));
+
+  fpta_txn *txn = nullptr;
+  fptu_rw *pt = fptu_alloc(1, 16);
+  ASSERT_NE(nullptr, pt);
+  uint64_t txn_id = 0;
+  for (unsigned n = 0; n < 11; ++n) {
+    ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+    uint64_t schema_version;
+    ASSERT_EQ(FPTA_OK,
+              fpta_transaction_versions(txn, &txn_id, &schema_version));
+    ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+    txn = nullptr;
+
+    if (n == 9) {
+      // явное ожидание сохранения
+      EXPECT_EQ(FPTA_OK, fpta_db_wait_durable(db, txn_id));
+      EXPECT_EQ(FPTA_OK, fpta_db_wait_durable(db, txn_id - 1));
+    }
+  }
+  free(pt);
+
+  // последнюю транзакцию сохраняет фоновый поток по задержке
+  usleep(50 * 1000);
+  EXPECT_EQ(FPTA_OK, fpta_db_wait_durable(db, txn_id));
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_wait_durable(db, txn_id + 1));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  ASSERT_NO_FATAL_FAILURE(close_db());
+
+  // в других режимах ограничения не применимы
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_lazy));
+  limits.max_lag_ms = 10;
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_durability_limits(db, &limits));
+  EXPECT_EQ(FPTA_OK, fpta_db_wait_durable(db, txn_id));
+}
+
+struct scheduled_insert {
+  fpta_name *table, *col_pk;
+  uint64_t pk;
+  bool fail;
+  unsigned calls;
+};
+
+static int scheduled_insert_closure(fpta_txn *txn, void *context) {
+  scheduled_insert *job = (scheduled_insert *)context;
+  job->calls += 1;
+  if (job->fail)
+    return FPTA_EVALUE;
+
+  fptu_rw *pt = fptu_alloc(1, 16);
+  if (!pt)
+    return FPTA_ENOMEM;
+  int rc = fpta_upsert_column(pt, job->col_pk, fpta_value_uint(job->pk));
+  if (rc == FPTA_OK)
+    rc = fpta_insert_row(txn, job->table, fptu_take_noshrink(pt));
+  free(pt);
+  return rc;
+}
+
+TEST_F(Transaction, WriteScheduler) {
+  /* Проверка планировщика пишущих транзакций.
+   *
+   * Сценарий:
+   *  1. Несколько потоков одновременно выполняют через fpta_db_write()
+   *     интерактивные и пакетные запросы на вставку строк, часть
+   *     пакетных запросов завершается ошибкой.
+   *  2. Проверяем, что сохранены строки только успешных запросов,
+   *     а ошибочные запросы не повлияли на соседей по пакету.
+   *  3. Сверяем статистику планировщика. */
+  fpta_name table, col_pk;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Scheduler"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Scheduler", &def));
+
+  fpta_txn *txn = nullptr;
+  scheduled_insert bad = {&table, &col_pk, 0, true, 0};
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_write(db, fpta_write_batch, nullptr, &bad));
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_write(db, (fpta_write_priority)42,
+                                       scheduled_insert_closure, &bad));
+  EXPECT_EQ(FPTA_EVALUE, fpta_db_write(db, fpta_write_interactive,
+                                       scheduled_insert_closure, &bad));
+
+  // у каждого потока каждый 10-й пакетный запрос ошибочный
+  const unsigned threads_count = 4, jobs_per_thread = 50;
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < threads_count; ++t) {
+    threads.emplace_back([&, t]() {
+      for (unsigned n = 0; n < jobs_per_thread; ++n) {
+        scheduled_insert job = {&table, &col_pk,
+                                (uint64_t)t * jobs_per_thread + n, false, 0};
+        const fpta_write_priority priority =
+            (t % 2) ? fpta_write_interactive : fpta_write_batch;
+        job.fail = priority == fpta_write_batch && n % 10 == 5;
+        EXPECT_EQ(job.fail ? FPTA_EVALUE : FPTA_OK,
+                  fpta_db_write(db, priority, scheduled_insert_closure, &job));
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  for (unsigned t = 0; t < threads_count; ++t) {
+    for (unsigned n = 0; n < jobs_per_thread; ++n) {
+      const bool failed = (t % 2) == 0 && n % 10 == 5;
+      const fpta_value pk = fpta_value_uint(t * jobs_per_thread + n);
+      fptu_ro row;
+      EXPECT_EQ(failed ? FPTA_NOTFOUND : FPTA_OK,
+                fpta_get(txn, &col_pk, &pk, &row));
+    }
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_write_stats stats;
+  EXPECT_EQ(FPTA_EINVAL, fpta_db_write_stats(db, nullptr));
+  ASSERT_EQ(FPTA_OK, fpta_db_write_stats(db, &stats));
+  EXPECT_EQ(0u, stats.queued[fpta_write_interactive]);
+  EXPECT_EQ(0u, stats.queued[fpta_write_batch]);
+  EXPECT_EQ(1u + jobs_per_thread * threads_count / 2,
+            stats.executed[fpta_write_interactive]);
+  EXPECT_EQ(jobs_per_thread * threads_count / 2,
+            stats.executed[fpta_write_batch]);
+  EXPECT_LE(stats.wait_max_us[fpta_write_batch],
+            stats.wait_total_us[fpta_write_batch]);
+  EXPECT_GT(stats.transactions, 0u);
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+}
+
+TEST_F(Transaction, WriteSchedulerIsolation) {
+  /* Проверка изоляции объединенных пакетных запросов.
+   *
+   * Сценарий:
+   *  1. В режиме с поддержкой точек сохранения несколько потоков
+   *     одновременно выполняют через fpta_db_write() пакетные запросы
+   *     на вставку строк, часть запросов завершается ошибкой, а часть
+   *     нарушает уникальность PK.
+   *  2. Проверяем, что каждая функция запроса вызвана ровно один раз,
+   *     т.е. ошибка не приводит к повторному выполнению соседей.
+   *  3. Проверяем, что сохранены строки только успешных запросов. */
+  fpta_name table, col_pk;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Isolation"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_lazy));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Isolation", &def));
+
+  // каждый 7-й запрос ошибочный, а каждый 5-й повторяет PK соседа
+  const unsigned threads_count = 4, jobs_per_thread = 50;
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < threads_count; ++t) {
+    threads.emplace_back([&, t]() {
+      for (unsigned n = 0; n < jobs_per_thread; ++n) {
+        scheduled_insert job = {&table, &col_pk,
+                                (uint64_t)t * jobs_per_thread + n, false, 0};
+        job.fail = n % 7 == 3;
+        const bool duplicate = n % 5 == 4;
+        if (duplicate)
+          job.pk -= 1;
+        int expected = job.fail ? FPTA_EVALUE : FPTA_OK;
+        if (duplicate && !job.fail && (n - 1) % 7 != 3)
+          expected = MDB_KEYEXIST;
+        EXPECT_EQ(expected,
+                  fpta_db_write(db, fpta_write_batch, scheduled_insert_closure,
+                                &job));
+        EXPECT_EQ(1u, job.calls);
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  for (unsigned t = 0; t < threads_count; ++t) {
+    for (unsigned n = 0; n < jobs_per_thread; ++n) {
+      /* строка вставлена собственным запросом или запросом-повтором */
+      const bool inserted = (n % 5 != 4 && n % 7 != 3) ||
+                            (n % 5 == 3 && (n + 1) % 7 != 3);
+      const fpta_value pk = fpta_value_uint(t * jobs_per_thread + n);
+      fptu_ro row;
+      EXPECT_EQ(inserted ? FPTA_OK : FPTA_NOTFOUND,
+                fpta_get(txn, &col_pk, &pk, &row));
+    }
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+}
+
+TEST_F(Transaction, Savepoints) {
+  /* Проверка точек сохранения.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с уникальным вторичным индексом.
+   *  2. В одной транзакции вставляем строки, каждую после установки
+   *     точки сохранения. Строки с повторяющимися значениями вторичного
+   *     индекса отвергаются, а их вставка отменяется откатом к точке
+   *     сохранения без отмены всей транзакции.
+   *  3. Проверяем вложенные точки сохранения и их автоматическую фиксацию
+   *     при завершении транзакции.
+   *  4. Проверяем контроль аргументов и отсутствие поддержки
+   *     в режиме fpta_async. */
+  fpta_name table, col_pk, col_code;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Savepoints"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_code, "code"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("code", fptu_uint32,
+                                          fpta_secondary_unique, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_lazy));
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_schema, &txn));
+  EXPECT_EQ(FPTA_EINVAL, fpta_savepoint_begin(txn));
+  ASSERT_EQ(FPTA_OK, fpta_table_create(txn, "Savepoints", &def));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  // каждая 5-я строка повторяет код предыдущей
+  fptu_rw *pt = fptu_alloc(2, 16);
+  ASSERT_NE(nullptr, pt);
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  EXPECT_EQ(FPTA_EINVAL, fpta_savepoint_rollback(txn));
+  EXPECT_EQ(FPTA_EINVAL, fpta_savepoint_release(txn));
+  unsigned code = 0, inserted = 0;
+  for (unsigned n = 0; n < 50; ++n) {
+    if (n % 5)
+      ++code;
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_code, fpta_value_uint(code)));
+
+    ASSERT_EQ(FPTA_OK, fpta_savepoint_begin(txn));
+    int rc = fpta_insert_row(txn, &table, fptu_take_noshrink(pt));
+    if (n % 5 || n == 0) {
+      EXPECT_EQ(FPTA_OK, rc);
+      EXPECT_EQ(FPTA_OK, fpta_savepoint_release(txn));
+      ++inserted;
+    } else {
+      EXPECT_EQ(FPTA_KEYEXIST, rc);
+      EXPECT_EQ(FPTA_OK, fpta_savepoint_rollback(txn));
+    }
+  }
+
+  // изменения внутри отмененной внешней точки отменяются целиком
+  ASSERT_EQ(FPTA_OK, fpta_savepoint_begin(txn));
+  ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(100)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_code, fpta_value_uint(100)));
+  ASSERT_EQ(FPTA_OK, fpta_savepoint_begin(txn));
+  EXPECT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  EXPECT_EQ(FPTA_OK, fpta_savepoint_release(txn));
+  EXPECT_EQ(FPTA_OK, fpta_savepoint_rollback(txn));
+
+  // незавершенная точка сохранения фиксируется вместе с транзакцией
+  ASSERT_EQ(FPTA_OK, fpta_savepoint_begin(txn));
+  ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(200)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_code, fpta_value_uint(200)));
+  EXPECT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  ++inserted;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+  free(pt);
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  fpta_cursor *cursor = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, &col_pk, fpta_value_begin(),
+                                      fpta_value_end(), nullptr,
+                                      fpta_unsorted_dont_fetch, &cursor));
+  size_t count = 0;
+  EXPECT_EQ(FPTA_OK, fpta_cursor_count(cursor, &count, INT_MAX));
+  EXPECT_EQ(inserted, count);
+  EXPECT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  const fpta_value pk100 = fpta_value_uint(100),
+                   pk200 = fpta_value_uint(200);
+  fptu_ro row;
+  EXPECT_EQ(FPTA_NOTFOUND, fpta_get(txn, &col_pk, &pk100, &row));
+  EXPECT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &pk200, &row));
+  EXPECT_EQ(FPTA_EINVAL, fpta_savepoint_begin(txn));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_code);
+  ASSERT_NO_FATAL_FAILURE(close_db());
+
+  // в режиме fpta_async вложенные транзакции недоступны
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  EXPECT_EQ(FPTA_ENOIMP, fpta_savepoint_begin(txn));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, true));
+}
+
+TEST_F(Transaction, SavepointFirstUse) {
+  /* Проверка таблицы, впервые используемой внутри точки сохранения.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу со вторичным индексом и журналом изменений,
+   *     после чего переоткрываем БД, чтобы дескрипторы таблиц
+   *     не были открыты.
+   *  2. В пишущей транзакции устанавливаем точку сохранения, вставляем
+   *     строку и откатываем точку сохранения.
+   *  3. Используем те же fpta_name в родительской транзакции, фиксируем
+   *     её и проверяем данные, индекс и журнал. */
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("code", fptu_uint32,
+                                          fpta_secondary_unique, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_changelog(&def, 0));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_lazy));
+  ASSERT_NO_FATAL_FAILURE(create_table("FirstUse", &def));
+  ASSERT_NO_FATAL_FAILURE(close_db());
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_lazy));
+
+  fpta_name table, col_pk, col_code;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "FirstUse"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_code, "code"));
+
+  fptu_rw *pt = fptu_alloc(2, 16);
+  ASSERT_NE(nullptr, pt);
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_savepoint_begin(txn));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_pk));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_code));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(1)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_code, fpta_value_uint(10)));
+  EXPECT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  ASSERT_EQ(FPTA_OK, fpta_savepoint_rollback(txn));
+
+  // дескрипторы, использованные внутри отмененной точки, остаются в силе
+  fptu_ro row;
+  fpta_value key = fpta_value_uint(1);
+  EXPECT_EQ(FPTA_NOTFOUND, fpta_get(txn, &col_pk, &key, &row));
+  ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(2)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_code, fpta_value_uint(20)));
+  EXPECT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  key = fpta_value_uint(20);
+  EXPECT_EQ(FPTA_OK, fpta_get(txn, &col_code, &key, &row));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+  free(pt);
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  key = fpta_value_uint(1);
+  EXPECT_EQ(FPTA_NOTFOUND, fpta_get(txn, &col_pk, &key, &row));
+  key = fpta_value_uint(10);
+  EXPECT_EQ(FPTA_NOTFOUND, fpta_get(txn, &col_code, &key, &row));
+  key = fpta_value_uint(20);
+  ASSERT_EQ(FPTA_OK, fpta_get(txn, &col_code, &key, &row));
+  fpta_value value;
+  ASSERT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(2u, value.uint);
+  uint64_t first = 0, last = 0;
+  ASSERT_EQ(FPTA_OK, fpta_changelog_bounds(txn, &table, &first, &last));
+  EXPECT_EQ(1u, first);
+  EXPECT_EQ(1u, last);
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_code);
+}
+
+struct laggard_counter {
+  unsigned calls;
+  uint64_t lag;
+};
+
+static bool laggard_consent(void *context, const fpta_txn *txn, uint64_t lag,
+                            unsigned age_ms) {
+  (void)txn;
+  (void)age_ms;
+  laggard_counter *counter = (laggard_counter *)context;
+  counter->calls += 1;
+  counter->lag = lag;
+  return true;
+}
+
+TEST_F(Transaction, LongtermReaders) {
+  /* Проверка учета длительных читающих транзакций.
+   *
+   * Сценарий:
+   *  1. Открываем читающую транзакцию и отмечаем её как длительную.
+   *  2. Фиксируем в другом потоке несколько пишущих транзакций
+   *     и проверяем отставание посредством fpta_db_readers_info().
+   *  3. Задаем политику отмены с минимальным порогом заполнения,
+   *     после очередной фиксации длительная транзакция должна быть
+   *     отменена с согласия функции политики.
+   *  4. Проверяем, что операции в отмененной транзакции не выполняются,
+   *     а её завершение возвращает FPTA_TXN_CANCELLED. */
+  fpta_name table, col_pk;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Longterm"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_lazy));
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_schema, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_table_create(txn, "Longterm", &def));
+  EXPECT_EQ(FPTA_EINVAL, fpta_transaction_longterm(txn));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  fpta_readers_info info;
+  EXPECT_EQ(FPTA_OK, fpta_db_readers_info(db, &info));
+  EXPECT_EQ(0u, info.longterm);
+  EXPECT_EQ(0u, info.oldest_lag);
+
+  fpta_txn *reader = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &reader));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_longterm(reader));
+  EXPECT_EQ(FPTA_OK, fpta_transaction_longterm(reader));
+  uint64_t snapshot, schema_version;
+  ASSERT_EQ(FPTA_OK,
+            fpta_transaction_versions(reader, &snapshot, &schema_version));
+
+  auto writes = [&](unsigned from, unsigned count) {
+    fptu_rw *pt = fptu_alloc(1, 16);
+    ASSERT_NE(nullptr, pt);
+    for (unsigned n = from; n < from + count; ++n) {
+      fpta_txn *writer = nullptr;
+      ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &writer));
+      ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+      ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+      ASSERT_EQ(FPTA_OK,
+                fpta_insert_row(writer, &table, fptu_take_noshrink(pt)));
+      ASSERT_EQ(FPTA_OK, fpta_transaction_end(writer, false));
+    }
+    free(pt);
+  };
+
+  std::thread(writes, 0, 5).join();
+  EXPECT_EQ(FPTA_OK, fpta_db_readers_info(db, &info));
+  EXPECT_EQ(1u, info.longterm);
+  EXPECT_EQ(snapshot, info.oldest_txnid);
+  EXPECT_EQ(5u, info.oldest_lag);
+  EXPECT_EQ(snapshot + 5, info.last_txnid);
+  EXPECT_LT(0u, info.space_used_percent);
+  EXPECT_EQ(0u, info.cancelled);
+
+  // пока политика не задана, транзакция остается действительной
+  fpta_value pk = fpta_value_uint(0);
+  fptu_ro row;
+  EXPECT_EQ(FPTA_NOTFOUND, fpta_get(reader, &col_pk, &pk, &row));
+
+  laggard_counter counter = {0, 0};
+  EXPECT_EQ(FPTA_EINVAL,
+            fpta_db_laggard_policy(db, 101, 1, laggard_consent, &counter));
+  EXPECT_EQ(FPTA_OK,
+            fpta_db_laggard_policy(db, 1, 1, laggard_consent, &counter));
+  std::thread(writes, 5, 1).join();
+  EXPECT_EQ(1u, counter.calls);
+  EXPECT_EQ(6u, counter.lag);
+
+  EXPECT_EQ(FPTA_EINVAL, fpta_get(reader, &col_pk, &pk, &row));
+  EXPECT_EQ(FPTA_TXN_CANCELLED, fpta_transaction_end(reader, false));
+  reader = nullptr;
+
+  EXPECT_EQ(FPTA_OK, fpta_db_readers_info(db, &info));
+  EXPECT_EQ(0u, info.longterm);
+  EXPECT_EQ(1u, info.cancelled);
+  EXPECT_EQ(FPTA_OK, fpta_db_laggard_policy(db, 0, 0, nullptr, nullptr));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+}
+
+//----------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -312,6 +312,575 @@ TEST(CrudSimple, GoogleTestCombine_IS_NOT_Supported_OnThisPlatform) {}
 
 //----------------------------------------------------------------------------
 
+/* Отдельные проверки CRUD-операций, каждая со своей схемой таблиц. */
+class CrudFeature : public db_fixture {
+protected:
+  CrudFeature() : db_fixture(testdb_name, testdb_name_lck) {}
+};
+
+TEST_F(CrudFeature, ColumnAdd) {
+  /* Проверка fpta_column_add().
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с PK и тремя колонками-счетчиками,
+   *     одна из которых индексирована.
+   *  2. Вставляем строку, в которой задан только один счетчик.
+   *  3. Увеличиваем и уменьшаем счетчики, в том числе отсутствующие.
+   *  4. Проверяем контроль переполнения и несоответствия типов.
+   *  5. Проверяем значения и поиск по вторичному индексу. */
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("hits", fptu_int64,
+                                          fpta_secondary_unique, &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("small", fptu_uint16, fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("real", fptu_fp64, fpta_index_none, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Counters", &def));
+
+  fpta_txn *txn = nullptr;
+  fpta_name table, col_pk, col_hits, col_small, col_real;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Counters"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_hits, "hits"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_small, "small"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_real, "real"));
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_pk));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_hits));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_small));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_real));
+
+  fptu_rw *pt = fptu_alloc(4, 42);
+  ASSERT_NE(nullptr, pt);
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(42)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_hits, fpta_value_sint(1)));
+  ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  free(pt);
+  pt = nullptr;
+
+  const fpta_value pk = fpta_value_uint(42);
+  fpta_value result;
+  EXPECT_EQ(FPTA_OK,
+            fpta_column_add(txn, &col_hits, &pk, fpta_value_sint(41), &result));
+  EXPECT_EQ(fpta_signed_int, result.type);
+  EXPECT_EQ(42, result.sint);
+  EXPECT_EQ(FPTA_OK,
+            fpta_column_add(txn, &col_hits, &pk, fpta_value_uint(8), &result));
+  EXPECT_EQ(50, result.sint);
+
+  // отсутствующий счетчик считается нулевым
+  EXPECT_EQ(FPTA_OK, fpta_column_add(txn, &col_small, &pk,
+                                     fpta_value_uint(UINT16_MAX), &result));
+  EXPECT_EQ(fpta_unsigned_int, result.type);
+  EXPECT_EQ(UINT16_MAX, result.uint);
+  EXPECT_EQ(FPTA_OK, fpta_column_add(txn, &col_real, &pk,
+                                     fpta_value_float(0.5), &result));
+  EXPECT_EQ(FPTA_OK, fpta_column_add(txn, &col_real, &pk,
+                                     fpta_value_float(-2.25), &result));
+  EXPECT_EQ(fpta_float_point, result.type);
+  EXPECT_EQ(-1.75, result.fp);
+
+  // переполнение, уход в минус для беззнакового и несоответствие типов
+  EXPECT_EQ(FPTA_EVALUE, fpta_column_add(txn, &col_small, &pk,
+                                         fpta_value_uint(1), &result));
+  EXPECT_EQ(FPTA_EVALUE, fpta_column_add(txn, &col_small, &pk,
+                                         fpta_value_sint(-65536), &result));
+  EXPECT_EQ(FPTA_EVALUE, fpta_column_add(txn, &col_hits, &pk,
+                                         fpta_value_sint(INT64_MAX), &result));
+  EXPECT_EQ(FPTA_ETYPE, fpta_column_add(txn, &col_real, &pk,
+                                        fpta_value_sint(1), &result));
+  EXPECT_EQ(FPTA_ETYPE, fpta_column_add(txn, &col_hits, &pk,
+                                        fpta_value_float(1), &result));
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_add(txn, &col_pk, &pk,
+                                         fpta_value_uint(1), &result));
+
+  // строки с таким PK нет
+  const fpta_value pk_missing = fpta_value_uint(24);
+  EXPECT_EQ(MDB_NOTFOUND, fpta_column_add(txn, &col_hits, &pk_missing,
+                                          fpta_value_sint(1), &result));
+
+  // уменьшение счетчика
+  EXPECT_EQ(FPTA_OK, fpta_column_add(txn, &col_small, &pk,
+                                     fpta_value_sint(-65530), nullptr));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  // проверяем значения и вторичный индекс
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  // в читающей транзакции изменения недопустимы
+  EXPECT_EQ(FPTA_EINVAL, fpta_column_add(txn, &col_hits, &pk,
+                                         fpta_value_sint(1), &result));
+  fptu_ro row;
+  EXPECT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &pk, &row));
+  fpta_value value;
+  EXPECT_EQ(FPTA_OK, fpta_get_column(row, &col_small, &value));
+  EXPECT_EQ(5u, value.uint);
+  EXPECT_EQ(FPTA_OK, fpta_get_column(row, &col_real, &value));
+  EXPECT_EQ(-1.75, value.fp);
+
+  const fpta_value hits_old = fpta_value_sint(1);
+  const fpta_value hits_new = fpta_value_sint(50);
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_hits, &hits_old, &row));
+  EXPECT_EQ(FPTA_OK, fpta_get(txn, &col_hits, &hits_new, &row));
+  EXPECT_EQ(FPTA_OK, fpta_get_column(row, &col_pk, &value));
+  EXPECT_EQ(42u, value.uint);
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_hits);
+  fpta_name_destroy(&col_small);
+  fpta_name_destroy(&col_real);
+}
+
+TEST_F(CrudFeature, DeleteRangeAndClear) {
+  /* Проверка fpta_delete_range() и fpta_table_clear().
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с PK и двумя вторичными индексами.
+   *  2. Вставляем 1000 строк, удаляем диапазон по PK, затем диапазон
+   *     по вторичному индексу.
+   *  3. Проверяем количество оставшихся строк по всем индексам.
+   *  4. Очищаем таблицу и проверяем что она пуста. */
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("se_uniq", fptu_int64,
+                                          fpta_secondary_unique, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("se_dups", fptu_uint32,
+                                          fpta_secondary_withdups, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  ASSERT_NO_FATAL_FAILURE(create_table("Purge", &def));
+
+  fpta_txn *txn = nullptr;
+  fpta_name table, col_pk, col_uniq, col_dups;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Purge"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_uniq, "se_uniq"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_dups, "se_dups"));
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_pk));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_uniq));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_dups));
+
+  fptu_rw *pt = fptu_alloc(3, 42);
+  ASSERT_NE(nullptr, pt);
+  for (unsigned n = 0; n < 1000; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_uniq, fpta_value_sint(-(int)n)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_dups, fpta_value_uint(n % 10)));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+  free(pt);
+  pt = nullptr;
+
+  // удаляем [100, 300) по первичному ключу
+  size_t deleted = 0;
+  EXPECT_EQ(FPTA_OK,
+            fpta_delete_range(txn, &col_pk, fpta_value_uint(100),
+                              fpta_value_uint(300), nullptr, &deleted));
+  EXPECT_EQ(200u, deleted);
+
+  // удаляем se_uniq в [-999, -899), т.е. pk в (899, 999]
+  EXPECT_EQ(FPTA_OK,
+            fpta_delete_range(txn, &col_uniq, fpta_value_sint(-999),
+                              fpta_value_sint(-899), nullptr, &deleted));
+  EXPECT_EQ(100u, deleted);
+
+  // удаляем все строки с se_dups == 0 из оставшихся
+  EXPECT_EQ(FPTA_OK,
+            fpta_delete_range(txn, &col_dups, fpta_value_uint(0),
+                              fpta_value_uint(1), nullptr, &deleted));
+  EXPECT_EQ(70u, deleted);
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  // проверяем согласованность всех индексов
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  fpta_name *columns[] = {&col_pk, &col_uniq, &col_dups};
+  for (fpta_name *column : columns) {
+    fpta_cursor *cursor = nullptr;
+    ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, column, fpta_value_begin(),
+                                        fpta_value_end(), nullptr,
+                                        fpta_unsorted_dont_fetch, &cursor));
+    size_t count = 0;
+    ASSERT_EQ(FPTA_OK, fpta_cursor_count(cursor, &count, INT_MAX));
+    EXPECT_EQ(630u, count);
+    ASSERT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  }
+
+  ASSERT_EQ(FPTA_OK, fpta_table_clear(txn, &table));
+  for (fpta_name *column : columns) {
+    fpta_cursor *cursor = nullptr;
+    ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, column, fpta_value_begin(),
+                                        fpta_value_end(), nullptr,
+                                        fpta_unsorted_dont_fetch, &cursor));
+    size_t count = 42;
+    ASSERT_EQ(FPTA_OK, fpta_cursor_count(cursor, &count, INT_MAX));
+    EXPECT_EQ(0u, count);
+    ASSERT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_uniq);
+  fpta_name_destroy(&col_dups);
+}
+
+TEST_F(CrudFeature, Expiry) {
+  /* Проверка TTL-колонки и fpta_expire().
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с PK и TTL-колонкой, для которой индекс
+   *     добавляется автоматически.
+   *  2. Вставляем строки, часть из которых уже устарела, а часть нет.
+   *  3. Проверяем что устаревшие строки не видны для fpta_get()
+   *     и курсоров по обоим индексам.
+   *  4. Удаляем устаревшие строки порциями посредством fpta_expire().
+   *  5. Проверяем что для таблицы без TTL возвращается FPTA_NO_INDEX. */
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_async));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("expire", fptu_datetime,
+                                          fpta_index_none, &def));
+  EXPECT_EQ(FPTA_COLUMN_MISSING, fpta_column_describe_expiry("nope", &def));
+  EXPECT_EQ(FPTA_ETYPE, fpta_column_describe_expiry("pk", &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe_expiry("expire", &def));
+  EXPECT_NE(FPTA_OK, fpta_column_describe_expiry("expire", &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  fpta_column_set def_plain;
+  fpta_column_set_init(&def_plain);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def_plain));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def_plain));
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_schema, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_table_create(txn, "Ttl", &def));
+  ASSERT_EQ(FPTA_OK, fpta_table_create(txn, "Plain", &def_plain));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  fpta_name table, plain, col_pk, col_expire;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Ttl"));
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&plain, "Plain"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_expire, "expire"));
+
+  // четные строки устарели час назад, нечетные устареют через час,
+  // а каждая десятая строка не устареет никогда
+  const fptu_time now = fptu_now_coarse();
+  fptu_time past = now, future = now, never;
+  past.utc -= 3600;
+  future.utc += 3600;
+  never.fixedpoint = UINT64_MAX;
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_pk));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh(txn, &col_expire));
+
+  fptu_rw *pt = fptu_alloc(2, 42);
+  ASSERT_NE(nullptr, pt);
+  for (unsigned n = 0; n < 100; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(n)));
+    const fptu_time expire = (n % 10 == 0) ? never : (n & 1) ? future : past;
+    ASSERT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_expire, fpta_value_datetime(expire)));
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, fptu_take_noshrink(pt)));
+  }
+  free(pt);
+  pt = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  // 45 устаревших строк не видны ни через fpta_get(), ни через курсоры
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  fptu_ro row;
+  fpta_value key = fpta_value_uint(2);
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_pk, &key, &row));
+  key = fpta_value_uint(3);
+  EXPECT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+  key = fpta_value_uint(10);
+  EXPECT_EQ(FPTA_OK, fpta_get(txn, &col_pk, &key, &row));
+
+  fpta_name *columns[] = {&col_pk, &col_expire};
+  for (fpta_name *column : columns) {
+    fpta_cursor *cursor = nullptr;
+    ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, column, fpta_value_begin(),
+                                        fpta_value_end(), nullptr,
+                                        fpta_unsorted_dont_fetch, &cursor));
+    size_t count = 0;
+    ASSERT_EQ(FPTA_OK, fpta_cursor_count(cursor, &count, INT_MAX));
+    EXPECT_EQ(55u, count);
+    ASSERT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  // удаляем устаревшие строки порциями по 20
+  size_t expired = 0, total = 0;
+  do {
+    ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+    ASSERT_EQ(FPTA_OK, fpta_expire(txn, &table, now, 20, &expired));
+    EXPECT_GE(20u, expired);
+    total += expired;
+    ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+    txn = nullptr;
+  } while (expired);
+  EXPECT_EQ(45u, total);
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  EXPECT_EQ(FPTA_NO_INDEX, fpta_expire(txn, &plain, now, 20, &expired));
+  EXPECT_EQ(0u, expired);
+
+  // после удаления строки остаются невидимыми, а количество
+  // "живых" строк не изменилось
+  key = fpta_value_uint(2);
+  EXPECT_EQ(MDB_NOTFOUND, fpta_get(txn, &col_pk, &key, &row));
+  for (fpta_name *column : columns) {
+    fpta_cursor *cursor = nullptr;
+    ASSERT_EQ(FPTA_OK, fpta_cursor_open(txn, column, fpta_value_begin(),
+                                        fpta_value_end(), nullptr,
+                                        fpta_unsorted_dont_fetch, &cursor));
+    size_t count = 0;
+    ASSERT_EQ(FPTA_OK, fpta_cursor_count(cursor, &count, INT_MAX));
+    EXPECT_EQ(55u, count);
+    ASSERT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  }
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+
+  fpta_name_destroy(&table);
+  fpta_name_destroy(&plain);
+  fpta_name_destroy(&col_pk);
+  fpta_name_destroy(&col_expire);
+}
+
+TEST_F(CrudFeature, ChangeLog) {
+  /* Проверка журнала изменений строк.
+   *
+   * Сценарий:
+   *  1. Создаем таблицу с журналом и вторичным индексом, а также таблицу
+   *     с журналом ограниченного размера.
+   *  2. Изменяем строки посредством fpta_put() и fpta_delete(), после чего
+   *     читаем журнал и проверяем виды изменений, PK и строки.
+   *  3. Изменяем строки через курсор и очищаем таблицу, продолжаем чтение
+   *     журнала с номера, следующего за последним прочитанным.
+   *  4. Удаляем обработанные записи и проверяем границы журнала.
+   *  5. Проверяем соблюдение ограничения размера журнала. */
+  fpta_name table, col_pk, col_val, capped, capped_pk, plain;
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&table, "Logged"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&table, &col_val, "val"));
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&capped, "Capped"));
+  ASSERT_EQ(FPTA_OK, fpta_column_init(&capped, &capped_pk, "pk"));
+  ASSERT_EQ(FPTA_OK, fpta_table_init(&plain, "Plain"));
+
+  fpta_column_set def;
+  fpta_column_set_init(&def);
+  ASSERT_EQ(FPTA_OK,
+            fpta_column_describe("pk", fptu_uint64, fpta_primary, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("val", fptu_uint64,
+                                          fpta_secondary_withdups, &def));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_changelog(&def, 0));
+  EXPECT_EQ(EEXIST, fpta_column_set_changelog(&def, 0));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def));
+
+  fpta_column_set def_capped;
+  fpta_column_set_init(&def_capped);
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("pk", fptu_uint64, fpta_primary,
+                                          &def_capped));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_changelog(&def_capped, 3));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def_capped));
+
+  fpta_column_set def_plain;
+  fpta_column_set_init(&def_plain);
+  ASSERT_EQ(FPTA_OK, fpta_column_describe("pk", fptu_uint64, fpta_primary,
+                                          &def_plain));
+  ASSERT_EQ(FPTA_OK, fpta_column_set_validate(&def_plain));
+
+  ASSERT_NO_FATAL_FAILURE(open_db(fpta_lazy));
+
+  fpta_txn *txn = nullptr;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_schema, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_table_create(txn, "Logged", &def));
+  ASSERT_EQ(FPTA_OK, fpta_table_create(txn, "Capped", &def_capped));
+  ASSERT_EQ(FPTA_OK, fpta_table_create(txn, "Plain", &def_plain));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  fptu_rw *pt = fptu_alloc(2, 32);
+  ASSERT_NE(nullptr, pt);
+  auto make_row = [&](uint64_t pk, uint64_t val) {
+    EXPECT_EQ(FPTU_OK, fptu_clear(pt));
+    EXPECT_EQ(FPTA_OK, fpta_upsert_column(pt, &col_pk, fpta_value_uint(pk)));
+    EXPECT_EQ(FPTA_OK,
+              fpta_upsert_column(pt, &col_val, fpta_value_uint(val)));
+    return fptu_take_noshrink(pt);
+  };
+
+  // изменения посредством fpta_put() и fpta_delete()
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_pk));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &table, &col_val));
+  ASSERT_EQ(FPTA_OK, fpta_name_refresh_couple(txn, &capped, &capped_pk));
+  for (uint64_t n = 1; n <= 3; ++n)
+    ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, make_row(n, n * 10)));
+  ASSERT_EQ(FPTA_OK, fpta_upsert_row(txn, &table, make_row(2, 21)));
+  ASSERT_EQ(FPTA_OK, fpta_delete(txn, &table, make_row(1, 10)));
+  uint64_t txnid;
+  ASSERT_EQ(FPTA_OK, fpta_transaction_versions(txn, &txnid, nullptr));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  struct expected_change {
+    fpta_change_kind kind;
+    uint64_t pk;
+    uint64_t val;
+  };
+
+  auto check_log = [&](uint64_t from_seq, const expected_change *expected,
+                       size_t count) {
+    fpta_txn *reader = nullptr;
+    ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &reader));
+    fpta_changelog *log = nullptr;
+    ASSERT_EQ(FPTA_OK, fpta_changelog_open(reader, &table, from_seq, &log));
+    ASSERT_NE(nullptr, log);
+    for (size_t i = 0; i < count; ++i) {
+      fpta_change change;
+      ASSERT_EQ(FPTA_OK, fpta_changelog_next(log, &change));
+      EXPECT_EQ(from_seq + i, change.seq);
+      EXPECT_EQ(expected[i].kind, change.kind);
+      if (expected[i].kind == fpta_change_clear) {
+        EXPECT_EQ(fpta_null, change.pk.type);
+        continue;
+      }
+      EXPECT_EQ(fpta_unsigned_int, change.pk.type);
+      EXPECT_EQ(expected[i].pk, change.pk.uint);
+      if (expected[i].kind == fpta_change_delete) {
+        EXPECT_EQ(0u, change.row.total_bytes);
+        continue;
+      }
+      fpta_value val;
+      ASSERT_EQ(FPTA_OK, fpta_get_column(change.row, &col_val, &val));
+      EXPECT_EQ(expected[i].val, val.uint);
+    }
+    fpta_change change;
+    EXPECT_EQ(FPTA_NODATA, fpta_changelog_next(log, &change));
+    EXPECT_EQ(FPTA_OK, fpta_changelog_close(log));
+    EXPECT_EQ(FPTA_OK, fpta_transaction_end(reader, false));
+  };
+
+  const expected_change put_changes[] = {{fpta_change_insert, 1, 10},
+                                         {fpta_change_insert, 2, 20},
+                                         {fpta_change_insert, 3, 30},
+                                         {fpta_change_update, 2, 21},
+                                         {fpta_change_delete, 1, 0}};
+  check_log(0, put_changes, 5);
+
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_read, &txn));
+  uint64_t first, last;
+  EXPECT_EQ(FPTA_OK, fpta_changelog_bounds(txn, &table, &first, &last));
+  EXPECT_EQ(1u, first);
+  EXPECT_EQ(5u, last);
+  fpta_changelog *log = nullptr;
+  EXPECT_EQ(FPTA_OK, fpta_changelog_open(txn, &table, 3, &log));
+  fpta_change change;
+  ASSERT_EQ(FPTA_OK, fpta_changelog_next(log, &change));
+  EXPECT_EQ(3u, change.seq);
+  EXPECT_EQ(txnid, change.txnid);
+  EXPECT_EQ(FPTA_OK, fpta_changelog_close(log));
+  EXPECT_EQ(FPTA_NO_INDEX, fpta_changelog_open(txn, &plain, 0, &log));
+  EXPECT_EQ(nullptr, log);
+  EXPECT_EQ(FPTA_EINVAL, fpta_changelog_trim(txn, &table, 5));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  // изменения через курсор и очистка таблицы
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  fpta_cursor *cursor = nullptr;
+  ASSERT_EQ(FPTA_OK,
+            fpta_cursor_open(txn, &col_pk, fpta_value_begin(),
+                             fpta_value_end(), nullptr, fpta_ascending,
+                             &cursor));
+  fpta_value pk = fpta_value_uint(3);
+  ASSERT_EQ(FPTA_OK, fpta_cursor_locate(cursor, true, &pk, nullptr));
+  ASSERT_EQ(FPTA_OK, fpta_cursor_update(cursor, make_row(3, 31)));
+  ASSERT_EQ(FPTA_OK, fpta_cursor_delete(cursor));
+  ASSERT_EQ(FPTA_OK, fpta_cursor_close(cursor));
+  ASSERT_EQ(FPTA_OK, fpta_table_clear(txn, &table));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  const expected_change cursor_changes[] = {{fpta_change_update, 3, 31},
+                                            {fpta_change_delete, 3, 0},
+                                            {fpta_change_clear, 0, 0}};
+  check_log(6, cursor_changes, 3);
+
+  // удаление обработанных записей, нумерация продолжается
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  EXPECT_EQ(FPTA_OK, fpta_changelog_trim(txn, &table, 7));
+  EXPECT_EQ(FPTA_OK, fpta_changelog_bounds(txn, &table, &first, &last));
+  EXPECT_EQ(8u, first);
+  EXPECT_EQ(8u, last);
+  EXPECT_EQ(FPTA_OK, fpta_changelog_trim(txn, &table, 8));
+  EXPECT_EQ(FPTA_OK, fpta_changelog_bounds(txn, &table, &first, &last));
+  EXPECT_EQ(9u, first);
+  EXPECT_EQ(8u, last);
+  ASSERT_EQ(FPTA_OK, fpta_insert_row(txn, &table, make_row(4, 40)));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  const expected_change after_trim[] = {{fpta_change_insert, 4, 40}};
+  check_log(9, after_trim, 1);
+
+  // журнал ограниченного размера
+  ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_write, &txn));
+  for (uint64_t n = 1; n <= 5; ++n) {
+    ASSERT_EQ(FPTU_OK, fptu_clear(pt));
+    ASSERT_EQ(FPTA_OK, fpta_upsert_column(pt, &capped_pk, fpta_value_uint(n)));
+    ASSERT_EQ(FPTA_OK,
+              fpta_insert_row(txn, &capped, fptu_take_noshrink(pt)));
+  }
+  EXPECT_EQ(FPTA_OK, fpta_changelog_bounds(txn, &capped, &first, &last));
+  EXPECT_EQ(3u, first);
+  EXPECT_EQ(5u, last);
+  // пропуск записей обнаруживается по номеру первой прочитанной
+  EXPECT_EQ(FPTA_OK, fpta_changelog_open(txn, &capped, 1, &log));
+  ASSERT_EQ(FPTA_OK, fpta_changelog_next(log, &change));
+  EXPECT_EQ(3u, change.seq);
+  EXPECT_EQ(fpta_change_insert, change.kind);
+  EXPECT_EQ(3u, change.pk.uint);
+  EXPECT_EQ(FPTA_OK, fpta_changelog_close(log));
+  ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  txn = nullptr;
+
+  free(pt);
+}
+
+//----------------------------------------------------------------------------
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
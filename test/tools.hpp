@@ -47,6 +47,56 @@ typedef std::unique_ptr<fpta_cursor, cursor_deleter> scoped_cursor_guard;
 
 //----------------------------------------------------------------------------
 
+/* Фикстура для тестов, которые сами описывают таблицы в пустой базе.
+ * Удаляет файлы базы до и после теста, а также закрывает базу,
+ * если тест не сделал этого сам. */
+class db_fixture : public ::testing::Test {
+protected:
+  const char *const db_name;
+  const char *const db_name_lck;
+  fpta_db *db;
+
+  db_fixture(const char *name, const char *name_lck)
+      : db_name(name), db_name_lck(name_lck), db(nullptr) {}
+
+  virtual void SetUp() {
+    ASSERT_TRUE(unlink(db_name) == 0 || errno == ENOENT);
+    ASSERT_TRUE(unlink(db_name_lck) == 0 || errno == ENOENT);
+  }
+
+  virtual void TearDown() {
+    if (db)
+      EXPECT_EQ(FPTA_SUCCESS, fpta_db_close(db));
+    db = nullptr;
+    ASSERT_TRUE(unlink(db_name) == 0 || errno == ENOENT);
+    ASSERT_TRUE(unlink(db_name_lck) == 0 || errno == ENOENT);
+  }
+
+  void open_db(fpta_durability durability, size_t megabytes = 1) {
+    ASSERT_EQ(nullptr, db);
+    ASSERT_EQ(FPTA_SUCCESS, fpta_db_open(db_name, durability, 0644,
+                                         megabytes, true, &db));
+    ASSERT_NE(nullptr, db);
+  }
+
+  void close_db() {
+    fpta_db *closing = db;
+    db = nullptr;
+    ASSERT_NE(nullptr, closing);
+    ASSERT_EQ(FPTA_SUCCESS, fpta_db_close(closing));
+  }
+
+  void create_table(const char *table_name, fpta_column_set *def) {
+    fpta_txn *txn = nullptr;
+    ASSERT_EQ(FPTA_OK, fpta_transaction_begin(db, fpta_schema, &txn));
+    ASSERT_NE(nullptr, txn);
+    ASSERT_EQ(FPTA_OK, fpta_table_create(txn, table_name, def));
+    ASSERT_EQ(FPTA_OK, fpta_transaction_end(txn, false));
+  }
+};
+
+//----------------------------------------------------------------------------
+
 /* простейший медленный тест на простоту */
 bool isPrime(unsigned number);
 